@@ -33,9 +33,11 @@
 #include "backends/x11/meta-backend-x11.h"
 #include "meta-cursor-tracker-private.h"
 #include "meta-stage.h"
+#include "util-private.h"
 
 #ifdef HAVE_NATIVE_BACKEND
 #include "backends/native/meta-backend-native.h"
+#include "backends/native/meta-backend-headless.h"
 #endif
 
 #include "backends/meta-idle-monitor-private.h"
@@ -554,7 +556,12 @@ get_backend_type (void)
 
 #if defined(CLUTTER_WINDOWING_EGL) && defined(HAVE_NATIVE_BACKEND)
   if (clutter_check_windowing_backend (CLUTTER_WINDOWING_EGL))
-    return META_TYPE_BACKEND_NATIVE;
+    {
+      if (meta_is_headless ())
+        return META_TYPE_BACKEND_HEADLESS;
+      else
+        return META_TYPE_BACKEND_NATIVE;
+    }
 #endif
 
   g_assert_not_reached ();
@@ -45,6 +45,12 @@ struct _MetaCursorRendererPrivate
 };
 typedef struct _MetaCursorRendererPrivate MetaCursorRendererPrivate;
 
+enum {
+  CURSOR_PAINTED,
+  LAST_SIGNAL
+};
+static guint signals[LAST_SIGNAL];
+
 G_DEFINE_TYPE_WITH_PRIVATE (MetaCursorRenderer, meta_cursor_renderer, G_TYPE_OBJECT);
 
 static void
@@ -86,6 +92,16 @@ static void
 meta_cursor_renderer_class_init (MetaCursorRendererClass *klass)
 {
   klass->update_cursor = meta_cursor_renderer_real_update_cursor;
+
+  /* Emitted once the cursor is on screen at its current position: right
+   * away when the backend handles it, or after the stage painted it.
+   */
+  signals[CURSOR_PAINTED] = g_signal_new ("cursor-painted",
+                                          G_TYPE_FROM_CLASS (klass),
+                                          G_SIGNAL_RUN_LAST,
+                                          0,
+                                          NULL, NULL, NULL,
+                                          G_TYPE_NONE, 0);
 }
 
 static void
@@ -161,6 +177,9 @@ update_cursor (MetaCursorRenderer *renderer,
 
   if (should_redraw)
     queue_redraw (renderer, cursor_sprite);
+
+  if (handled_by_backend)
+    g_signal_emit (renderer, signals[CURSOR_PAINTED], 0);
 }
 
 MetaCursorRenderer *
@@ -199,12 +218,24 @@ meta_cursor_renderer_set_position (MetaCursorRenderer *renderer,
 
   g_assert (meta_is_wayland_compositor ());
 
+  /* The native backend moves the cursor before the motion event is
+   * dispatched; don't redo the work when the event arrives.
+   */
+  if (priv->current_x == x && priv->current_y == y)
+    return;
+
   priv->current_x = x;
   priv->current_y = y;
 
   update_cursor (renderer, priv->displayed_cursor);
 }
 
+void
+meta_cursor_renderer_emit_painted (MetaCursorRenderer *renderer)
+{
+  g_signal_emit (renderer, signals[CURSOR_PAINTED], 0);
+}
+
 MetaCursorSprite *
 meta_cursor_renderer_get_cursor (MetaCursorRenderer *renderer)
 {
@@ -25,6 +25,7 @@
 #include "meta-stage.h"
 
 #include <meta/meta-backend.h>
+#include <backends/meta-backend-private.h>
 #include <meta/util.h>
 
 typedef struct {
@@ -36,6 +37,9 @@ typedef struct {
   MetaRectangle current_rect;
   MetaRectangle previous_rect;
   gboolean previous_is_valid;
+
+  /* Whether it was set since it was last painted */
+  gboolean needs_paint;
 } MetaOverlay;
 
 struct _MetaStagePrivate {
@@ -83,13 +87,17 @@ meta_overlay_set (MetaOverlay   *overlay,
     }
 
   overlay->current_rect = *rect;
+  overlay->needs_paint = TRUE;
 }
 
-static void
+/* Returns whether the overlay was set since it was last painted */
+static gboolean
 meta_overlay_paint (MetaOverlay *overlay)
 {
+  gboolean was_set;
+
   if (!overlay->enabled)
-    return;
+    return FALSE;
 
   g_assert (meta_is_wayland_compositor ());
 
@@ -104,6 +112,11 @@ meta_overlay_paint (MetaOverlay *overlay)
 
   overlay->previous_rect = overlay->current_rect;
   overlay->previous_is_valid = TRUE;
+
+  was_set = overlay->needs_paint;
+  overlay->needs_paint = FALSE;
+
+  return was_set;
 }
 
 static void
@@ -123,7 +136,12 @@ meta_stage_paint (ClutterActor *actor)
 
   CLUTTER_ACTOR_CLASS (meta_stage_parent_class)->paint (actor);
 
-  meta_overlay_paint (&priv->cursor_overlay);
+  if (meta_overlay_paint (&priv->cursor_overlay))
+    {
+      MetaBackend *backend = meta_get_backend ();
+
+      meta_cursor_renderer_emit_painted (meta_backend_get_cursor_renderer (backend));
+    }
 }
 
 static void
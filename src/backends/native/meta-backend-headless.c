@@ -0,0 +1,185 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/*
+ * The headless backend runs mutter as a Wayland display server on
+ * machines without a GPU or a session, such as CI runners. Clutter can
+ * only render through Cogl's KMS winsys, so it still needs a DRM device
+ * with an output: a virtual one like vkms, which Mesa renders to in
+ * software, and whose vblank events drive the frame clock like a real
+ * monitor would.
+ *
+ * Unlike the native backend, it doesn't take control of a logind
+ * session and never opens the input devices of the machine.
+ */
+
+#include "config.h"
+
+#include "meta-backend-headless.h"
+
+#include <meta/util.h>
+#include <clutter/egl/clutter-egl.h>
+#include <clutter/evdev/clutter-evdev.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "backends/meta-cursor-renderer.h"
+
+/* How many /dev/dri/card* nodes to look at for a device to use */
+#define MAX_DRM_CARDS 16
+
+G_DEFINE_TYPE (MetaBackendHeadless, meta_backend_headless, META_TYPE_BACKEND_NATIVE);
+
+static gboolean
+has_connected_output (int fd)
+{
+  drmModeRes *resources;
+  gboolean found = FALSE;
+  int i;
+
+  resources = drmModeGetResources (fd);
+  if (!resources)
+    return FALSE;
+
+  for (i = 0; i < resources->count_connectors && !found; i++)
+    {
+      drmModeConnector *connector;
+
+      connector = drmModeGetConnector (fd, resources->connectors[i]);
+      if (!connector)
+        continue;
+
+      found = (connector->connection == DRM_MODE_CONNECTED &&
+               connector->count_modes > 0);
+      drmModeFreeConnector (connector);
+    }
+
+  drmModeFreeResources (resources);
+
+  return found;
+}
+
+static int
+open_drm_device (GError **error)
+{
+  const char *path;
+  int fd;
+  int i;
+
+  path = g_getenv ("META_HEADLESS_DRM_DEVICE");
+  if (path)
+    {
+      fd = open (path, O_RDWR | O_CLOEXEC);
+      if (fd < 0)
+        {
+          int errsv = errno;
+
+          g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                       "Could not open %s: %s", path, g_strerror (errsv));
+        }
+
+      return fd;
+    }
+
+  for (i = 0; i < MAX_DRM_CARDS; i++)
+    {
+      g_autofree char *card_path = g_strdup_printf ("/dev/dri/card%d", i);
+
+      fd = open (card_path, O_RDWR | O_CLOEXEC);
+      if (fd < 0)
+        continue;
+
+      if (has_connected_output (fd))
+        {
+          meta_verbose ("Running headless on %s\n", card_path);
+          return fd;
+        }
+
+      close (fd);
+    }
+
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+               "No DRM device with a connected output; load vkms or "
+               "set META_HEADLESS_DRM_DEVICE");
+  return -1;
+}
+
+static int
+open_input_device (const char  *path,
+                   int          flags,
+                   gpointer     user_data,
+                   GError     **error)
+{
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_PERMISSION_DENIED,
+               "Input devices are not used when headless");
+  return -1;
+}
+
+static void
+close_input_device (int      fd,
+                    gpointer user_data)
+{
+  close (fd);
+}
+
+static gboolean
+meta_backend_headless_init_session (MetaBackendNative  *native,
+                                    GError            **error)
+{
+  int fd;
+
+  fd = open_drm_device (error);
+  if (fd < 0)
+    return FALSE;
+
+  clutter_egl_set_kms_fd (fd);
+  clutter_evdev_set_device_callbacks (open_input_device,
+                                      close_input_device,
+                                      NULL);
+
+  return TRUE;
+}
+
+static MetaCursorRenderer *
+meta_backend_headless_create_cursor_renderer (MetaBackend *backend)
+{
+  /* Virtual outputs have no cursor planes; draw it with the stage */
+  return meta_cursor_renderer_new ();
+}
+
+static void
+meta_backend_headless_class_init (MetaBackendHeadlessClass *klass)
+{
+  MetaBackendClass *backend_class = META_BACKEND_CLASS (klass);
+  MetaBackendNativeClass *native_class = META_BACKEND_NATIVE_CLASS (klass);
+
+  backend_class->create_cursor_renderer = meta_backend_headless_create_cursor_renderer;
+
+  native_class->init_session = meta_backend_headless_init_session;
+}
+
+static void
+meta_backend_headless_init (MetaBackendHeadless *headless)
+{
+}
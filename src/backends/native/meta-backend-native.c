@@ -36,6 +36,7 @@
 #include "meta-monitor-manager-kms.h"
 #include "meta-cursor-renderer-native.h"
 #include "meta-launcher.h"
+#include "backends/meta-cursor-tracker-private.h"
 
 #include <stdlib.h>
 
@@ -47,6 +48,11 @@ struct _MetaBackendNativePrivate
   guint sleep_signal_id;
   GCancellable *cancellable;
   GDBusConnection *system_bus;
+
+  /* Compiled keymaps by layout set, so that switching between input
+   * sources doesn't compile them again */
+  struct xkb_context *xkb_context;
+  GHashTable *keymaps;
 };
 typedef struct _MetaBackendNativePrivate MetaBackendNativePrivate;
 
@@ -58,14 +64,16 @@ meta_backend_native_finalize (GObject *object)
   MetaBackendNative *native = META_BACKEND_NATIVE (object);
   MetaBackendNativePrivate *priv = meta_backend_native_get_instance_private (native);
 
-  meta_launcher_free (priv->launcher);
+  g_clear_pointer (&priv->launcher, meta_launcher_free);
 
-  g_object_unref (priv->up_client);
+  g_clear_object (&priv->up_client);
   if (priv->sleep_signal_id)
     g_dbus_connection_signal_unsubscribe (priv->system_bus, priv->sleep_signal_id);
   g_cancellable_cancel (priv->cancellable);
   g_clear_object (&priv->cancellable);
   g_clear_object (&priv->system_bus);
+  g_hash_table_destroy (priv->keymaps);
+  xkb_context_unref (priv->xkb_context);
 
   G_OBJECT_CLASS (meta_backend_native_parent_class)->finalize (object);
 }
@@ -192,19 +200,14 @@ constrain_all_screen_monitors (ClutterInputDevice *device,
 }
 
 static void
-pointer_constrain_callback (ClutterInputDevice *device,
-			    guint32             time,
-			    float              *new_x,
-			    float              *new_y,
-			    gpointer            user_data)
+constrain_to_monitors (ClutterInputDevice *device,
+                       float              *new_x,
+                       float              *new_y)
 {
   MetaMonitorManager *monitor_manager;
   MetaMonitorInfo *monitors;
   unsigned int n_monitors;
 
-  /* Constrain to barriers */
-  constrain_to_barriers (device, time, new_x, new_y);
-
   monitor_manager = meta_monitor_manager_get ();
   monitors = meta_monitor_manager_get_monitor_infos (monitor_manager, &n_monitors);
 
@@ -216,6 +219,36 @@ pointer_constrain_callback (ClutterInputDevice *device,
   constrain_all_screen_monitors(device, monitors, n_monitors, new_x, new_y);
 }
 
+static void
+pointer_constrain_callback (ClutterInputDevice *device,
+			    guint32             time,
+			    float              *new_x,
+			    float              *new_y,
+			    gpointer            user_data)
+{
+  ClutterDeviceManager *manager = clutter_device_manager_get_default ();
+  MetaCursorTracker *tracker;
+
+  /* Constrain to barriers */
+  constrain_to_barriers (device, time, new_x, new_y);
+
+  constrain_to_monitors (device, new_x, new_y);
+
+  if (device != clutter_device_manager_get_core_device (manager, CLUTTER_POINTER_DEVICE))
+    return;
+
+  /* This runs as soon as libinput events are read, while the stage only
+   * dispatches the resulting motion event on the next frame. Move the
+   * cursor right away so it doesn't lag behind by up to a frame.
+   *
+   * This still runs on the main loop: libinput is owned and dispatched
+   * by Clutter, so while the compositor is busy, e.g. painting, the
+   * cursor doesn't move either.
+   */
+  tracker = meta_cursor_tracker_get_for_screen (NULL);
+  meta_cursor_tracker_update_position (tracker, *new_x, *new_y);
+}
+
 static void
 meta_backend_native_post_init (MetaBackend *backend)
 {
@@ -262,32 +295,59 @@ meta_backend_native_warp_pointer (MetaBackend *backend,
   clutter_evdev_warp_pointer (device, time_, x, y);
 }
 
+/* Layout sets kept compiled; more than that is unusual */
+#define MAX_CACHED_KEYMAPS 8
+
 static void
 meta_backend_native_set_keymap (MetaBackend *backend,
                                 const char  *layouts,
                                 const char  *variants,
                                 const char  *options)
 {
+  MetaBackendNative *native = META_BACKEND_NATIVE (backend);
+  MetaBackendNativePrivate *priv = meta_backend_native_get_instance_private (native);
   ClutterDeviceManager *manager = clutter_device_manager_get_default ();
   struct xkb_rule_names names;
   struct xkb_keymap *keymap;
-  struct xkb_context *context;
+  char *key;
+
+  key = g_strdup_printf ("%s\n%s\n%s",
+                         layouts ? layouts : "",
+                         variants ? variants : "",
+                         options ? options : "");
+
+  keymap = g_hash_table_lookup (priv->keymaps, key);
+  if (keymap)
+    {
+      g_free (key);
+    }
+  else
+    {
+      names.rules = DEFAULT_XKB_RULES_FILE;
+      names.model = DEFAULT_XKB_MODEL;
+      names.layout = layouts;
+      names.variant = variants;
+      names.options = options;
 
-  names.rules = DEFAULT_XKB_RULES_FILE;
-  names.model = DEFAULT_XKB_MODEL;
-  names.layout = layouts;
-  names.variant = variants;
-  names.options = options;
+      keymap = xkb_keymap_new_from_names (priv->xkb_context, &names,
+                                          XKB_KEYMAP_COMPILE_NO_FLAGS);
 
-  context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
-  keymap = xkb_keymap_new_from_names (context, &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
-  xkb_context_unref (context);
+      if (keymap)
+        {
+          if (g_hash_table_size (priv->keymaps) >= MAX_CACHED_KEYMAPS)
+            g_hash_table_remove_all (priv->keymaps);
+
+          g_hash_table_insert (priv->keymaps, key, keymap);
+        }
+      else
+        {
+          g_free (key);
+        }
+    }
 
   clutter_evdev_set_keyboard_map (manager, keymap);
 
   g_signal_emit_by_name (backend, "keymap-changed", 0);
-
-  xkb_keymap_unref (keymap);
 }
 
 static struct xkb_keymap *
@@ -306,12 +366,54 @@ meta_backend_native_lock_layout_group (MetaBackend *backend,
   g_signal_emit_by_name (backend, "keymap-layout-group-changed", idx, 0);
 }
 
+/* Takes control of the logind session, which opens the DRM and input
+ * devices on our behalf and tells us when we are switched away from */
+static gboolean
+meta_backend_native_init_session (MetaBackendNative  *native,
+                                  GError            **error)
+{
+  MetaBackendNativePrivate *priv = meta_backend_native_get_instance_private (native);
+
+  priv->launcher = meta_launcher_new (error);
+  if (priv->launcher == NULL)
+    return FALSE;
+
+  priv->up_client = up_client_new ();
+  g_signal_connect (priv->up_client, "notify::lid-is-closed",
+                    G_CALLBACK (lid_is_closed_changed_cb), NULL);
+
+  g_bus_get (G_BUS_TYPE_SYSTEM,
+             priv->cancellable,
+             system_bus_gotten_cb,
+             native);
+
+  return TRUE;
+}
+
+static void
+meta_backend_native_constructed (GObject *object)
+{
+  MetaBackendNative *native = META_BACKEND_NATIVE (object);
+  GError *error = NULL;
+
+  G_OBJECT_CLASS (meta_backend_native_parent_class)->constructed (object);
+
+  /* This runs before Clutter is initialized, so that the DRM device is
+   * known by the time the Cogl renderer is set up */
+  if (!META_BACKEND_NATIVE_GET_CLASS (native)->init_session (native, &error))
+    {
+      g_warning ("Can't initialize KMS backend: %s\n", error->message);
+      exit (1);
+    }
+}
+
 static void
 meta_backend_native_class_init (MetaBackendNativeClass *klass)
 {
   MetaBackendClass *backend_class = META_BACKEND_CLASS (klass);
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
 
+  object_class->constructed = meta_backend_native_constructed;
   object_class->finalize = meta_backend_native_finalize;
 
   backend_class->post_init = meta_backend_native_post_init;
@@ -323,32 +425,22 @@ meta_backend_native_class_init (MetaBackendNativeClass *klass)
   backend_class->set_keymap = meta_backend_native_set_keymap;
   backend_class->get_keymap = meta_backend_native_get_keymap;
   backend_class->lock_layout_group = meta_backend_native_lock_layout_group;
+
+  klass->init_session = meta_backend_native_init_session;
 }
 
 static void
 meta_backend_native_init (MetaBackendNative *native)
 {
   MetaBackendNativePrivate *priv = meta_backend_native_get_instance_private (native);
-  GError *error = NULL;
-
-  priv->launcher = meta_launcher_new (&error);
-  if (priv->launcher == NULL)
-    {
-      g_warning ("Can't initialize KMS backend: %s\n", error->message);
-      exit (1);
-    }
 
   priv->barrier_manager = meta_barrier_manager_native_new ();
 
-  priv->up_client = up_client_new ();
-  g_signal_connect (priv->up_client, "notify::lid-is-closed",
-                    G_CALLBACK (lid_is_closed_changed_cb), NULL);
+  priv->xkb_context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
+  priv->keymaps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify) xkb_keymap_unref);
 
   priv->cancellable = g_cancellable_new ();
-  g_bus_get (G_BUS_TYPE_SYSTEM,
-             priv->cancellable,
-             system_bus_gotten_cb,
-             native);
 }
 
 gboolean
@@ -358,6 +450,13 @@ meta_activate_vt (int vt, GError **error)
   MetaBackendNative *native = META_BACKEND_NATIVE (backend);
   MetaBackendNativePrivate *priv = meta_backend_native_get_instance_private (native);
 
+  if (priv->launcher == NULL)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   "Not running in a session");
+      return FALSE;
+    }
+
   return meta_launcher_activate_vt (priv->launcher, vt, error);
 }
 
@@ -390,6 +489,10 @@ meta_activate_session (void)
   MetaBackendNative *native = META_BACKEND_NATIVE (backend);
   MetaBackendNativePrivate *priv = meta_backend_native_get_instance_private (native);
 
+  /* Headless, there is no session to activate */
+  if (priv->launcher == NULL)
+    return TRUE;
+
   if (!meta_launcher_activate_session (priv->launcher, &error))
     {
       g_warning ("Could not activate session: %s\n", error->message);
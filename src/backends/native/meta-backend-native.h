@@ -45,6 +45,9 @@ struct _MetaBackendNative
 struct _MetaBackendNativeClass
 {
   MetaBackendClass parent_class;
+
+  gboolean (* init_session) (MetaBackendNative  *native,
+                             GError            **error);
 };
 
 GType meta_backend_native_get_type (void) G_GNUC_CONST;
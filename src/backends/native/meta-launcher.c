@@ -46,28 +46,70 @@
 #include "meta-cursor-renderer-native.h"
 #include "meta-idle-monitor-native.h"
 
+/* A TakeDevice call issued before the device is opened */
+typedef struct
+{
+  gint64 devnum;
+  GAsyncResult *result;
+} DeviceRequest;
+
 struct _MetaLauncher
 {
   Login1Session *session_proxy;
   Login1Seat *seat_proxy;
 
   gboolean session_active;
+
+  /* The replies to the calls made at startup are dispatched in a context
+   * of their own, so that they can be waited for without running the
+   * main loop. */
+  GMainContext *startup_context;
+  /* devnum → DeviceRequest */
+  GHashTable *device_requests;
+  guint release_unclaimed_id;
 };
 
+static char *
+get_session_id (GError **error)
+{
+  const char *session_id_env;
+  char *session_id;
+  char *result;
+  int r;
+
+  r = sd_pid_get_session (0, &session_id);
+  if (r >= 0)
+    {
+      result = g_strdup (session_id);
+      free (session_id);
+      return result;
+    }
+
+  /* Not part of a logind session, which is the case when running
+   * against a stand-in logind on a private bus */
+  session_id_env = g_getenv ("XDG_SESSION_ID");
+  if (session_id_env)
+    return g_strdup (session_id_env);
+
+  g_set_error (error,
+               G_IO_ERROR,
+               G_IO_ERROR_NOT_FOUND,
+               "Could not get session for PID: %s", g_strerror (-r));
+  return NULL;
+}
+
 static Login1Session *
 get_session_proxy (GCancellable *cancellable,
                    GError      **error)
 {
   char *proxy_path;
-  char *session_id;
+  g_autofree char *session_id = NULL;
   Login1Session *session_proxy;
 
-  if (sd_pid_get_session (getpid (), &session_id) < 0)
+  session_id = get_session_id (error);
+  if (!session_id)
     {
-      g_set_error (error,
-                   G_IO_ERROR,
-                   G_IO_ERROR_NOT_FOUND,
-                   "Could not get session ID: %m");
+      g_prefix_error (error, "Could not get session ID: ");
       return NULL;
     }
 
@@ -169,6 +211,185 @@ take_device (Login1Session *session_proxy,
   return TRUE;
 }
 
+static void
+on_async_result (GObject      *source,
+                 GAsyncResult *result,
+                 gpointer      user_data)
+{
+  GAsyncResult **result_out = user_data;
+
+  *result_out = g_object_ref (result);
+}
+
+static void
+wait_for_result (MetaLauncher  *self,
+                 GAsyncResult **result)
+{
+  while (*result == NULL)
+    g_main_context_iteration (self->startup_context, TRUE);
+}
+
+static void
+device_request_free (DeviceRequest *request)
+{
+  g_clear_object (&request->result);
+  g_slice_free (DeviceRequest, request);
+}
+
+/* Must be called with the startup context pushed as thread default */
+static void
+request_device (MetaLauncher *self,
+                int           dev_major,
+                int           dev_minor)
+{
+  gint64 devnum = makedev (dev_major, dev_minor);
+  DeviceRequest *request;
+
+  if (g_hash_table_contains (self->device_requests, &devnum))
+    return;
+
+  request = g_slice_new0 (DeviceRequest);
+  request->devnum = devnum;
+  g_hash_table_insert (self->device_requests, &request->devnum, request);
+
+  login1_session_call_take_device (self->session_proxy,
+                                   dev_major,
+                                   dev_minor,
+                                   NULL,
+                                   NULL,
+                                   on_async_result,
+                                   &request->result);
+}
+
+static gboolean
+finish_device_request (MetaLauncher  *self,
+                       DeviceRequest *request,
+                       int           *out_fd,
+                       GError       **error)
+{
+  g_autoptr (GVariant) fd_variant = NULL;
+  g_autoptr (GUnixFDList) fd_list = NULL;
+  int fd;
+
+  wait_for_result (self, &request->result);
+
+  if (!login1_session_call_take_device_finish (self->session_proxy,
+                                               &fd_variant,
+                                               NULL, /* paused */
+                                               &fd_list,
+                                               request->result,
+                                               error))
+    return FALSE;
+
+  fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_variant), error);
+  if (fd == -1)
+    return FALSE;
+
+  *out_fd = fd;
+  return TRUE;
+}
+
+/* Gets the device from the requests made at startup if there is one,
+ * or with a new TakeDevice call otherwise */
+static gboolean
+claim_device (MetaLauncher  *self,
+              int            dev_major,
+              int            dev_minor,
+              int           *out_fd,
+              GError       **error)
+{
+  gint64 devnum = makedev (dev_major, dev_minor);
+  DeviceRequest *request;
+  gboolean success;
+
+  if (self->device_requests == NULL ||
+      !g_hash_table_lookup_extended (self->device_requests, &devnum,
+                                     NULL, (gpointer *) &request))
+    return take_device (self->session_proxy, dev_major, dev_minor,
+                        out_fd, NULL, error);
+
+  g_hash_table_steal (self->device_requests, &devnum);
+  success = finish_device_request (self, request, out_fd, error);
+  device_request_free (request);
+
+  return success;
+}
+
+/* Gives back the devices taken at startup that weren't opened, and
+ * stops using the startup context */
+static void
+release_unclaimed_devices (MetaLauncher *self)
+{
+  GHashTableIter iter;
+  DeviceRequest *request;
+
+  g_hash_table_iter_init (&iter, self->device_requests);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &request))
+    {
+      int fd;
+
+      if (finish_device_request (self, request, &fd, NULL))
+        {
+          close (fd);
+          login1_session_call_release_device (self->session_proxy,
+                                              major (request->devnum),
+                                              minor (request->devnum),
+                                              NULL, NULL, NULL);
+        }
+    }
+
+  g_clear_pointer (&self->device_requests, g_hash_table_destroy);
+  g_clear_pointer (&self->startup_context, g_main_context_unref);
+}
+
+static gboolean
+on_startup_done (gpointer user_data)
+{
+  MetaLauncher *self = user_data;
+
+  self->release_unclaimed_id = 0;
+  release_unclaimed_devices (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+request_input_devices (MetaLauncher *self,
+                       const gchar  *seat_name)
+{
+  const gchar *subsystems[] = {"input", NULL};
+  GUdevClient *gudev_client = g_udev_client_new (subsystems);
+  GUdevEnumerator *enumerator = g_udev_enumerator_new (gudev_client);
+  GList *devices, *l;
+
+  g_udev_enumerator_add_match_subsystem (enumerator, "input");
+  g_udev_enumerator_add_match_name (enumerator, "event*");
+  g_udev_enumerator_add_match_property (enumerator, "ID_INPUT", "1");
+
+  devices = g_udev_enumerator_execute (enumerator);
+
+  for (l = devices; l; l = l->next)
+    {
+      GUdevDevice *dev = l->data;
+      GUdevDeviceNumber devnum;
+      const gchar *device_seat;
+
+      if (g_udev_device_get_device_type (dev) != G_UDEV_DEVICE_TYPE_CHAR)
+        continue;
+
+      device_seat = g_udev_device_get_property (dev, "ID_SEAT");
+      if (g_strcmp0 (device_seat ? device_seat : "seat0", seat_name) != 0)
+        continue;
+
+      devnum = g_udev_device_get_device_number (dev);
+      request_device (self, major (devnum), minor (devnum));
+    }
+
+  g_list_free_full (devices, g_object_unref);
+  g_object_unref (enumerator);
+  g_object_unref (gudev_client);
+}
+
 static gboolean
 get_device_info_from_path (const char *path,
                            int        *out_major,
@@ -222,7 +443,7 @@ on_evdev_device_open (const char  *path,
       return -1;
     }
 
-  if (!take_device (self->session_proxy, major, minor, &fd, NULL, error))
+  if (!claim_device (self, major, minor, &fd, error))
     return -1;
 
   return fd;
@@ -356,14 +577,11 @@ out:
 }
 
 static gboolean
-get_kms_fd (Login1Session *session_proxy,
-            const gchar   *seat_id,
-            int           *fd_out,
-            GError       **error)
+get_kms_device (const gchar *seat_id,
+                int         *major_out,
+                int         *minor_out,
+                GError     **error)
 {
-  int major, minor;
-  int fd;
-
   g_autofree gchar *path = get_primary_gpu_path (seat_id);
   if (!path)
     {
@@ -374,7 +592,7 @@ get_kms_fd (Login1Session *session_proxy,
       return FALSE;
     }
 
-  if (!get_device_info_from_path (path, &major, &minor))
+  if (!get_device_info_from_path (path, major_out, minor_out))
     {
       g_set_error (error,
                    G_IO_ERROR,
@@ -383,46 +601,39 @@ get_kms_fd (Login1Session *session_proxy,
       return FALSE;
     }
 
-  if (!take_device (session_proxy, major, minor, &fd, NULL, error))
-    {
-      g_prefix_error (error, "Could not open DRM device: ");
-      return FALSE;
-    }
-
-  *fd_out = fd;
-
   return TRUE;
 }
 
 static gchar *
 get_seat_id (GError **error)
 {
-  char *session_id, *seat_id;
+  g_autofree char *session_id = NULL;
+  const char *seat_id_env;
+  char *seat_id;
+  gchar *result;
   int r;
 
-  r = sd_pid_get_session (0, &session_id);
-  if (r < 0)
-    {
-      g_set_error (error,
-                   G_IO_ERROR,
-                   G_IO_ERROR_NOT_FOUND,
-                   "Could not get session for PID: %s", g_strerror (-r));
-      return NULL;
-    }
+  session_id = get_session_id (error);
+  if (!session_id)
+    return NULL;
 
   r = sd_session_get_seat (session_id, &seat_id);
-  free (session_id);
-
-  if (r < 0)
+  if (r >= 0)
     {
-      g_set_error (error,
-                   G_IO_ERROR,
-                   G_IO_ERROR_NOT_FOUND,
-                   "Could not get seat for session: %s", g_strerror (-r));
-      return NULL;
+      result = g_strdup (seat_id);
+      free (seat_id);
+      return result;
     }
 
-  return seat_id;
+  seat_id_env = g_getenv ("XDG_SEAT");
+  if (seat_id_env)
+    return g_strdup (seat_id_env);
+
+  g_set_error (error,
+               G_IO_ERROR,
+               G_IO_ERROR_NOT_FOUND,
+               "Could not get seat for session: %s", g_strerror (-r));
+  return NULL;
 }
 
 MetaLauncher *
@@ -430,16 +641,47 @@ meta_launcher_new (GError **error)
 {
   MetaLauncher *self = NULL;
   Login1Session *session_proxy = NULL;
-  Login1Seat *seat_proxy = NULL;
-  char *seat_id = NULL;
+  g_autoptr (GAsyncResult) take_control_result = NULL;
+  g_autofree char *seat_id = NULL;
   gboolean have_control = FALSE;
+  int kms_major, kms_minor;
   int kms_fd;
 
   session_proxy = get_session_proxy (NULL, error);
   if (!session_proxy)
     goto fail;
 
-  if (!login1_session_call_take_control_sync (session_proxy, FALSE, NULL, error))
+  seat_id = get_seat_id (error);
+  if (!seat_id)
+    goto fail;
+
+  if (!get_kms_device (seat_id, &kms_major, &kms_minor, error))
+    goto fail;
+
+  self = g_slice_new0 (MetaLauncher);
+  self->session_proxy = session_proxy;
+  self->startup_context = g_main_context_new ();
+  self->device_requests = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+                                                 NULL,
+                                                 (GDestroyNotify) device_request_free);
+
+  /* logind handles the calls of a connection in order, so the devices
+   * can be requested right after TakeControl, without waiting for it to
+   * complete. The input devices are taken along with the DRM device, and
+   * their file descriptors collected when Clutter opens them. */
+  g_main_context_push_thread_default (self->startup_context);
+
+  login1_session_call_take_control (session_proxy, FALSE, NULL,
+                                    on_async_result, &take_control_result);
+  request_device (self, kms_major, kms_minor);
+  request_input_devices (self, seat_id);
+
+  g_main_context_pop_thread_default (self->startup_context);
+
+  wait_for_result (self, &take_control_result);
+  if (!login1_session_call_take_control_finish (session_proxy,
+                                                take_control_result,
+                                                error))
     {
       g_prefix_error (error, "Could not take control: ");
       goto fail;
@@ -447,22 +689,15 @@ meta_launcher_new (GError **error)
 
   have_control = TRUE;
 
-  seat_id = get_seat_id (error);
-  if (!seat_id)
-    goto fail;
-
-  seat_proxy = get_seat_proxy (NULL, error);
-  if (!seat_proxy)
-    goto fail;
-
-  if (!get_kms_fd (session_proxy, seat_id, &kms_fd, error))
+  self->seat_proxy = get_seat_proxy (NULL, error);
+  if (!self->seat_proxy)
     goto fail;
 
-  free (seat_id);
-
-  self = g_slice_new0 (MetaLauncher);
-  self->session_proxy = session_proxy;
-  self->seat_proxy = seat_proxy;
+  if (!claim_device (self, kms_major, kms_minor, &kms_fd, error))
+    {
+      g_prefix_error (error, "Could not open DRM device: ");
+      goto fail;
+    }
 
   self->session_active = TRUE;
 
@@ -471,15 +706,23 @@ meta_launcher_new (GError **error)
                                       on_evdev_device_close,
                                       self);
 
+  /* Clutter opens the input devices it wants during initialization,
+   * which is over by the time the main loop runs */
+  self->release_unclaimed_id = g_idle_add (on_startup_done, self);
+
   g_signal_connect (self->session_proxy, "notify::active", G_CALLBACK (on_active_changed), self);
   return self;
 
  fail:
+  if (self)
+    {
+      release_unclaimed_devices (self);
+      g_clear_object (&self->seat_proxy);
+      g_slice_free (MetaLauncher, self);
+    }
   if (have_control)
     login1_session_call_release_control_sync (session_proxy, NULL, NULL);
   g_clear_object (&session_proxy);
-  g_clear_object (&seat_proxy);
-  free (seat_id);
 
   return NULL;
 }
@@ -487,6 +730,12 @@ meta_launcher_new (GError **error)
 void
 meta_launcher_free (MetaLauncher *self)
 {
+  if (self->release_unclaimed_id)
+    {
+      g_source_remove (self->release_unclaimed_id);
+      release_unclaimed_devices (self);
+    }
+
   g_object_unref (self->seat_proxy);
   g_object_unref (self->session_proxy);
   g_slice_free (MetaLauncher, self);
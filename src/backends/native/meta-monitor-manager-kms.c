@@ -39,6 +39,7 @@
 
 #include <meta/main.h>
 #include <meta/errors.h>
+#include <meta/util.h>
 
 #include <gudev/gudev.h>
 
@@ -68,6 +69,27 @@ typedef struct {
   uint32_t underscan_vborder_prop_id;
 } MetaCRTCKms;
 
+typedef struct {
+  uint32_t flags;
+  char name[DRM_PROP_NAME_LEN];
+} PropertyInfo;
+
+/* What was parsed from the EDID of a connector. The kernel reuses blob
+ * ids as soon as a blob is freed, so the parsed data is only reused
+ * while the EDID has the same contents. The EDID is read again for
+ * every read_current, unless the last probe already read it from
+ * probed_blob_id. */
+typedef struct {
+  GBytes *edid;
+  uint32_t probed_blob_id;
+  char *vendor;
+  char *product;
+  char *serial;
+} ConnectorCache;
+
+/* Wait for a burst of hotplug events to end before probing */
+#define HOTPLUG_SETTLE_TIMEOUT_MS 100
+
 struct _MetaMonitorManagerKms
 {
   MetaMonitorManager parent_instance;
@@ -77,7 +99,19 @@ struct _MetaMonitorManagerKms
   drmModeConnector **connectors;
   unsigned int       n_connectors;
 
+  /* Probed after a hotplug, to be used by the next read_current */
+  drmModeConnector **probed_connectors;
+  unsigned int       n_probed_connectors;
+
+  /* Property id → PropertyInfo; property ids don't change */
+  GHashTable *property_info;
+  /* CRTC id → MetaCRTCKms */
+  GHashTable *crtc_properties;
+  /* Connector id → ConnectorCache */
+  GHashTable *connector_caches;
+
   GUdevClient *udev;
+  guint hotplug_timeout_id;
 
   GSettings *desktop_settings;
 };
@@ -90,14 +124,82 @@ struct _MetaMonitorManagerKmsClass
 G_DEFINE_TYPE (MetaMonitorManagerKms, meta_monitor_manager_kms, META_TYPE_MONITOR_MANAGER);
 
 static void
-free_resources (MetaMonitorManagerKms *manager_kms)
+free_connectors (drmModeConnector **connectors,
+                 unsigned int       n_connectors)
 {
   unsigned i;
 
-  for (i = 0; i < manager_kms->n_connectors; i++)
-    drmModeFreeConnector (manager_kms->connectors[i]);
+  for (i = 0; i < n_connectors; i++)
+    drmModeFreeConnector (connectors[i]);
+
+  g_free (connectors);
+}
+
+static void
+free_resources (MetaMonitorManagerKms *manager_kms)
+{
+  free_connectors (manager_kms->connectors, manager_kms->n_connectors);
+}
+
+static void
+connector_cache_free (ConnectorCache *cache)
+{
+  g_clear_pointer (&cache->edid, g_bytes_unref);
+  g_free (cache->vendor);
+  g_free (cache->product);
+  g_free (cache->serial);
+  g_slice_free (ConnectorCache, cache);
+}
+
+static ConnectorCache *
+get_connector_cache (MetaMonitorManagerKms *manager_kms,
+                     uint32_t               connector_id)
+{
+  ConnectorCache *cache;
+
+  cache = g_hash_table_lookup (manager_kms->connector_caches,
+                               GUINT_TO_POINTER (connector_id));
+  if (!cache)
+    {
+      cache = g_slice_new0 (ConnectorCache);
+      g_hash_table_insert (manager_kms->connector_caches,
+                           GUINT_TO_POINTER (connector_id), cache);
+    }
 
-  g_free (manager_kms->connectors);
+  return cache;
+}
+
+static const PropertyInfo *
+get_property_info (MetaMonitorManagerKms *manager_kms,
+                   uint32_t               prop_id)
+{
+  PropertyInfo *info;
+  drmModePropertyPtr prop;
+
+  info = g_hash_table_lookup (manager_kms->property_info,
+                              GUINT_TO_POINTER (prop_id));
+  if (info)
+    return info;
+
+  prop = drmModeGetProperty (manager_kms->fd, prop_id);
+  if (!prop)
+    return NULL;
+
+  info = g_slice_new0 (PropertyInfo);
+  info->flags = prop->flags;
+  g_strlcpy (info->name, prop->name, sizeof (info->name));
+  g_hash_table_insert (manager_kms->property_info,
+                       GUINT_TO_POINTER (prop_id), info);
+
+  drmModeFreeProperty (prop);
+
+  return info;
+}
+
+static void
+property_info_free (PropertyInfo *info)
+{
+  g_slice_free (PropertyInfo, info);
 }
 
 static int
@@ -208,12 +310,12 @@ find_connector_properties (MetaMonitorManagerKms *manager_kms,
   output_kms->suggested_y = -1;
   for (i = 0; i < output_kms->connector->count_props; i++)
     {
-      drmModePropertyPtr prop = drmModeGetProperty (manager_kms->fd, output_kms->connector->props[i]);
+      const PropertyInfo *prop = get_property_info (manager_kms, output_kms->connector->props[i]);
       if (!prop)
         continue;
 
       if ((prop->flags & DRM_MODE_PROP_ENUM) && strcmp (prop->name, "DPMS") == 0)
-        output_kms->dpms_prop_id = prop->prop_id;
+        output_kms->dpms_prop_id = output_kms->connector->props[i];
       else if ((prop->flags & DRM_MODE_PROP_BLOB) && strcmp (prop->name, "EDID") == 0)
         output_kms->edid_blob_id = output_kms->connector->prop_values[i];
       else if ((prop->flags & DRM_MODE_PROP_BLOB) &&
@@ -228,8 +330,6 @@ find_connector_properties (MetaMonitorManagerKms *manager_kms,
       else if ((prop->flags & DRM_MODE_PROP_RANGE) &&
                strcmp (prop->name, "hotplug_mode_update") == 0)
         output_kms->hotplug_mode_update = output_kms->connector->prop_values[i];
-      
-      drmModeFreeProperty (prop);
     }
 }
 
@@ -237,12 +337,20 @@ static void
 find_crtc_properties (MetaMonitorManagerKms *manager_kms,
                       MetaCRTC *meta_crtc)
 {
-  MetaCRTCKms *crtc_kms;
+  MetaCRTCKms *crtc_kms, *cached;
   drmModeObjectPropertiesPtr props;
   size_t i;
 
   crtc_kms = meta_crtc->driver_private;
 
+  cached = g_hash_table_lookup (manager_kms->crtc_properties,
+                                GUINT_TO_POINTER (meta_crtc->crtc_id));
+  if (cached)
+    {
+      *crtc_kms = *cached;
+      return;
+    }
+
   props = drmModeObjectGetProperties (manager_kms->fd, meta_crtc->crtc_id, DRM_MODE_OBJECT_CRTC);
   if (!props)
     return;
@@ -262,22 +370,40 @@ find_crtc_properties (MetaMonitorManagerKms *manager_kms,
 
       drmModeFreeProperty (prop);
     }
+
+  drmModeFreeObjectProperties (props);
+
+  g_hash_table_insert (manager_kms->crtc_properties,
+                       GUINT_TO_POINTER (meta_crtc->crtc_id),
+                       g_memdup (crtc_kms, sizeof (MetaCRTCKms)));
+}
+
+static void
+connector_cache_set_edid (ConnectorCache *cache,
+                          GBytes         *edid)
+{
+  if (edid && cache->edid && g_bytes_equal (edid, cache->edid))
+    return;
+
+  g_clear_pointer (&cache->edid, g_bytes_unref);
+  g_clear_pointer (&cache->vendor, g_free);
+  g_clear_pointer (&cache->product, g_free);
+  g_clear_pointer (&cache->serial, g_free);
+
+  cache->edid = edid ? g_bytes_ref (edid) : NULL;
 }
 
 static GBytes *
-read_output_edid (MetaMonitorManagerKms *manager_kms,
-                  MetaOutput            *output)
+fetch_edid (MetaMonitorManagerKms *manager_kms,
+            uint32_t               connector_id,
+            uint32_t               blob_id)
 {
-  MetaOutputKms *output_kms = output->driver_private;
   drmModePropertyBlobPtr edid_blob = NULL;
 
-  if (output_kms->edid_blob_id == 0)
-    return NULL;
-
-  edid_blob = drmModeGetPropertyBlob (manager_kms->fd, output_kms->edid_blob_id);
+  edid_blob = drmModeGetPropertyBlob (manager_kms->fd, blob_id);
   if (!edid_blob)
     {
-      meta_warning ("Failed to read EDID of output %s: %s\n", output->name, strerror(errno));
+      meta_warning ("Failed to read EDID of connector %u: %s\n", connector_id, strerror(errno));
       return NULL;
     }
 
@@ -293,6 +419,68 @@ read_output_edid (MetaMonitorManagerKms *manager_kms,
     }
 }
 
+static GBytes *
+read_output_edid (MetaMonitorManagerKms *manager_kms,
+                  MetaOutput            *output)
+{
+  MetaOutputKms *output_kms = output->driver_private;
+  ConnectorCache *cache;
+  uint32_t probed_blob_id;
+  GBytes *edid;
+
+  cache = get_connector_cache (manager_kms, output->winsys_id);
+
+  /* Only good for the read_current right after the probe */
+  probed_blob_id = cache->probed_blob_id;
+  cache->probed_blob_id = 0;
+
+  if (output_kms->edid_blob_id == 0)
+    {
+      connector_cache_set_edid (cache, NULL);
+      return NULL;
+    }
+
+  if (cache->edid && probed_blob_id == output_kms->edid_blob_id)
+    return g_bytes_ref (cache->edid);
+
+  edid = fetch_edid (manager_kms, output->winsys_id, output_kms->edid_blob_id);
+  connector_cache_set_edid (cache, edid);
+
+  return edid;
+}
+
+static void
+output_parse_edid (MetaMonitorManagerKms *manager_kms,
+                   MetaOutput            *output)
+{
+  ConnectorCache *cache;
+  GBytes *edid;
+
+  edid = read_output_edid (manager_kms, output);
+  cache = get_connector_cache (manager_kms, output->winsys_id);
+
+  if (!cache->edid || !cache->vendor)
+    {
+      meta_output_parse_edid (output, edid);
+
+      g_free (cache->vendor);
+      g_free (cache->product);
+      g_free (cache->serial);
+      cache->vendor = g_strdup (output->vendor);
+      cache->product = g_strdup (output->product);
+      cache->serial = g_strdup (output->serial);
+    }
+  else
+    {
+      output->vendor = g_strdup (cache->vendor);
+      output->product = g_strdup (cache->product);
+      output->serial = g_strdup (cache->serial);
+    }
+
+  if (edid)
+    g_bytes_unref (edid);
+}
+
 static gboolean
 output_get_tile_info (MetaMonitorManagerKms *manager_kms,
                       MetaOutput            *output)
@@ -322,6 +510,7 @@ output_get_tile_info (MetaMonitorManagerKms *manager_kms,
                     &output->tile_info.loc_v_tile,
                     &output->tile_info.tile_w,
                     &output->tile_info.tile_h);
+      drmModeFreePropertyBlob (tile_blob);
 
       if (ret != 8)
         return FALSE;
@@ -429,6 +618,178 @@ get_output_scale (MetaMonitorManager *manager,
     return compute_scale (output);
 }
 
+static void
+probe_connectors (MetaMonitorManagerKms  *manager_kms,
+                  drmModeRes             *resources,
+                  drmModeConnector     ***connectors_out,
+                  unsigned int           *n_connectors_out)
+{
+  drmModeConnector **connectors;
+  int i;
+
+  connectors = g_new (drmModeConnector *, resources->count_connectors);
+  for (i = 0; i < resources->count_connectors; i++)
+    connectors[i] = drmModeGetConnector (manager_kms->fd, resources->connectors[i]);
+
+  *connectors_out = connectors;
+  *n_connectors_out = resources->count_connectors;
+}
+
+/* A monitor replaced within the hotplug debounce may get the blob id
+ * the EDID of the previous one had. The EDID read here is kept in the
+ * cache, so read_current doesn't read it again. */
+static gboolean
+edid_blob_changed (MetaMonitorManagerKms *manager_kms,
+                   uint32_t               connector_id,
+                   uint32_t               blob_id)
+{
+  ConnectorCache *cache;
+  GBytes *edid;
+  gboolean changed;
+
+  cache = g_hash_table_lookup (manager_kms->connector_caches,
+                               GUINT_TO_POINTER (connector_id));
+  /* Nothing was read from it yet, there is nothing to compare */
+  if (!cache || !cache->edid)
+    return FALSE;
+
+  edid = fetch_edid (manager_kms, connector_id, blob_id);
+  if (!edid)
+    return TRUE;
+
+  changed = !g_bytes_equal (edid, cache->edid);
+  connector_cache_set_edid (cache, edid);
+  cache->probed_blob_id = blob_id;
+  g_bytes_unref (edid);
+
+  return changed;
+}
+
+static gboolean
+connector_changed (MetaMonitorManagerKms *manager_kms,
+                   drmModeConnector      *old,
+                   drmModeConnector      *new)
+{
+  int i;
+
+  if (old->connection != new->connection ||
+      old->mmWidth != new->mmWidth ||
+      old->mmHeight != new->mmHeight ||
+      old->subpixel != new->subpixel ||
+      old->count_modes != new->count_modes ||
+      old->count_props != new->count_props)
+    return TRUE;
+
+  if (memcmp (old->modes, new->modes,
+              sizeof (drmModeModeInfo) * new->count_modes) != 0)
+    return TRUE;
+
+  for (i = 0; i < new->count_props; i++)
+    {
+      const PropertyInfo *prop;
+
+      if (old->props[i] != new->props[i])
+        return TRUE;
+
+      prop = get_property_info (manager_kms, new->props[i]);
+
+      if (old->prop_values[i] == new->prop_values[i])
+        {
+          if (prop && (prop->flags & DRM_MODE_PROP_BLOB) &&
+              strcmp (prop->name, "EDID") == 0 && new->prop_values[i] != 0 &&
+              edid_blob_changed (manager_kms, new->connector_id,
+                                 new->prop_values[i]))
+            return TRUE;
+
+          continue;
+        }
+
+      /* The DPMS state is ours to change */
+      if (!prop || strcmp (prop->name, "DPMS") != 0)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+static drmModeConnector *
+find_connector (drmModeConnector **connectors,
+                unsigned int       n_connectors,
+                uint32_t           connector_id)
+{
+  unsigned int i;
+
+  for (i = 0; i < n_connectors; i++)
+    if (connectors[i] && connectors[i]->connector_id == connector_id)
+      return connectors[i];
+
+  return NULL;
+}
+
+/* Probes the connectors, and keeps the result for the next read_current
+ * if any of them changed. The caches of connectors that are gone are
+ * dropped; connector ids of MST outputs are allocated anew each time. */
+static gboolean
+probe_for_changes (MetaMonitorManagerKms *manager_kms)
+{
+  drmModeRes *resources;
+  drmModeConnector **connectors;
+  unsigned int n_connectors, i;
+  GHashTableIter iter;
+  gpointer key, value;
+  gboolean changed;
+
+  resources = drmModeGetResources (manager_kms->fd);
+  if (!resources)
+    return TRUE;
+
+  probe_connectors (manager_kms, resources, &connectors, &n_connectors);
+  drmModeFreeResources (resources);
+
+  changed = n_connectors != manager_kms->n_connectors;
+
+  for (i = 0; i < n_connectors; i++)
+    {
+      drmModeConnector *old;
+
+      if (!connectors[i])
+        {
+          changed = TRUE;
+          continue;
+        }
+
+      old = find_connector (manager_kms->connectors, manager_kms->n_connectors,
+                            connectors[i]->connector_id);
+      if (!old || connector_changed (manager_kms, old, connectors[i]))
+        changed = TRUE;
+    }
+
+  g_hash_table_iter_init (&iter, manager_kms->connector_caches);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      ConnectorCache *cache = value;
+
+      if (!find_connector (connectors, n_connectors, GPOINTER_TO_UINT (key)))
+        g_hash_table_iter_remove (&iter);
+      else if (!changed)
+        cache->probed_blob_id = 0;
+    }
+
+  if (changed)
+    {
+      free_connectors (manager_kms->probed_connectors,
+                       manager_kms->n_probed_connectors);
+      manager_kms->probed_connectors = connectors;
+      manager_kms->n_probed_connectors = n_connectors;
+    }
+  else
+    {
+      free_connectors (connectors, n_connectors);
+    }
+
+  return changed;
+}
+
 static void
 meta_monitor_manager_kms_read_current (MetaMonitorManager *manager)
 {
@@ -461,14 +822,22 @@ meta_monitor_manager_kms_read_current (MetaMonitorManager *manager)
      are freed by the platform-independent layer. */
   free_resources (manager_kms);
 
-  manager_kms->n_connectors = resources->count_connectors;
-  manager_kms->connectors = g_new (drmModeConnector *, manager_kms->n_connectors);
-  for (i = 0; i < manager_kms->n_connectors; i++)
+  if (manager_kms->probed_connectors)
     {
-      drmModeConnector *connector;
+      manager_kms->connectors = manager_kms->probed_connectors;
+      manager_kms->n_connectors = manager_kms->n_probed_connectors;
+      manager_kms->probed_connectors = NULL;
+      manager_kms->n_probed_connectors = 0;
+    }
+  else
+    {
+      probe_connectors (manager_kms, resources,
+                        &manager_kms->connectors, &manager_kms->n_connectors);
+    }
 
-      connector = drmModeGetConnector (manager_kms->fd, resources->connectors[i]);
-      manager_kms->connectors[i] = connector;
+  for (i = 0; i < manager_kms->n_connectors; i++)
+    {
+      drmModeConnector *connector = manager_kms->connectors[i];
 
       if (connector && connector->connection == DRM_MODE_CONNECTED)
         {
@@ -573,7 +942,6 @@ meta_monitor_manager_kms_read_current (MetaMonitorManager *manager)
       drmModeConnector *connector;
       GArray *crtcs;
       unsigned int crtc_mask;
-      GBytes *edid;
 
       connector = manager_kms->connectors[i];
       meta_output = &manager->outputs[n_actual_outputs];
@@ -691,9 +1059,7 @@ meta_monitor_manager_kms_read_current (MetaMonitorManager *manager)
           meta_output->suggested_y = output_kms->suggested_y;
           meta_output->hotplug_mode_update = output_kms->hotplug_mode_update;
           
-          edid = read_output_edid (manager_kms, meta_output);
-          meta_output_parse_edid (meta_output, edid);
-          g_bytes_unref (edid);
+          output_parse_edid (manager_kms, meta_output);
 
           /* MetaConnectorType matches DRM's connector types */
           meta_output->connector_type = (MetaConnectorType) connector->connector_type;
@@ -1130,6 +1496,27 @@ meta_monitor_manager_kms_set_crtc_gamma (MetaMonitorManager *manager,
   drmModeCrtcSetGamma (manager_kms->fd, crtc->crtc_id, size, red, green, blue);
 }
 
+static gboolean
+on_hotplug_settled (gpointer user_data)
+{
+  MetaMonitorManagerKms *manager_kms = META_MONITOR_MANAGER_KMS (user_data);
+  MetaMonitorManager *manager = META_MONITOR_MANAGER (manager_kms);
+
+  manager_kms->hotplug_timeout_id = 0;
+
+  if (!probe_for_changes (manager_kms))
+    {
+      meta_verbose ("Hotplug event without connector changes\n");
+      return G_SOURCE_REMOVE;
+    }
+
+  meta_monitor_manager_read_current_config (manager);
+
+  meta_monitor_manager_on_hotplug (manager);
+
+  return G_SOURCE_REMOVE;
+}
+
 static void
 on_uevent (GUdevClient *client,
            const char  *action,
@@ -1137,14 +1524,16 @@ on_uevent (GUdevClient *client,
            gpointer     user_data)
 {
   MetaMonitorManagerKms *manager_kms = META_MONITOR_MANAGER_KMS (user_data);
-  MetaMonitorManager *manager = META_MONITOR_MANAGER (manager_kms);
 
   if (!g_udev_device_get_property_as_boolean (device, "HOTPLUG"))
     return;
 
-  meta_monitor_manager_read_current_config (manager);
+  if (manager_kms->hotplug_timeout_id)
+    g_source_remove (manager_kms->hotplug_timeout_id);
 
-  meta_monitor_manager_on_hotplug (manager);
+  manager_kms->hotplug_timeout_id = g_timeout_add (HOTPLUG_SETTLE_TIMEOUT_MS,
+                                                   on_hotplug_settled,
+                                                   manager_kms);
 }
 
 static void
@@ -1162,6 +1551,13 @@ meta_monitor_manager_kms_init (MetaMonitorManagerKms *manager_kms)
 
   manager_kms->fd = cogl_kms_renderer_get_kms_fd (cogl_renderer);
 
+  manager_kms->property_info =
+    g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) property_info_free);
+  manager_kms->crtc_properties =
+    g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  manager_kms->connector_caches =
+    g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) connector_cache_free);
+
   const char *subsystems[2] = { "drm", NULL };
   manager_kms->udev = g_udev_client_new (subsystems);
   g_signal_connect (manager_kms->udev, "uevent",
@@ -1175,6 +1571,12 @@ meta_monitor_manager_kms_dispose (GObject *object)
 {
   MetaMonitorManagerKms *manager_kms = META_MONITOR_MANAGER_KMS (object);
 
+  if (manager_kms->hotplug_timeout_id)
+    {
+      g_source_remove (manager_kms->hotplug_timeout_id);
+      manager_kms->hotplug_timeout_id = 0;
+    }
+
   g_clear_object (&manager_kms->udev);
   g_clear_object (&manager_kms->desktop_settings);
 
@@ -1187,6 +1589,12 @@ meta_monitor_manager_kms_finalize (GObject *object)
   MetaMonitorManagerKms *manager_kms = META_MONITOR_MANAGER_KMS (object);
 
   free_resources (manager_kms);
+  free_connectors (manager_kms->probed_connectors,
+                   manager_kms->n_probed_connectors);
+
+  g_hash_table_destroy (manager_kms->property_info);
+  g_hash_table_destroy (manager_kms->crtc_properties);
+  g_hash_table_destroy (manager_kms->connector_caches);
 
   G_OBJECT_CLASS (meta_monitor_manager_kms_parent_class)->finalize (object);
 }
@@ -8,6 +8,10 @@
 #include <meta/compositor.h>
 #include <meta/display.h>
 #include "meta-plugin-manager.h"
+#include "meta-capture-stream.h"
+#include "meta-frame-timings-manager.h"
+#include "meta-repaint-scheduler.h"
+#include "meta-texture-memory-manager.h"
 #include "meta-window-actor-private.h"
 #include <clutter/clutter.h>
 
@@ -32,21 +36,39 @@ struct _MetaCompositor
   CoglOnscreen          *onscreen;
   CoglFrameClosure      *frame_closure;
 
-  /* Used for unredirecting fullscreen windows */
+  /* Used for unredirecting fullscreen windows; per monitor, the window
+   * unredirected on it or NULL */
   guint                  disable_unredirect_count;
-  MetaWindow            *unredirected_window;
+  GPtrArray             *unredirected_windows;
 
   gint                   switch_workspace_in_progress;
 
   MetaPluginManager *plugin_mgr;
 
+  /* Releases textures of long hidden windows */
+  MetaTextureMemoryManager *texture_memory;
+
+  /* Exports the frame statistics of windows */
+  MetaFrameTimingsManager *frame_timings;
+
+  /* Picks the sync delay, unless META_DISABLE_REPAINT_SCHEDULER is set */
+  MetaRepaintScheduler *repaint_scheduler;
+
+  /* Set up if META_CAPTURE_SOCKET is set */
+  MetaCaptureStream *capture_stream;
+
   gboolean frame_has_updated_xsurfaces;
   gboolean have_x11_sync_object;
 };
 
-/* Wait 2ms after vblank before starting to draw next frame */
+/* Wait 2ms after vblank before starting to draw next frame; the repaint
+ * scheduler adjusts this, and falls back to it */
 #define META_SYNC_DELAY 2
 
+/* Window pixels to scale down into thumbnails per frame, about two
+ * 1920x1080 windows */
+#define META_THUMBNAIL_UPDATE_BUDGET (2 * 1920 * 1080)
+
 void meta_switch_workspace_completed (MetaCompositor *compositor);
 
 gboolean meta_begin_modal_for_plugin (MetaCompositor   *compositor,
@@ -60,4 +82,6 @@ void     meta_end_modal_for_plugin   (MetaCompositor   *compositor,
 gint64 meta_compositor_monotonic_time_to_server_time (MetaDisplay *display,
                                                       gint64       monotonic_time);
 
+int meta_compositor_get_sync_delay (MetaCompositor *compositor);
+
 #endif /* META_COMPOSITOR_PRIVATE_H */
@@ -75,6 +75,7 @@
 #include <X11/extensions/shape.h>
 #include <X11/extensions/Xcomposite.h>
 #include "meta-sync-ring.h"
+#include "meta-texture-memory-manager.h"
 
 #include "backends/x11/meta-backend-x11.h"
 
@@ -126,6 +127,12 @@ meta_compositor_destroy (MetaCompositor *compositor)
 
   if (compositor->have_x11_sync_object)
     meta_sync_ring_destroy ();
+
+  g_clear_pointer (&compositor->texture_memory, meta_texture_memory_manager_free);
+  g_clear_pointer (&compositor->frame_timings, meta_frame_timings_manager_free);
+  g_clear_pointer (&compositor->capture_stream, meta_capture_stream_free);
+  g_clear_pointer (&compositor->repaint_scheduler, meta_repaint_scheduler_free);
+  g_clear_pointer (&compositor->unredirected_windows, g_ptr_array_unref);
 }
 
 static void
@@ -413,6 +420,10 @@ after_stage_paint (ClutterStage *stage,
   for (l = compositor->windows; l; l = l->next)
     meta_window_actor_post_paint (l->data);
 
+  if (compositor->capture_stream)
+    meta_capture_stream_after_paint (compositor->capture_stream,
+                                     compositor->onscreen);
+
 #ifdef HAVE_WAYLAND
   if (meta_is_wayland_compositor ())
     meta_wayland_compositor_paint_finished (meta_wayland_compositor_get_default ());
@@ -487,6 +498,10 @@ meta_compositor_manage (MetaCompositor *compositor)
 
   clutter_stage_set_sync_delay (CLUTTER_STAGE (compositor->stage), META_SYNC_DELAY);
 
+  if (!g_getenv ("META_DISABLE_REPAINT_SCHEDULER"))
+    compositor->repaint_scheduler =
+      meta_repaint_scheduler_new (CLUTTER_STAGE (compositor->stage), META_SYNC_DELAY);
+
   compositor->window_group = meta_window_group_new (screen);
   compositor->top_window_group = meta_window_group_new (screen);
   compositor->feedback_group = meta_window_group_new (screen);
@@ -535,6 +550,24 @@ meta_compositor_manage (MetaCompositor *compositor)
   redirect_windows (display->screen);
 
   compositor->plugin_mgr = meta_plugin_manager_new (compositor);
+
+  compositor->texture_memory = meta_texture_memory_manager_new (compositor);
+  compositor->frame_timings = meta_frame_timings_manager_new (compositor);
+
+  if (g_getenv ("META_CAPTURE_SOCKET"))
+    {
+      GError *error = NULL;
+
+      compositor->capture_stream =
+        meta_capture_stream_new (CLUTTER_STAGE (compositor->stage),
+                                 g_getenv ("META_CAPTURE_SOCKET"),
+                                 &error);
+      if (compositor->capture_stream == NULL)
+        {
+          meta_warning ("Failed to set up capture stream: %s\n", error->message);
+          g_error_free (error);
+        }
+    }
 }
 
 void
@@ -554,38 +587,46 @@ meta_compositor_unmanage (MetaCompositor *compositor)
 }
 
 /**
- * meta_shape_cow_for_window:
+ * meta_shape_cow_for_windows:
  * @compositor: A #MetaCompositor
- * @window: (nullable): A #MetaWindow to shape the COW for
+ * @windows: The #MetaWindows to shape the COW for
  *
- * Sets an bounding shape on the COW so that the given window
- * is exposed. If @window is %NULL it clears the shape again.
+ * Sets an bounding shape on the COW so that the given windows
+ * are exposed. If @windows is empty it clears the shape again.
  *
  * Used so we can unredirect windows, by shaping away the part
  * of the COW, letting the raw window be seen through below.
  */
 static void
-meta_shape_cow_for_window (MetaCompositor *compositor,
-                           MetaWindow *window)
+meta_shape_cow_for_windows (MetaCompositor *compositor,
+                            GPtrArray      *windows)
 {
   MetaDisplay *display = compositor->display;
   Display *xdisplay = meta_display_get_xdisplay (display);
 
-  if (window == NULL)
+  if (windows->len == 0)
     XFixesSetWindowShapeRegion (xdisplay, compositor->output, ShapeBounding, 0, 0, None);
   else
     {
       XserverRegion output_region;
-      XRectangle screen_rect, window_bounds;
+      XRectangle screen_rect;
+      XRectangle *window_bounds;
       int width, height;
-      MetaRectangle rect;
+      guint i;
 
-      meta_window_get_frame_rect (window, &rect);
+      window_bounds = g_new (XRectangle, windows->len);
+
+      for (i = 0; i < windows->len; i++)
+        {
+          MetaRectangle rect;
+
+          meta_window_get_frame_rect (g_ptr_array_index (windows, i), &rect);
 
-      window_bounds.x = rect.x;
-      window_bounds.y = rect.y;
-      window_bounds.width = rect.width;
-      window_bounds.height = rect.height;
+          window_bounds[i].x = rect.x;
+          window_bounds[i].y = rect.y;
+          window_bounds[i].width = rect.width;
+          window_bounds[i].height = rect.height;
+        }
 
       meta_screen_get_size (display->screen, &width, &height);
       screen_rect.x = 0;
@@ -593,35 +634,217 @@ meta_shape_cow_for_window (MetaCompositor *compositor,
       screen_rect.width = width;
       screen_rect.height = height;
 
-      output_region = XFixesCreateRegion (xdisplay, &window_bounds, 1);
+      output_region = XFixesCreateRegion (xdisplay, window_bounds, windows->len);
 
       XFixesInvertRegion (xdisplay, output_region, &screen_rect, output_region);
       XFixesSetWindowShapeRegion (xdisplay, compositor->output, ShapeBounding, 0, 0, output_region);
       XFixesDestroyRegion (xdisplay, output_region);
+
+      g_free (window_bounds);
+    }
+}
+
+static gboolean
+has_window (GPtrArray  *windows,
+            MetaWindow *window)
+{
+  guint i;
+
+  for (i = 0; i < windows->len; i++)
+    if (g_ptr_array_index (windows, i) == window)
+      return TRUE;
+
+  return FALSE;
+}
+
+/* Returns each window in @windows once, leaving out NULL entries */
+static GPtrArray *
+get_distinct_windows (GPtrArray *windows)
+{
+  GPtrArray *distinct = g_ptr_array_new ();
+  guint i;
+
+  for (i = 0; i < windows->len; i++)
+    {
+      MetaWindow *window = g_ptr_array_index (windows, i);
+
+      if (window != NULL && !has_window (distinct, window))
+        g_ptr_array_add (distinct, window);
     }
+
+  return distinct;
 }
 
+/* @windows holds, per monitor, the window to unredirect on it, or NULL
+ * to composite the monitor; a window covering several monitors is given
+ * for each of them. Takes ownership of @windows. */
 static void
-set_unredirected_window (MetaCompositor *compositor,
-                         MetaWindow     *window)
+set_unredirected_windows (MetaCompositor *compositor,
+                          GPtrArray      *windows)
 {
-  if (compositor->unredirected_window == window)
-    return;
+  GPtrArray *old_windows = compositor->unredirected_windows;
+  GPtrArray *old_distinct, *new_distinct;
+  gboolean changed = FALSE;
+  guint i;
+
+  for (i = 0; i < MAX (old_windows->len, windows->len); i++)
+    {
+      MetaWindow *old_window = i < old_windows->len ? g_ptr_array_index (old_windows, i) : NULL;
+      MetaWindow *new_window = i < windows->len ? g_ptr_array_index (windows, i) : NULL;
+
+      if (old_window == new_window)
+        continue;
+
+      if (new_window != NULL)
+        meta_topic (META_DEBUG_COMPOSITOR,
+                    "Monitor %u: unredirected %s\n", i, new_window->desc);
+      else
+        meta_topic (META_DEBUG_COMPOSITOR, "Monitor %u: composited\n", i);
+
+      changed = TRUE;
+    }
+
+  if (!changed)
+    {
+      g_ptr_array_unref (windows);
+      return;
+    }
+
+  old_distinct = get_distinct_windows (old_windows);
+  new_distinct = get_distinct_windows (windows);
+
+  for (i = 0; i < old_distinct->len; i++)
+    {
+      MetaWindow *window = g_ptr_array_index (old_distinct, i);
+
+      if (!has_window (new_distinct, window))
+        {
+          MetaWindowActor *window_actor = META_WINDOW_ACTOR (meta_window_get_compositor_private (window));
+          meta_window_actor_set_unredirected (window_actor, FALSE);
+        }
+    }
+
+  meta_shape_cow_for_windows (compositor, new_distinct);
+
+  for (i = 0; i < new_distinct->len; i++)
+    {
+      MetaWindow *window = g_ptr_array_index (new_distinct, i);
+
+      if (!has_window (old_distinct, window))
+        {
+          MetaWindowActor *window_actor = META_WINDOW_ACTOR (meta_window_get_compositor_private (window));
+          meta_window_actor_set_unredirected (window_actor, TRUE);
+        }
+    }
+
+  compositor->unredirected_windows = windows;
+
+  g_ptr_array_unref (old_windows);
+  g_ptr_array_unref (old_distinct);
+  g_ptr_array_unref (new_distinct);
+}
+
+/* The window to unredirect on a monitor is the topmost visible window
+ * on it, if it covers the whole monitor and can be unredirected. Other
+ * monitors keep being composited. */
+static MetaWindow *
+find_unredirect_window_for_monitor (MetaCompositor *compositor,
+                                    int             monitor)
+{
+  MetaRectangle monitor_rect;
+  GList *l;
+
+  meta_screen_get_monitor_geometry (compositor->display->screen,
+                                    monitor, &monitor_rect);
+
+  for (l = g_list_last (compositor->windows); l; l = l->prev)
+    {
+      MetaWindowActor *window_actor = l->data;
+      MetaWindow *window = meta_window_actor_get_meta_window (window_actor);
+      MetaRectangle rect;
+
+      if (!CLUTTER_ACTOR_IS_VISIBLE (window_actor))
+        continue;
+
+      meta_window_get_frame_rect (window, &rect);
+      if (!meta_rectangle_overlap (&rect, &monitor_rect))
+        continue;
+
+      if (meta_rectangle_contains_rect (&rect, &monitor_rect) &&
+          meta_window_actor_should_unredirect (window_actor))
+        return window;
+
+      return NULL;
+    }
+
+  return NULL;
+}
+
+/* An unredirected window is shown by the X server wherever it is, so it
+ * must be the window to unredirect on every monitor it overlaps; one
+ * reaching into a monitor where other windows are on top, or which it
+ * doesn't cover, stays composited. */
+static gboolean
+is_unredirect_window_on_its_monitors (MetaCompositor *compositor,
+                                      GPtrArray      *windows,
+                                      MetaWindow     *window)
+{
+  MetaRectangle rect;
+  guint i;
+
+  meta_window_get_frame_rect (window, &rect);
 
-  if (compositor->unredirected_window != NULL)
+  for (i = 0; i < windows->len; i++)
     {
-      MetaWindowActor *window_actor = META_WINDOW_ACTOR (meta_window_get_compositor_private (compositor->unredirected_window));
-      meta_window_actor_set_unredirected (window_actor, FALSE);
+      MetaRectangle monitor_rect;
+
+      if (g_ptr_array_index (windows, i) == window)
+        continue;
+
+      meta_screen_get_monitor_geometry (compositor->display->screen,
+                                        i, &monitor_rect);
+      if (meta_rectangle_overlap (&rect, &monitor_rect))
+        return FALSE;
     }
 
-  meta_shape_cow_for_window (compositor, window);
-  compositor->unredirected_window = window;
+  return TRUE;
+}
+
+static void
+update_unredirected_windows (MetaCompositor *compositor)
+{
+  int n_monitors = meta_screen_get_n_monitors (compositor->display->screen);
+  GPtrArray *windows;
+  int i;
+
+  windows = g_ptr_array_sized_new (n_monitors);
 
-  if (compositor->unredirected_window != NULL)
+  for (i = 0; i < n_monitors; i++)
     {
-      MetaWindowActor *window_actor = META_WINDOW_ACTOR (meta_window_get_compositor_private (compositor->unredirected_window));
-      meta_window_actor_set_unredirected (window_actor, TRUE);
+      MetaWindow *window = NULL;
+
+      if (compositor->disable_unredirect_count == 0)
+        window = find_unredirect_window_for_monitor (compositor, i);
+
+      g_ptr_array_add (windows, window);
+    }
+
+  for (i = 0; i < n_monitors; i++)
+    {
+      MetaWindow *window = g_ptr_array_index (windows, i);
+
+      if (window != NULL &&
+          !is_unredirect_window_on_its_monitors (compositor, windows, window))
+        {
+          int j;
+
+          for (j = i; j < n_monitors; j++)
+            if (g_ptr_array_index (windows, j) == window)
+              g_ptr_array_index (windows, j) = NULL;
+        }
     }
+
+  set_unredirected_windows (compositor, windows);
 }
 
 void
@@ -644,8 +867,20 @@ meta_compositor_remove_window (MetaCompositor *compositor,
 {
   MetaWindowActor *window_actor = META_WINDOW_ACTOR (meta_window_get_compositor_private (window));
 
-  if (compositor->unredirected_window == window)
-    set_unredirected_window (compositor, NULL);
+  if (has_window (compositor->unredirected_windows, window))
+    {
+      GPtrArray *windows = g_ptr_array_sized_new (compositor->unredirected_windows->len);
+      guint i;
+
+      for (i = 0; i < compositor->unredirected_windows->len; i++)
+        {
+          MetaWindow *other = g_ptr_array_index (compositor->unredirected_windows, i);
+
+          g_ptr_array_add (windows, other == window ? NULL : other);
+        }
+
+      set_unredirected_windows (compositor, windows);
+    }
 
   meta_window_actor_destroy (window_actor);
 }
@@ -1035,14 +1270,94 @@ frame_callback (CoglOnscreen  *onscreen,
 
       for (l = compositor->windows; l; l = l->next)
         meta_window_actor_frame_complete (l->data, frame_info, presentation_time);
+
+      if (compositor->capture_stream)
+        meta_capture_stream_frame_complete (compositor->capture_stream,
+                                            frame_info, presentation_time);
+
+      if (compositor->display->input_replay)
+        meta_input_replay_frame_complete (compositor->display->input_replay,
+                                          frame_info, presentation_time);
+
+      if (compositor->repaint_scheduler)
+        meta_repaint_scheduler_frame_complete (compositor->repaint_scheduler,
+                                               frame_info, presentation_time);
     }
 }
 
+typedef struct
+{
+  MetaWindowActor *window_actor;
+  gint64 dirty_time;
+} DirtyThumbnail;
+
+static int
+compare_thumbnail_dirty_time (gconstpointer a,
+                              gconstpointer b)
+{
+  const DirtyThumbnail *dirty_a = a;
+  const DirtyThumbnail *dirty_b = b;
+
+  /* Oldest first */
+  if (dirty_a->dirty_time < dirty_b->dirty_time)
+    return -1;
+  else if (dirty_a->dirty_time > dirty_b->dirty_time)
+    return 1;
+  else
+    return 0;
+}
+
+/* Bring window thumbnails up to date, spending at most
+ * META_THUMBNAIL_UPDATE_BUDGET window pixels per frame. The thumbnails
+ * that have been out of date the longest go first, and at least one is
+ * updated per frame so that large windows make progress too. */
+static void
+update_thumbnails (MetaCompositor *compositor)
+{
+  GArray *dirty;
+  GList *l;
+  gsize budget = META_THUMBNAIL_UPDATE_BUDGET;
+  guint i;
+
+  dirty = g_array_new (FALSE, FALSE, sizeof (DirtyThumbnail));
+
+  /* The dirty time walks the surface tree, so it is only asked once */
+  for (l = compositor->windows; l; l = l->next)
+    {
+      DirtyThumbnail thumbnail;
+
+      thumbnail.window_actor = l->data;
+      thumbnail.dirty_time = meta_window_actor_get_thumbnail_dirty_time (l->data);
+
+      if (thumbnail.dirty_time != 0)
+        g_array_append_val (dirty, thumbnail);
+    }
+
+  g_array_sort (dirty, compare_thumbnail_dirty_time);
+
+  for (i = 0; i < dirty->len; i++)
+    {
+      DirtyThumbnail *thumbnail = &g_array_index (dirty, DirtyThumbnail, i);
+      gsize cost;
+
+      if (i > 0 && budget == 0)
+        break;
+
+      cost = meta_window_actor_update_thumbnail (thumbnail->window_actor);
+      budget -= MIN (cost, budget);
+    }
+
+  /* Keep going at the next frame */
+  if (i < dirty->len)
+    clutter_actor_queue_redraw (compositor->stage);
+
+  g_array_free (dirty, TRUE);
+}
+
 static gboolean
 meta_pre_paint_func (gpointer data)
 {
   GList *l;
-  MetaWindowActor *top_window;
   MetaCompositor *compositor = data;
 
   if (compositor->onscreen == NULL)
@@ -1054,16 +1369,18 @@ meta_pre_paint_func (gpointer data)
                                                                     NULL);
     }
 
+  if (compositor->repaint_scheduler)
+    meta_repaint_scheduler_before_paint (compositor->repaint_scheduler,
+                                         compositor->onscreen);
+
+  if (compositor->display->input_replay)
+    meta_input_replay_before_paint (compositor->display->input_replay,
+                                    compositor->onscreen);
+
   if (compositor->windows == NULL)
     return TRUE;
 
-  top_window = g_list_last (compositor->windows)->data;
-
-  if (meta_window_actor_should_unredirect (top_window) &&
-      compositor->disable_unredirect_count == 0)
-    set_unredirected_window (compositor, meta_window_actor_get_meta_window (top_window));
-  else
-    set_unredirected_window (compositor, NULL);
+  update_unredirected_windows (compositor);
 
   for (l = compositor->windows; l; l = l->next)
     meta_window_actor_pre_paint (l->data);
@@ -1098,6 +1415,9 @@ meta_pre_paint_func (gpointer data)
         XSync (compositor->display->xdisplay, False);
     }
 
+  /* After the X drawing was synchronized with, as above */
+  update_thumbnails (compositor);
+
   return TRUE;
 }
 
@@ -1114,6 +1434,9 @@ meta_post_paint_func (gpointer data)
       compositor->frame_has_updated_xsurfaces = FALSE;
     }
 
+  if (compositor->repaint_scheduler)
+    meta_repaint_scheduler_after_paint (compositor->repaint_scheduler);
+
   return TRUE;
 }
 
@@ -1139,6 +1462,7 @@ meta_compositor_new (MetaDisplay *display)
 
   compositor = g_new0 (MetaCompositor, 1);
   compositor->display = display;
+  compositor->unredirected_windows = g_ptr_array_new ();
 
   if (g_getenv("META_DISABLE_MIPMAPS"))
     compositor->no_mipmaps = TRUE;
@@ -1205,6 +1529,29 @@ meta_enable_unredirect_for_screen (MetaScreen *screen)
     compositor->disable_unredirect_count--;
 }
 
+/**
+ * meta_get_unredirected_window_for_monitor:
+ * @screen: a #MetaScreen
+ * @monitor: the monitor number
+ *
+ * Gets the window shown on @monitor without compositing, if any.
+ * Fullscreen windows are unredirected per monitor, so other monitors
+ * can keep being composited.
+ *
+ * Return value: (transfer none) (nullable): the unredirected window
+ */
+MetaWindow *
+meta_get_unredirected_window_for_monitor (MetaScreen *screen,
+                                          int         monitor)
+{
+  MetaCompositor *compositor = get_compositor_for_screen (screen);
+
+  if (monitor < 0 || monitor >= (int) compositor->unredirected_windows->len)
+    return NULL;
+
+  return g_ptr_array_index (compositor->unredirected_windows, monitor);
+}
+
 #define FLASH_TIME_MS 50
 
 static void
@@ -1297,6 +1644,16 @@ meta_compositor_monotonic_time_to_server_time (MetaDisplay *display,
     return monotonic_time + compositor->server_time_offset;
 }
 
+/* The time after a vblank the next paint starts at, in milliseconds */
+int
+meta_compositor_get_sync_delay (MetaCompositor *compositor)
+{
+  if (compositor->repaint_scheduler)
+    return meta_repaint_scheduler_get_sync_delay (compositor->repaint_scheduler);
+  else
+    return META_SYNC_DELAY;
+}
+
 void
 meta_compositor_show_tile_preview (MetaCompositor *compositor,
                                    MetaWindow     *window,
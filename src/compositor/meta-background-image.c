@@ -24,12 +24,58 @@
 
 #include <config.h>
 
+#include <math.h>
+#include <string.h>
+#include <utime.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <clutter/clutter.h>
 #include <meta/meta-background-image.h>
+#include <meta/util.h>
 #include "cogl-utils.h"
 
+/* Images decoded at a reduced size are written to disk, premultiplied and
+ * ready for upload, so that the next time they are needed they can simply
+ * be mapped instead of decoded again. Using an entry touches it; the least
+ * recently used entries are removed once the cache grows past its limits.
+ */
+#define CACHE_MAGIC   0x4347424d /* "MBGC" */
+#define CACHE_VERSION 1
+
+#define CACHE_MAX_ENTRIES 16
+#define CACHE_MAX_SIZE    (256 * 1024 * 1024)
+
+#define READ_CHUNK_SIZE 65536
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint64 mtime;
+  guint32 mtime_usec;
+  guint32 has_alpha;
+  guint64 file_size;
+  guint32 width;
+  guint32 height;
+  guint32 stride;
+  guint32 padding;
+} CacheHeader;
+
+/* Either premultiplied pixels in the layout of CAIRO_FORMAT_ARGB32, as
+ * kept in the cache, or the pixels of a pixbuf that isn't cached */
+typedef struct
+{
+  GMappedFile *mapped_file;
+  GdkPixbuf *pixbuf;
+  guchar *pixels; /* owned unless mapped_file or pixbuf is set */
+  CoglPixelFormat format;
+  int width;
+  int height;
+  int stride;
+  gboolean has_alpha;
+} DecodedImage;
+
 enum
 {
   LOADED,
@@ -54,6 +100,9 @@ struct _MetaBackgroundImage
 {
   GObject parent_instance;
   GFile *file;
+  char *key;
+  int target_width;
+  int target_height;
   MetaBackgroundImageCache *cache;
   gboolean in_cache;
   gboolean loaded;
@@ -70,7 +119,7 @@ G_DEFINE_TYPE (MetaBackgroundImageCache, meta_background_image_cache, G_TYPE_OBJ
 static void
 meta_background_image_cache_init (MetaBackgroundImageCache *cache)
 {
-  cache->images = g_hash_table_new (g_file_hash, (GEqualFunc) g_file_equal);
+  cache->images = g_hash_table_new (g_str_hash, g_str_equal);
 }
 
 static void
@@ -116,6 +165,423 @@ meta_background_image_cache_get_default (void)
   return cache;
 }
 
+static void
+decoded_image_free (DecodedImage *decoded)
+{
+  if (decoded->mapped_file)
+    g_mapped_file_unref (decoded->mapped_file);
+  else if (decoded->pixbuf)
+    g_object_unref (decoded->pixbuf);
+  else
+    g_free (decoded->pixels);
+
+  g_slice_free (DecodedImage, decoded);
+}
+
+static char *
+get_cache_dir (void)
+{
+  return g_build_filename (g_get_user_cache_dir (),
+                           "mutter", "backgrounds", NULL);
+}
+
+static char *
+get_cache_path (MetaBackgroundImage *image)
+{
+  char *uri, *checksum, *name, *dir, *path;
+
+  uri = g_file_get_uri (image->file);
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA1, uri, -1);
+  name = g_strdup_printf ("%s-%dx%d", checksum,
+                          image->target_width, image->target_height);
+  dir = get_cache_dir ();
+  path = g_build_filename (dir, name, NULL);
+
+  g_free (dir);
+  g_free (name);
+  g_free (checksum);
+  g_free (uri);
+
+  return path;
+}
+
+typedef struct
+{
+  char *path;
+  time_t mtime;
+  goffset size;
+} CacheEntry;
+
+static int
+compare_cache_entries (gconstpointer a,
+                       gconstpointer b)
+{
+  const CacheEntry *entry_a = a;
+  const CacheEntry *entry_b = b;
+
+  /* Most recently used first */
+  if (entry_a->mtime > entry_b->mtime)
+    return -1;
+  else if (entry_a->mtime < entry_b->mtime)
+    return 1;
+  else
+    return 0;
+}
+
+/* Removes the least recently used entries until the cache fits into
+ * CACHE_MAX_ENTRIES and CACHE_MAX_SIZE */
+static void
+prune_cache (void)
+{
+  GArray *entries;
+  GDir *dir;
+  const char *name;
+  char *dir_path;
+  goffset total_size = 0;
+  guint i;
+
+  dir_path = get_cache_dir ();
+  dir = g_dir_open (dir_path, 0, NULL);
+  if (dir == NULL)
+    {
+      g_free (dir_path);
+      return;
+    }
+
+  entries = g_array_new (FALSE, FALSE, sizeof (CacheEntry));
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      CacheEntry entry;
+      GStatBuf buf;
+
+      entry.path = g_build_filename (dir_path, name, NULL);
+      if (g_stat (entry.path, &buf) != 0 || !S_ISREG (buf.st_mode))
+        {
+          g_free (entry.path);
+          continue;
+        }
+
+      entry.mtime = buf.st_mtime;
+      entry.size = buf.st_size;
+      g_array_append_val (entries, entry);
+    }
+
+  g_dir_close (dir);
+  g_free (dir_path);
+
+  g_array_sort (entries, compare_cache_entries);
+
+  for (i = 0; i < entries->len; i++)
+    {
+      CacheEntry *entry = &g_array_index (entries, CacheEntry, i);
+
+      total_size += entry->size;
+
+      if (i >= CACHE_MAX_ENTRIES || total_size > CACHE_MAX_SIZE)
+        g_unlink (entry->path);
+
+      g_free (entry->path);
+    }
+
+  g_array_free (entries, TRUE);
+}
+
+static void
+fill_cache_header (CacheHeader *header,
+                   GFileInfo   *info)
+{
+  memset (header, 0, sizeof (*header));
+  header->magic = CACHE_MAGIC;
+  header->version = CACHE_VERSION;
+  header->mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+  header->mtime_usec = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+  header->file_size = g_file_info_get_size (info);
+}
+
+static DecodedImage *
+load_from_cache (const char *path,
+                 GFileInfo  *info)
+{
+  GMappedFile *mapped_file;
+  CacheHeader expected;
+  const CacheHeader *header;
+  DecodedImage *decoded;
+  gsize length;
+
+  mapped_file = g_mapped_file_new (path, FALSE, NULL);
+  if (mapped_file == NULL)
+    return NULL;
+
+  length = g_mapped_file_get_length (mapped_file);
+  header = (const CacheHeader *) g_mapped_file_get_contents (mapped_file);
+
+  fill_cache_header (&expected, info);
+
+  if (length < sizeof (CacheHeader) ||
+      header->magic != expected.magic ||
+      header->version != expected.version ||
+      header->mtime != expected.mtime ||
+      header->mtime_usec != expected.mtime_usec ||
+      header->file_size != expected.file_size ||
+      header->width == 0 || header->height == 0 ||
+      header->width > G_MAXINT / 4 ||
+      header->stride < header->width * 4 ||
+      (length - sizeof (CacheHeader)) / header->stride < header->height)
+    {
+      g_mapped_file_unref (mapped_file);
+      return NULL;
+    }
+
+  /* Mark the entry as recently used */
+  utime (path, NULL);
+
+  decoded = g_slice_new0 (DecodedImage);
+  decoded->mapped_file = mapped_file;
+  decoded->pixels = (guchar *) (header + 1);
+  decoded->width = header->width;
+  decoded->height = header->height;
+  decoded->stride = header->stride;
+  decoded->has_alpha = header->has_alpha;
+  decoded->format = CLUTTER_CAIRO_FORMAT_ARGB32;
+
+  return decoded;
+}
+
+static void
+write_to_cache (const char   *path,
+                GFileInfo    *info,
+                DecodedImage *decoded)
+{
+  GError *error = NULL;
+  GFile *file;
+  GFileOutputStream *stream;
+  CacheHeader header;
+  char *dir;
+
+  dir = g_path_get_dirname (path);
+  g_mkdir_with_parents (dir, 0700);
+  g_free (dir);
+
+  fill_cache_header (&header, info);
+  header.width = decoded->width;
+  header.height = decoded->height;
+  header.stride = decoded->stride;
+  header.has_alpha = decoded->has_alpha;
+
+  /* g_file_replace() writes to a temporary file and renames it into
+   * place on close, so readers never see a partially written entry.
+   */
+  file = g_file_new_for_path (path);
+  stream = g_file_replace (file, NULL, FALSE,
+                           G_FILE_CREATE_PRIVATE | G_FILE_CREATE_REPLACE_DESTINATION,
+                           NULL, &error);
+  if (stream == NULL)
+    goto out;
+
+  if (!g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+                                  &header, sizeof (header),
+                                  NULL, NULL, &error) ||
+      !g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+                                  decoded->pixels,
+                                  (gsize) decoded->stride * decoded->height,
+                                  NULL, NULL, &error))
+    {
+      GCancellable *cancellable = g_cancellable_new ();
+
+      /* Closing with a cancelled cancellable discards the temporary file */
+      g_cancellable_cancel (cancellable);
+      g_output_stream_close (G_OUTPUT_STREAM (stream), cancellable, NULL);
+      g_object_unref (cancellable);
+      g_object_unref (stream);
+      goto out;
+    }
+
+  g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, &error);
+  g_object_unref (stream);
+
+  prune_cache ();
+
+out:
+  if (error)
+    {
+      meta_verbose ("Failed to write background cache '%s': %s\n",
+                    path, error->message);
+      g_error_free (error);
+    }
+
+  g_object_unref (file);
+}
+
+typedef struct
+{
+  MetaBackgroundImage *image;
+  gboolean scaled;
+} DecodeData;
+
+static void
+on_size_prepared (GdkPixbufLoader *loader,
+                  int              width,
+                  int              height,
+                  DecodeData      *data)
+{
+  MetaBackgroundImage *image = data->image;
+  double scale;
+
+  /* Scale down, keeping the aspect ratio, to the smallest size that
+   * still covers the target size; never scale up.
+   */
+  scale = MAX ((double) image->target_width / width,
+               (double) image->target_height / height);
+
+  if (scale < 1.0)
+    {
+      gdk_pixbuf_loader_set_size (loader,
+                                  MAX (1, (int) ceil (width * scale)),
+                                  MAX (1, (int) ceil (height * scale)));
+      data->scaled = TRUE;
+    }
+}
+
+static GdkPixbuf *
+decode_file (MetaBackgroundImage  *image,
+             gboolean             *scaled,
+             GError              **error)
+{
+  DecodeData data = { image, FALSE };
+  GdkPixbufLoader *loader;
+  GFileInputStream *stream;
+  GdkPixbuf *pixbuf = NULL;
+  guchar *buffer;
+  gssize n_read;
+
+  stream = g_file_read (image->file, NULL, error);
+  if (stream == NULL)
+    return NULL;
+
+  loader = gdk_pixbuf_loader_new ();
+  if (image->target_width > 0 && image->target_height > 0)
+    g_signal_connect (loader, "size-prepared",
+                      G_CALLBACK (on_size_prepared), &data);
+
+  buffer = g_malloc (READ_CHUNK_SIZE);
+
+  while (TRUE)
+    {
+      n_read = g_input_stream_read (G_INPUT_STREAM (stream),
+                                    buffer, READ_CHUNK_SIZE,
+                                    NULL, error);
+      if (n_read <= 0)
+        break;
+
+      if (!gdk_pixbuf_loader_write (loader, buffer, n_read, error))
+        {
+          n_read = -1;
+          break;
+        }
+    }
+
+  g_free (buffer);
+  g_object_unref (stream);
+
+  if (n_read < 0)
+    {
+      gdk_pixbuf_loader_close (loader, NULL);
+      g_object_unref (loader);
+      return NULL;
+    }
+
+  if (gdk_pixbuf_loader_close (loader, error))
+    {
+      pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+      if (pixbuf != NULL)
+        g_object_ref (pixbuf);
+      else
+        g_set_error (error, GDK_PIXBUF_ERROR, GDK_PIXBUF_ERROR_FAILED,
+                     "No image data");
+    }
+
+  g_object_unref (loader);
+
+  *scaled = data.scaled;
+
+  return pixbuf;
+}
+
+static inline guint8
+premultiply (guint8 c,
+             guint8 a)
+{
+  guint t = c * a + 0x80;
+
+  return ((t >> 8) + t) >> 8;
+}
+
+/* Converts to premultiplied pixels in the layout of CAIRO_FORMAT_ARGB32 */
+static DecodedImage *
+premultiply_pixbuf (GdkPixbuf *pixbuf)
+{
+  DecodedImage *decoded;
+  const guchar *src_pixels;
+  int src_stride, n_channels;
+  int x, y;
+
+  decoded = g_slice_new0 (DecodedImage);
+  decoded->width = gdk_pixbuf_get_width (pixbuf);
+  decoded->height = gdk_pixbuf_get_height (pixbuf);
+  decoded->has_alpha = gdk_pixbuf_get_has_alpha (pixbuf);
+  decoded->stride = cairo_format_stride_for_width (CAIRO_FORMAT_ARGB32,
+                                                   decoded->width);
+  decoded->pixels = g_malloc ((gsize) decoded->stride * decoded->height);
+  decoded->format = CLUTTER_CAIRO_FORMAT_ARGB32;
+
+  src_pixels = gdk_pixbuf_get_pixels (pixbuf);
+  src_stride = gdk_pixbuf_get_rowstride (pixbuf);
+  n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+
+  for (y = 0; y < decoded->height; y++)
+    {
+      const guchar *src = src_pixels + y * src_stride;
+      guint32 *dst = (guint32 *) (decoded->pixels + y * decoded->stride);
+
+      for (x = 0; x < decoded->width; x++)
+        {
+          guint8 r = src[0], g = src[1], b = src[2];
+          guint8 a = decoded->has_alpha ? src[3] : 0xff;
+
+          if (a != 0xff)
+            {
+              r = premultiply (r, a);
+              g = premultiply (g, a);
+              b = premultiply (b, a);
+            }
+
+          dst[x] = ((guint32) a << 24) | (r << 16) | (g << 8) | b;
+          src += n_channels;
+        }
+    }
+
+  return decoded;
+}
+
+/* Uploaded as is, without a converted copy alongside the pixbuf */
+static DecodedImage *
+wrap_pixbuf (GdkPixbuf *pixbuf)
+{
+  DecodedImage *decoded;
+
+  decoded = g_slice_new0 (DecodedImage);
+  decoded->pixbuf = pixbuf;
+  decoded->pixels = gdk_pixbuf_get_pixels (pixbuf);
+  decoded->width = gdk_pixbuf_get_width (pixbuf);
+  decoded->height = gdk_pixbuf_get_height (pixbuf);
+  decoded->stride = gdk_pixbuf_get_rowstride (pixbuf);
+  decoded->has_alpha = gdk_pixbuf_get_has_alpha (pixbuf);
+  decoded->format = decoded->has_alpha ? COGL_PIXEL_FORMAT_RGBA_8888 : COGL_PIXEL_FORMAT_RGB_888;
+
+  return decoded;
+}
+
 static void
 load_file (GTask               *task,
            MetaBackgroundImage *image,
@@ -123,26 +589,63 @@ load_file (GTask               *task,
            GCancellable        *cancellable)
 {
   GError *error = NULL;
+  GFileInfo *info = NULL;
   GdkPixbuf *pixbuf;
-  GFileInputStream *stream;
+  DecodedImage *decoded;
+  gboolean scaled;
+  char *cache_path = NULL;
+
+  /* Full size decodes are not cached; the decoded pixels would be far
+   * larger than the compressed file they come from.
+   */
+  if (image->target_width > 0 && image->target_height > 0)
+    info = g_file_query_info (image->file,
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+                              G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                              G_FILE_QUERY_INFO_NONE,
+                              NULL, NULL);
+
+  if (info != NULL &&
+      !g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED))
+    g_clear_object (&info);
+
+  if (info != NULL)
+    {
+      cache_path = get_cache_path (image);
 
-  stream = g_file_read (image->file, NULL, &error);
-  if (stream == NULL)
+      decoded = load_from_cache (cache_path, info);
+      if (decoded != NULL)
+        goto out;
+    }
+
+  pixbuf = decode_file (image, &scaled, &error);
+  if (pixbuf == NULL)
     {
       g_task_return_error (task, error);
-      return;
+      decoded = NULL;
+      goto out;
     }
 
-  pixbuf = gdk_pixbuf_new_from_stream (G_INPUT_STREAM (stream), NULL, &error);
-  g_object_unref (stream);
+  /* Images smaller than the target were decoded at full size */
+  if (info != NULL && scaled)
+    {
+      decoded = premultiply_pixbuf (pixbuf);
+      g_object_unref (pixbuf);
 
-  if (pixbuf == NULL)
+      write_to_cache (cache_path, info, decoded);
+    }
+  else
     {
-      g_task_return_error (task, error);
-      return;
+      decoded = wrap_pixbuf (pixbuf);
     }
 
-  g_task_return_pointer (task, pixbuf, (GDestroyNotify) g_object_unref);
+out:
+  if (decoded != NULL)
+    g_task_return_pointer (task, decoded, (GDestroyNotify) decoded_image_free);
+
+  g_free (cache_path);
+  g_clear_object (&info);
 }
 
 static void
@@ -154,15 +657,12 @@ file_loaded (GObject      *source_object,
   GError *error = NULL;
   GTask *task;
   CoglTexture *texture;
-  GdkPixbuf *pixbuf;
-  int width, height, row_stride;
-  guchar *pixels;
-  gboolean has_alpha;
+  DecodedImage *decoded;
 
   task = G_TASK (result);
-  pixbuf = g_task_propagate_pointer (task, &error);
+  decoded = g_task_propagate_pointer (task, &error);
 
-  if (pixbuf == NULL)
+  if (decoded == NULL)
     {
       char *uri = g_file_get_uri (image->file);
       g_warning ("Failed to load background '%s': %s",
@@ -172,31 +672,26 @@ file_loaded (GObject      *source_object,
       goto out;
     }
 
-  width = gdk_pixbuf_get_width (pixbuf);
-  height = gdk_pixbuf_get_height (pixbuf);
-  row_stride = gdk_pixbuf_get_rowstride (pixbuf);
-  pixels = gdk_pixbuf_get_pixels (pixbuf);
-  has_alpha = gdk_pixbuf_get_has_alpha (pixbuf);
-
-  texture = meta_create_texture (width, height,
-                                 has_alpha ? COGL_TEXTURE_COMPONENTS_RGBA : COGL_TEXTURE_COMPONENTS_RGB,
+  texture = meta_create_texture (decoded->width, decoded->height,
+                                 decoded->has_alpha ? COGL_TEXTURE_COMPONENTS_RGBA : COGL_TEXTURE_COMPONENTS_RGB,
                                  META_TEXTURE_ALLOW_SLICING);
 
   if (!cogl_texture_set_data (texture,
-                              has_alpha ? COGL_PIXEL_FORMAT_RGBA_8888 : COGL_PIXEL_FORMAT_RGB_888,
-                              row_stride,
-                              pixels, 0,
+                              decoded->format,
+                              decoded->stride,
+                              decoded->pixels, 0,
                               NULL))
     {
       g_warning ("Failed to create texture for background");
       cogl_object_unref (texture);
+      texture = NULL;
     }
 
   image->texture = texture;
 
 out:
-  if (pixbuf != NULL)
-    g_object_unref (pixbuf);
+  if (decoded != NULL)
+    decoded_image_free (decoded);
 
   image->loaded = TRUE;
   g_signal_emit (image, signals[LOADED], 0);
@@ -220,22 +715,61 @@ out:
 MetaBackgroundImage *
 meta_background_image_cache_load (MetaBackgroundImageCache *cache,
                                   GFile                    *file)
+{
+  return meta_background_image_cache_load_for_size (cache, file, 0, 0);
+}
+
+/**
+ * meta_background_image_cache_load_for_size:
+ * @cache: a #MetaBackgroundImageCache
+ * @file: #GFile to load
+ * @width: width the image will be displayed at, or 0
+ * @height: height the image will be displayed at, or 0
+ *
+ * Like meta_background_image_cache_load(), but the image is decoded at
+ * the smallest size, keeping its aspect ratio, that still covers
+ * @width x @height; images are never scaled up. If either dimension is
+ * 0, the image is loaded at its natural size. Images decoded at a
+ * reduced size are kept in a disk cache, so that later loads of an
+ * unchanged file don't have to decode it again.
+ *
+ * Return value: (transfer full): a #MetaBackgroundImage to dereference to get the loaded texture
+ */
+MetaBackgroundImage *
+meta_background_image_cache_load_for_size (MetaBackgroundImageCache *cache,
+                                           GFile                    *file,
+                                           int                       width,
+                                           int                       height)
 {
   MetaBackgroundImage *image;
   GTask *task;
+  char *uri, *key;
 
   g_return_val_if_fail (META_IS_BACKGROUND_IMAGE_CACHE (cache), NULL);
   g_return_val_if_fail (file != NULL, NULL);
 
-  image = g_hash_table_lookup (cache->images, file);
+  if (width <= 0 || height <= 0)
+    width = height = 0;
+
+  uri = g_file_get_uri (file);
+  key = g_strdup_printf ("%dx%d %s", width, height, uri);
+  g_free (uri);
+
+  image = g_hash_table_lookup (cache->images, key);
   if (image != NULL)
-    return g_object_ref (image);
+    {
+      g_free (key);
+      return g_object_ref (image);
+    }
 
   image = g_object_new (META_TYPE_BACKGROUND_IMAGE, NULL);
   image->cache = cache;
   image->in_cache = TRUE;
   image->file = g_object_ref (file);
-  g_hash_table_insert (cache->images, image->file, image);
+  image->key = key;
+  image->target_width = width;
+  image->target_height = height;
+  g_hash_table_insert (cache->images, image->key, image);
 
   task = g_task_new (image, NULL, file_loaded, NULL);
 
@@ -257,17 +791,24 @@ void
 meta_background_image_cache_purge (MetaBackgroundImageCache *cache,
                                    GFile                    *file)
 {
-  MetaBackgroundImage *image;
+  GHashTableIter iter;
+  gpointer key, value;
 
   g_return_if_fail (META_IS_BACKGROUND_IMAGE_CACHE (cache));
   g_return_if_fail (file != NULL);
 
-  image = g_hash_table_lookup (cache->images, file);
-  if (image == NULL)
-    return;
+  /* The file may be loaded at several sizes */
+  g_hash_table_iter_init (&iter, cache->images);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      MetaBackgroundImage *image = value;
 
-  g_hash_table_remove (cache->images, image->file);
-  image->in_cache = FALSE;
+      if (g_file_equal (image->file, file))
+        {
+          g_hash_table_iter_remove (&iter);
+          image->in_cache = FALSE;
+        }
+    }
 }
 
 G_DEFINE_TYPE (MetaBackgroundImage, meta_background_image, G_TYPE_OBJECT);
@@ -283,12 +824,13 @@ meta_background_image_finalize (GObject *object)
   MetaBackgroundImage *image = META_BACKGROUND_IMAGE (object);
 
   if (image->in_cache)
-    g_hash_table_remove (image->cache->images, image->file);
+    g_hash_table_remove (image->cache->images, image->key);
 
   if (image->texture)
     cogl_object_unref (image->texture);
   if (image->file)
     g_object_unref (image->file);
+  g_free (image->key);
 
   G_OBJECT_CLASS (meta_background_image_parent_class)->finalize (object);
 }
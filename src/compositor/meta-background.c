@@ -57,6 +57,15 @@ struct _MetaBackgroundPrivate
   GFile *file2;
   MetaBackgroundImage *background_image2;
 
+  /* The images being replaced by a reload at another size, drawn until
+   * the new ones are loaded */
+  MetaBackgroundImage *old_background_image1;
+  MetaBackgroundImage *old_background_image2;
+
+  /* Size the images are decoded at; 0 for their natural size */
+  int image_width;
+  int image_height;
+
   CoglTexture *color_texture;
   CoglTexture *wallpaper_texture;
 
@@ -74,6 +83,7 @@ enum
 G_DEFINE_TYPE (MetaBackground, meta_background, G_TYPE_OBJECT)
 
 static gboolean texture_has_alpha (CoglTexture *texture);
+static void     reload_images     (MetaBackground *self);
 
 static GSList *all_backgrounds = NULL;
 
@@ -146,6 +156,8 @@ on_monitors_changed (MetaScreen     *screen,
 
       for (i = 0; i < priv->n_monitors; i++)
         priv->monitors[i].dirty = TRUE;
+
+      reload_images (self);
     }
 }
 
@@ -209,12 +221,24 @@ meta_background_get_property (GObject      *object,
     }
 }
 
+static CoglTexture *
+get_image_texture (MetaBackgroundImage *image,
+                   MetaBackgroundImage *old_image)
+{
+  if (image && meta_background_image_is_loaded (image))
+    return meta_background_image_get_texture (image);
+  else if (old_image)
+    return meta_background_image_get_texture (old_image);
+  else
+    return NULL;
+}
+
 static gboolean
 need_prerender (MetaBackground *self)
 {
   MetaBackgroundPrivate *priv = self->priv;
-  CoglTexture *texture1 = priv->background_image1 ? meta_background_image_get_texture (priv->background_image1) : NULL;
-  CoglTexture *texture2 = priv->background_image2 ? meta_background_image_get_texture (priv->background_image2) : NULL;
+  CoglTexture *texture1 = get_image_texture (priv->background_image1, priv->old_background_image1);
+  CoglTexture *texture2 = get_image_texture (priv->background_image2, priv->old_background_image2);
 
   if (texture1 == NULL && texture2 == NULL)
     return FALSE;
@@ -244,6 +268,14 @@ static void
 on_background_loaded (MetaBackgroundImage *image,
                       MetaBackground      *self)
 {
+  MetaBackgroundPrivate *priv = self->priv;
+
+  if (image == priv->background_image1)
+    g_clear_object (&priv->old_background_image1);
+  else if (image == priv->background_image2)
+    g_clear_object (&priv->old_background_image2);
+
+  free_wallpaper_texture (self);
   mark_changed (self);
 }
 
@@ -264,18 +296,31 @@ static void
 set_file (MetaBackground       *self,
           GFile               **filep,
           MetaBackgroundImage **imagep,
-          GFile                *file)
+          MetaBackgroundImage **old_imagep,
+          GFile                *file,
+          gboolean              force_reload)
 {
-  if (!file_equal0 (*filep, file))
+  MetaBackgroundPrivate *priv = self->priv;
+  gboolean same_file = file_equal0 (*filep, file);
+
+  if (!same_file || force_reload)
     {
       g_clear_object (filep);
+      g_clear_object (old_imagep);
 
       if (*imagep)
         {
           g_signal_handlers_disconnect_by_func (*imagep,
                                                 (gpointer)on_background_loaded,
                                                 self);
-          g_object_unref (*imagep);
+
+          /* Reloading the same file at another size; keep drawing what
+           * we have rather than flashing the background color */
+          if (same_file && file != NULL &&
+              meta_background_image_get_success (*imagep))
+            *old_imagep = *imagep;
+          else
+            g_object_unref (*imagep);
           *imagep = NULL;
         }
 
@@ -284,13 +329,103 @@ set_file (MetaBackground       *self,
           MetaBackgroundImageCache *cache = meta_background_image_cache_get_default ();
 
           *filep = g_object_ref (file);
-          *imagep = meta_background_image_cache_load (cache, file);
+          *imagep = meta_background_image_cache_load_for_size (cache, file,
+                                                               priv->image_width,
+                                                               priv->image_height);
           g_signal_connect (*imagep, "loaded",
                             G_CALLBACK (on_background_loaded), self);
+
+          if (meta_background_image_is_loaded (*imagep))
+            g_clear_object (old_imagep);
+        }
+    }
+}
+
+/* Images are decoded no larger than they will be drawn; styles that
+ * draw the image at its natural size need the full image.
+ */
+static void
+get_image_size (MetaBackground *self,
+                int            *width,
+                int            *height)
+{
+  MetaBackgroundPrivate *priv = self->priv;
+  MetaRectangle geometry;
+  int i;
+
+  *width = 0;
+  *height = 0;
+
+  if (priv->screen == NULL)
+    return;
+
+  switch (priv->style)
+    {
+    case G_DESKTOP_BACKGROUND_STYLE_STRETCHED:
+    case G_DESKTOP_BACKGROUND_STYLE_SCALED:
+    case G_DESKTOP_BACKGROUND_STYLE_ZOOM:
+      for (i = 0; i < priv->n_monitors; i++)
+        {
+          meta_screen_get_monitor_geometry (priv->screen, i, &geometry);
+          *width = MAX (*width, geometry.width);
+          *height = MAX (*height, geometry.height);
         }
+      break;
+    case G_DESKTOP_BACKGROUND_STYLE_SPANNED:
+      meta_screen_get_size (priv->screen, width, height);
+      break;
+    case G_DESKTOP_BACKGROUND_STYLE_WALLPAPER:
+    case G_DESKTOP_BACKGROUND_STYLE_CENTERED:
+    default:
+      break;
     }
 }
 
+static gboolean
+update_image_size (MetaBackground *self)
+{
+  MetaBackgroundPrivate *priv = self->priv;
+  int width, height;
+
+  get_image_size (self, &width, &height);
+
+  if (width == priv->image_width && height == priv->image_height)
+    return FALSE;
+
+  priv->image_width = width;
+  priv->image_height = height;
+
+  return TRUE;
+}
+
+static void
+reload_images (MetaBackground *self)
+{
+  MetaBackgroundPrivate *priv = self->priv;
+  GFile *file1, *file2;
+
+  if (!update_image_size (self))
+    return;
+
+  if (priv->file1 == NULL && priv->file2 == NULL)
+    return;
+
+  /* set_file() drops its reference to the old file */
+  file1 = priv->file1 ? g_object_ref (priv->file1) : NULL;
+  file2 = priv->file2 ? g_object_ref (priv->file2) : NULL;
+
+  set_file (self, &priv->file1, &priv->background_image1,
+            &priv->old_background_image1, file1, TRUE);
+  set_file (self, &priv->file2, &priv->background_image2,
+            &priv->old_background_image2, file2, TRUE);
+
+  g_clear_object (&file1);
+  g_clear_object (&file2);
+
+  free_wallpaper_texture (self);
+  mark_changed (self);
+}
+
 static void
 meta_background_dispose (GObject *object)
 {
@@ -300,8 +435,10 @@ meta_background_dispose (GObject *object)
   free_color_texture (self);
   free_wallpaper_texture (self);
 
-  set_file (self, &priv->file1, &priv->background_image1, NULL);
-  set_file (self, &priv->file2, &priv->background_image2, NULL);
+  set_file (self, &priv->file1, &priv->background_image1,
+            &priv->old_background_image1, NULL, FALSE);
+  set_file (self, &priv->file2, &priv->background_image2,
+            &priv->old_background_image2, NULL, FALSE);
 
   set_screen (self, NULL);
 
@@ -733,8 +870,8 @@ meta_background_get_texture (MetaBackground         *self,
   monitor_area.width = geometry.width;
   monitor_area.height = geometry.height;
 
-  texture1 = priv->background_image1 ? meta_background_image_get_texture (priv->background_image1) : NULL;
-  texture2 = priv->background_image2 ? meta_background_image_get_texture (priv->background_image2) : NULL;
+  texture1 = get_image_texture (priv->background_image1, priv->old_background_image1);
+  texture2 = get_image_texture (priv->background_image2, priv->old_background_image2);
 
   if (texture1 == NULL && texture2 == NULL)
     {
@@ -915,18 +1052,23 @@ meta_background_set_blend (MetaBackground          *self,
                            GDesktopBackgroundStyle  style)
 {
   MetaBackgroundPrivate *priv;
+  gboolean size_changed;
 
   g_return_if_fail (META_IS_BACKGROUND (self));
   g_return_if_fail (blend_factor >= 0.0 && blend_factor <= 1.0);
 
   priv = self->priv;
 
-  set_file (self, &priv->file1, &priv->background_image1, file1);
-  set_file (self, &priv->file2, &priv->background_image2, file2);
-
   priv->blend_factor = blend_factor;
   priv->style = style;
 
+  size_changed = update_image_size (self);
+
+  set_file (self, &priv->file1, &priv->background_image1,
+            &priv->old_background_image1, file1, size_changed);
+  set_file (self, &priv->file2, &priv->background_image2,
+            &priv->old_background_image2, file2, size_changed);
+
   free_wallpaper_texture (self);
   mark_changed (self);
 }
@@ -0,0 +1,730 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaCaptureStream
+ *
+ * Streams the damaged parts of the composited output to a local consumer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Each slot of the shared file holds a complete image of the output. Every
+ * slot remembers which parts of the output changed since it was last
+ * written (its stale region), so that only those are read back from the
+ * framebuffer when it is reused. The read back goes through pixel buffer
+ * objects, like meta_shaped_texture_capture_async(), so painting doesn't
+ * wait for the GPU; the pixels are copied into the slot once the GPU is
+ * done, and the frame is sent once it is both copied and presented. The
+ * protocol is described in meta-capture-stream.h.
+ */
+
+#include <config.h>
+
+#include "meta-capture-stream.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <gdk/gdk.h> /* for gdk_rectangle_intersect() */
+#include <glib/gstdio.h>
+#include <gio/gunixfdmessage.h>
+#include <gio/gunixsocketaddress.h>
+
+#include <meta/util.h>
+#include "util-private.h"
+
+#define N_SLOTS 3
+
+typedef struct
+{
+  gboolean busy;
+  cairo_region_t *stale;
+} CaptureSlot;
+
+typedef struct
+{
+  cairo_rectangle_int_t rect;
+  CoglBitmap *bitmap;
+} Readback;
+
+typedef struct
+{
+  MetaCaptureStream *stream;
+  gint64 frame_counter;
+  int slot;
+  cairo_region_t *damage;
+
+  /* NULL once the pixels are copied into the slot */
+  GArray *readbacks;
+  CoglFramebuffer *framebuffer;
+  CoglFenceClosure *fence;
+  guint readback_idle_id;
+
+  gboolean presented;
+  gint64 presentation_time;
+} PendingFrame;
+
+struct _MetaCaptureStream
+{
+  ClutterStage *stage;
+  char *socket_path;
+
+  GSocketService *service;
+  GSocketConnection *connection;
+  GSource *socket_source;
+
+  int fd;
+  guint8 *data;
+  gsize slot_size;
+  int width, height, stride;
+
+  CaptureSlot slots[N_SLOTS];
+  GQueue pending_frames;
+
+  /* Damage not yet reported to the consumer */
+  cairo_region_t *unsent_damage;
+  guint64 sequence;
+  guint frames_dropped;
+};
+
+static void
+free_readbacks (PendingFrame *frame)
+{
+  guint i;
+
+  if (frame->fence)
+    {
+      cogl_framebuffer_cancel_fence_callback (frame->framebuffer, frame->fence);
+      frame->fence = NULL;
+    }
+
+  if (frame->readback_idle_id)
+    {
+      g_source_remove (frame->readback_idle_id);
+      frame->readback_idle_id = 0;
+    }
+
+  if (frame->readbacks)
+    {
+      for (i = 0; i < frame->readbacks->len; i++)
+        cogl_object_unref (g_array_index (frame->readbacks, Readback, i).bitmap);
+      g_clear_pointer (&frame->readbacks, g_array_unref);
+    }
+
+  g_clear_pointer (&frame->framebuffer, cogl_object_unref);
+}
+
+static void
+pending_frame_free (PendingFrame *frame)
+{
+  free_readbacks (frame);
+  cairo_region_destroy (frame->damage);
+  g_slice_free (PendingFrame, frame);
+}
+
+static void
+free_buffers (MetaCaptureStream *stream)
+{
+  int i;
+
+  g_queue_foreach (&stream->pending_frames, (GFunc) pending_frame_free, NULL);
+  g_queue_clear (&stream->pending_frames);
+
+  for (i = 0; i < N_SLOTS; i++)
+    g_clear_pointer (&stream->slots[i].stale, cairo_region_destroy);
+
+  if (stream->data)
+    {
+      munmap (stream->data, stream->slot_size * N_SLOTS);
+      stream->data = NULL;
+    }
+
+  if (stream->fd != -1)
+    {
+      close (stream->fd);
+      stream->fd = -1;
+    }
+
+  stream->width = 0;
+  stream->height = 0;
+}
+
+static void
+disconnect_consumer (MetaCaptureStream *stream)
+{
+  if (stream->socket_source)
+    {
+      g_source_destroy (stream->socket_source);
+      g_source_unref (stream->socket_source);
+      stream->socket_source = NULL;
+    }
+
+  if (stream->connection)
+    {
+      g_io_stream_close (G_IO_STREAM (stream->connection), NULL, NULL);
+      g_clear_object (&stream->connection);
+    }
+
+  free_buffers (stream);
+
+  meta_verbose ("Capture stream consumer disconnected\n");
+}
+
+static gboolean
+send_setup (MetaCaptureStream  *stream,
+            GError            **error)
+{
+  GSocket *socket = g_socket_connection_get_socket (stream->connection);
+  MetaCaptureSetup setup = { 0, };
+  GOutputVector vector;
+  GSocketControlMessage *fd_message;
+  gssize sent;
+
+  setup.type = META_CAPTURE_MESSAGE_SETUP;
+  setup.n_slots = N_SLOTS;
+  setup.width = stream->width;
+  setup.height = stream->height;
+  setup.stride = stream->stride;
+  setup.slot_size = stream->slot_size;
+
+  vector.buffer = &setup;
+  vector.size = sizeof (setup);
+
+  fd_message = g_unix_fd_message_new ();
+  if (!g_unix_fd_message_append_fd (G_UNIX_FD_MESSAGE (fd_message),
+                                    stream->fd, error))
+    {
+      g_object_unref (fd_message);
+      return FALSE;
+    }
+
+  sent = g_socket_send_message (socket, NULL, &vector, 1,
+                                &fd_message, 1,
+                                G_SOCKET_MSG_NONE, NULL, error);
+  g_object_unref (fd_message);
+
+  if (sent != sizeof (setup))
+    {
+      if (sent >= 0)
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                             "Short write");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+setup_buffers (MetaCaptureStream  *stream,
+               int                 width,
+               int                 height,
+               GError            **error)
+{
+  cairo_rectangle_int_t full = { 0, 0, width, height };
+  int i;
+
+  free_buffers (stream);
+
+  stream->width = width;
+  stream->height = height;
+  stream->stride = cairo_format_stride_for_width (CAIRO_FORMAT_ARGB32, width);
+  stream->slot_size = (gsize) stream->stride * height;
+
+  stream->fd = meta_create_anonymous_file ("mutter-capture",
+                                           stream->slot_size * N_SLOTS,
+                                           error);
+  if (stream->fd == -1)
+    return FALSE;
+
+  stream->data = mmap (NULL, stream->slot_size * N_SLOTS,
+                       PROT_READ | PROT_WRITE, MAP_SHARED, stream->fd, 0);
+  if (stream->data == MAP_FAILED)
+    {
+      stream->data = NULL;
+      g_set_error_literal (error, G_FILE_ERROR,
+                           g_file_error_from_errno (errno),
+                           strerror (errno));
+      return FALSE;
+    }
+
+  /* Nothing was copied into the slots yet */
+  for (i = 0; i < N_SLOTS; i++)
+    {
+      stream->slots[i].busy = FALSE;
+      stream->slots[i].stale = cairo_region_create_rectangle (&full);
+    }
+
+  g_clear_pointer (&stream->unsent_damage, cairo_region_destroy);
+  stream->unsent_damage = cairo_region_create_rectangle (&full);
+
+  return send_setup (stream, error);
+}
+
+static gboolean
+on_socket_readable (GSocket      *socket,
+                    GIOCondition  condition,
+                    gpointer      user_data)
+{
+  MetaCaptureStream *stream = user_data;
+  uint32_t released[16];
+  GError *error = NULL;
+  gssize received;
+  int i;
+
+  received = g_socket_receive (socket, (char *) released, sizeof (released),
+                               NULL, &error);
+  if (received < 0 &&
+      g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+    {
+      g_error_free (error);
+      return G_SOURCE_CONTINUE;
+    }
+
+  if (received <= 0)
+    {
+      g_clear_error (&error);
+      /* Destroys our source */
+      disconnect_consumer (stream);
+      return G_SOURCE_REMOVE;
+    }
+
+  /* Partial indices can't happen with well behaved consumers; any left
+   * over bytes are dropped. */
+  for (i = 0; i < received / (gssize) sizeof (uint32_t); i++)
+    {
+      if (released[i] < N_SLOTS)
+        stream->slots[released[i]].busy = FALSE;
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+on_incoming (GSocketService    *service,
+             GSocketConnection *connection,
+             GObject           *source_object,
+             gpointer           user_data)
+{
+  MetaCaptureStream *stream = user_data;
+  GSocket *socket;
+  float width, height;
+  GError *error = NULL;
+
+  /* One consumer at a time; the connection is closed when we return */
+  if (stream->connection)
+    {
+      meta_verbose ("Rejecting capture stream consumer, one is connected already\n");
+      return TRUE;
+    }
+
+  stream->connection = g_object_ref (connection);
+  socket = g_socket_connection_get_socket (connection);
+  g_socket_set_blocking (socket, FALSE);
+
+  clutter_actor_get_size (CLUTTER_ACTOR (stream->stage), &width, &height);
+  if (!setup_buffers (stream, width, height, &error))
+    {
+      meta_warning ("Failed to set up capture stream: %s\n", error->message);
+      g_error_free (error);
+      disconnect_consumer (stream);
+      return TRUE;
+    }
+
+  stream->socket_source = g_socket_create_source (socket, G_IO_IN | G_IO_HUP | G_IO_ERR, NULL);
+  g_source_set_callback (stream->socket_source,
+                         (GSourceFunc) on_socket_readable, stream, NULL);
+  g_source_attach (stream->socket_source, NULL);
+
+  stream->sequence = 0;
+  stream->frames_dropped = 0;
+
+  meta_verbose ("Capture stream consumer connected\n");
+
+  /* Make sure there is a frame to send */
+  clutter_actor_queue_redraw (CLUTTER_ACTOR (stream->stage));
+
+  return TRUE;
+}
+
+static void send_frame (MetaCaptureStream *stream,
+                        PendingFrame      *frame,
+                        gint64             presentation_time);
+
+/* Sends the frames at the head of the queue that are presented and
+ * copied, in order */
+static void
+flush_frames (MetaCaptureStream *stream)
+{
+  PendingFrame *frame;
+
+  while ((frame = g_queue_peek_head (&stream->pending_frames)) &&
+         frame->presented && frame->readbacks == NULL)
+    {
+      g_queue_pop_head (&stream->pending_frames);
+
+      if (stream->connection)
+        send_frame (stream, frame, frame->presentation_time);
+
+      /* The consumer may have been disconnected, which frees the queue */
+      pending_frame_free (frame);
+    }
+}
+
+static void
+finish_readback (PendingFrame *frame)
+{
+  MetaCaptureStream *stream = frame->stream;
+  guint8 *slot_data = stream->data + frame->slot * stream->slot_size;
+  guint i;
+
+  for (i = 0; i < frame->readbacks->len; i++)
+    {
+      Readback *readback = &g_array_index (frame->readbacks, Readback, i);
+      CoglBuffer *buffer = COGL_BUFFER (cogl_bitmap_get_buffer (readback->bitmap));
+      int src_stride = cogl_bitmap_get_rowstride (readback->bitmap);
+      const guint8 *src;
+      guint8 *dst;
+      int y;
+
+      src = cogl_buffer_map (buffer, COGL_BUFFER_ACCESS_READ, 0);
+      if (src == NULL)
+        {
+          meta_verbose ("Failed to map capture stream pixel buffer\n");
+          continue;
+        }
+
+      dst = slot_data + readback->rect.y * stream->stride + readback->rect.x * 4;
+      for (y = 0; y < readback->rect.height; y++)
+        memcpy (dst + y * stream->stride, src + y * src_stride,
+                readback->rect.width * 4);
+
+      cogl_buffer_unmap (buffer);
+    }
+
+  free_readbacks (frame);
+
+  flush_frames (stream);
+}
+
+static gboolean
+readback_idle_cb (gpointer user_data)
+{
+  PendingFrame *frame = user_data;
+
+  frame->readback_idle_id = 0;
+  finish_readback (frame);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+readback_fence_cb (CoglFence *fence,
+                   void      *user_data)
+{
+  PendingFrame *frame = user_data;
+
+  /* Sending may disconnect the consumer, which cancels fences; don't do
+   * that from within a fence callback */
+  frame->fence = NULL;
+  frame->readback_idle_id = g_idle_add (readback_idle_cb, frame);
+}
+
+static void
+queue_readback (PendingFrame    *frame,
+                CoglFramebuffer *framebuffer,
+                cairo_region_t  *region)
+{
+  CoglContext *ctx = cogl_framebuffer_get_context (framebuffer);
+  int i, n_rects;
+
+  n_rects = cairo_region_num_rectangles (region);
+  frame->readbacks = g_array_sized_new (FALSE, FALSE, sizeof (Readback), n_rects);
+  frame->framebuffer = cogl_object_ref (framebuffer);
+
+  for (i = 0; i < n_rects; i++)
+    {
+      Readback readback;
+
+      cairo_region_get_rectangle (region, i, &readback.rect);
+
+      /* A bitmap created this way is backed by a pixel buffer object, so
+       * the read only queues the transfer */
+      readback.bitmap = cogl_bitmap_new_with_size (ctx,
+                                                   readback.rect.width,
+                                                   readback.rect.height,
+                                                   CLUTTER_CAIRO_FORMAT_ARGB32);
+      cogl_framebuffer_read_pixels_into_bitmap (framebuffer,
+                                                readback.rect.x, readback.rect.y,
+                                                COGL_READ_PIXELS_COLOR_BUFFER,
+                                                readback.bitmap);
+      g_array_append_val (frame->readbacks, readback);
+    }
+
+  if (cogl_has_feature (ctx, COGL_FEATURE_ID_FENCE))
+    frame->fence = cogl_framebuffer_add_fence_callback (framebuffer,
+                                                        readback_fence_cb,
+                                                        frame);
+  else
+    frame->readback_idle_id = g_idle_add (readback_idle_cb, frame);
+}
+
+/**
+ * meta_capture_stream_after_paint:
+ * @stream: a #MetaCaptureStream
+ * @onscreen: the framebuffer the stage was painted to
+ *
+ * Starts reading back the parts of the output damaged by this frame, and
+ * by any frame the consumer missed, into a free slot. The slot is sent to
+ * the consumer once the frame is presented and the pixels have arrived.
+ * Must be called before the buffers are swapped.
+ */
+void
+meta_capture_stream_after_paint (MetaCaptureStream *stream,
+                                 CoglOnscreen      *onscreen)
+{
+  cairo_rectangle_int_t stage_rect = { 0, 0, 0, 0 };
+  cairo_rectangle_int_t clip;
+  PendingFrame *frame;
+  float width, height;
+  int i, slot = -1;
+
+  if (stream->connection == NULL || onscreen == NULL)
+    return;
+
+  clutter_actor_get_size (CLUTTER_ACTOR (stream->stage), &width, &height);
+  if ((int) width != stream->width || (int) height != stream->height)
+    {
+      GError *error = NULL;
+
+      if (!setup_buffers (stream, width, height, &error))
+        {
+          meta_warning ("Failed to resize capture stream: %s\n", error->message);
+          g_error_free (error);
+          disconnect_consumer (stream);
+          return;
+        }
+    }
+
+  stage_rect.width = stream->width;
+  stage_rect.height = stream->height;
+
+  clutter_stage_get_redraw_clip_bounds (stream->stage, &clip);
+  if (gdk_rectangle_intersect (&clip, &stage_rect, &clip))
+    {
+      for (i = 0; i < N_SLOTS; i++)
+        cairo_region_union_rectangle (stream->slots[i].stale, &clip);
+      cairo_region_union_rectangle (stream->unsent_damage, &clip);
+    }
+
+  if (cairo_region_is_empty (stream->unsent_damage))
+    return;
+
+  for (i = 0; i < N_SLOTS; i++)
+    {
+      if (!stream->slots[i].busy)
+        {
+          slot = i;
+          break;
+        }
+    }
+
+  /* The consumer holds all slots; it'll get the damage with the next
+   * frame it has room for. */
+  if (slot == -1)
+    {
+      stream->frames_dropped++;
+      return;
+    }
+
+  frame = g_slice_new0 (PendingFrame);
+  frame->stream = stream;
+  frame->frame_counter = cogl_onscreen_get_frame_counter (onscreen);
+  frame->slot = slot;
+  frame->damage = stream->unsent_damage;
+  stream->unsent_damage = cairo_region_create ();
+
+  queue_readback (frame, COGL_FRAMEBUFFER (onscreen), stream->slots[slot].stale);
+
+  cairo_region_destroy (stream->slots[slot].stale);
+  stream->slots[slot].stale = cairo_region_create ();
+  stream->slots[slot].busy = TRUE;
+
+  g_queue_push_tail (&stream->pending_frames, frame);
+}
+
+static void
+send_frame (MetaCaptureStream *stream,
+            PendingFrame      *frame,
+            gint64             presentation_time)
+{
+  GSocket *socket = g_socket_connection_get_socket (stream->connection);
+  MetaCaptureFrame header = { 0, };
+  GByteArray *message;
+  GError *error = NULL;
+  gssize sent;
+  int i, n_rects;
+
+  n_rects = cairo_region_num_rectangles (frame->damage);
+
+  header.type = META_CAPTURE_MESSAGE_FRAME;
+  header.slot = frame->slot;
+  header.sequence = stream->sequence;
+  header.presentation_time = presentation_time;
+  header.n_rects = n_rects;
+  header.frames_dropped = stream->frames_dropped;
+
+  message = g_byte_array_sized_new (sizeof (header) + n_rects * sizeof (MetaCaptureRect));
+  g_byte_array_append (message, (guint8 *) &header, sizeof (header));
+
+  for (i = 0; i < n_rects; i++)
+    {
+      cairo_rectangle_int_t rect;
+      MetaCaptureRect capture_rect;
+
+      cairo_region_get_rectangle (frame->damage, i, &rect);
+      capture_rect.x = rect.x;
+      capture_rect.y = rect.y;
+      capture_rect.width = rect.width;
+      capture_rect.height = rect.height;
+      g_byte_array_append (message, (guint8 *) &capture_rect, sizeof (capture_rect));
+    }
+
+  sent = g_socket_send (socket, (char *) message->data, message->len, NULL, &error);
+
+  if (sent < 0 && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+    {
+      /* The consumer isn't reading; hand the slot and damage back and
+       * try again with a later frame. */
+      g_error_free (error);
+      stream->slots[frame->slot].busy = FALSE;
+      cairo_region_union (stream->unsent_damage, frame->damage);
+      stream->frames_dropped++;
+    }
+  else if (sent != (gssize) message->len)
+    {
+      if (error)
+        {
+          meta_verbose ("Failed to send capture frame: %s\n", error->message);
+          g_error_free (error);
+        }
+      disconnect_consumer (stream);
+    }
+  else
+    {
+      stream->sequence++;
+      stream->frames_dropped = 0;
+    }
+
+  g_byte_array_unref (message);
+}
+
+/**
+ * meta_capture_stream_frame_complete:
+ * @stream: a #MetaCaptureStream
+ * @frame_info: the #CoglFrameInfo of the presented frame
+ * @presentation_time: the presentation time of the frame, in the
+ *   g_get_monotonic_time() time base, or 0 if unknown
+ *
+ * Sends the frames captured up to the one that was presented, as far as
+ * their pixels have arrived.
+ */
+void
+meta_capture_stream_frame_complete (MetaCaptureStream *stream,
+                                    CoglFrameInfo     *frame_info,
+                                    gint64             presentation_time)
+{
+  gint64 frame_counter = cogl_frame_info_get_frame_counter (frame_info);
+  GList *l;
+
+  if (presentation_time == 0)
+    presentation_time = g_get_monotonic_time ();
+
+  for (l = stream->pending_frames.head; l; l = l->next)
+    {
+      PendingFrame *frame = l->data;
+
+      if (frame->frame_counter > frame_counter)
+        break;
+
+      if (!frame->presented)
+        {
+          frame->presented = TRUE;
+          frame->presentation_time = presentation_time;
+        }
+    }
+
+  flush_frames (stream);
+}
+
+MetaCaptureStream *
+meta_capture_stream_new (ClutterStage  *stage,
+                         const char    *socket_path,
+                         GError       **error)
+{
+  MetaCaptureStream *stream;
+  GSocketAddress *address;
+
+  stream = g_slice_new0 (MetaCaptureStream);
+  stream->stage = stage;
+  stream->socket_path = g_strdup (socket_path);
+  stream->fd = -1;
+  stream->unsent_damage = cairo_region_create ();
+  g_queue_init (&stream->pending_frames);
+
+  /* Left over from a previous instance */
+  g_unlink (socket_path);
+
+  stream->service = g_socket_service_new ();
+  address = g_unix_socket_address_new (socket_path);
+
+  if (!g_socket_listener_add_address (G_SOCKET_LISTENER (stream->service),
+                                      address,
+                                      G_SOCKET_TYPE_STREAM,
+                                      G_SOCKET_PROTOCOL_DEFAULT,
+                                      NULL, NULL, error))
+    {
+      g_object_unref (address);
+      meta_capture_stream_free (stream);
+      return NULL;
+    }
+
+  g_object_unref (address);
+
+  g_signal_connect (stream->service, "incoming",
+                    G_CALLBACK (on_incoming), stream);
+  g_socket_service_start (stream->service);
+
+  return stream;
+}
+
+void
+meta_capture_stream_free (MetaCaptureStream *stream)
+{
+  if (stream->connection)
+    disconnect_consumer (stream);
+
+  free_buffers (stream);
+
+  g_socket_service_stop (stream->service);
+  g_socket_listener_close (G_SOCKET_LISTENER (stream->service));
+  g_object_unref (stream->service);
+
+  g_unlink (stream->socket_path);
+  g_free (stream->socket_path);
+
+  g_clear_pointer (&stream->unsent_damage, cairo_region_destroy);
+
+  g_slice_free (MetaCaptureStream, stream);
+}
@@ -0,0 +1,93 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaCaptureStream
+ *
+ * Streams the damaged parts of the composited output to a local consumer
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef META_CAPTURE_STREAM_H
+#define META_CAPTURE_STREAM_H
+
+#include <stdint.h>
+#include <clutter/clutter.h>
+
+/*
+ * Wire protocol
+ *
+ * A single consumer connects to the Unix socket named by the
+ * META_CAPTURE_SOCKET environment variable. All messages are in host
+ * byte order.
+ *
+ * The compositor first sends a MetaCaptureSetup message, with the file
+ * descriptor of a shared memory file attached as SCM_RIGHTS. The file
+ * holds n_slots images of slot_size bytes each; pixels are premultiplied
+ * ARGB in native endianness, like CAIRO_FORMAT_ARGB32. A new setup
+ * message, with a new file, is sent when the size of the output changes.
+ *
+ * For each frame presented, the compositor sends a MetaCaptureFrame
+ * message followed by n_rects MetaCaptureRect structures: the parts of
+ * the output that changed since the previous frame message. The slot is
+ * then owned by the consumer, which is expected to hand it back by
+ * sending the slot index as an uint32_t once done reading it. While the
+ * consumer holds all slots, frames are not captured and their damage is
+ * reported with the next frame instead.
+ */
+
+#define META_CAPTURE_MESSAGE_SETUP 1
+#define META_CAPTURE_MESSAGE_FRAME 2
+
+typedef struct
+{
+  uint32_t type;
+  uint32_t n_slots;
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;
+  uint32_t padding;
+  uint64_t slot_size;
+} MetaCaptureSetup;
+
+typedef struct
+{
+  uint32_t type;
+  uint32_t slot;
+  uint64_t sequence;
+  /* In microseconds, in the CLOCK_MONOTONIC time base */
+  int64_t presentation_time;
+  uint32_t n_rects;
+  uint32_t frames_dropped;
+} MetaCaptureFrame;
+
+typedef struct
+{
+  int32_t x, y;
+  int32_t width, height;
+} MetaCaptureRect;
+
+typedef struct _MetaCaptureStream MetaCaptureStream;
+
+MetaCaptureStream *meta_capture_stream_new  (ClutterStage      *stage,
+                                             const char        *socket_path,
+                                             GError           **error);
+void               meta_capture_stream_free (MetaCaptureStream *stream);
+
+void meta_capture_stream_after_paint    (MetaCaptureStream *stream,
+                                         CoglOnscreen      *onscreen);
+void meta_capture_stream_frame_complete (MetaCaptureStream *stream,
+                                         CoglFrameInfo     *frame_info,
+                                         gint64             presentation_time);
+
+#endif /* META_CAPTURE_STREAM_H */
@@ -0,0 +1,200 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaFrameTimingsManager
+ *
+ * Exports the frame statistics of all windows on the session bus
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The statistics themselves are kept by each MetaWindowActor, see
+ * meta_window_actor_get_frame_stats(); this only makes them available as
+ * org.gnome.Mutter.FrameTimings, so that a janking application can be
+ * identified on a running session. The timings of the compositor's own
+ * recent frames come from the MetaRepaintScheduler.
+ */
+
+#include <config.h>
+
+#include "meta-frame-timings-manager.h"
+
+#include <meta/main.h>
+#include <meta/util.h>
+#include <meta/window.h>
+
+#include "compositor-private.h"
+#include "meta-dbus-frame-timings.h"
+
+struct _MetaFrameTimingsManager
+{
+  MetaCompositor *compositor;
+
+  guint dbus_name_id;
+  MetaDBusFrameTimings *skeleton;
+};
+
+static GVariant *
+histogram_to_variant (const guint *histogram)
+{
+  return g_variant_new_fixed_array (G_VARIANT_TYPE_UINT32,
+                                    histogram,
+                                    META_FRAME_STATS_N_BUCKETS,
+                                    sizeof (guint));
+}
+
+static gboolean
+handle_get_timings (MetaDBusFrameTimings    *skeleton,
+                    GDBusMethodInvocation   *invocation,
+                    MetaFrameTimingsManager *manager)
+{
+  GVariantBuilder builder;
+  GList *l;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(suuauau)"));
+
+  for (l = manager->compositor->windows; l; l = l->next)
+    {
+      MetaWindowActor *window_actor = l->data;
+      MetaWindow *window = meta_window_actor_get_meta_window (window_actor);
+      MetaFrameStats stats;
+
+      meta_window_actor_get_frame_stats (window_actor, &stats);
+
+      g_variant_builder_add (&builder, "(suu@au@au)",
+                             meta_window_get_description (window),
+                             stats.n_frames,
+                             stats.n_missed_frames,
+                             histogram_to_variant (stats.interval_histogram),
+                             histogram_to_variant (stats.latency_histogram));
+    }
+
+  meta_dbus_frame_timings_complete_get_timings (skeleton, invocation,
+                                                g_variant_builder_end (&builder));
+  return TRUE;
+}
+
+static gboolean
+handle_get_repaint_timings (MetaDBusFrameTimings    *skeleton,
+                            GDBusMethodInvocation   *invocation,
+                            MetaFrameTimingsManager *manager)
+{
+  MetaRepaintScheduler *scheduler = manager->compositor->repaint_scheduler;
+  GVariantBuilder builder;
+  guint i, n_frames;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(xxxib)"));
+
+  n_frames = scheduler ? meta_repaint_scheduler_get_n_frames (scheduler) : 0;
+
+  for (i = 0; i < n_frames; i++)
+    {
+      const MetaRepaintFrame *frame = meta_repaint_scheduler_get_frame (scheduler, i);
+
+      g_variant_builder_add (&builder, "(xxxib)",
+                             frame->presentation_time,
+                             frame->paint_time,
+                             frame->slack,
+                             frame->sync_delay,
+                             frame->missed);
+    }
+
+  meta_dbus_frame_timings_complete_get_repaint_timings (skeleton, invocation,
+                                                        g_variant_builder_end (&builder));
+  return TRUE;
+}
+
+static void
+on_bus_acquired (GDBusConnection *connection,
+                 const char      *name,
+                 gpointer         user_data)
+{
+  MetaFrameTimingsManager *manager = user_data;
+  GError *error = NULL;
+
+  if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (manager->skeleton),
+                                         connection,
+                                         "/org/gnome/Mutter/FrameTimings",
+                                         &error))
+    {
+      meta_warning ("Failed to export frame timings object: %s\n", error->message);
+      g_error_free (error);
+    }
+}
+
+static void
+on_name_acquired (GDBusConnection *connection,
+                  const char      *name,
+                  gpointer         user_data)
+{
+  meta_verbose ("Acquired name %s\n", name);
+}
+
+static void
+on_name_lost (GDBusConnection *connection,
+              const char      *name,
+              gpointer         user_data)
+{
+  meta_verbose ("Lost or failed to acquire name %s\n", name);
+}
+
+MetaFrameTimingsManager *
+meta_frame_timings_manager_new (MetaCompositor *compositor)
+{
+  MetaFrameTimingsManager *manager;
+  guint64 limits[META_FRAME_STATS_N_BUCKETS];
+  int i;
+
+  manager = g_slice_new0 (MetaFrameTimingsManager);
+  manager->compositor = compositor;
+
+  for (i = 0; i < META_FRAME_STATS_N_BUCKETS; i++)
+    limits[i] = meta_frame_stats_get_bucket_limit (i);
+
+  manager->skeleton = meta_dbus_frame_timings_skeleton_new ();
+  g_signal_connect (manager->skeleton, "handle-get-timings",
+                    G_CALLBACK (handle_get_timings), manager);
+  g_signal_connect (manager->skeleton, "handle-get-repaint-timings",
+                    G_CALLBACK (handle_get_repaint_timings), manager);
+  meta_dbus_frame_timings_set_bucket_limits (manager->skeleton,
+                                             g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+                                                                        limits,
+                                                                        META_FRAME_STATS_N_BUCKETS,
+                                                                        sizeof (guint64)));
+
+  manager->dbus_name_id =
+    g_bus_own_name (G_BUS_TYPE_SESSION,
+                    "org.gnome.Mutter.FrameTimings",
+                    G_BUS_NAME_OWNER_FLAGS_ALLOW_REPLACEMENT |
+                    (meta_get_replace_current_wm () ?
+                     G_BUS_NAME_OWNER_FLAGS_REPLACE : 0),
+                    on_bus_acquired,
+                    on_name_acquired,
+                    on_name_lost,
+                    manager, NULL);
+
+  return manager;
+}
+
+void
+meta_frame_timings_manager_free (MetaFrameTimingsManager *manager)
+{
+  if (manager->dbus_name_id)
+    g_bus_unown_name (manager->dbus_name_id);
+
+  g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (manager->skeleton));
+  g_object_unref (manager->skeleton);
+
+  g_slice_free (MetaFrameTimingsManager, manager);
+}
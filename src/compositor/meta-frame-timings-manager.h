@@ -0,0 +1,31 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaFrameTimingsManager
+ *
+ * Exports the frame statistics of all windows on the session bus
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef META_FRAME_TIMINGS_MANAGER_H
+#define META_FRAME_TIMINGS_MANAGER_H
+
+#include <meta/types.h>
+
+typedef struct _MetaFrameTimingsManager MetaFrameTimingsManager;
+
+MetaFrameTimingsManager *meta_frame_timings_manager_new  (MetaCompositor          *compositor);
+void                     meta_frame_timings_manager_free (MetaFrameTimingsManager *manager);
+
+#endif /* META_FRAME_TIMINGS_MANAGER_H */
@@ -0,0 +1,188 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaFrameTimings
+ *
+ * Rolling statistics of the frames presented for a window
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * For every frame that presents new window contents we record how long
+ * it has been since the previous such frame (the frame interval), and
+ * how long it took from the contents being damaged until the frame was
+ * presented (the latency). Only the histogram bucket of each value is
+ * kept, for the last HISTORY_LENGTH frames, so the histograms can be
+ * updated as frames fall out of the history.
+ */
+
+#include <config.h>
+
+#include "meta-frame-timings.h"
+
+/* Number of frames the statistics are computed over */
+#define HISTORY_LENGTH 600
+
+/* Updates further apart than this, in microseconds, mean the window was
+ * idle in between rather than slow, and don't count as an interval */
+#define MAX_FRAME_INTERVAL G_USEC_PER_SEC
+
+#define NO_BUCKET 0xff
+
+typedef struct
+{
+  guint8 interval_bucket;
+  guint8 latency_bucket;
+  guint8 missed;
+} FrameSample;
+
+struct _MetaFrameTimings
+{
+  FrameSample samples[HISTORY_LENGTH];
+  int next_sample;
+  int n_samples;
+
+  gint64 last_presentation_time;
+
+  MetaFrameStats stats;
+};
+
+/* Upper bounds, in microseconds; roughly 240, 120, 90, 60, 40, 30, 20,
+ * 15 and 10 frames per second */
+static const gint64 bucket_limits[META_FRAME_STATS_N_BUCKETS] = {
+  4167, 8334, 11112, 16667, 25000, 33334, 50000, 66667, 100000, G_MAXINT64
+};
+
+/**
+ * meta_frame_stats_get_bucket_limit:
+ * @bucket: index of a histogram bucket
+ *
+ * Returns: the upper bound, exclusive, in microseconds of the values
+ *   counted in @bucket of the histograms of a #MetaFrameStats. The last
+ *   bucket is unbounded and returns %G_MAXINT64.
+ */
+gint64
+meta_frame_stats_get_bucket_limit (int bucket)
+{
+  g_return_val_if_fail (bucket >= 0 && bucket < META_FRAME_STATS_N_BUCKETS, 0);
+
+  return bucket_limits[bucket];
+}
+
+static guint8
+get_bucket (gint64 value)
+{
+  guint8 i;
+
+  for (i = 0; i < META_FRAME_STATS_N_BUCKETS - 1; i++)
+    if (value < bucket_limits[i])
+      break;
+
+  return i;
+}
+
+static void
+remove_sample (MetaFrameTimings *timings,
+               FrameSample      *sample)
+{
+  MetaFrameStats *stats = &timings->stats;
+
+  stats->n_frames--;
+  stats->latency_histogram[sample->latency_bucket]--;
+  if (sample->interval_bucket != NO_BUCKET)
+    stats->interval_histogram[sample->interval_bucket]--;
+  if (sample->missed)
+    stats->n_missed_frames--;
+}
+
+static void
+add_sample (MetaFrameTimings *timings,
+            FrameSample      *sample)
+{
+  MetaFrameStats *stats = &timings->stats;
+
+  stats->n_frames++;
+  stats->latency_histogram[sample->latency_bucket]++;
+  if (sample->interval_bucket != NO_BUCKET)
+    stats->interval_histogram[sample->interval_bucket]++;
+  if (sample->missed)
+    stats->n_missed_frames++;
+}
+
+/**
+ * meta_frame_timings_add_frame:
+ * @timings: a #MetaFrameTimings
+ * @update_time: monotonic time the window contents were damaged at
+ * @presentation_time: monotonic time the frame was presented at
+ * @refresh_interval: refresh interval of the output in microseconds, or 0
+ *   if not known
+ *
+ * Records a frame presenting new contents of the window. A frame is
+ * counted as missed when its latency exceeds two refresh intervals, that
+ * is, when the update didn't make it into the frame started after it nor
+ * into the one after that.
+ */
+void
+meta_frame_timings_add_frame (MetaFrameTimings *timings,
+                              gint64            update_time,
+                              gint64            presentation_time,
+                              int               refresh_interval)
+{
+  FrameSample *sample;
+  gint64 latency;
+  gint64 interval;
+
+  sample = &timings->samples[timings->next_sample];
+
+  if (timings->n_samples == HISTORY_LENGTH)
+    remove_sample (timings, sample);
+  else
+    timings->n_samples++;
+
+  timings->next_sample = (timings->next_sample + 1) % HISTORY_LENGTH;
+
+  latency = MAX (presentation_time - update_time, 0);
+  interval = presentation_time - timings->last_presentation_time;
+
+  sample->latency_bucket = get_bucket (latency);
+  if (timings->last_presentation_time != 0 &&
+      interval > 0 && interval < MAX_FRAME_INTERVAL)
+    sample->interval_bucket = get_bucket (interval);
+  else
+    sample->interval_bucket = NO_BUCKET;
+  sample->missed = refresh_interval > 0 && latency > 2 * refresh_interval;
+
+  add_sample (timings, sample);
+
+  timings->last_presentation_time = presentation_time;
+}
+
+void
+meta_frame_timings_get_stats (MetaFrameTimings *timings,
+                              MetaFrameStats   *stats)
+{
+  *stats = timings->stats;
+}
+
+MetaFrameTimings *
+meta_frame_timings_new (void)
+{
+  return g_slice_new0 (MetaFrameTimings);
+}
+
+void
+meta_frame_timings_free (MetaFrameTimings *timings)
+{
+  g_slice_free (MetaFrameTimings, timings);
+}
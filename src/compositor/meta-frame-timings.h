@@ -0,0 +1,40 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaFrameTimings
+ *
+ * Rolling statistics of the frames presented for a window
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef META_FRAME_TIMINGS_H
+#define META_FRAME_TIMINGS_H
+
+#include <glib.h>
+#include <meta/meta-window-actor.h>
+
+typedef struct _MetaFrameTimings MetaFrameTimings;
+
+MetaFrameTimings *meta_frame_timings_new  (void);
+void              meta_frame_timings_free (MetaFrameTimings *timings);
+
+void meta_frame_timings_add_frame (MetaFrameTimings *timings,
+                                   gint64            update_time,
+                                   gint64            presentation_time,
+                                   int               refresh_interval);
+
+void meta_frame_timings_get_stats (MetaFrameTimings *timings,
+                                   MetaFrameStats   *stats);
+
+#endif /* META_FRAME_TIMINGS_H */
@@ -0,0 +1,393 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaRepaintScheduler
+ *
+ * Starts painting the stage as late before the next vblank as recent
+ * paint durations allow
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The master clock starts a paint the stage's sync delay after the last
+ * vblank. With a fixed delay, a quick paint is done long before the next
+ * vblank, and the frame shows client content and input older than it
+ * could. This sets the delay so that painting, from the pre-paint work
+ * to the post-paint work, ends a safety margin before the next vblank,
+ * going by the longest of the recent paints.
+ *
+ * A frame counts as missed when it is presented later than the vblank
+ * it was aimed at. The margin then grows, and the fixed delay is used
+ * again for a while; the margin shrinks back as frames make it.
+ */
+
+#include <config.h>
+
+#include "meta-repaint-scheduler.h"
+
+#include <meta/util.h>
+
+/* Paint durations the delay is based on */
+#define PAINT_HISTORY_LENGTH 32
+/* Presented frames kept for tracing */
+#define FRAME_HISTORY_LENGTH 128
+/* Frames painted but not yet presented; normally just one */
+#define MAX_PENDING_FRAMES 4
+
+/* In microseconds */
+#define BASE_SAFETY_MARGIN 2000
+#define SAFETY_MARGIN_STEP 1000
+#define SAFETY_MARGIN_DECAY 50
+#define DEFAULT_REFRESH_INTERVAL 16667
+
+/* How long to use the fixed delay after a missed frame */
+#define FALLBACK_FRAMES 120
+
+typedef struct
+{
+  gint64 frame_counter;
+  gint64 paint_start_time;
+  gint64 paint_end_time;
+  gint64 target_presentation_time;
+  int sync_delay;
+  /* Started at the sync delay rather than, say, when damage arrived
+   * late in an idle interval */
+  gboolean on_schedule;
+} PendingFrame;
+
+struct _MetaRepaintScheduler
+{
+  ClutterStage *stage;
+
+  int fallback_sync_delay;
+  int sync_delay;
+
+  gint64 refresh_interval;
+  gint64 last_presentation_time;
+  gint64 safety_margin;
+  int fallback_frames_left;
+
+  gint64 paint_times[PAINT_HISTORY_LENGTH];
+  guint n_paint_times;
+  guint next_paint_time;
+
+  PendingFrame *painting;
+  GQueue pending_frames;
+
+  MetaRepaintFrame frames[FRAME_HISTORY_LENGTH];
+  guint n_frames;
+  guint next_frame;
+};
+
+static void
+pending_frame_free (PendingFrame *frame)
+{
+  g_slice_free (PendingFrame, frame);
+}
+
+static gint64
+get_max_paint_time (MetaRepaintScheduler *scheduler)
+{
+  gint64 max_paint_time = 0;
+  guint i;
+
+  for (i = 0; i < scheduler->n_paint_times; i++)
+    max_paint_time = MAX (max_paint_time, scheduler->paint_times[i]);
+
+  return max_paint_time;
+}
+
+static void
+update_sync_delay (MetaRepaintScheduler *scheduler)
+{
+  int sync_delay;
+
+  if (scheduler->last_presentation_time == 0 ||
+      scheduler->n_paint_times == 0)
+    {
+      /* Nothing to go by yet */
+      sync_delay = scheduler->fallback_sync_delay;
+    }
+  else
+    {
+      gint64 budget = (scheduler->refresh_interval -
+                       get_max_paint_time (scheduler) -
+                       scheduler->safety_margin);
+
+      sync_delay = budget > 0 ? budget / 1000 : 0;
+
+      /* Falling back never means starting later than the paints need */
+      if (scheduler->fallback_frames_left > 0)
+        sync_delay = MIN (sync_delay, scheduler->fallback_sync_delay);
+    }
+
+  if (sync_delay == scheduler->sync_delay)
+    return;
+
+  scheduler->sync_delay = sync_delay;
+  clutter_stage_set_sync_delay (scheduler->stage, sync_delay);
+}
+
+/* The first vblank after @time, going by the last presentation */
+static gint64
+get_next_vblank_time (MetaRepaintScheduler *scheduler,
+                      gint64                time)
+{
+  gint64 last = scheduler->last_presentation_time;
+
+  if (last == 0 || time < last)
+    return 0;
+
+  return last + ((time - last) / scheduler->refresh_interval + 1) * scheduler->refresh_interval;
+}
+
+/**
+ * meta_repaint_scheduler_before_paint:
+ * @scheduler: a #MetaRepaintScheduler
+ * @onscreen: the #CoglOnscreen of the stage
+ *
+ * Called when the pre-paint work for a frame starts.
+ */
+void
+meta_repaint_scheduler_before_paint (MetaRepaintScheduler *scheduler,
+                                     CoglOnscreen         *onscreen)
+{
+  PendingFrame *frame;
+  gint64 now = g_get_monotonic_time ();
+
+  g_clear_pointer (&scheduler->painting, pending_frame_free);
+
+  frame = g_slice_new0 (PendingFrame);
+  frame->frame_counter = cogl_onscreen_get_frame_counter (onscreen);
+  frame->paint_start_time = now;
+  frame->target_presentation_time = get_next_vblank_time (scheduler, now);
+  frame->sync_delay = scheduler->sync_delay;
+
+  if (frame->target_presentation_time != 0)
+    {
+      gint64 since_vblank = (now - frame->target_presentation_time +
+                             scheduler->refresh_interval);
+
+      frame->on_schedule = since_vblank <= (frame->sync_delay + 1) * 1000;
+    }
+
+  scheduler->painting = frame;
+}
+
+/**
+ * meta_repaint_scheduler_after_paint:
+ * @scheduler: a #MetaRepaintScheduler
+ *
+ * Called when the post-paint work for a frame is done.
+ */
+void
+meta_repaint_scheduler_after_paint (MetaRepaintScheduler *scheduler)
+{
+  PendingFrame *frame = scheduler->painting;
+  gint64 paint_time;
+
+  if (frame == NULL)
+    return;
+
+  scheduler->painting = NULL;
+
+  frame->paint_end_time = g_get_monotonic_time ();
+  paint_time = frame->paint_end_time - frame->paint_start_time;
+
+  scheduler->paint_times[scheduler->next_paint_time] = paint_time;
+  scheduler->next_paint_time = (scheduler->next_paint_time + 1) % PAINT_HISTORY_LENGTH;
+  scheduler->n_paint_times = MIN (scheduler->n_paint_times + 1, PAINT_HISTORY_LENGTH);
+
+  g_queue_push_tail (&scheduler->pending_frames, frame);
+
+  /* Frames without completion events would otherwise pile up */
+  while (g_queue_get_length (&scheduler->pending_frames) > MAX_PENDING_FRAMES)
+    pending_frame_free (g_queue_pop_head (&scheduler->pending_frames));
+}
+
+static void
+record_frame (MetaRepaintScheduler *scheduler,
+              PendingFrame         *pending,
+              gint64                presentation_time,
+              gboolean              missed)
+{
+  MetaRepaintFrame *frame = &scheduler->frames[scheduler->next_frame];
+
+  frame->presentation_time = presentation_time;
+  frame->paint_time = pending->paint_end_time - pending->paint_start_time;
+  frame->slack = (pending->target_presentation_time != 0 ?
+                  pending->target_presentation_time - pending->paint_end_time : 0);
+  frame->sync_delay = pending->sync_delay;
+  frame->missed = missed;
+
+  scheduler->next_frame = (scheduler->next_frame + 1) % FRAME_HISTORY_LENGTH;
+  scheduler->n_frames = MIN (scheduler->n_frames + 1, FRAME_HISTORY_LENGTH);
+}
+
+/**
+ * meta_repaint_scheduler_frame_complete:
+ * @scheduler: a #MetaRepaintScheduler
+ * @frame_info: the #CoglFrameInfo of the presented frame
+ * @presentation_time: the presentation time of the frame, in the
+ *   g_get_monotonic_time() time base, or 0 if unknown
+ *
+ * Checks whether the frame made the vblank it was aimed at, and picks
+ * the delay for the next one.
+ */
+void
+meta_repaint_scheduler_frame_complete (MetaRepaintScheduler *scheduler,
+                                       CoglFrameInfo        *frame_info,
+                                       gint64                presentation_time)
+{
+  gint64 frame_counter = cogl_frame_info_get_frame_counter (frame_info);
+  float refresh_rate = cogl_frame_info_get_refresh_rate (frame_info);
+  PendingFrame *frame = NULL;
+  PendingFrame *pending;
+  gboolean missed;
+
+  /* Keep the last frame up to the presented one */
+  while ((pending = g_queue_peek_head (&scheduler->pending_frames)) &&
+         pending->frame_counter <= frame_counter)
+    {
+      g_queue_pop_head (&scheduler->pending_frames);
+
+      if (frame)
+        pending_frame_free (frame);
+      frame = pending;
+    }
+
+  /* Without timestamps the fixed delay is kept */
+  if (presentation_time == 0)
+    goto out;
+
+  /* 0.0 is a flag for not known, but sanity-check against other odd numbers */
+  if (refresh_rate >= 1.0)
+    scheduler->refresh_interval = (gint64) (0.5 + G_USEC_PER_SEC / refresh_rate);
+
+  scheduler->last_presentation_time = presentation_time;
+
+  if (frame == NULL || frame->frame_counter != frame_counter)
+    goto out;
+
+  /* Up to half an interval late is jitter in the timestamps */
+  missed = (frame->target_presentation_time != 0 &&
+            presentation_time > (frame->target_presentation_time +
+                                 scheduler->refresh_interval / 2));
+
+  record_frame (scheduler, frame, presentation_time, missed);
+
+  /* A frame started off schedule had less time than planned for */
+  if (missed && frame->on_schedule)
+    {
+      meta_topic (META_DEBUG_COMPOSITOR,
+                  "Frame missed its vblank (paint took %" G_GINT64_FORMAT " us, "
+                  "started %d ms after vblank), falling back\n",
+                  frame->paint_end_time - frame->paint_start_time,
+                  frame->sync_delay);
+
+      scheduler->safety_margin = MIN (scheduler->safety_margin + SAFETY_MARGIN_STEP,
+                                      scheduler->refresh_interval / 2);
+      scheduler->fallback_frames_left = FALLBACK_FRAMES;
+    }
+  else if (!missed)
+    {
+      scheduler->safety_margin = MAX (scheduler->safety_margin - SAFETY_MARGIN_DECAY,
+                                      BASE_SAFETY_MARGIN);
+      if (scheduler->fallback_frames_left > 0)
+        scheduler->fallback_frames_left--;
+    }
+
+  update_sync_delay (scheduler);
+
+ out:
+  if (frame)
+    pending_frame_free (frame);
+}
+
+/**
+ * meta_repaint_scheduler_get_sync_delay:
+ * @scheduler: a #MetaRepaintScheduler
+ *
+ * Return value: the time after a vblank the next paint starts at, in
+ *   milliseconds
+ */
+int
+meta_repaint_scheduler_get_sync_delay (MetaRepaintScheduler *scheduler)
+{
+  return scheduler->sync_delay;
+}
+
+/**
+ * meta_repaint_scheduler_get_n_frames:
+ * @scheduler: a #MetaRepaintScheduler
+ *
+ * Return value: the number of recently presented frames kept
+ */
+guint
+meta_repaint_scheduler_get_n_frames (MetaRepaintScheduler *scheduler)
+{
+  return scheduler->n_frames;
+}
+
+/**
+ * meta_repaint_scheduler_get_frame:
+ * @scheduler: a #MetaRepaintScheduler
+ * @index: the index of the frame, oldest first
+ *
+ * Return value: the timings of a recently presented frame
+ */
+const MetaRepaintFrame *
+meta_repaint_scheduler_get_frame (MetaRepaintScheduler *scheduler,
+                                  guint                 index)
+{
+  guint first;
+
+  g_return_val_if_fail (index < scheduler->n_frames, NULL);
+
+  first = (scheduler->next_frame + FRAME_HISTORY_LENGTH - scheduler->n_frames) % FRAME_HISTORY_LENGTH;
+
+  return &scheduler->frames[(first + index) % FRAME_HISTORY_LENGTH];
+}
+
+MetaRepaintScheduler *
+meta_repaint_scheduler_new (ClutterStage *stage,
+                            int           fallback_sync_delay)
+{
+  MetaRepaintScheduler *scheduler;
+
+  scheduler = g_slice_new0 (MetaRepaintScheduler);
+  scheduler->stage = stage;
+  scheduler->fallback_sync_delay = fallback_sync_delay;
+  scheduler->sync_delay = fallback_sync_delay;
+  scheduler->refresh_interval = DEFAULT_REFRESH_INTERVAL;
+  scheduler->safety_margin = BASE_SAFETY_MARGIN;
+  g_queue_init (&scheduler->pending_frames);
+
+  clutter_stage_set_sync_delay (stage, fallback_sync_delay);
+
+  return scheduler;
+}
+
+void
+meta_repaint_scheduler_free (MetaRepaintScheduler *scheduler)
+{
+  g_clear_pointer (&scheduler->painting, pending_frame_free);
+
+  g_queue_foreach (&scheduler->pending_frames, (GFunc) pending_frame_free, NULL);
+  g_queue_clear (&scheduler->pending_frames);
+
+  clutter_stage_set_sync_delay (scheduler->stage, scheduler->fallback_sync_delay);
+
+  g_slice_free (MetaRepaintScheduler, scheduler);
+}
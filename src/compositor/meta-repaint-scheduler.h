@@ -0,0 +1,63 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaRepaintScheduler
+ *
+ * Starts painting the stage as late before the next vblank as recent
+ * paint durations allow
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef META_REPAINT_SCHEDULER_H
+#define META_REPAINT_SCHEDULER_H
+
+#include <clutter/clutter.h>
+
+/* A presented frame, as kept for tracing */
+typedef struct
+{
+  /* In the g_get_monotonic_time() time base */
+  gint64 presentation_time;
+  /* From the start of the pre-paint work to the end of the post-paint
+   * work, in microseconds */
+  gint64 paint_time;
+  /* From the end of the post-paint work to the vblank the frame was
+   * aimed at, in microseconds; negative when painting overran it */
+  gint64 slack;
+  /* The delay after the previous vblank painting was started with, in
+   * milliseconds */
+  int sync_delay;
+  gboolean missed;
+} MetaRepaintFrame;
+
+typedef struct _MetaRepaintScheduler MetaRepaintScheduler;
+
+MetaRepaintScheduler *meta_repaint_scheduler_new  (ClutterStage         *stage,
+                                                   int                   fallback_sync_delay);
+void                  meta_repaint_scheduler_free (MetaRepaintScheduler *scheduler);
+
+void meta_repaint_scheduler_before_paint   (MetaRepaintScheduler *scheduler,
+                                            CoglOnscreen         *onscreen);
+void meta_repaint_scheduler_after_paint    (MetaRepaintScheduler *scheduler);
+void meta_repaint_scheduler_frame_complete (MetaRepaintScheduler *scheduler,
+                                            CoglFrameInfo        *frame_info,
+                                            gint64                presentation_time);
+
+int meta_repaint_scheduler_get_sync_delay (MetaRepaintScheduler *scheduler);
+
+guint                   meta_repaint_scheduler_get_n_frames (MetaRepaintScheduler *scheduler);
+const MetaRepaintFrame *meta_repaint_scheduler_get_frame    (MetaRepaintScheduler *scheduler,
+                                                             guint                 index);
+
+#endif /* META_REPAINT_SCHEDULER_H */
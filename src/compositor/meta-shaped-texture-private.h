@@ -37,4 +37,17 @@ void meta_shaped_texture_set_fallback_size (MetaShapedTexture *stex,
                                             guint              fallback_height);
 gboolean meta_shaped_texture_is_obscured (MetaShapedTexture *self);
 
+void meta_shaped_texture_set_fallback_texture (MetaShapedTexture *stex,
+                                               CoglTexture       *fallback_texture);
+gboolean meta_shaped_texture_draw (MetaShapedTexture *stex,
+                                   CoglFramebuffer   *framebuffer,
+                                   float              x_1,
+                                   float              y_1,
+                                   float              x_2,
+                                   float              y_2);
+CoglTexture *meta_shaped_texture_create_thumbnail (MetaShapedTexture *stex,
+                                                   int                width,
+                                                   int                height);
+gsize meta_shaped_texture_get_memory_usage (MetaShapedTexture *stex);
+
 #endif
@@ -32,8 +32,11 @@
 
 #include <cogl/cogl.h>
 #include <gdk/gdk.h> /* for gdk_rectangle_intersect() */
+#include <gio/gio.h>
+#include <string.h>
 
 #include "clutter-utils.h"
+#include "cogl-utils.h"
 #include "meta-texture-tower.h"
 
 #include "meta-cullable.h"
@@ -78,6 +81,11 @@ struct _MetaShapedTexturePrivate
   CoglTexture *texture;
   CoglTexture *mask_texture;
 
+  /* A scaled down copy of the contents, painted stretched over the
+   * fallback size while there is no texture; see
+   * meta_shaped_texture_set_fallback_texture() */
+  CoglTexture *fallback_texture;
+
   /* The region containing only fully opaque pixels */
   cairo_region_t *opaque_region;
 
@@ -178,6 +186,7 @@ meta_shaped_texture_dispose (GObject *object)
   priv->paint_tower = NULL;
 
   g_clear_pointer (&priv->texture, cogl_object_unref);
+  g_clear_pointer (&priv->fallback_texture, cogl_object_unref);
   g_clear_pointer (&priv->opaque_region, cairo_region_destroy);
 
   meta_shaped_texture_set_mask_texture (self, NULL);
@@ -288,6 +297,9 @@ set_cogl_texture (MetaShapedTexture *stex,
 
   if (cogl_tex != NULL)
     {
+      /* The real contents are back, the scaled down copy is stale */
+      g_clear_pointer (&priv->fallback_texture, cogl_object_unref);
+
       cogl_object_ref (cogl_tex);
       width = cogl_texture_get_width (COGL_TEXTURE (cogl_tex));
       height = cogl_texture_get_height (COGL_TEXTURE (cogl_tex));
@@ -316,6 +328,38 @@ set_cogl_texture (MetaShapedTexture *stex,
     meta_texture_tower_set_base_texture (priv->paint_tower, cogl_tex);
 }
 
+static void
+paint_fallback_texture (MetaShapedTexture *stex)
+{
+  MetaShapedTexturePrivate *priv = stex->priv;
+  CoglContext *ctx;
+  CoglFramebuffer *fb;
+  CoglPipeline *pipeline;
+  ClutterActorBox alloc;
+  CoglColor color;
+  guchar opacity;
+
+  ctx = clutter_backend_get_cogl_context (clutter_get_default_backend ());
+  fb = cogl_get_draw_framebuffer ();
+
+  opacity = clutter_actor_get_paint_opacity (CLUTTER_ACTOR (stex));
+  clutter_actor_get_allocation_box (CLUTTER_ACTOR (stex), &alloc);
+
+  pipeline = get_unmasked_pipeline (ctx);
+  cogl_pipeline_set_layer_texture (pipeline, 0, priv->fallback_texture);
+  cogl_pipeline_set_layer_filters (pipeline, 0,
+                                   COGL_PIPELINE_FILTER_LINEAR,
+                                   COGL_PIPELINE_FILTER_LINEAR);
+
+  cogl_color_init_from_4ub (&color, opacity, opacity, opacity, opacity);
+  cogl_pipeline_set_color (pipeline, &color);
+
+  cogl_framebuffer_draw_rectangle (fb, pipeline,
+                                   0, 0,
+                                   alloc.x2 - alloc.x1,
+                                   alloc.y2 - alloc.y1);
+}
+
 static void
 meta_shaped_texture_paint (ClutterActor *actor)
 {
@@ -335,6 +379,15 @@ meta_shaped_texture_paint (ClutterActor *actor)
   if (!CLUTTER_ACTOR_IS_REALIZED (CLUTTER_ACTOR (stex)))
     clutter_actor_realize (CLUTTER_ACTOR (stex));
 
+  /* The texture was dropped to save memory; until it is imported
+   * again, make do with the scaled down copy, if any. */
+  if (priv->texture == NULL)
+    {
+      if (priv->fallback_texture != NULL)
+        paint_fallback_texture (stex);
+      return;
+    }
+
   /* The GL EXT_texture_from_pixmap extension does allow for it to be
    * used together with SGIS_generate_mipmap, however this is very
    * rarely supported. Also, even when it is supported there
@@ -887,6 +940,244 @@ meta_shaped_texture_get_image (MetaShapedTexture     *stex,
   return surface;
 }
 
+typedef struct
+{
+  CoglOffscreen *offscreen;
+  CoglBitmap *bitmap;
+  cairo_format_t format;
+  int width, height;
+} CaptureData;
+
+static void
+capture_data_free (CaptureData *data)
+{
+  g_clear_pointer (&data->bitmap, cogl_object_unref);
+  g_clear_pointer (&data->offscreen, cogl_object_unref);
+  g_slice_free (CaptureData, data);
+}
+
+static void
+capture_finish_readback (GTask *task)
+{
+  CaptureData *data = g_task_get_task_data (task);
+  CoglBuffer *buffer;
+  cairo_surface_t *surface;
+  const guint8 *src;
+  guint8 *dst;
+  int src_stride, dst_stride, row_size, y;
+
+  /* Don't bother mapping the pixels for a capture nobody wants anymore */
+  if (g_task_return_error_if_cancelled (task))
+    {
+      g_object_unref (task);
+      return;
+    }
+
+  buffer = COGL_BUFFER (cogl_bitmap_get_buffer (data->bitmap));
+  src = cogl_buffer_map (buffer, COGL_BUFFER_ACCESS_READ, 0);
+  if (src == NULL)
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                               "Failed to map the pixel buffer");
+      g_object_unref (task);
+      return;
+    }
+
+  surface = cairo_image_surface_create (data->format, data->width, data->height);
+  dst = cairo_image_surface_get_data (surface);
+  dst_stride = cairo_image_surface_get_stride (surface);
+  src_stride = cogl_bitmap_get_rowstride (data->bitmap);
+  row_size = MIN (src_stride, dst_stride);
+
+  for (y = 0; y < data->height; y++)
+    memcpy (dst + y * dst_stride, src + y * src_stride, row_size);
+
+  cogl_buffer_unmap (buffer);
+  cairo_surface_mark_dirty (surface);
+
+  g_task_return_pointer (task, surface, (GDestroyNotify) cairo_surface_destroy);
+  g_object_unref (task);
+}
+
+static gboolean
+capture_idle_cb (gpointer user_data)
+{
+  capture_finish_readback (user_data);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+capture_fence_cb (CoglFence *fence,
+                  void      *user_data)
+{
+  /* Don't free the framebuffer from within its own fence callback */
+  g_idle_add (capture_idle_cb, user_data);
+}
+
+static CoglPixelFormat
+pixel_format_for_cairo_format (cairo_format_t format)
+{
+  switch (format)
+    {
+    case CAIRO_FORMAT_ARGB32:
+    case CAIRO_FORMAT_RGB24:
+      return CLUTTER_CAIRO_FORMAT_ARGB32;
+    case CAIRO_FORMAT_RGB16_565:
+      return COGL_PIXEL_FORMAT_RGB_565;
+    default:
+      return COGL_PIXEL_FORMAT_ANY;
+    }
+}
+
+/**
+ * meta_shaped_texture_capture_async:
+ * @stex: A #MetaShapedTexture
+ * @clip: (nullable): the part of the texture to capture, or %NULL for all
+ *   of it. It is clipped to the bounds of the texture.
+ * @format: the format of the resulting image; one of
+ *   %CAIRO_FORMAT_ARGB32, %CAIRO_FORMAT_RGB24 or %CAIRO_FORMAT_RGB16_565
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: the function to call when the image is ready
+ * @user_data: data for @callback
+ *
+ * Asynchronous version of meta_shaped_texture_get_image() that doesn't
+ * wait for the GPU. The contents are rendered, with the mask applied, and
+ * read back into a pixel buffer; the buffer is only mapped once the GPU
+ * signals that it is done, or when the main loop is idle if fences are
+ * not supported.
+ *
+ * Call meta_shaped_texture_capture_finish() from @callback to get the
+ * image. Once @cancellable is cancelled, the buffer is no longer mapped
+ * and the capture finishes with %G_IO_ERROR_CANCELLED.
+ */
+void
+meta_shaped_texture_capture_async (MetaShapedTexture     *stex,
+                                   cairo_rectangle_int_t *clip,
+                                   cairo_format_t         format,
+                                   GCancellable          *cancellable,
+                                   GAsyncReadyCallback    callback,
+                                   gpointer               user_data)
+{
+  MetaShapedTexturePrivate *priv = stex->priv;
+  CoglContext *ctx = clutter_backend_get_cogl_context (clutter_get_default_backend ());
+  cairo_rectangle_int_t rect = { 0, 0, 0, 0 };
+  CoglPixelFormat pixel_format;
+  CoglTexture *texture;
+  CoglFramebuffer *fb;
+  CaptureData *data;
+  CoglError *catch_error = NULL;
+  GTask *task;
+
+  g_return_if_fail (META_IS_SHAPED_TEXTURE (stex));
+
+  task = g_task_new (stex, cancellable, callback, user_data);
+
+  if (g_task_return_error_if_cancelled (task))
+    {
+      g_object_unref (task);
+      return;
+    }
+
+  pixel_format = pixel_format_for_cairo_format (format);
+  if (pixel_format == COGL_PIXEL_FORMAT_ANY)
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                               "Unsupported image format %d", format);
+      g_object_unref (task);
+      return;
+    }
+
+  if (priv->texture == NULL)
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                               "There are no contents to capture");
+      g_object_unref (task);
+      return;
+    }
+
+  rect.width = priv->tex_width;
+  rect.height = priv->tex_height;
+
+  if (clip != NULL && !gdk_rectangle_intersect (&rect, clip, &rect))
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                               "The clip is outside of the contents");
+      g_object_unref (task);
+      return;
+    }
+
+  data = g_slice_new0 (CaptureData);
+  data->format = format;
+  data->width = rect.width;
+  data->height = rect.height;
+  g_task_set_task_data (task, data, (GDestroyNotify) capture_data_free);
+
+  /* Let the GPU apply the mask rather than blending with cairo */
+  texture = meta_create_texture (rect.width, rect.height,
+                                 COGL_TEXTURE_COMPONENTS_RGBA,
+                                 META_TEXTURE_FLAGS_NONE);
+  data->offscreen = cogl_offscreen_new_with_texture (texture);
+  cogl_object_unref (texture);
+  fb = COGL_FRAMEBUFFER (data->offscreen);
+
+  if (!cogl_framebuffer_allocate (fb, &catch_error))
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                               "Failed to allocate the capture framebuffer: %s",
+                               catch_error->message);
+      cogl_error_free (catch_error);
+      g_object_unref (task);
+      return;
+    }
+
+  cogl_framebuffer_orthographic (fb, 0, 0, rect.width, rect.height, -1., 1.);
+  cogl_framebuffer_clear4f (fb, COGL_BUFFER_BIT_COLOR, 0, 0, 0, 0);
+  meta_shaped_texture_draw (stex, fb,
+                            -rect.x, -rect.y,
+                            priv->tex_width - rect.x,
+                            priv->tex_height - rect.y);
+
+  /* A bitmap created this way is backed by a pixel buffer object, so the
+   * read only queues the transfer */
+  data->bitmap = cogl_bitmap_new_with_size (ctx, rect.width, rect.height,
+                                            pixel_format);
+  if (!cogl_framebuffer_read_pixels_into_bitmap (fb, 0, 0,
+                                                 COGL_READ_PIXELS_COLOR_BUFFER,
+                                                 data->bitmap))
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                               "Failed to read back the contents");
+      g_object_unref (task);
+      return;
+    }
+
+  if (cogl_has_feature (ctx, COGL_FEATURE_ID_FENCE))
+    cogl_framebuffer_add_fence_callback (fb, capture_fence_cb, task);
+  else
+    g_idle_add (capture_idle_cb, task);
+}
+
+/**
+ * meta_shaped_texture_capture_finish:
+ * @stex: A #MetaShapedTexture
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError
+ *
+ * Finishes a capture started with meta_shaped_texture_capture_async().
+ *
+ * Returns: (transfer full) (nullable): a new cairo surface to be freed
+ * with cairo_surface_destroy(), or %NULL on error.
+ */
+cairo_surface_t *
+meta_shaped_texture_capture_finish (MetaShapedTexture  *stex,
+                                    GAsyncResult       *result,
+                                    GError            **error)
+{
+  g_return_val_if_fail (g_task_is_valid (result, stex), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
 void
 meta_shaped_texture_set_fallback_size (MetaShapedTexture *self,
                                        guint              fallback_width,
@@ -898,6 +1189,180 @@ meta_shaped_texture_set_fallback_size (MetaShapedTexture *self,
   priv->fallback_height = fallback_height;
 }
 
+/**
+ * meta_shaped_texture_set_fallback_texture:
+ * @stex: a #MetaShapedTexture
+ * @fallback_texture: (nullable): a scaled down copy of the contents
+ *
+ * Sets a texture that is painted, stretched to the fallback size, while
+ * @stex has no texture of its own. Setting a new texture with
+ * meta_shaped_texture_set_texture() drops the fallback texture.
+ */
+void
+meta_shaped_texture_set_fallback_texture (MetaShapedTexture *stex,
+                                          CoglTexture       *fallback_texture)
+{
+  MetaShapedTexturePrivate *priv = stex->priv;
+
+  g_clear_pointer (&priv->fallback_texture, cogl_object_unref);
+
+  if (fallback_texture != NULL)
+    priv->fallback_texture = cogl_object_ref (fallback_texture);
+
+  if (priv->texture == NULL)
+    clutter_actor_queue_redraw (CLUTTER_ACTOR (stex));
+}
+
+/**
+ * meta_shaped_texture_draw:
+ * @stex: a #MetaShapedTexture
+ * @framebuffer: the #CoglFramebuffer to draw to
+ * @x_1: left edge of the rectangle to draw to
+ * @y_1: top edge of the rectangle to draw to
+ * @x_2: right edge of the rectangle to draw to
+ * @y_2: bottom edge of the rectangle to draw to
+ *
+ * Draws the contents of @stex, with the mask applied, scaled into the given
+ * rectangle of @framebuffer, independently of the stage. Falls back to the
+ * texture set with meta_shaped_texture_set_fallback_texture() while @stex
+ * has no texture.
+ *
+ * Returns: %FALSE if there was nothing to draw
+ */
+gboolean
+meta_shaped_texture_draw (MetaShapedTexture *stex,
+                          CoglFramebuffer   *framebuffer,
+                          float              x_1,
+                          float              y_1,
+                          float              x_2,
+                          float              y_2)
+{
+  MetaShapedTexturePrivate *priv = stex->priv;
+  CoglContext *ctx;
+  CoglPipeline *pipeline;
+  CoglColor color;
+
+  ctx = clutter_backend_get_cogl_context (clutter_get_default_backend ());
+
+  if (priv->texture == NULL)
+    {
+      if (priv->fallback_texture == NULL)
+        return FALSE;
+
+      pipeline = cogl_pipeline_copy (get_unmasked_pipeline (ctx));
+      cogl_pipeline_set_layer_texture (pipeline, 0, priv->fallback_texture);
+    }
+  else if (priv->mask_texture == NULL)
+    {
+      pipeline = cogl_pipeline_copy (get_unmasked_pipeline (ctx));
+      cogl_pipeline_set_layer_texture (pipeline, 0, priv->texture);
+    }
+  else
+    {
+      pipeline = cogl_pipeline_copy (get_masked_pipeline (ctx));
+      cogl_pipeline_set_layer_texture (pipeline, 0, priv->texture);
+      cogl_pipeline_set_layer_texture (pipeline, 1, priv->mask_texture);
+      cogl_pipeline_set_layer_filters (pipeline, 1,
+                                       COGL_PIPELINE_FILTER_LINEAR,
+                                       COGL_PIPELINE_FILTER_LINEAR);
+    }
+
+  cogl_pipeline_set_layer_filters (pipeline, 0,
+                                   COGL_PIPELINE_FILTER_LINEAR,
+                                   COGL_PIPELINE_FILTER_LINEAR);
+
+  cogl_color_init_from_4ub (&color, 255, 255, 255, 255);
+  cogl_pipeline_set_color (pipeline, &color);
+
+  cogl_framebuffer_draw_rectangle (framebuffer, pipeline, x_1, y_1, x_2, y_2);
+
+  cogl_object_unref (pipeline);
+
+  return TRUE;
+}
+
+/**
+ * meta_shaped_texture_create_thumbnail:
+ * @stex: a #MetaShapedTexture
+ * @width: the width of the thumbnail
+ * @height: the height of the thumbnail
+ *
+ * Renders the contents of @stex, with the mask applied, scaled into a
+ * new texture of @width x @height pixels.
+ *
+ * Returns: (transfer full) (nullable): the new texture, or %NULL if
+ * @stex has no contents or the texture couldn't be allocated.
+ */
+CoglTexture *
+meta_shaped_texture_create_thumbnail (MetaShapedTexture *stex,
+                                      int                width,
+                                      int                height)
+{
+  MetaShapedTexturePrivate *priv = stex->priv;
+  CoglTexture *thumbnail;
+  CoglOffscreen *offscreen;
+  CoglFramebuffer *fb;
+  CoglError *catch_error = NULL;
+
+  if (priv->texture == NULL || width <= 0 || height <= 0)
+    return NULL;
+
+  thumbnail = meta_create_texture (width, height,
+                                   COGL_TEXTURE_COMPONENTS_RGBA,
+                                   META_TEXTURE_FLAGS_NONE);
+  offscreen = cogl_offscreen_new_with_texture (thumbnail);
+  fb = COGL_FRAMEBUFFER (offscreen);
+
+  if (!cogl_framebuffer_allocate (fb, &catch_error))
+    {
+      cogl_error_free (catch_error);
+      cogl_object_unref (offscreen);
+      cogl_object_unref (thumbnail);
+      return NULL;
+    }
+
+  cogl_framebuffer_orthographic (fb, 0, 0, width, height, -1., 1.);
+  cogl_framebuffer_clear4f (fb, COGL_BUFFER_BIT_COLOR, 0, 0, 0, 0);
+
+  meta_shaped_texture_draw (stex, fb, 0, 0, width, height);
+
+  cogl_object_unref (offscreen);
+
+  return thumbnail;
+}
+
+/**
+ * meta_shaped_texture_get_memory_usage:
+ * @stex: a #MetaShapedTexture
+ *
+ * Estimates the amount of texture memory kept alive by @stex: the
+ * texture, the mask, the levels of the mipmap emulation and the
+ * fallback texture.
+ *
+ * Returns: the estimated size in bytes
+ */
+gsize
+meta_shaped_texture_get_memory_usage (MetaShapedTexture *stex)
+{
+  MetaShapedTexturePrivate *priv = stex->priv;
+  gsize usage = 0;
+
+  if (priv->texture != NULL)
+    usage += (gsize) priv->tex_width * priv->tex_height * 4;
+
+  if (priv->mask_texture != NULL)
+    usage += (gsize) cogl_texture_get_width (priv->mask_texture) *
+             cogl_texture_get_height (priv->mask_texture);
+
+  if (priv->fallback_texture != NULL)
+    usage += (gsize) cogl_texture_get_width (priv->fallback_texture) *
+             cogl_texture_get_height (priv->fallback_texture) * 4;
+
+  usage += meta_texture_tower_get_memory_usage (priv->paint_tower);
+
+  return usage;
+}
+
 static void
 meta_shaped_texture_cull_out (MetaCullable   *cullable,
                               cairo_region_t *unobscured_region,
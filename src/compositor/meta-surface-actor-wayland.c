@@ -128,7 +128,7 @@ meta_surface_actor_wayland_get_subsurface_rect (MetaSurfaceActorWayland *self,
                                                 MetaRectangle           *rect)
 {
   MetaWaylandSurface *surface = meta_surface_actor_wayland_get_surface (self);
-  CoglTexture *texture = surface->buffer->texture;
+  MetaWaylandBuffer *buffer = surface->buffer;
   MetaWindow *toplevel_window;
   int monitor_scale;
   float x, y;
@@ -140,8 +140,8 @@ meta_surface_actor_wayland_get_subsurface_rect (MetaSurfaceActorWayland *self,
   *rect = (MetaRectangle) {
     .x = x / monitor_scale,
     .y = y / monitor_scale,
-    .width = cogl_texture_get_width (texture) / surface->scale,
-    .height = cogl_texture_get_height (texture) / surface->scale,
+    .width = buffer->width / surface->scale,
+    .height = buffer->height / surface->scale,
   };
 }
 
@@ -356,6 +356,39 @@ meta_surface_actor_wayland_paint (ClutterActor *actor)
   CLUTTER_ACTOR_CLASS (meta_surface_actor_wayland_parent_class)->paint (actor);
 }
 
+static void
+meta_surface_actor_wayland_release_texture (MetaSurfaceActor *actor)
+{
+  MetaSurfaceActorWayland *self = META_SURFACE_ACTOR_WAYLAND (actor);
+  MetaSurfaceActorWaylandPrivate *priv =
+    meta_surface_actor_wayland_get_instance_private (self);
+  MetaShapedTexture *stex = meta_surface_actor_get_texture (actor);
+
+  meta_shaped_texture_set_texture (stex, NULL);
+
+  /* The client keeps the buffer attached, so we can import it again when
+   * the texture is restored. */
+  if (priv->surface && priv->surface->buffer)
+    meta_wayland_buffer_release_texture (priv->surface->buffer);
+}
+
+static void
+meta_surface_actor_wayland_restore_texture (MetaSurfaceActor *actor)
+{
+  MetaSurfaceActorWayland *self = META_SURFACE_ACTOR_WAYLAND (actor);
+  MetaSurfaceActorWaylandPrivate *priv =
+    meta_surface_actor_wayland_get_instance_private (self);
+  MetaShapedTexture *stex = meta_surface_actor_get_texture (actor);
+  CoglTexture *texture;
+
+  if (!priv->surface || !priv->surface->buffer)
+    return;
+
+  texture = meta_wayland_buffer_ensure_texture (priv->surface->buffer);
+  meta_shaped_texture_set_texture (stex, texture);
+  clutter_actor_queue_redraw (CLUTTER_ACTOR (actor));
+}
+
 static void
 meta_surface_actor_wayland_dispose (GObject *object)
 {
@@ -387,6 +420,9 @@ meta_surface_actor_wayland_class_init (MetaSurfaceActorWaylandClass *klass)
 
   surface_actor_class->get_window = meta_surface_actor_wayland_get_window;
 
+  surface_actor_class->release_texture = meta_surface_actor_wayland_release_texture;
+  surface_actor_class->restore_texture = meta_surface_actor_wayland_restore_texture;
+
   object_class->dispose = meta_surface_actor_wayland_dispose;
 }
 
@@ -414,6 +450,11 @@ meta_surface_actor_wayland_set_texture (MetaSurfaceActorWayland *self,
                                         CoglTexture *texture)
 {
   MetaShapedTexture *stex = meta_surface_actor_get_texture (META_SURFACE_ACTOR (self));
+
+  /* A newly attached buffer brings the contents back */
+  if (texture != NULL)
+    meta_surface_actor_restore_texture (META_SURFACE_ACTOR (self));
+
   meta_shaped_texture_set_texture (stex, texture);
 }
 
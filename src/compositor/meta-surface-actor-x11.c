@@ -228,6 +228,11 @@ meta_surface_actor_x11_pre_paint (MetaSurfaceActor *actor)
       priv->received_damage = FALSE;
     }
 
+  /* Don't name a new pixmap while the texture is released to save
+   * memory; it is done on the first paint after it is restored. */
+  if (meta_surface_actor_is_texture_released (actor))
+    return;
+
   update_pixmap (self);
 }
 
@@ -319,6 +324,21 @@ meta_surface_actor_x11_is_unredirected (MetaSurfaceActor *actor)
   return priv->unredirected;
 }
 
+static void
+meta_surface_actor_x11_release_texture (MetaSurfaceActor *actor)
+{
+  MetaSurfaceActorX11 *self = META_SURFACE_ACTOR_X11 (actor);
+
+  detach_pixmap (self);
+}
+
+static void
+meta_surface_actor_x11_restore_texture (MetaSurfaceActor *actor)
+{
+  /* The pixmap is named again in pre_paint() */
+  clutter_actor_queue_redraw (CLUTTER_ACTOR (actor));
+}
+
 static void
 meta_surface_actor_x11_dispose (GObject *object)
 {
@@ -355,6 +375,9 @@ meta_surface_actor_x11_class_init (MetaSurfaceActorX11Class *klass)
   surface_actor_class->is_unredirected = meta_surface_actor_x11_is_unredirected;
 
   surface_actor_class->get_window = meta_surface_actor_x11_get_window;
+
+  surface_actor_class->release_texture = meta_surface_actor_x11_release_texture;
+  surface_actor_class->restore_texture = meta_surface_actor_x11_restore_texture;
 }
 
 static void
@@ -18,15 +18,26 @@
 #include "meta-cullable.h"
 #include "meta-shaped-texture-private.h"
 
+/* Largest dimension of the copy painted in place of a released texture */
+#define THUMBNAIL_SIZE 256
+
 struct _MetaSurfaceActorPrivate
 {
   MetaShapedTexture *texture;
 
   cairo_region_t *input_region;
 
+  /* Bumped whenever the contents change, see
+   * meta_surface_actor_get_damage_serial() */
+  guint damage_serial;
+
   /* Freeze/thaw accounting */
   guint needs_damage_all : 1;
   guint frozen : 1;
+
+  /* The texture was dropped to save memory, see
+   * meta_surface_actor_release_texture() */
+  guint texture_released : 1;
 };
 
 static void cullable_iface_init (MetaCullableInterface *iface);
@@ -164,6 +175,7 @@ texture_size_changed (MetaShapedTexture *texture,
                       gpointer           user_data)
 {
   MetaSurfaceActor *actor = META_SURFACE_ACTOR (user_data);
+  actor->priv->damage_serial++;
   g_signal_emit (actor, signals[SIZE_CHANGED], 0);
 }
 
@@ -189,6 +201,20 @@ meta_surface_actor_get_image (MetaSurfaceActor      *self,
   return meta_shaped_texture_get_image (self->priv->texture, clip);
 }
 
+/* The result is to be finished with meta_shaped_texture_capture_finish()
+ * on the source object passed to @callback. */
+void
+meta_surface_actor_capture_async (MetaSurfaceActor      *self,
+                                  cairo_rectangle_int_t *clip,
+                                  cairo_format_t         format,
+                                  GCancellable          *cancellable,
+                                  GAsyncReadyCallback    callback,
+                                  gpointer               user_data)
+{
+  meta_shaped_texture_capture_async (self->priv->texture, clip, format,
+                                     cancellable, callback, user_data);
+}
+
 MetaShapedTexture *
 meta_surface_actor_get_texture (MetaSurfaceActor *self)
 {
@@ -269,6 +295,7 @@ meta_surface_actor_process_damage (MetaSurfaceActor *self,
     }
 
   META_SURFACE_ACTOR_GET_CLASS (self)->process_damage (self, x, y, width, height);
+  priv->damage_serial++;
 
   if (meta_surface_actor_is_visible (self))
     meta_surface_actor_update_area (self, x, y, width, height);
@@ -362,3 +389,104 @@ meta_surface_actor_get_window (MetaSurfaceActor *self)
 {
   return META_SURFACE_ACTOR_GET_CLASS (self)->get_window (self);
 }
+
+/**
+ * meta_surface_actor_release_texture:
+ * @self: a #MetaSurfaceActor
+ *
+ * Drops the texture backing @self to save memory, keeping a scaled down
+ * copy around to paint in the meantime. The texture is imported again on
+ * meta_surface_actor_restore_texture().
+ *
+ * Returns: an estimate of the number of bytes released
+ */
+gsize
+meta_surface_actor_release_texture (MetaSurfaceActor *self)
+{
+  MetaSurfaceActorPrivate *priv = self->priv;
+  MetaSurfaceActorClass *klass = META_SURFACE_ACTOR_GET_CLASS (self);
+  CoglTexture *texture, *thumbnail;
+  gsize usage_before, usage_after;
+  int width, height, thumb_width, thumb_height;
+
+  if (priv->texture_released || klass->release_texture == NULL)
+    return 0;
+
+  texture = meta_shaped_texture_get_texture (priv->texture);
+  if (texture == NULL)
+    return 0;
+
+  usage_before = meta_shaped_texture_get_memory_usage (priv->texture);
+
+  width = cogl_texture_get_width (texture);
+  height = cogl_texture_get_height (texture);
+
+  if (width > height)
+    {
+      thumb_width = MIN (width, THUMBNAIL_SIZE);
+      thumb_height = MAX (1, height * thumb_width / width);
+    }
+  else
+    {
+      thumb_height = MIN (height, THUMBNAIL_SIZE);
+      thumb_width = MAX (1, width * thumb_height / height);
+    }
+
+  thumbnail = meta_shaped_texture_create_thumbnail (priv->texture,
+                                                    thumb_width,
+                                                    thumb_height);
+
+  /* Keep the actor at its current size while it has no texture */
+  meta_shaped_texture_set_fallback_size (priv->texture, width, height);
+
+  priv->texture_released = TRUE;
+  klass->release_texture (self);
+
+  /* Setting the texture drops the fallback, so set it afterwards */
+  meta_shaped_texture_set_fallback_texture (priv->texture, thumbnail);
+  if (thumbnail != NULL)
+    cogl_object_unref (thumbnail);
+
+  usage_after = meta_shaped_texture_get_memory_usage (priv->texture);
+
+  return usage_before > usage_after ? usage_before - usage_after : 0;
+}
+
+/**
+ * meta_surface_actor_restore_texture:
+ * @self: a #MetaSurfaceActor
+ *
+ * Imports the texture dropped by meta_surface_actor_release_texture()
+ * again. Depending on the backend this may only happen on the next paint.
+ */
+void
+meta_surface_actor_restore_texture (MetaSurfaceActor *self)
+{
+  MetaSurfaceActorPrivate *priv = self->priv;
+
+  if (!priv->texture_released)
+    return;
+
+  priv->texture_released = FALSE;
+  META_SURFACE_ACTOR_GET_CLASS (self)->restore_texture (self);
+}
+
+/**
+ * meta_surface_actor_get_damage_serial:
+ * @self: a #MetaSurfaceActor
+ *
+ * Returns: a number that changes whenever damage is processed or the
+ *   size of the contents changes, whether or not the damage is visible
+ *   on the stage
+ */
+guint
+meta_surface_actor_get_damage_serial (MetaSurfaceActor *self)
+{
+  return self->priv->damage_serial;
+}
+
+gboolean
+meta_surface_actor_is_texture_released (MetaSurfaceActor *self)
+{
+  return self->priv->texture_released;
+}
@@ -37,6 +37,9 @@ struct _MetaSurfaceActorClass
   gboolean (* is_unredirected)   (MetaSurfaceActor *actor);
 
   MetaWindow *(* get_window)      (MetaSurfaceActor *actor);
+
+  void     (* release_texture)   (MetaSurfaceActor *actor);
+  void     (* restore_texture)   (MetaSurfaceActor *actor);
 };
 
 struct _MetaSurfaceActor
@@ -50,6 +53,12 @@ GType meta_surface_actor_get_type (void);
 
 cairo_surface_t *meta_surface_actor_get_image (MetaSurfaceActor      *self,
                                                cairo_rectangle_int_t *clip);
+void meta_surface_actor_capture_async (MetaSurfaceActor      *self,
+                                       cairo_rectangle_int_t *clip,
+                                       cairo_format_t         format,
+                                       GCancellable          *cancellable,
+                                       GAsyncReadyCallback    callback,
+                                       gpointer               user_data);
 
 MetaShapedTexture *meta_surface_actor_get_texture (MetaSurfaceActor *self);
 MetaWindow        *meta_surface_actor_get_window  (MetaSurfaceActor *self);
@@ -66,6 +75,7 @@ void meta_surface_actor_process_damage (MetaSurfaceActor *actor,
 void meta_surface_actor_pre_paint (MetaSurfaceActor *actor);
 gboolean meta_surface_actor_is_argb32 (MetaSurfaceActor *actor);
 gboolean meta_surface_actor_is_visible (MetaSurfaceActor *actor);
+guint meta_surface_actor_get_damage_serial (MetaSurfaceActor *actor);
 
 void meta_surface_actor_set_frozen (MetaSurfaceActor *actor,
                                     gboolean          frozen);
@@ -75,6 +85,10 @@ void meta_surface_actor_set_unredirected (MetaSurfaceActor *actor,
                                           gboolean          unredirected);
 gboolean meta_surface_actor_is_unredirected (MetaSurfaceActor *actor);
 
+gsize meta_surface_actor_release_texture (MetaSurfaceActor *actor);
+void meta_surface_actor_restore_texture (MetaSurfaceActor *actor);
+gboolean meta_surface_actor_is_texture_released (MetaSurfaceActor *actor);
+
 G_END_DECLS
 
 #endif /* META_SURFACE_ACTOR_PRIVATE_H */
@@ -0,0 +1,304 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaTextureMemoryManager
+ *
+ * Releases the textures of windows that have been hidden for a long time
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Every window keeps its full size texture alive, even while it is
+ * minimized or on another workspace. Once the textures of all windows
+ * together exceed the texture-memory-budget preference, the manager
+ * releases the textures of windows that have been hidden for longer than
+ * texture-reclaim-timeout, longest hidden first. The window is drawn from
+ * a scaled down copy until it is shown again, at which point the texture
+ * is imported again.
+ *
+ * The current usage is exported on the session bus as
+ * org.gnome.Mutter.TextureMemory.
+ */
+
+#include <config.h>
+
+#include "meta-texture-memory-manager.h"
+
+#include <meta/prefs.h>
+#include <meta/main.h>
+#include <meta/util.h>
+#include <meta/window.h>
+
+#include "compositor-private.h"
+#include "meta-window-actor-private.h"
+#include "meta-dbus-texture-memory.h"
+
+/* How often to look for windows to release, in seconds */
+#define RECLAIM_INTERVAL 10
+
+struct _MetaTextureMemoryManager
+{
+  MetaCompositor *compositor;
+
+  guint reclaim_id;
+  guint dbus_name_id;
+  MetaDBusTextureMemory *skeleton;
+
+  gsize resident_bytes;
+  gsize reclaimed_bytes;
+};
+
+static gsize
+get_budget_bytes (void)
+{
+  return (gsize) meta_prefs_get_texture_memory_budget () * 1024 * 1024;
+}
+
+static void
+update_usage (MetaTextureMemoryManager *manager)
+{
+  GList *l;
+
+  manager->resident_bytes = 0;
+  manager->reclaimed_bytes = 0;
+
+  for (l = manager->compositor->windows; l; l = l->next)
+    {
+      MetaWindowActor *window_actor = l->data;
+
+      manager->resident_bytes += meta_window_actor_get_texture_memory (window_actor);
+      manager->reclaimed_bytes += meta_window_actor_get_reclaimed_memory (window_actor);
+    }
+
+  if (manager->skeleton)
+    {
+      meta_dbus_texture_memory_set_resident_bytes (manager->skeleton,
+                                                   manager->resident_bytes);
+      meta_dbus_texture_memory_set_reclaimed_bytes (manager->skeleton,
+                                                    manager->reclaimed_bytes);
+      meta_dbus_texture_memory_set_budget_bytes (manager->skeleton,
+                                                 get_budget_bytes ());
+    }
+}
+
+static int
+compare_hidden_time (gconstpointer a,
+                     gconstpointer b)
+{
+  gint64 hidden_a = meta_window_actor_get_hidden_time ((MetaWindowActor *) a);
+  gint64 hidden_b = meta_window_actor_get_hidden_time ((MetaWindowActor *) b);
+
+  /* Longest hidden first */
+  if (hidden_a > hidden_b)
+    return -1;
+  else if (hidden_a < hidden_b)
+    return 1;
+  else
+    return 0;
+}
+
+/**
+ * meta_texture_memory_manager_reclaim:
+ * @manager: a #MetaTextureMemoryManager
+ *
+ * Releases the textures of windows hidden for longer than the
+ * texture-reclaim-timeout preference until the textures of all windows
+ * fit into the texture-memory-budget preference.
+ */
+void
+meta_texture_memory_manager_reclaim (MetaTextureMemoryManager *manager)
+{
+  gint64 timeout;
+  gsize budget;
+  GList *candidates = NULL;
+  GList *l;
+
+  update_usage (manager);
+
+  timeout = (gint64) meta_prefs_get_texture_reclaim_timeout () * G_USEC_PER_SEC;
+  budget = get_budget_bytes ();
+
+  if (timeout == 0 || manager->resident_bytes <= budget)
+    return;
+
+  for (l = manager->compositor->windows; l; l = l->next)
+    {
+      MetaWindowActor *window_actor = l->data;
+
+      if (meta_window_actor_get_hidden_time (window_actor) < timeout)
+        continue;
+
+      if (meta_window_actor_get_reclaimed_memory (window_actor) > 0)
+        continue;
+
+      candidates = g_list_prepend (candidates, window_actor);
+    }
+
+  candidates = g_list_sort (candidates, compare_hidden_time);
+
+  for (l = candidates; l && manager->resident_bytes > budget; l = l->next)
+    {
+      MetaWindowActor *window_actor = l->data;
+      MetaWindow *window = meta_window_actor_get_meta_window (window_actor);
+      gsize released;
+
+      released = meta_window_actor_release_textures (window_actor);
+      if (released == 0)
+        continue;
+
+      meta_verbose ("Released %" G_GSIZE_FORMAT " bytes of textures for %s\n",
+                    released, meta_window_get_description (window));
+
+      manager->resident_bytes -= MIN (released, manager->resident_bytes);
+    }
+
+  g_list_free (candidates);
+
+  update_usage (manager);
+}
+
+static gboolean
+reclaim_timeout (gpointer data)
+{
+  MetaTextureMemoryManager *manager = data;
+
+  meta_texture_memory_manager_reclaim (manager);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+prefs_changed_callback (MetaPreference pref,
+                        gpointer       data)
+{
+  MetaTextureMemoryManager *manager = data;
+
+  if (pref == META_PREF_TEXTURE_RECLAIM_TIMEOUT ||
+      pref == META_PREF_TEXTURE_MEMORY_BUDGET)
+    meta_texture_memory_manager_reclaim (manager);
+}
+
+static gboolean
+handle_get_usage (MetaDBusTextureMemory    *skeleton,
+                  GDBusMethodInvocation    *invocation,
+                  MetaTextureMemoryManager *manager)
+{
+  GVariantBuilder builder;
+  GList *l;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sttt)"));
+
+  for (l = manager->compositor->windows; l; l = l->next)
+    {
+      MetaWindowActor *window_actor = l->data;
+      MetaWindow *window = meta_window_actor_get_meta_window (window_actor);
+
+      g_variant_builder_add (&builder, "(sttt)",
+                             meta_window_get_description (window),
+                             (guint64) meta_window_actor_get_texture_memory (window_actor),
+                             (guint64) meta_window_actor_get_reclaimed_memory (window_actor),
+                             (guint64) (meta_window_actor_get_hidden_time (window_actor) / 1000));
+    }
+
+  update_usage (manager);
+
+  meta_dbus_texture_memory_complete_get_usage (skeleton, invocation,
+                                               g_variant_builder_end (&builder));
+  return TRUE;
+}
+
+static void
+on_bus_acquired (GDBusConnection *connection,
+                 const char      *name,
+                 gpointer         user_data)
+{
+  MetaTextureMemoryManager *manager = user_data;
+  GError *error = NULL;
+
+  if (!g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (manager->skeleton),
+                                         connection,
+                                         "/org/gnome/Mutter/TextureMemory",
+                                         &error))
+    {
+      meta_warning ("Failed to export texture memory object: %s\n", error->message);
+      g_error_free (error);
+    }
+}
+
+static void
+on_name_acquired (GDBusConnection *connection,
+                  const char      *name,
+                  gpointer         user_data)
+{
+  meta_verbose ("Acquired name %s\n", name);
+}
+
+static void
+on_name_lost (GDBusConnection *connection,
+              const char      *name,
+              gpointer         user_data)
+{
+  meta_verbose ("Lost or failed to acquire name %s\n", name);
+}
+
+MetaTextureMemoryManager *
+meta_texture_memory_manager_new (MetaCompositor *compositor)
+{
+  MetaTextureMemoryManager *manager;
+
+  manager = g_slice_new0 (MetaTextureMemoryManager);
+  manager->compositor = compositor;
+
+  manager->skeleton = meta_dbus_texture_memory_skeleton_new ();
+  g_signal_connect (manager->skeleton, "handle-get-usage",
+                    G_CALLBACK (handle_get_usage), manager);
+  update_usage (manager);
+
+  manager->dbus_name_id =
+    g_bus_own_name (G_BUS_TYPE_SESSION,
+                    "org.gnome.Mutter.TextureMemory",
+                    G_BUS_NAME_OWNER_FLAGS_ALLOW_REPLACEMENT |
+                    (meta_get_replace_current_wm () ?
+                     G_BUS_NAME_OWNER_FLAGS_REPLACE : 0),
+                    on_bus_acquired,
+                    on_name_acquired,
+                    on_name_lost,
+                    manager, NULL);
+
+  manager->reclaim_id = g_timeout_add_seconds (RECLAIM_INTERVAL,
+                                               reclaim_timeout,
+                                               manager);
+  g_source_set_name_by_id (manager->reclaim_id, "[mutter] reclaim_timeout");
+
+  meta_prefs_add_listener (prefs_changed_callback, manager);
+
+  return manager;
+}
+
+void
+meta_texture_memory_manager_free (MetaTextureMemoryManager *manager)
+{
+  meta_prefs_remove_listener (prefs_changed_callback, manager);
+
+  if (manager->reclaim_id)
+    g_source_remove (manager->reclaim_id);
+
+  if (manager->dbus_name_id)
+    g_bus_unown_name (manager->dbus_name_id);
+
+  g_dbus_interface_skeleton_unexport (G_DBUS_INTERFACE_SKELETON (manager->skeleton));
+  g_object_unref (manager->skeleton);
+
+  g_slice_free (MetaTextureMemoryManager, manager);
+}
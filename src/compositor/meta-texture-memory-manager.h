@@ -0,0 +1,33 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaTextureMemoryManager
+ *
+ * Releases the textures of windows that have been hidden for a long time
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef META_TEXTURE_MEMORY_MANAGER_H
+#define META_TEXTURE_MEMORY_MANAGER_H
+
+#include <meta/types.h>
+
+typedef struct _MetaTextureMemoryManager MetaTextureMemoryManager;
+
+MetaTextureMemoryManager *meta_texture_memory_manager_new  (MetaCompositor           *compositor);
+void                      meta_texture_memory_manager_free (MetaTextureMemoryManager *manager);
+
+void meta_texture_memory_manager_reclaim (MetaTextureMemoryManager *manager);
+
+#endif /* META_TEXTURE_MEMORY_MANAGER_H */
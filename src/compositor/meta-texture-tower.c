@@ -488,3 +488,33 @@ meta_texture_tower_get_paint_texture (MetaTextureTower *tower)
 
   return tower->textures[level];
 }
+
+/**
+ * meta_texture_tower_get_memory_usage:
+ * @tower: a #MetaTextureTower
+ *
+ * Estimates the amount of texture memory held by the scaled down levels
+ * of the tower. The base texture is not owned by the tower and isn't
+ * included.
+ *
+ * Return value: the estimated size in bytes
+ */
+gsize
+meta_texture_tower_get_memory_usage (MetaTextureTower *tower)
+{
+  gsize usage = 0;
+  int i;
+
+  g_return_val_if_fail (tower != NULL, 0);
+
+  for (i = 1; i < tower->n_levels; i++)
+    {
+      if (tower->textures[i] == NULL)
+        continue;
+
+      usage += (gsize) cogl_texture_get_width (tower->textures[i]) *
+               cogl_texture_get_height (tower->textures[i]) * 4;
+    }
+
+  return usage;
+}
@@ -61,6 +61,7 @@ void              meta_texture_tower_update_area       (MetaTextureTower *tower,
                                                         int               width,
                                                         int               height);
 CoglTexture      *meta_texture_tower_get_paint_texture (MetaTextureTower *tower);
+gsize             meta_texture_tower_get_memory_usage  (MetaTextureTower *tower);
 
 G_BEGIN_DECLS
 
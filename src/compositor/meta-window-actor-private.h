@@ -60,4 +60,12 @@ void meta_window_actor_effect_completed (MetaWindowActor  *actor,
 MetaSurfaceActor *meta_window_actor_get_surface (MetaWindowActor *self);
 void meta_window_actor_update_surface (MetaWindowActor *self);
 
+gsize  meta_window_actor_get_texture_memory   (MetaWindowActor *self);
+gsize  meta_window_actor_get_reclaimed_memory (MetaWindowActor *self);
+gint64 meta_window_actor_get_hidden_time      (MetaWindowActor *self);
+gsize  meta_window_actor_release_textures     (MetaWindowActor *self);
+
+gint64 meta_window_actor_get_thumbnail_dirty_time (MetaWindowActor *self);
+gsize  meta_window_actor_update_thumbnail         (MetaWindowActor *self);
+
 #endif /* META_WINDOW_ACTOR_PRIVATE_H */
@@ -24,12 +24,14 @@
 #include <meta/meta-shadow-factory.h>
 
 #include "compositor-private.h"
+#include "cogl-utils.h"
 #include "meta-shaped-texture-private.h"
 #include "meta-window-actor-private.h"
 #include "meta-texture-rectangle.h"
 #include "region-utils.h"
 #include "meta-monitor-manager-private.h"
 #include "meta-cullable.h"
+#include "meta-frame-timings.h"
 
 #include "meta-surface-actor.h"
 #include "meta-surface-actor-x11.h"
@@ -98,6 +100,26 @@ struct _MetaWindowActorPrivate
   GList            *frames;
   guint             freeze_count;
 
+  /* Monotonic time the window was hidden at, 0 while it is visible */
+  gint64            hidden_since;
+  /* Texture memory released by meta_window_actor_release_textures() */
+  gsize             reclaimed_bytes;
+
+  /* See meta_window_actor_get_thumbnail() */
+  CoglTexture      *thumbnail;
+  int               thumbnail_max_width;
+  int               thumbnail_max_height;
+  guint             thumbnail_damage_serial;
+  gint64            thumbnail_dirty_since;
+
+  /* Monotonic time of the first content update since the last paint */
+  gint64            content_update_time;
+  /* The update being drawn in frame timed_frame_counter, see
+   * meta_window_actor_get_frame_stats() */
+  gint64            timed_update_time;
+  gint64            timed_frame_counter;
+  MetaFrameTimings *frame_timings;
+
   guint		    visible                : 1;
   guint		    disposed               : 1;
 
@@ -139,6 +161,7 @@ struct _FrameData
 enum
 {
   FIRST_FRAME,
+  THUMBNAIL_CHANGED,
   LAST_SIGNAL
 };
 
@@ -235,6 +258,21 @@ meta_window_actor_class_init (MetaWindowActorClass *klass)
                   NULL, NULL, NULL,
                   G_TYPE_NONE, 0);
 
+  /**
+   * MetaWindowActor::thumbnail-changed:
+   * @actor: the #MetaWindowActor instance
+   *
+   * The ::thumbnail-changed signal is emitted when the texture returned
+   * by meta_window_actor_get_thumbnail() was updated.
+   */
+  signals[THUMBNAIL_CHANGED] =
+    g_signal_new ("thumbnail-changed",
+                  G_TYPE_FROM_CLASS (object_class),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL, NULL,
+                  G_TYPE_NONE, 0);
+
   pspec = g_param_spec_object ("meta-window",
                                "MetaWindow",
                                "The displayed MetaWindow",
@@ -276,6 +314,7 @@ meta_window_actor_init (MetaWindowActor *self)
 						   META_TYPE_WINDOW_ACTOR,
 						   MetaWindowActorPrivate);
   priv->shadow_class = NULL;
+  priv->timed_frame_counter = -1;
 }
 
 static void
@@ -303,6 +342,9 @@ surface_repaint_scheduled (MetaSurfaceActor *actor,
   MetaWindowActorPrivate *priv = self->priv;
 
   priv->repaint_scheduled = TRUE;
+
+  if (priv->content_update_time == 0)
+    priv->content_update_time = g_get_monotonic_time ();
 }
 
 static gboolean
@@ -474,6 +516,7 @@ meta_window_actor_dispose (GObject *object)
   g_clear_pointer (&priv->focused_shadow, meta_shadow_unref);
   g_clear_pointer (&priv->unfocused_shadow, meta_shadow_unref);
   g_clear_pointer (&priv->shadow_shape, meta_window_shape_unref);
+  g_clear_pointer (&priv->thumbnail, cogl_object_unref);
 
   compositor->windows = g_list_remove (compositor->windows, (gconstpointer) self);
 
@@ -491,6 +534,7 @@ meta_window_actor_finalize (GObject *object)
   MetaWindowActorPrivate *priv = self->priv;
 
   g_list_free_full (priv->frames, (GDestroyNotify) frame_data_free);
+  g_clear_pointer (&priv->frame_timings, meta_frame_timings_free);
 
   G_OBJECT_CLASS (meta_window_actor_parent_class)->finalize (object);
 }
@@ -693,6 +737,23 @@ assign_frame_counter_to_frames (MetaWindowActor *self)
     }
 }
 
+static void
+assign_frame_counter_to_update (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+  CoglOnscreen *onscreen;
+
+  /* Keep at most one update in flight; a later one is timed with the
+   * next frame, starting from its own update time */
+  if (priv->content_update_time == 0 || priv->timed_frame_counter != -1)
+    return;
+
+  onscreen = COGL_ONSCREEN (cogl_get_draw_framebuffer ());
+  priv->timed_frame_counter = cogl_onscreen_get_frame_counter (onscreen);
+  priv->timed_update_time = priv->content_update_time;
+  priv->content_update_time = 0;
+}
+
 static void
 meta_window_actor_paint (ClutterActor *actor)
 {
@@ -883,6 +944,220 @@ meta_window_actor_get_texture (MetaWindowActor *self)
     return NULL;
 }
 
+/**
+ * meta_window_actor_get_thumbnail:
+ * @self: a #MetaWindowActor
+ * @max_width: the maximum width of the thumbnail
+ * @max_height: the maximum height of the thumbnail
+ *
+ * Gets a scaled down copy of the window contents, fitting into
+ * @max_width x @max_height while keeping the aspect ratio. This is
+ * cheaper to draw many times over than the window itself, e.g. in an
+ * overview.
+ *
+ * The thumbnail is kept up to date with the window contents, but to
+ * bound the cost per frame, only a limited number of thumbnails are
+ * updated at each frame; #MetaWindowActor::thumbnail-changed is emitted
+ * when that happens. The first call thus returns %NULL, as may calls
+ * after changing the size.
+ *
+ * Return value: (transfer none) (nullable): the thumbnail, or %NULL
+ */
+CoglTexture *
+meta_window_actor_get_thumbnail (MetaWindowActor *self,
+                                 int              max_width,
+                                 int              max_height)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+
+  g_return_val_if_fail (max_width > 0 && max_height > 0, NULL);
+
+  if (priv->thumbnail_max_width != max_width ||
+      priv->thumbnail_max_height != max_height)
+    {
+      priv->thumbnail_max_width = max_width;
+      priv->thumbnail_max_height = max_height;
+      priv->thumbnail_dirty_since = g_get_monotonic_time ();
+
+      clutter_actor_queue_redraw (priv->compositor->stage);
+    }
+
+  return priv->thumbnail;
+}
+
+/**
+ * meta_window_actor_clear_thumbnail:
+ * @self: a #MetaWindowActor
+ *
+ * Frees the thumbnail and stops keeping it up to date, until the next
+ * call to meta_window_actor_get_thumbnail().
+ */
+void
+meta_window_actor_clear_thumbnail (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+
+  g_clear_pointer (&priv->thumbnail, cogl_object_unref);
+  priv->thumbnail_max_width = 0;
+  priv->thumbnail_max_height = 0;
+  priv->thumbnail_dirty_since = 0;
+}
+
+static guint
+get_damage_serial (ClutterActor *actor)
+{
+  ClutterActorIter iter;
+  ClutterActor *child;
+  guint serial;
+
+  serial = meta_surface_actor_get_damage_serial (META_SURFACE_ACTOR (actor));
+
+  /* Wayland subsurfaces */
+  clutter_actor_iter_init (&iter, actor);
+  while (clutter_actor_iter_next (&iter, &child))
+    {
+      if (META_IS_SURFACE_ACTOR (child))
+        serial += get_damage_serial (child);
+    }
+
+  return serial;
+}
+
+/**
+ * meta_window_actor_get_thumbnail_dirty_time:
+ * @self: a #MetaWindowActor
+ *
+ * Returns: the monotonic time since which the thumbnail has been out of
+ *   date, or 0 if it is up to date or no thumbnail was requested
+ */
+gint64
+meta_window_actor_get_thumbnail_dirty_time (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+  guint serial;
+
+  if (priv->thumbnail_max_width == 0 || priv->surface == NULL)
+    return 0;
+
+  serial = get_damage_serial (CLUTTER_ACTOR (priv->surface));
+  if (serial != priv->thumbnail_damage_serial && priv->thumbnail_dirty_since == 0)
+    priv->thumbnail_dirty_since = g_get_monotonic_time ();
+
+  return priv->thumbnail_dirty_since;
+}
+
+static void
+draw_surface_thumbnail (ClutterActor    *actor,
+                        CoglFramebuffer *fb,
+                        float            x,
+                        float            y)
+{
+  ClutterActorIter iter;
+  ClutterActor *child;
+  MetaShapedTexture *stex;
+
+  stex = meta_surface_actor_get_texture (META_SURFACE_ACTOR (actor));
+
+  /* Follow the stacking order of subsurfaces around their parent */
+  clutter_actor_iter_init (&iter, actor);
+  while (clutter_actor_iter_next (&iter, &child))
+    {
+      float child_x, child_y, width, height;
+
+      if (!clutter_actor_is_visible (child))
+        continue;
+
+      clutter_actor_get_position (child, &child_x, &child_y);
+
+      if (child == CLUTTER_ACTOR (stex))
+        {
+          clutter_actor_get_size (child, &width, &height);
+          meta_shaped_texture_draw (stex, fb,
+                                    x + child_x, y + child_y,
+                                    x + child_x + width, y + child_y + height);
+        }
+      else if (META_IS_SURFACE_ACTOR (child))
+        {
+          draw_surface_thumbnail (child, fb, x + child_x, y + child_y);
+        }
+    }
+}
+
+/**
+ * meta_window_actor_update_thumbnail:
+ * @self: a #MetaWindowActor
+ *
+ * Renders the thumbnail requested with meta_window_actor_get_thumbnail()
+ * again.
+ *
+ * Returns: the number of window pixels that were scaled down, as a
+ *   measure of the work done
+ */
+gsize
+meta_window_actor_update_thumbnail (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+  ClutterActor *surface_actor;
+  CoglOffscreen *offscreen;
+  CoglFramebuffer *fb;
+  CoglError *catch_error = NULL;
+  float surface_width, surface_height;
+  double scale;
+  int width, height;
+
+  if (priv->thumbnail_max_width == 0 || priv->surface == NULL)
+    return 0;
+
+  surface_actor = CLUTTER_ACTOR (priv->surface);
+
+  priv->thumbnail_damage_serial = get_damage_serial (surface_actor);
+  priv->thumbnail_dirty_since = 0;
+
+  clutter_actor_get_size (surface_actor, &surface_width, &surface_height);
+  if (surface_width < 1 || surface_height < 1)
+    return 0;
+
+  scale = MIN (priv->thumbnail_max_width / surface_width,
+               priv->thumbnail_max_height / surface_height);
+  scale = MIN (scale, 1.0);
+
+  width = MAX (1, (int) (surface_width * scale));
+  height = MAX (1, (int) (surface_height * scale));
+
+  if (priv->thumbnail == NULL ||
+      cogl_texture_get_width (priv->thumbnail) != width ||
+      cogl_texture_get_height (priv->thumbnail) != height)
+    {
+      g_clear_pointer (&priv->thumbnail, cogl_object_unref);
+      priv->thumbnail = meta_create_texture (width, height,
+                                             COGL_TEXTURE_COMPONENTS_RGBA,
+                                             META_TEXTURE_FLAGS_NONE);
+    }
+
+  offscreen = cogl_offscreen_new_with_texture (priv->thumbnail);
+  fb = COGL_FRAMEBUFFER (offscreen);
+
+  if (!cogl_framebuffer_allocate (fb, &catch_error))
+    {
+      cogl_error_free (catch_error);
+      cogl_object_unref (offscreen);
+      g_clear_pointer (&priv->thumbnail, cogl_object_unref);
+      return 0;
+    }
+
+  /* Draw in surface coordinates, scaled down to the thumbnail */
+  cogl_framebuffer_orthographic (fb, 0, 0, surface_width, surface_height, -1., 1.);
+  cogl_framebuffer_clear4f (fb, COGL_BUFFER_BIT_COLOR, 0, 0, 0, 0);
+
+  draw_surface_thumbnail (surface_actor, fb, 0, 0);
+
+  cogl_object_unref (offscreen);
+
+  g_signal_emit (self, signals[THUMBNAIL_CHANGED], 0);
+
+  return (gsize) surface_width * surface_height;
+}
+
 /**
  * meta_window_actor_get_surface:
  * @self: a #MetaWindowActor
@@ -1294,6 +1569,61 @@ meta_window_actor_sync_actor_geometry (MetaWindowActor *self,
                           window_rect.width, window_rect.height);
 }
 
+/* Subsurfaces are children of the actor of their parent surface */
+static gsize
+release_surface_textures (MetaSurfaceActor *surface)
+{
+  ClutterActor *child;
+  gsize released;
+
+  released = meta_surface_actor_release_texture (surface);
+
+  for (child = clutter_actor_get_first_child (CLUTTER_ACTOR (surface));
+       child != NULL;
+       child = clutter_actor_get_next_sibling (child))
+    {
+      if (META_IS_SURFACE_ACTOR (child))
+        released += release_surface_textures (META_SURFACE_ACTOR (child));
+    }
+
+  return released;
+}
+
+static void
+restore_surface_textures (MetaSurfaceActor *surface)
+{
+  ClutterActor *child;
+
+  meta_surface_actor_restore_texture (surface);
+
+  for (child = clutter_actor_get_first_child (CLUTTER_ACTOR (surface));
+       child != NULL;
+       child = clutter_actor_get_next_sibling (child))
+    {
+      if (META_IS_SURFACE_ACTOR (child))
+        restore_surface_textures (META_SURFACE_ACTOR (child));
+    }
+}
+
+static gsize
+get_surface_texture_memory (MetaSurfaceActor *surface)
+{
+  ClutterActor *child;
+  gsize bytes;
+
+  bytes = meta_shaped_texture_get_memory_usage (meta_surface_actor_get_texture (surface));
+
+  for (child = clutter_actor_get_first_child (CLUTTER_ACTOR (surface));
+       child != NULL;
+       child = clutter_actor_get_next_sibling (child))
+    {
+      if (META_IS_SURFACE_ACTOR (child))
+        bytes += get_surface_texture_memory (META_SURFACE_ACTOR (child));
+    }
+
+  return bytes;
+}
+
 void
 meta_window_actor_show (MetaWindowActor   *self,
                         MetaCompEffect     effect)
@@ -1305,6 +1635,11 @@ meta_window_actor_show (MetaWindowActor   *self,
   g_return_if_fail (!priv->visible);
 
   self->priv->visible = TRUE;
+  priv->hidden_since = 0;
+
+  if (priv->surface)
+    restore_surface_textures (priv->surface);
+  priv->reclaimed_bytes = 0;
 
   switch (effect)
     {
@@ -1339,6 +1674,7 @@ meta_window_actor_hide (MetaWindowActor *self,
   g_return_if_fail (priv->visible);
 
   priv->visible = FALSE;
+  priv->hidden_since = g_get_monotonic_time ();
 
   /* If a plugin is animating a workspace transition, we have to
    * hold off on hiding the window, and do it after the workspace
@@ -1366,6 +1702,88 @@ meta_window_actor_hide (MetaWindowActor *self,
     clutter_actor_hide (CLUTTER_ACTOR (self));
 }
 
+/**
+ * meta_window_actor_get_texture_memory:
+ * @self: a #MetaWindowActor
+ *
+ * Returns: an estimate of the texture memory used by the window contents,
+ *   including subsurfaces, in bytes
+ */
+gsize
+meta_window_actor_get_texture_memory (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+
+  if (priv->surface == NULL)
+    return 0;
+
+  return get_surface_texture_memory (priv->surface);
+}
+
+/**
+ * meta_window_actor_get_reclaimed_memory:
+ * @self: a #MetaWindowActor
+ *
+ * Returns: the texture memory released by
+ *   meta_window_actor_release_textures() since the window was hidden
+ */
+gsize
+meta_window_actor_get_reclaimed_memory (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+
+  /* A Wayland client attaching a new buffer brings the texture back */
+  if (priv->surface == NULL ||
+      !meta_surface_actor_is_texture_released (priv->surface))
+    return 0;
+
+  return priv->reclaimed_bytes;
+}
+
+/**
+ * meta_window_actor_get_hidden_time:
+ * @self: a #MetaWindowActor
+ *
+ * Returns: the time in microseconds since the window was hidden, or 0
+ *   if it is visible
+ */
+gint64
+meta_window_actor_get_hidden_time (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+
+  if (priv->visible || priv->hidden_since == 0)
+    return 0;
+
+  return g_get_monotonic_time () - priv->hidden_since;
+}
+
+/**
+ * meta_window_actor_release_textures:
+ * @self: a #MetaWindowActor
+ *
+ * Drops the textures of a hidden window, keeping only a scaled down copy
+ * of the contents. They are imported again when the window is shown.
+ *
+ * Returns: an estimate of the number of bytes released
+ */
+gsize
+meta_window_actor_release_textures (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+  gsize released;
+
+  if (priv->visible || priv->surface == NULL ||
+      meta_window_actor_is_destroyed (self) ||
+      meta_window_actor_effect_in_progress (self))
+    return 0;
+
+  released = release_surface_textures (priv->surface);
+  priv->reclaimed_bytes += released;
+
+  return released;
+}
+
 void
 meta_window_actor_size_change (MetaWindowActor    *self,
                                MetaSizeChange      which_change,
@@ -1428,6 +1846,10 @@ meta_window_actor_new (MetaWindow *window)
 
   clutter_actor_hide (CLUTTER_ACTOR (self));
 
+  /* Windows mapped minimized or on another workspace are never hidden
+   * through meta_window_actor_hide(); they are hidden from the start */
+  priv->hidden_since = g_get_monotonic_time ();
+
   /* Initial position in the stack is arbitrary; stacking will be synced
    * before we first paint.
    */
@@ -1925,6 +2347,7 @@ meta_window_actor_pre_paint (MetaWindowActor *self)
   meta_window_actor_handle_updates (self);
 
   assign_frame_counter_to_frames (self);
+  assign_frame_counter_to_update (self);
 }
 
 static void
@@ -2024,7 +2447,7 @@ do_send_frame_timings (MetaWindowActor  *self,
     }
 
   ev.data.l[3] = refresh_interval;
-  ev.data.l[4] = 1000 * META_SYNC_DELAY;
+  ev.data.l[4] = 1000 * meta_compositor_get_sync_delay (priv->compositor);
 
   meta_error_trap_push (display);
   XSendEvent (xdisplay, ev.window, False, 0, (XEvent*) &ev);
@@ -2032,23 +2455,54 @@ do_send_frame_timings (MetaWindowActor  *self,
   meta_error_trap_pop (display);
 }
 
-static void
-send_frame_timings (MetaWindowActor  *self,
-                    FrameData        *frame,
-                    CoglFrameInfo    *frame_info,
-                    gint64            presentation_time)
+static int
+get_refresh_interval (CoglFrameInfo *frame_info)
 {
   float refresh_rate;
-  int refresh_interval;
 
   refresh_rate = cogl_frame_info_get_refresh_rate (frame_info);
   /* 0.0 is a flag for not known, but sanity-check against other odd numbers */
   if (refresh_rate >= 1.0)
-    refresh_interval = (int) (0.5 + 1000000 / refresh_rate);
+    return (int) (0.5 + 1000000 / refresh_rate);
   else
-    refresh_interval = 0;
+    return 0;
+}
 
-  do_send_frame_timings (self, frame, refresh_interval, presentation_time);
+static void
+send_frame_timings (MetaWindowActor  *self,
+                    FrameData        *frame,
+                    CoglFrameInfo    *frame_info,
+                    gint64            presentation_time)
+{
+  do_send_frame_timings (self, frame, get_refresh_interval (frame_info),
+                         presentation_time);
+}
+
+static void
+record_frame_timings (MetaWindowActor *self,
+                      CoglFrameInfo   *frame_info,
+                      gint64           presentation_time)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+  gint64 frame_counter = cogl_frame_info_get_frame_counter (frame_info);
+
+  if (priv->timed_frame_counter == -1 ||
+      priv->timed_frame_counter > frame_counter)
+    return;
+
+  /* Without presentation timestamps, completion is the best we know */
+  if (presentation_time == 0)
+    presentation_time = g_get_monotonic_time ();
+
+  if (priv->frame_timings == NULL)
+    priv->frame_timings = meta_frame_timings_new ();
+
+  meta_frame_timings_add_frame (priv->frame_timings,
+                                priv->timed_update_time,
+                                presentation_time,
+                                get_refresh_interval (frame_info));
+
+  priv->timed_frame_counter = -1;
 }
 
 void
@@ -2084,6 +2538,44 @@ meta_window_actor_frame_complete (MetaWindowActor *self,
 
       l = l_next;
     }
+
+  record_frame_timings (self, frame_info, presentation_time);
+}
+
+/**
+ * meta_window_actor_get_frame_stats:
+ * @self: a #MetaWindowActor
+ * @stats: (out caller-allocates): return location for the statistics
+ *
+ * Gets statistics of the most recent frames that presented new contents
+ * of the window, both for X11 and Wayland clients. Updates made while the
+ * window is fully obscured are not counted.
+ */
+void
+meta_window_actor_get_frame_stats (MetaWindowActor *self,
+                                   MetaFrameStats  *stats)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+
+  if (priv->frame_timings)
+    meta_frame_timings_get_stats (priv->frame_timings, stats);
+  else
+    memset (stats, 0, sizeof (MetaFrameStats));
+}
+
+/**
+ * meta_window_actor_reset_frame_stats:
+ * @self: a #MetaWindowActor
+ *
+ * Discards the statistics of the frames presented so far, so that
+ * meta_window_actor_get_frame_stats() only covers frames from now on.
+ */
+void
+meta_window_actor_reset_frame_stats (MetaWindowActor *self)
+{
+  MetaWindowActorPrivate *priv = self->priv;
+
+  g_clear_pointer (&priv->frame_timings, meta_frame_timings_free);
 }
 
 void
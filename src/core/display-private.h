@@ -36,6 +36,7 @@
 #include <meta/display.h>
 #include "keybindings-private.h"
 #include "meta-gesture-tracker-private.h"
+#include "meta-input-recording.h"
 #include <meta/prefs.h>
 #include <meta/barrier.h>
 #include <clutter/clutter.h>
@@ -261,6 +262,10 @@ struct _MetaDisplay
   MetaGestureTracker *gesture_tracker;
   ClutterEventSequence *pointer_emulating_sequence;
 
+  /* Managed by events.c */
+  MetaInputRecorder *input_recorder;
+  MetaInputReplay *input_replay;
+
   MetaAlarmFilter alarm_filter;
   gpointer alarm_filter_data;
 
@@ -23,6 +23,8 @@
 #include "config.h"
 #include "events.h"
 
+#include <stdlib.h>
+
 #include <meta/meta-backend.h>
 
 #include "display-private.h"
@@ -371,8 +373,68 @@ event_callback (const ClutterEvent *event,
                 gpointer            data)
 {
   MetaDisplay *display = data;
+  gboolean bypass_clutter;
+
+  if (display->input_recorder)
+    meta_input_recorder_record_event (display->input_recorder, event);
+
+  bypass_clutter = meta_display_handle_event (display, event);
+
+  if (display->input_replay)
+    meta_input_replay_event_handled (display->input_replay, event);
 
-  return meta_display_handle_event (display, event);
+  return bypass_clutter;
+}
+
+/* META_INPUT_RECORD names a file to record input events to.
+ * META_INPUT_REPLAY names a recording to replay, META_INPUT_REPLAY_SPEED
+ * how much faster than recorded, META_INPUT_REPLAY_DELAY how many
+ * milliseconds to wait before starting, and META_INPUT_REPLAY_REPORT a
+ * file to write the latency of every replayed event to.
+ */
+static void
+init_input_recording (MetaDisplay *display)
+{
+  const char *record_path = g_getenv ("META_INPUT_RECORD");
+  const char *replay_path = g_getenv ("META_INPUT_REPLAY");
+  GError *error = NULL;
+
+  if (record_path)
+    {
+      display->input_recorder = meta_input_recorder_new (record_path, &error);
+      if (!display->input_recorder)
+        {
+          meta_warning ("Failed to record input events: %s\n", error->message);
+          g_clear_error (&error);
+        }
+    }
+
+  if (replay_path)
+    {
+      const char *speed_str = g_getenv ("META_INPUT_REPLAY_SPEED");
+      const char *delay_str = g_getenv ("META_INPUT_REPLAY_DELAY");
+      double speed = speed_str ? g_ascii_strtod (speed_str, NULL) : 1.0;
+      guint delay_ms = delay_str ? atoi (delay_str) : 1000;
+
+      if (speed <= 0)
+        {
+          meta_warning ("Invalid input replay speed %s\n", speed_str);
+          speed = 1.0;
+        }
+
+      display->input_replay = meta_input_replay_new (replay_path,
+                                                     g_getenv ("META_INPUT_REPLAY_REPORT"),
+                                                     speed, &error);
+      if (display->input_replay)
+        {
+          meta_input_replay_start (display->input_replay, delay_ms);
+        }
+      else
+        {
+          meta_warning ("Failed to replay input events: %s\n", error->message);
+          g_clear_error (&error);
+        }
+    }
 }
 
 void
@@ -382,6 +444,8 @@ meta_display_init_events (MetaDisplay *display)
                                                             event_callback,
                                                             NULL,
                                                             display);
+
+  init_input_recording (display);
 }
 
 void
@@ -389,4 +453,7 @@ meta_display_free_events (MetaDisplay *display)
 {
   clutter_event_remove_filter (display->clutter_event_filter);
   display->clutter_event_filter = 0;
+
+  g_clear_pointer (&display->input_recorder, meta_input_recorder_free);
+  g_clear_pointer (&display->input_replay, meta_input_replay_free);
 }
@@ -172,6 +172,9 @@ static gboolean  opt_wayland;
 #ifdef HAVE_NATIVE_BACKEND
 static gboolean  opt_display_server;
 #endif
+#if defined(HAVE_WAYLAND) && defined(HAVE_NATIVE_BACKEND)
+static gboolean  opt_headless;
+#endif
 
 static GOptionEntry meta_options[] = {
   {
@@ -223,6 +226,13 @@ static GOptionEntry meta_options[] = {
     &opt_display_server,
     N_("Run as a full display server, rather than nested")
   },
+#endif
+#if defined(HAVE_WAYLAND) && defined(HAVE_NATIVE_BACKEND)
+  {
+    "headless", 0, 0, G_OPTION_ARG_NONE,
+    &opt_headless,
+    N_("Run as a headless display server, without a session or input devices")
+  },
 #endif
   {NULL}
 };
@@ -367,20 +377,25 @@ static void
 init_backend (void)
 {
   gboolean session_type_is_wayland = FALSE;
+  gboolean headless = FALSE;
 
 #if defined(HAVE_WAYLAND) && defined(HAVE_NATIVE_BACKEND)
-  session_type_is_wayland = check_for_wayland_session_type ();
+  headless = opt_headless;
+  if (!headless)
+    session_type_is_wayland = check_for_wayland_session_type ();
 #endif
 
 #if defined(CLUTTER_WINDOWING_EGL) && defined(HAVE_NATIVE_BACKEND)
-  if (opt_display_server || session_type_is_wayland)
+  if (opt_display_server || headless || session_type_is_wayland)
     clutter_set_windowing_backend (CLUTTER_WINDOWING_EGL);
   else
 #endif
     clutter_set_windowing_backend (CLUTTER_WINDOWING_X11);
 
+  meta_set_is_headless (headless);
+
 #ifdef HAVE_WAYLAND
-  meta_set_is_wayland_compositor (opt_wayland || session_type_is_wayland);
+  meta_set_is_wayland_compositor (opt_wayland || headless || session_type_is_wayland);
 #endif
 }
 
@@ -442,7 +457,8 @@ meta_init (void)
   meta_clutter_init ();
 
 #ifdef HAVE_WAYLAND
-  /* Bring up Wayland. This also launches Xwayland and sets DISPLAY as well... */
+  /* Bring up Wayland. This also sets DISPLAY for the Xwayland launched
+   * by meta_wayland_pre_clutter_init()... */
   if (meta_is_wayland_compositor ())
     meta_wayland_init ();
 #endif
@@ -457,6 +473,13 @@ meta_init (void)
 
   meta_main_loop = g_main_loop_new (NULL, FALSE);
 
+#ifdef HAVE_WAYLAND
+  /* Xwayland was initializing in the meantime, along with the backend
+   * and the Wayland globals; GTK+ is the first to connect to it */
+  if (meta_is_wayland_compositor ())
+    meta_wayland_wait_for_xwayland ();
+#endif
+
   meta_ui_init ();
 
   meta_restart_init ();
@@ -0,0 +1,631 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaInputRecorder, MetaInputReplay
+ *
+ * Recording of the input events handled by Mutter, and replay of the
+ * recordings with latency measurements
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The recorder writes the pointer, keyboard, scroll and touch events
+ * reaching the display's event filter to a file. The replay injects the
+ * events of such a file into the stage with the core devices, at the
+ * recorded pace or faster, and follows each of them:
+ *
+ *  - to the moment Mutter has handled it, including handing it to
+ *    Wayland clients (the dispatch latency);
+ *  - to the presentation of the first frame painted after that (the
+ *    present latency). Redraws done by clients in response can't be told
+ *    apart from other updates, so this measures Mutter's own part of the
+ *    input latency: the cursor, and window moves and resizes.
+ *
+ * Injected events are recognized when handled by their type and time,
+ * which is set to the time of injection. Clutter merges queued motion
+ * events, so an injected event that isn't seen is taken as merged into
+ * the next one that is.
+ */
+
+#include <config.h>
+
+#include "meta-input-recording.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <gio/gio.h>
+
+#include <meta/util.h>
+#include "backends/meta-backend-private.h"
+
+/* How long to wait after injecting the last event for it to be presented */
+#define FINISH_TIMEOUT_MS 1000
+
+struct _MetaInputRecorder
+{
+  FILE *file;
+  gint64 start_time;
+
+  /* ClutterEventSequence → slot + 1 */
+  GHashTable *touch_slots;
+  guint32 next_touch_slot;
+};
+
+typedef struct
+{
+  guint32 time;
+  gint64 inject_time;
+  gint64 handled_time;
+  gint64 frame_counter;
+  gint64 presentation_time;
+} ReplayResult;
+
+struct _MetaInputReplay
+{
+  char *contents;
+  const MetaInputRecord *records;
+  guint n_records;
+  ReplayResult *results;
+
+  char *report_path;
+  double speed;
+
+  ClutterStage *stage;
+  ClutterInputDevice *pointer;
+  ClutterInputDevice *keyboard;
+
+  GSource *source;
+  guint finish_id;
+  gint64 start_time;
+  guint next_record;
+
+  /* Indices of records injected but not handled yet, handled but not
+   * painted yet, and painted but not presented yet */
+  GQueue unhandled;
+  GQueue unpainted;
+  GQueue unpresented;
+};
+
+static gboolean
+is_key_event (ClutterEventType type)
+{
+  return type == CLUTTER_KEY_PRESS || type == CLUTTER_KEY_RELEASE;
+}
+
+/**
+ * meta_input_recorder_new: (skip)
+ * @path: the file to record to
+ * @error: return location for an error
+ *
+ * Returns: a new #MetaInputRecorder, or %NULL if @path can't be written
+ */
+MetaInputRecorder *
+meta_input_recorder_new (const char  *path,
+                         GError     **error)
+{
+  MetaInputRecorder *recorder;
+  MetaInputRecordingHeader header = { { 0 } };
+  FILE *file;
+
+  file = fopen (path, "wb");
+  if (file == NULL)
+    {
+      int errsv = errno;
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                   "Failed to open %s: %s", path, g_strerror (errsv));
+      return NULL;
+    }
+
+  memcpy (header.magic, META_INPUT_RECORDING_MAGIC, sizeof (header.magic));
+  header.version = META_INPUT_RECORDING_VERSION;
+  header.record_size = sizeof (MetaInputRecord);
+  fwrite (&header, sizeof (header), 1, file);
+
+  recorder = g_new0 (MetaInputRecorder, 1);
+  recorder->file = file;
+  recorder->start_time = -1;
+  recorder->touch_slots = g_hash_table_new (NULL, NULL);
+
+  return recorder;
+}
+
+void
+meta_input_recorder_free (MetaInputRecorder *recorder)
+{
+  fclose (recorder->file);
+  g_hash_table_destroy (recorder->touch_slots);
+  g_free (recorder);
+}
+
+static guint32
+get_touch_slot (MetaInputRecorder  *recorder,
+                const ClutterEvent *event)
+{
+  ClutterEventSequence *sequence = clutter_event_get_event_sequence (event);
+  guint32 slot;
+
+  slot = GPOINTER_TO_UINT (g_hash_table_lookup (recorder->touch_slots, sequence));
+  if (slot == 0)
+    {
+      slot = ++recorder->next_touch_slot;
+      g_hash_table_insert (recorder->touch_slots, sequence, GUINT_TO_POINTER (slot));
+    }
+
+  if (event->type == CLUTTER_TOUCH_END || event->type == CLUTTER_TOUCH_CANCEL)
+    g_hash_table_remove (recorder->touch_slots, sequence);
+
+  return slot - 1;
+}
+
+/**
+ * meta_input_recorder_record_event: (skip)
+ * @recorder: a #MetaInputRecorder
+ * @event: an event about to be handled
+ *
+ * Appends @event to the recording, if it is of a type that can be
+ * replayed.
+ */
+void
+meta_input_recorder_record_event (MetaInputRecorder  *recorder,
+                                  const ClutterEvent *event)
+{
+  MetaInputRecord record = { 0 };
+  gint64 now = g_get_monotonic_time ();
+  gdouble dx, dy;
+
+  switch (event->type)
+    {
+    case CLUTTER_MOTION:
+      break;
+    case CLUTTER_BUTTON_PRESS:
+    case CLUTTER_BUTTON_RELEASE:
+      record.detail = clutter_event_get_button (event);
+      break;
+    case CLUTTER_KEY_PRESS:
+    case CLUTTER_KEY_RELEASE:
+      record.detail = clutter_event_get_key_code (event);
+      record.keyval = clutter_event_get_key_symbol (event);
+      record.unicode = clutter_event_get_key_unicode (event);
+      break;
+    case CLUTTER_SCROLL:
+      record.detail = clutter_event_get_scroll_direction (event);
+      if (record.detail == CLUTTER_SCROLL_SMOOTH)
+        {
+          clutter_event_get_scroll_delta (event, &dx, &dy);
+          record.dx = dx;
+          record.dy = dy;
+        }
+      break;
+    case CLUTTER_TOUCH_BEGIN:
+    case CLUTTER_TOUCH_UPDATE:
+    case CLUTTER_TOUCH_END:
+    case CLUTTER_TOUCH_CANCEL:
+      record.detail = get_touch_slot (recorder, event);
+      break;
+    default:
+      return;
+    }
+
+  if (recorder->start_time < 0)
+    recorder->start_time = now;
+
+  record.type = event->type;
+  record.time = clutter_event_get_time (event);
+  record.offset = now - recorder->start_time;
+  record.modifier_state = clutter_event_get_state (event);
+
+  if (!is_key_event (event->type))
+    clutter_event_get_coords (event, &record.x, &record.y);
+
+  fwrite (&record, sizeof (record), 1, recorder->file);
+}
+
+/**
+ * meta_input_replay_new: (skip)
+ * @path: a file written by #MetaInputRecorder
+ * @report_path: (allow-none): a file to write the latency of every event to
+ * @speed: how much faster than recorded to replay the events
+ * @error: return location for an error
+ *
+ * Returns: a new #MetaInputReplay, or %NULL if @path isn't a recording
+ */
+MetaInputReplay *
+meta_input_replay_new (const char  *path,
+                       const char  *report_path,
+                       double       speed,
+                       GError     **error)
+{
+  MetaInputReplay *replay;
+  MetaInputRecordingHeader header;
+  ClutterDeviceManager *manager;
+  char *contents;
+  gsize length;
+
+  if (!g_file_get_contents (path, &contents, &length, error))
+    return NULL;
+
+  if (length < sizeof (header))
+    goto invalid;
+
+  memcpy (&header, contents, sizeof (header));
+  if (memcmp (header.magic, META_INPUT_RECORDING_MAGIC, sizeof (header.magic)) != 0 ||
+      header.version != META_INPUT_RECORDING_VERSION ||
+      header.record_size != sizeof (MetaInputRecord) ||
+      (length - sizeof (header)) % sizeof (MetaInputRecord) != 0)
+    goto invalid;
+
+  manager = clutter_device_manager_get_default ();
+
+  replay = g_new0 (MetaInputReplay, 1);
+  replay->contents = contents;
+  replay->records = (const MetaInputRecord *) (contents + sizeof (header));
+  replay->n_records = (length - sizeof (header)) / sizeof (MetaInputRecord);
+  replay->results = g_new0 (ReplayResult, replay->n_records);
+  replay->report_path = g_strdup (report_path);
+  replay->speed = speed;
+  replay->stage = CLUTTER_STAGE (meta_backend_get_stage (meta_get_backend ()));
+  replay->pointer = clutter_device_manager_get_core_device (manager, CLUTTER_POINTER_DEVICE);
+  replay->keyboard = clutter_device_manager_get_core_device (manager, CLUTTER_KEYBOARD_DEVICE);
+  g_queue_init (&replay->unhandled);
+  g_queue_init (&replay->unpainted);
+  g_queue_init (&replay->unpresented);
+
+  return replay;
+
+ invalid:
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+               "%s is not an input recording of this version", path);
+  g_free (contents);
+  return NULL;
+}
+
+void
+meta_input_replay_free (MetaInputReplay *replay)
+{
+  if (replay->source)
+    g_source_destroy (replay->source);
+  if (replay->finish_id)
+    g_source_remove (replay->finish_id);
+
+  g_queue_clear (&replay->unhandled);
+  g_queue_clear (&replay->unpainted);
+  g_queue_clear (&replay->unpresented);
+
+  g_free (replay->report_path);
+  g_free (replay->results);
+  g_free (replay->contents);
+  g_free (replay);
+}
+
+static void
+inject_record (MetaInputReplay *replay,
+               guint            index,
+               gint64           now)
+{
+  const MetaInputRecord *record = &replay->records[index];
+  ReplayResult *result = &replay->results[index];
+  ClutterInputDevice *device;
+  ClutterEvent *event;
+
+  device = is_key_event (record->type) ? replay->keyboard : replay->pointer;
+
+  event = clutter_event_new (record->type);
+  clutter_event_set_device (event, device);
+  clutter_event_set_source_device (event, device);
+  clutter_event_set_stage (event, replay->stage);
+  clutter_event_set_state (event, record->modifier_state);
+
+  switch (record->type)
+    {
+    case CLUTTER_BUTTON_PRESS:
+    case CLUTTER_BUTTON_RELEASE:
+      clutter_event_set_button (event, record->detail);
+      break;
+    case CLUTTER_KEY_PRESS:
+    case CLUTTER_KEY_RELEASE:
+      clutter_event_set_key_code (event, record->detail);
+      clutter_event_set_key_symbol (event, record->keyval);
+      clutter_event_set_key_unicode (event, record->unicode);
+      break;
+    case CLUTTER_SCROLL:
+      clutter_event_set_scroll_direction (event, record->detail);
+      if (record->detail == CLUTTER_SCROLL_SMOOTH)
+        clutter_event_set_scroll_delta (event, record->dx, record->dy);
+      break;
+    case CLUTTER_TOUCH_BEGIN:
+    case CLUTTER_TOUCH_UPDATE:
+    case CLUTTER_TOUCH_END:
+    case CLUTTER_TOUCH_CANCEL:
+      event->touch.sequence = GUINT_TO_POINTER (record->detail + 1);
+      break;
+    default:
+      break;
+    }
+
+  if (!is_key_event (record->type))
+    clutter_event_set_coords (event, record->x, record->y);
+
+  result->time = (guint32) (now / 1000);
+  result->inject_time = now;
+  result->handled_time = -1;
+  result->frame_counter = -1;
+  result->presentation_time = -1;
+  clutter_event_set_time (event, result->time);
+
+  g_queue_push_tail (&replay->unhandled, GUINT_TO_POINTER (index));
+
+  /* Queued on the stage, and handled on the next frame clock tick */
+  clutter_do_event (event);
+  clutter_event_free (event);
+}
+
+static gint64
+get_percentile (GArray *values,
+                int     percentile)
+{
+  if (values->len == 0)
+    return -1;
+
+  return g_array_index (values, gint64, (values->len - 1) * percentile / 100);
+}
+
+static int
+compare_latencies (gconstpointer a,
+                   gconstpointer b)
+{
+  gint64 la = *(const gint64 *) a;
+  gint64 lb = *(const gint64 *) b;
+
+  return (la > lb) - (la < lb);
+}
+
+static void
+write_report (MetaInputReplay *replay)
+{
+  FILE *file;
+  guint i;
+
+  file = fopen (replay->report_path, "w");
+  if (file == NULL)
+    {
+      meta_warning ("Failed to write input replay report to %s: %s\n",
+                    replay->report_path, g_strerror (errno));
+      return;
+    }
+
+  fprintf (file, "# event type offset-us dispatch-us present-us\n");
+  for (i = 0; i < replay->n_records; i++)
+    {
+      ReplayResult *result = &replay->results[i];
+
+      fprintf (file, "%u %u %" G_GUINT64_FORMAT " %" G_GINT64_FORMAT " %" G_GINT64_FORMAT "\n",
+               i, replay->records[i].type, replay->records[i].offset,
+               result->handled_time < 0 ? -1 : result->handled_time - result->inject_time,
+               result->presentation_time < 0 ? -1 : result->presentation_time - result->inject_time);
+    }
+
+  fclose (file);
+}
+
+static gboolean
+finish_replay (gpointer data)
+{
+  MetaInputReplay *replay = data;
+  GArray *dispatch, *present;
+  guint i;
+
+  replay->finish_id = 0;
+
+  dispatch = g_array_new (FALSE, FALSE, sizeof (gint64));
+  present = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  for (i = 0; i < replay->n_records; i++)
+    {
+      ReplayResult *result = &replay->results[i];
+      gint64 latency;
+
+      if (result->handled_time >= 0)
+        {
+          latency = result->handled_time - result->inject_time;
+          g_array_append_val (dispatch, latency);
+        }
+      if (result->presentation_time >= 0)
+        {
+          latency = result->presentation_time - result->inject_time;
+          g_array_append_val (present, latency);
+        }
+    }
+
+  g_array_sort (dispatch, compare_latencies);
+  g_array_sort (present, compare_latencies);
+
+  g_message ("Replayed %u input events. Dispatch latency (us): "
+             "median %" G_GINT64_FORMAT ", 95%% %" G_GINT64_FORMAT ", max %" G_GINT64_FORMAT "; "
+             "present latency (us) of %u presented: "
+             "median %" G_GINT64_FORMAT ", 95%% %" G_GINT64_FORMAT ", max %" G_GINT64_FORMAT,
+             replay->n_records,
+             get_percentile (dispatch, 50), get_percentile (dispatch, 95),
+             get_percentile (dispatch, 100),
+             present->len,
+             get_percentile (present, 50), get_percentile (present, 95),
+             get_percentile (present, 100));
+
+  if (replay->report_path)
+    write_report (replay);
+
+  g_array_free (dispatch, TRUE);
+  g_array_free (present, TRUE);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+inject_due_records (gpointer data)
+{
+  MetaInputReplay *replay = data;
+  gint64 now = g_get_monotonic_time ();
+
+  while (replay->next_record < replay->n_records)
+    {
+      const MetaInputRecord *record = &replay->records[replay->next_record];
+      gint64 due = replay->start_time + (gint64) (record->offset / replay->speed);
+
+      if (due > now)
+        {
+          g_source_set_ready_time (replay->source, due);
+          return G_SOURCE_CONTINUE;
+        }
+
+      inject_record (replay, replay->next_record, now);
+      replay->next_record++;
+    }
+
+  replay->source = NULL;
+  replay->finish_id = g_timeout_add (FINISH_TIMEOUT_MS, finish_replay, replay);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+replay_source_dispatch (GSource     *source,
+                        GSourceFunc  callback,
+                        gpointer     user_data)
+{
+  return callback (user_data);
+}
+
+static GSourceFuncs replay_source_funcs = {
+  NULL,
+  NULL,
+  replay_source_dispatch,
+  NULL,
+};
+
+/**
+ * meta_input_replay_start: (skip)
+ * @replay: a #MetaInputReplay
+ * @delay_ms: time to wait before the first event
+ *
+ * Starts injecting the recorded events. Once done, a summary of the
+ * latencies is logged and the report is written.
+ */
+void
+meta_input_replay_start (MetaInputReplay *replay,
+                         guint            delay_ms)
+{
+  g_return_if_fail (replay->source == NULL && replay->next_record == 0);
+
+  replay->start_time = g_get_monotonic_time () + delay_ms * 1000;
+
+  replay->source = g_source_new (&replay_source_funcs, sizeof (GSource));
+  g_source_set_callback (replay->source, inject_due_records, replay, NULL);
+  g_source_set_ready_time (replay->source, replay->start_time);
+  g_source_attach (replay->source, NULL);
+  g_source_unref (replay->source);
+}
+
+/**
+ * meta_input_replay_event_handled: (skip)
+ * @replay: a #MetaInputReplay
+ * @event: an event Mutter is done handling
+ *
+ * Records the dispatch time of @event if it was injected by @replay, and
+ * of the injected events merged into it.
+ */
+void
+meta_input_replay_event_handled (MetaInputReplay    *replay,
+                                 const ClutterEvent *event)
+{
+  guint32 time = clutter_event_get_time (event);
+  gint64 now;
+  guint last, index;
+  GList *l;
+
+  for (l = replay->unhandled.head; l; l = l->next)
+    {
+      index = GPOINTER_TO_UINT (l->data);
+
+      if (replay->records[index].type == (uint32_t) event->type &&
+          replay->results[index].time == time)
+        break;
+    }
+
+  if (l == NULL)
+    return;
+
+  now = g_get_monotonic_time ();
+  last = index;
+
+  do
+    {
+      index = GPOINTER_TO_UINT (g_queue_pop_head (&replay->unhandled));
+      replay->results[index].handled_time = now;
+      g_queue_push_tail (&replay->unpainted, GUINT_TO_POINTER (index));
+    }
+  while (index != last);
+}
+
+/**
+ * meta_input_replay_before_paint: (skip)
+ * @replay: a #MetaInputReplay
+ * @onscreen: the onscreen framebuffer about to be painted
+ *
+ * Assigns the events handled so far to the frame about to be painted.
+ */
+void
+meta_input_replay_before_paint (MetaInputReplay *replay,
+                                CoglOnscreen    *onscreen)
+{
+  gint64 frame_counter = cogl_onscreen_get_frame_counter (onscreen);
+
+  while (!g_queue_is_empty (&replay->unpainted))
+    {
+      guint index = GPOINTER_TO_UINT (g_queue_pop_head (&replay->unpainted));
+
+      replay->results[index].frame_counter = frame_counter;
+      g_queue_push_tail (&replay->unpresented, GUINT_TO_POINTER (index));
+    }
+}
+
+/**
+ * meta_input_replay_frame_complete: (skip)
+ * @replay: a #MetaInputReplay
+ * @frame_info: the #CoglFrameInfo of the presented frame
+ * @presentation_time: its presentation time, or 0 if unknown
+ *
+ * Records the presentation time of the events painted up to the frame.
+ */
+void
+meta_input_replay_frame_complete (MetaInputReplay *replay,
+                                  CoglFrameInfo   *frame_info,
+                                  gint64           presentation_time)
+{
+  gint64 frame_counter = cogl_frame_info_get_frame_counter (frame_info);
+
+  if (presentation_time == 0)
+    presentation_time = g_get_monotonic_time ();
+
+  while (!g_queue_is_empty (&replay->unpresented))
+    {
+      guint index = GPOINTER_TO_UINT (g_queue_peek_head (&replay->unpresented));
+      ReplayResult *result = &replay->results[index];
+
+      if (result->frame_counter > frame_counter)
+        break;
+
+      result->presentation_time = presentation_time;
+      g_queue_pop_head (&replay->unpresented);
+    }
+}
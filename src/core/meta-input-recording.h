@@ -0,0 +1,91 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*- */
+/*
+ * MetaInputRecorder, MetaInputReplay
+ *
+ * Recording of the input events handled by Mutter, and replay of the
+ * recordings with latency measurements
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef META_INPUT_RECORDING_H
+#define META_INPUT_RECORDING_H
+
+#include <stdint.h>
+#include <clutter/clutter.h>
+
+/*
+ * File format
+ *
+ * A MetaInputRecordingHeader followed by MetaInputRecord structures, one
+ * per event, in host byte order. Event types and modifier states are
+ * the ClutterEventType and ClutterModifierType values of the Clutter
+ * version that made the recording.
+ */
+
+#define META_INPUT_RECORDING_MAGIC "MTRINPUT"
+#define META_INPUT_RECORDING_VERSION 1
+
+typedef struct
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+} MetaInputRecordingHeader;
+
+typedef struct
+{
+  uint32_t type;
+  /* The event time, in milliseconds */
+  uint32_t time;
+  /* When the event reached Mutter, in microseconds since the first one */
+  uint64_t offset;
+  uint32_t modifier_state;
+  /* Button, hardware keycode, scroll direction or touch slot */
+  uint32_t detail;
+  uint32_t keyval;
+  uint32_t unicode;
+  float x, y;
+  /* Smooth scroll deltas */
+  float dx, dy;
+} MetaInputRecord;
+
+typedef struct _MetaInputRecorder MetaInputRecorder;
+typedef struct _MetaInputReplay MetaInputReplay;
+
+MetaInputRecorder *meta_input_recorder_new  (const char         *path,
+                                             GError            **error);
+void               meta_input_recorder_free (MetaInputRecorder  *recorder);
+
+void meta_input_recorder_record_event (MetaInputRecorder  *recorder,
+                                       const ClutterEvent *event);
+
+MetaInputReplay *meta_input_replay_new  (const char       *path,
+                                         const char       *report_path,
+                                         double            speed,
+                                         GError          **error);
+void             meta_input_replay_free (MetaInputReplay  *replay);
+
+void meta_input_replay_start (MetaInputReplay *replay,
+                              guint            delay_ms);
+
+void meta_input_replay_event_handled  (MetaInputReplay    *replay,
+                                       const ClutterEvent *event);
+void meta_input_replay_before_paint   (MetaInputReplay    *replay,
+                                       CoglOnscreen       *onscreen);
+void meta_input_replay_frame_complete (MetaInputReplay    *replay,
+                                       CoglFrameInfo      *frame_info,
+                                       gint64              presentation_time);
+
+#endif /* META_INPUT_RECORDING_H */
@@ -81,6 +81,7 @@ static GDesktopFocusMode focus_mode = G_DESKTOP_FOCUS_MODE_CLICK;
 static GDesktopFocusNewWindows focus_new_windows = G_DESKTOP_FOCUS_NEW_WINDOWS_SMART;
 static gboolean raise_on_click = TRUE;
 static gboolean center_new_windows = FALSE;
+static gboolean coalesce_pointer_motion = FALSE;
 static gboolean attach_modal_dialogs = FALSE;
 static int num_workspaces = 4;
 static GDesktopTitlebarAction action_double_click_titlebar = G_DESKTOP_TITLEBAR_ACTION_TOGGLE_MAXIMIZE;
@@ -103,6 +104,8 @@ static char *cursor_theme = NULL;
 static int   cursor_size = 24;
 static int   draggable_border_width = 10;
 static int   drag_threshold;
+static int   texture_reclaim_timeout = 300;
+static int   texture_memory_budget = 512;
 static gboolean resize_with_right_button = FALSE;
 static gboolean edge_tiling = FALSE;
 static gboolean force_fullscreen = TRUE;
@@ -296,6 +299,13 @@ static MetaBoolPreference preferences_bool[] =
       },
       &center_new_windows,
     },
+    {
+      { "coalesce-pointer-motion",
+        SCHEMA_MUTTER,
+        META_PREF_COALESCE_POINTER_MOTION,
+      },
+      &coalesce_pointer_motion,
+    },
     {
       { "raise-on-click",
         SCHEMA_GENERAL,
@@ -493,6 +503,20 @@ static MetaIntPreference preferences_int[] =
       },
       &drag_threshold
     },
+    {
+      { "texture-reclaim-timeout",
+        SCHEMA_MUTTER,
+        META_PREF_TEXTURE_RECLAIM_TIMEOUT,
+      },
+      &texture_reclaim_timeout
+    },
+    {
+      { "texture-memory-budget",
+        SCHEMA_MUTTER,
+        META_PREF_TEXTURE_MEMORY_BUDGET,
+      },
+      &texture_memory_budget
+    },
     { { NULL, 0, 0 }, NULL },
   };
 
@@ -1327,6 +1351,12 @@ meta_prefs_get_center_new_windows (void)
   return center_new_windows;
 }
 
+gboolean
+meta_prefs_get_coalesce_pointer_motion (void)
+{
+  return coalesce_pointer_motion;
+}
+
 gboolean
 meta_prefs_get_attach_modal_dialogs (void)
 {
@@ -1851,6 +1881,15 @@ meta_preference_to_string (MetaPreference pref)
 
     case META_PREF_AUTO_MAXIMIZE:
       return "AUTO_MAXIMIZE";
+
+    case META_PREF_TEXTURE_RECLAIM_TIMEOUT:
+      return "TEXTURE_RECLAIM_TIMEOUT";
+
+    case META_PREF_TEXTURE_MEMORY_BUDGET:
+      return "TEXTURE_MEMORY_BUDGET";
+
+    case META_PREF_COALESCE_POINTER_MOTION:
+      return "COALESCE_POINTER_MOTION";
     }
 
   return "(unknown)";
@@ -2288,6 +2327,18 @@ meta_prefs_get_drag_threshold (void)
   return drag_threshold;
 }
 
+int
+meta_prefs_get_texture_reclaim_timeout (void)
+{
+  return texture_reclaim_timeout;
+}
+
+int
+meta_prefs_get_texture_memory_budget (void)
+{
+  return texture_memory_budget;
+}
+
 void
 meta_prefs_set_force_fullscreen (gboolean whether)
 {
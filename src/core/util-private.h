@@ -34,4 +34,11 @@ void     meta_set_syncing (gboolean setting);
 void     meta_set_replace_current_wm (gboolean setting);
 void     meta_set_is_wayland_compositor (gboolean setting);
 
+gboolean meta_is_headless (void);
+void     meta_set_is_headless (gboolean setting);
+
+int      meta_create_anonymous_file (const char  *name,
+                                     gsize        size,
+                                     GError     **error);
+
 #endif
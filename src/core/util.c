@@ -38,7 +38,9 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
+#include <sys/syscall.h>
 #include <X11/Xlib.h>   /* must explicitly be included for Solaris; #326746 */
 #include <X11/Xutil.h>  /* Just for the definition of the various gravities */
 
@@ -54,6 +56,7 @@ static gboolean is_debugging = FALSE;
 static gboolean replace_current = FALSE;
 static int no_prefix = 0;
 static gboolean is_wayland_compositor = FALSE;
+static gboolean is_headless = FALSE;
 
 #ifdef WITH_VERBOSE_MODE
 static FILE* logfile = NULL;
@@ -205,6 +208,18 @@ meta_set_is_wayland_compositor (gboolean value)
   is_wayland_compositor = value;
 }
 
+gboolean
+meta_is_headless (void)
+{
+  return is_headless;
+}
+
+void
+meta_set_is_headless (gboolean value)
+{
+  is_headless = value;
+}
+
 char *
 meta_g_utf8_strndup (const gchar *src,
                      gsize        n)
@@ -960,5 +975,71 @@ meta_get_locale_direction (void)
     }
 }
 
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+/**
+ * meta_create_anonymous_file:
+ * @name: a name for the file, for debugging purposes
+ * @size: the size of the file
+ * @error: return location for a #GError
+ *
+ * Creates a file that only lives in memory, to be shared with other
+ * processes by passing the file descriptor. If available, a memfd is
+ * used, which allows sealing the file; otherwise an unlinked temporary
+ * file.
+ *
+ * Returns: a close-on-exec file descriptor, or -1 on error
+ */
+int
+meta_create_anonymous_file (const char  *name,
+                            gsize        size,
+                            GError     **error)
+{
+  int fd = -1;
+
+#ifdef __NR_memfd_create
+  fd = syscall (__NR_memfd_create, name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#endif
+
+  if (fd == -1)
+    {
+      char *template, *path;
+      int flags;
+
+      template = g_strdup_printf ("%s-XXXXXX", name);
+      fd = g_file_open_tmp (template, &path, error);
+      g_free (template);
+
+      if (fd == -1)
+        return -1;
+
+      unlink (path);
+      g_free (path);
+
+      flags = fcntl (fd, F_GETFD);
+      if (flags == -1 || fcntl (fd, F_SETFD, flags | FD_CLOEXEC) == -1)
+        goto err;
+    }
+
+  if (ftruncate (fd, size) < 0)
+    goto err;
+
+  return fd;
+
+ err:
+  g_set_error_literal (error,
+                       G_FILE_ERROR,
+                       g_file_error_from_errno (errno),
+                       strerror (errno));
+  close (fd);
+
+  return -1;
+}
+
 /* eof util.c */
 
@@ -41,6 +41,8 @@ ClutterActor *meta_get_feedback_group_for_screen (MetaScreen *screen);
 
 void        meta_disable_unredirect_for_screen  (MetaScreen *screen);
 void        meta_enable_unredirect_for_screen   (MetaScreen *screen);
+MetaWindow *meta_get_unredirected_window_for_monitor (MetaScreen *screen,
+                                                      int         monitor);
 
 void meta_set_stage_input_region     (MetaScreen    *screen,
                                       XserverRegion  region);
@@ -70,6 +70,10 @@ GType meta_background_image_cache_get_type (void);
 
 MetaBackgroundImage *meta_background_image_cache_load  (MetaBackgroundImageCache *cache,
                                                         GFile                    *file);
+MetaBackgroundImage *meta_background_image_cache_load_for_size (MetaBackgroundImageCache *cache,
+                                                                GFile                    *file,
+                                                                int                       width,
+                                                                int                       height);
 void                 meta_background_image_cache_purge (MetaBackgroundImageCache *cache,
                                                         GFile                    *file);
 
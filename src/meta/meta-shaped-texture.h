@@ -25,6 +25,7 @@
 #define __META_SHAPED_TEXTURE_H__
 
 #include <clutter/clutter.h>
+#include <gio/gio.h>
 #include <X11/Xlib.h>
 
 G_BEGIN_DECLS
@@ -81,6 +82,16 @@ void meta_shaped_texture_set_opaque_region (MetaShapedTexture *stex,
 cairo_surface_t * meta_shaped_texture_get_image (MetaShapedTexture     *stex,
                                                  cairo_rectangle_int_t *clip);
 
+void              meta_shaped_texture_capture_async  (MetaShapedTexture     *stex,
+                                                      cairo_rectangle_int_t *clip,
+                                                      cairo_format_t         format,
+                                                      GCancellable          *cancellable,
+                                                      GAsyncReadyCallback    callback,
+                                                      gpointer               user_data);
+cairo_surface_t * meta_shaped_texture_capture_finish (MetaShapedTexture     *stex,
+                                                      GAsyncResult          *result,
+                                                      GError               **error);
+
 G_END_DECLS
 
 #endif /* __META_SHAPED_TEXTURE_H__ */
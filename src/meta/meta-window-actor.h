@@ -62,6 +62,39 @@ MetaWindow *       meta_window_actor_get_meta_window      (MetaWindowActor *self
 ClutterActor *     meta_window_actor_get_texture          (MetaWindowActor *self);
 gboolean       meta_window_actor_is_destroyed (MetaWindowActor *self);
 
+CoglTexture *  meta_window_actor_get_thumbnail   (MetaWindowActor *self,
+                                                  int              max_width,
+                                                  int              max_height);
+void           meta_window_actor_clear_thumbnail (MetaWindowActor *self);
+
+#define META_FRAME_STATS_N_BUCKETS 10
+
+/**
+ * MetaFrameStats:
+ * @n_frames: number of frames the statistics cover
+ * @n_missed_frames: frames presented more than two refresh intervals
+ *   after the window contents changed
+ * @interval_histogram: time between consecutive frames updating the window
+ * @latency_histogram: time from the window contents changing until the
+ *   frame showing them was presented
+ *
+ * Statistics of the most recent frames that presented new contents of a
+ * window. See meta_frame_stats_get_bucket_limit() for the ranges counted
+ * by the histogram buckets.
+ */
+typedef struct
+{
+  guint n_frames;
+  guint n_missed_frames;
+  guint interval_histogram[META_FRAME_STATS_N_BUCKETS];
+  guint latency_histogram[META_FRAME_STATS_N_BUCKETS];
+} MetaFrameStats;
+
+gint64         meta_frame_stats_get_bucket_limit (int              bucket);
+void           meta_window_actor_get_frame_stats (MetaWindowActor *self,
+                                                  MetaFrameStats  *stats);
+void           meta_window_actor_reset_frame_stats (MetaWindowActor *self);
+
 typedef enum {
   META_SHADOW_MODE_AUTO,
   META_SHADOW_MODE_FORCED_OFF,
@@ -64,6 +64,10 @@
  * @META_PREF_DRAGGABLE_BORDER_WIDTH: draggable border width
  * @META_PREF_AUTO_MAXIMIZE: auto-maximize
  * @META_PREF_CENTER_NEW_WINDOWS: center new windows
+ * @META_PREF_DRAG_THRESHOLD: drag threshold
+ * @META_PREF_TEXTURE_RECLAIM_TIMEOUT: texture reclaim timeout
+ * @META_PREF_TEXTURE_MEMORY_BUDGET: texture memory budget
+ * @META_PREF_COALESCE_POINTER_MOTION: coalesce pointer motion
  */
 
 /* Keep in sync with GSettings schemas! */
@@ -102,6 +106,9 @@ typedef enum
   META_PREF_AUTO_MAXIMIZE,
   META_PREF_CENTER_NEW_WINDOWS,
   META_PREF_DRAG_THRESHOLD,
+  META_PREF_TEXTURE_RECLAIM_TIMEOUT,
+  META_PREF_TEXTURE_MEMORY_BUDGET,
+  META_PREF_COALESCE_POINTER_MOTION,
 } MetaPreference;
 
 typedef void (* MetaPrefsChangedFunc) (MetaPreference pref,
@@ -139,6 +146,7 @@ gboolean                    meta_prefs_get_gnome_animations   (void);
 gboolean                    meta_prefs_get_edge_tiling        (void);
 gboolean                    meta_prefs_get_auto_maximize      (void);
 gboolean                    meta_prefs_get_center_new_windows (void);
+gboolean                    meta_prefs_get_coalesce_pointer_motion (void);
 gboolean                    meta_prefs_get_show_fallback_app_menu (void);
 
 void                        meta_prefs_get_button_layout (MetaButtonLayout *button_layout);
@@ -166,6 +174,9 @@ gboolean meta_prefs_get_workspaces_only_on_primary (void);
 int      meta_prefs_get_draggable_border_width (void);
 int      meta_prefs_get_drag_threshold (void);
 
+int      meta_prefs_get_texture_reclaim_timeout (void);
+int      meta_prefs_get_texture_memory_budget (void);
+
 gboolean meta_prefs_get_ignore_request_hide_titlebar (void);
 void     meta_prefs_set_ignore_request_hide_titlebar (gboolean whether);
 
@@ -0,0 +1,44 @@
+#!/bin/sh
+# Runs mutter-test-runner headless on the virtual KMS driver, loading it
+# if needed, with software rendering.
+#
+# Usage: run-kms-tests.sh <mutter-test-runner> <test>...
+
+runner=$1
+shift
+
+find_vkms_card () {
+    for card in /sys/class/drm/card*; do
+        case $card in
+            *-*) continue ;;
+        esac
+        driver=$(readlink "$card/device/driver" 2>/dev/null)
+        if [ "${driver##*/}" = vkms ]; then
+            echo "/dev/dri/${card##*/}"
+            return 0
+        fi
+    done
+    return 1
+}
+
+device=$(find_vkms_card)
+if [ -z "$device" ]; then
+    if [ "$(id -u)" != 0 ]; then
+        echo "vkms is not loaded, and loading it needs root; skipping" >&2
+        exit 77
+    fi
+    modprobe vkms || exit 77
+    udevadm settle
+    device=$(find_vkms_card)
+fi
+
+if [ -z "$device" ]; then
+    echo "No vkms device found; skipping" >&2
+    exit 77
+fi
+
+META_HEADLESS_DRM_DEVICE=$device
+LIBGL_ALWAYS_SOFTWARE=1
+export META_HEADLESS_DRM_DEVICE LIBGL_ALWAYS_SOFTWARE
+
+exec "$runner" --headless --perf-output=kms-perf.json "$@"
@@ -21,16 +21,357 @@
 #include <gtk/gtk.h>
 #include <gdk/gdkx.h>
 #include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <X11/extensions/sync.h>
 
 const char *client_id = "0";
 static gboolean wayland;
+static char *load_spec;
 GHashTable *windows;
 
 static void read_next_line (GDataInputStream *in);
 
+typedef enum
+{
+  ANIMATION_REDRAW,
+  ANIMATION_RESIZE,
+  ANIMATION_MOVE
+} AnimationMode;
+
+typedef struct
+{
+  GtkWidget *window;
+  AnimationMode mode;
+  guint timeout_id;
+  int frame;
+} Animation;
+
+static void
+animation_free (Animation *animation)
+{
+  g_source_remove (animation->timeout_id);
+  g_free (animation);
+}
+
+static gboolean
+animation_step (gpointer data)
+{
+  Animation *animation = data;
+
+  animation->frame++;
+
+  switch (animation->mode)
+    {
+    case ANIMATION_REDRAW:
+      gtk_widget_queue_draw (animation->window);
+      break;
+    case ANIMATION_RESIZE:
+      gtk_window_resize (GTK_WINDOW (animation->window),
+                         100 + (animation->frame % 20) * 10,
+                         100 + (animation->frame % 10) * 10);
+      break;
+    case ANIMATION_MOVE:
+      gtk_window_move (GTK_WINDOW (animation->window),
+                       (animation->frame * 10) % 500, 100);
+      break;
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+typedef enum
+{
+  DAMAGE_FULL,
+  DAMAGE_RECTS,
+  DAMAGE_SCROLL
+} DamagePattern;
+
+/* Generates a reproducible workload for a window: redraws at a fixed
+ * rate with a damage pattern, and optionally changes the title and
+ * other properties, or sends bursts of resizes. All randomness comes
+ * from a seeded generator, so the same spec produces the same requests
+ * from run to run.
+ */
+typedef struct
+{
+  GtkWidget *window;
+  GtkWidget *area;
+  char *title;
+  GRand *rand;
+
+  int width;
+  int height;
+  DamagePattern damage;
+  int n_rects;
+  int resize_storm;
+
+  guint frame_timeout_id;
+  guint property_timeout_id;
+  guint resize_idle_id;
+  int n_pending_resizes;
+  int frame;
+  int property_serial;
+} LoadGenerator;
+
+static void
+load_generator_free (LoadGenerator *load)
+{
+  if (load->frame_timeout_id)
+    g_source_remove (load->frame_timeout_id);
+  if (load->property_timeout_id)
+    g_source_remove (load->property_timeout_id);
+  if (load->resize_idle_id)
+    g_source_remove (load->resize_idle_id);
+
+  if (gtk_widget_get_parent (load->area))
+    gtk_container_remove (GTK_CONTAINER (load->window), load->area);
+  g_object_unref (load->area);
+
+  g_rand_free (load->rand);
+  g_free (load->title);
+  g_free (load);
+}
+
+static gboolean
+on_load_draw (GtkWidget     *widget,
+              cairo_t       *cr,
+              LoadGenerator *load)
+{
+  int width = gtk_widget_get_allocated_width (widget);
+  int height = gtk_widget_get_allocated_height (widget);
+  int frame = load->frame;
+  int y;
+
+  /* Change the color every frame, so that every damaged pixel changes */
+  cairo_set_source_rgb (cr,
+                        (frame % 64) / 63.0,
+                        ((frame / 64) % 64) / 63.0,
+                        0.5);
+  cairo_paint (cr);
+
+  if (load->damage == DAMAGE_SCROLL)
+    {
+      cairo_set_source_rgb (cr, 1, 1, 1);
+      for (y = -(frame * 4) % 32; y < height; y += 32)
+        cairo_rectangle (cr, 0, y, width, 16);
+      cairo_fill (cr);
+    }
+
+  return TRUE;
+}
+
+/* Each resize of a storm is sent from its own main loop iteration and
+ * flushed right away; gtk_window_resize() would only apply the last one
+ * on the next layout. On X11 the compositor gets a ConfigureRequest for
+ * each; a Wayland compositor only sees the size the next commit has.
+ */
+static gboolean
+load_generator_resize (gpointer data)
+{
+  LoadGenerator *load = data;
+  GdkWindow *window = gtk_widget_get_window (load->window);
+
+  gdk_window_resize (window,
+                     g_rand_int_range (load->rand, load->width / 2, load->width * 2),
+                     g_rand_int_range (load->rand, load->height / 2, load->height * 2));
+  gdk_display_flush (gdk_window_get_display (window));
+
+  if (--load->n_pending_resizes > 0)
+    return G_SOURCE_CONTINUE;
+
+  load->resize_idle_id = 0;
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+load_generator_frame (gpointer data)
+{
+  LoadGenerator *load = data;
+  int width = gtk_widget_get_allocated_width (load->area);
+  int height = gtk_widget_get_allocated_height (load->area);
+  int i;
+
+  load->frame++;
+
+  switch (load->damage)
+    {
+    case DAMAGE_FULL:
+    case DAMAGE_SCROLL:
+      /* Scrolling redraws everything too, there is no way to have the
+       * compositor copy the unchanged part */
+      gtk_widget_queue_draw (load->area);
+      break;
+    case DAMAGE_RECTS:
+      for (i = 0; i < load->n_rects; i++)
+        {
+          int rect_width = g_rand_int_range (load->rand, 8, 64);
+          int rect_height = g_rand_int_range (load->rand, 8, 64);
+
+          gtk_widget_queue_draw_area (load->area,
+                                      g_rand_int_range (load->rand, 0, MAX (width - rect_width, 1)),
+                                      g_rand_int_range (load->rand, 0, MAX (height - rect_height, 1)),
+                                      rect_width, rect_height);
+        }
+      break;
+    }
+
+  if (load->resize_storm > 0)
+    {
+      load->n_pending_resizes += load->resize_storm;
+      if (load->resize_idle_id == 0)
+        load->resize_idle_id = g_idle_add (load_generator_resize, load);
+    }
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+load_generator_change_properties (gpointer data)
+{
+  LoadGenerator *load = data;
+  char *title;
+  char *role;
+
+  load->property_serial++;
+
+  /* The runner matches windows by the part of the title before a space */
+  title = g_strdup_printf ("%s %d", load->title, load->property_serial);
+  gtk_window_set_title (GTK_WINDOW (load->window), title);
+  g_free (title);
+
+  /* WM_WINDOW_ROLE; not used with Wayland */
+  role = g_strdup_printf ("load-%d", load->property_serial);
+  gtk_window_set_role (GTK_WINDOW (load->window), role);
+  g_free (role);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+parse_size (const char *str,
+            int        *width,
+            int        *height)
+{
+  return (sscanf (str, "%dx%d", width, height) == 2 &&
+          *width > 0 && *width <= 8192 &&
+          *height > 0 && *height <= 8192);
+}
+
+static gboolean
+parse_rate (const char *str,
+            int        *rate)
+{
+  *rate = atoi (str);
+  return *rate >= 0 && *rate <= 1000;
+}
+
+static void
+stop_load (GtkWidget *window)
+{
+  LoadGenerator *load = g_object_get_data (G_OBJECT (window), "test-load");
+
+  if (load == NULL)
+    return;
+
+  gtk_window_set_title (GTK_WINDOW (window), load->title);
+  g_object_set_data (G_OBJECT (window), "test-load", NULL);
+}
+
+static gboolean
+start_load (GtkWidget  *window,
+            char      **args,
+            int         n_args)
+{
+  LoadGenerator *load;
+  int width = 256, height = 256;
+  int rate = 60, property_rate = 0;
+  int n_rects = 16, resize_storm = 0;
+  DamagePattern damage = DAMAGE_FULL;
+  guint32 seed = 1;
+  int i;
+
+  for (i = 0; i < n_args; i++)
+    {
+      const char *value = strchr (args[i], '=');
+      gboolean valid = FALSE;
+
+      if (value == NULL)
+        {
+          g_print ("load: expected key=value, got %s", args[i]);
+          return FALSE;
+        }
+
+      value++;
+
+      if (g_str_has_prefix (args[i], "size="))
+        valid = parse_size (value, &width, &height);
+      else if (g_str_has_prefix (args[i], "rate="))
+        valid = parse_rate (value, &rate);
+      else if (g_str_has_prefix (args[i], "properties="))
+        valid = parse_rate (value, &property_rate);
+      else if (g_str_has_prefix (args[i], "rects="))
+        valid = (n_rects = atoi (value)) > 0;
+      else if (g_str_has_prefix (args[i], "resize-storm="))
+        valid = (resize_storm = atoi (value)) >= 0;
+      else if (g_str_has_prefix (args[i], "seed="))
+        {
+          seed = strtoul (value, NULL, 10);
+          valid = TRUE;
+        }
+      else if (g_str_has_prefix (args[i], "damage="))
+        {
+          valid = TRUE;
+          if (strcmp (value, "full") == 0)
+            damage = DAMAGE_FULL;
+          else if (strcmp (value, "rects") == 0)
+            damage = DAMAGE_RECTS;
+          else if (strcmp (value, "scroll") == 0)
+            damage = DAMAGE_SCROLL;
+          else
+            valid = FALSE;
+        }
+
+      if (!valid)
+        {
+          g_print ("load: invalid option %s", args[i]);
+          return FALSE;
+        }
+    }
+
+  stop_load (window);
+
+  load = g_new0 (LoadGenerator, 1);
+  load->window = window;
+  load->title = g_strdup (gtk_window_get_title (GTK_WINDOW (window)));
+  load->rand = g_rand_new_with_seed (seed);
+  load->width = width;
+  load->height = height;
+  load->damage = damage;
+  load->n_rects = n_rects;
+  load->resize_storm = resize_storm;
+
+  load->area = g_object_ref (gtk_drawing_area_new ());
+  g_signal_connect (load->area, "draw", G_CALLBACK (on_load_draw), load);
+  gtk_container_add (GTK_CONTAINER (window), load->area);
+  gtk_widget_show (load->area);
+
+  gtk_window_resize (GTK_WINDOW (window), width, height);
+
+  if (rate > 0)
+    load->frame_timeout_id = g_timeout_add (1000 / rate, load_generator_frame, load);
+  if (property_rate > 0)
+    load->property_timeout_id = g_timeout_add (1000 / property_rate,
+                                               load_generator_change_properties,
+                                               load);
+
+  g_object_set_data_full (G_OBJECT (window), "test-load",
+                          load, (GDestroyNotify) load_generator_free);
+
+  return TRUE;
+}
+
 static GtkWidget *
 lookup_window (const char *window_id)
 {
@@ -291,6 +632,73 @@ process_line (const char *line)
 
       gtk_window_deiconify (GTK_WINDOW (window));
     }
+  else if (strcmp (argv[0], "load") == 0)
+    {
+      if (argc < 3)
+        {
+          g_print ("usage: load <id> stop|<key>=<value>...");
+          goto out;
+        }
+
+      GtkWidget *window = lookup_window (argv[1]);
+      if (!window)
+        goto out;
+
+      if (argc == 3 && strcmp (argv[2], "stop") == 0)
+        stop_load (window);
+      else if (!start_load (window, argv + 2, argc - 2))
+        goto out;
+    }
+  else if (strcmp (argv[0], "animate") == 0)
+    {
+      AnimationMode mode;
+      int fps;
+
+      if (argc != 4)
+        {
+          g_print ("usage: animate <id> [redraw|resize|move] <fps>");
+          goto out;
+        }
+
+      GtkWidget *window = lookup_window (argv[1]);
+      if (!window)
+        goto out;
+
+      if (strcmp (argv[2], "redraw") == 0)
+        mode = ANIMATION_REDRAW;
+      else if (strcmp (argv[2], "resize") == 0)
+        mode = ANIMATION_RESIZE;
+      else if (strcmp (argv[2], "move") == 0)
+        mode = ANIMATION_MOVE;
+      else
+        {
+          g_print ("usage: animate <id> [redraw|resize|move] <fps>");
+          goto out;
+        }
+
+      fps = atoi (argv[3]);
+      if (fps < 0 || fps > 1000)
+        {
+          g_print ("animate: invalid rate %s", argv[3]);
+          goto out;
+        }
+
+      /* Replacing the data stops a previous animation */
+      if (fps == 0)
+        {
+          g_object_set_data (G_OBJECT (window), "test-animation", NULL);
+        }
+      else
+        {
+          Animation *animation = g_new0 (Animation, 1);
+
+          animation->window = window;
+          animation->mode = mode;
+          animation->timeout_id = g_timeout_add (1000 / fps, animation_step, animation);
+          g_object_set_data_full (G_OBJECT (window), "test-animation",
+                                  animation, (GDestroyNotify) animation_free);
+        }
+    }
   else
     {
       g_print ("Unknown command %s", argv[0]);
@@ -346,6 +754,12 @@ const GOptionEntry options[] = {
     "Identifier used in Window titles for this client",
     "CLIENT_ID",
   },
+  {
+    "load", 0, 0, G_OPTION_ARG_STRING,
+    &load_spec,
+    "Create a window generating the given load, as with the load command; options are separated by commas",
+    "SPEC",
+  },
   { NULL }
 };
 
@@ -377,6 +791,19 @@ main(int argc, char **argv)
   GInputStream *raw_in = g_unix_input_stream_new (0, FALSE);
   GDataInputStream *in = g_data_input_stream_new (raw_in);
 
+  if (load_spec)
+    {
+      char *spec = g_strdelimit (g_strdup (load_spec), ",", ' ');
+      char *line = g_strdup_printf ("load load %s", spec);
+
+      process_line ("create load");
+      process_line ("show load");
+      process_line (line);
+
+      g_free (line);
+      g_free (spec);
+    }
+
   read_next_line (in);
 
   gtk_main ();
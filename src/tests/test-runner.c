@@ -17,15 +17,23 @@
  * along with this program; if not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
 #include <gio/gio.h>
+#include <math.h>
 #include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include <meta/main.h>
+#include <meta/meta-window-actor.h>
 #include <meta/util.h>
 #include <meta/window.h>
 #include <ui/ui.h>
+#include "backends/meta-backend-private.h"
+#include "backends/meta-monitor-manager-private.h"
 #include "meta-plugin-manager.h"
 #include "wayland/meta-wayland.h"
 #include "window-private.h"
@@ -264,37 +272,25 @@ test_client_line_read (GObject      *source,
   g_main_loop_quit (client->loop);
 }
 
-static gboolean test_client_do (TestClient *client,
-                                GError   **error,
-                                ...) G_GNUC_NULL_TERMINATED;
+static void
+append_quoted_word (GString    *command,
+                    const char *word)
+{
+  if (command->len > 0)
+    g_string_append_c (command, ' ');
+
+  char *quoted = g_shell_quote (word);
+  g_string_append (command, quoted);
+  g_free (quoted);
+}
 
 static gboolean
-test_client_do (TestClient *client,
-                GError    **error,
-                ...)
+test_client_send (TestClient *client,
+                  GString    *command,
+                  GError    **error)
 {
-  GString *command = g_string_new (NULL);
   char *line = NULL;
 
-  va_list vap;
-  va_start (vap, error);
-
-  while (TRUE)
-    {
-      char *word = va_arg (vap, char *);
-      if (word == NULL)
-        break;
-
-      if (command->len > 0)
-        g_string_append_c (command, ' ');
-
-      char *quoted = g_shell_quote (word);
-      g_string_append (command, quoted);
-      g_free (quoted);
-    }
-
-  va_end (vap);
-
   g_string_append_c (command, '\n');
 
   if (!g_data_output_stream_put_string (client->in, command->str,
@@ -329,12 +325,68 @@ test_client_do (TestClient *client,
     }
 
  out:
-  g_string_free (command, TRUE);
   g_free (line);
 
   return *error == NULL;
 }
 
+static gboolean test_client_do (TestClient *client,
+                                GError   **error,
+                                ...) G_GNUC_NULL_TERMINATED;
+
+static gboolean
+test_client_do (TestClient *client,
+                GError    **error,
+                ...)
+{
+  GString *command = g_string_new (NULL);
+  gboolean result;
+
+  va_list vap;
+  va_start (vap, error);
+
+  while (TRUE)
+    {
+      char *word = va_arg (vap, char *);
+      if (word == NULL)
+        break;
+
+      append_quoted_word (command, word);
+    }
+
+  va_end (vap);
+
+  result = test_client_send (client, command, error);
+  g_string_free (command, TRUE);
+
+  return result;
+}
+
+/* Like test_client_do(), for a command followed by a variable number
+ * of arguments */
+static gboolean
+test_client_do_argv (TestClient *client,
+                     GError    **error,
+                     const char *command_name,
+                     const char *window_id,
+                     char      **args,
+                     int         n_args)
+{
+  GString *command = g_string_new (NULL);
+  gboolean result;
+  int i;
+
+  append_quoted_word (command, command_name);
+  append_quoted_word (command, window_id);
+  for (i = 0; i < n_args; i++)
+    append_quoted_word (command, args[i]);
+
+  result = test_client_send (client, command, error);
+  g_string_free (command, TRUE);
+
+  return result;
+}
+
 static gboolean
 test_client_wait (TestClient *client,
                   GError    **error)
@@ -372,12 +424,17 @@ test_client_find_window (TestClient *client,
   MetaWindow *result = NULL;
   char *expected_title = g_strdup_printf ("test/%s/%s",
                                           client->id, window_id);
+  size_t len = strlen (expected_title);
   GSList *l;
 
   for (l = windows; l; l = l->next)
     {
       MetaWindow *window = l->data;
-      if (g_strcmp0 (window->title, expected_title) == 0)
+
+      /* A window generating load may append " <serial>" to its title */
+      if (window->title &&
+          strncmp (window->title, expected_title, len) == 0 &&
+          (window->title[len] == '\0' || window->title[len] == ' '))
         {
           result = window;
           break;
@@ -407,12 +464,378 @@ test_client_alarm_filter (TestClient            *client,
 
 /**********************************************************************/
 
+/* A named part of a test case that performance is measured over; see
+ * the 'phase' command */
+typedef struct {
+  char *name;
+
+  gint64 start_time;
+  gint64 start_cpu_time;
+  gint64 duration;
+  gint64 cpu_time;
+
+  /* In microseconds, the interval between consecutive stage paints and
+   * the time each paint took */
+  GArray *frame_times;
+  GArray *paint_times;
+  gint64 last_paint_time;
+
+  /* In microseconds, from a set_connector or set_mode command to the
+   * first frame painted with the new configuration, and from a pointer
+   * warp to the cursor being on screen */
+  GArray *reconfig_times;
+  GArray *cursor_latencies;
+
+  /* Summed over all test windows */
+  MetaFrameStats frame_stats;
+
+  guint64 rss;
+  guint64 peak_rss;
+} PerfPhase;
+
+static gint64
+get_cpu_time (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+
+  return ((gint64) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC +
+          usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+static guint64
+get_rss (void)
+{
+  char *contents;
+  unsigned long size, resident;
+  int n_read;
+
+  if (!g_file_get_contents ("/proc/self/statm", &contents, NULL, NULL))
+    return 0;
+
+  n_read = sscanf (contents, "%lu %lu", &size, &resident);
+  g_free (contents);
+
+  if (n_read != 2)
+    return 0;
+
+  return (guint64) resident * sysconf (_SC_PAGESIZE);
+}
+
+static guint64
+get_peak_rss (void)
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+
+  /* In kilobytes on Linux */
+  return (guint64) usage.ru_maxrss * 1024;
+}
+
+static void
+foreach_test_window_actor (void (* func) (MetaWindowActor *actor,
+                                          gpointer         data),
+                           gpointer data)
+{
+  MetaDisplay *display = meta_get_display ();
+  GSList *windows;
+  GSList *l;
+
+  windows = meta_display_list_windows (display, META_LIST_INCLUDE_OVERRIDE_REDIRECT);
+
+  for (l = windows; l; l = l->next)
+    {
+      MetaWindow *window = l->data;
+      GObject *actor = meta_window_get_compositor_private (window);
+
+      if (actor && window->title && g_str_has_prefix (window->title, "test/"))
+        func (META_WINDOW_ACTOR (actor), data);
+    }
+
+  g_slist_free (windows);
+}
+
+static void
+reset_frame_stats (MetaWindowActor *actor,
+                   gpointer         data)
+{
+  meta_window_actor_reset_frame_stats (actor);
+}
+
+static void
+add_frame_stats (MetaWindowActor *actor,
+                 gpointer         data)
+{
+  MetaFrameStats *total = data;
+  MetaFrameStats stats;
+  int i;
+
+  meta_window_actor_get_frame_stats (actor, &stats);
+
+  total->n_frames += stats.n_frames;
+  total->n_missed_frames += stats.n_missed_frames;
+
+  for (i = 0; i < META_FRAME_STATS_N_BUCKETS; i++)
+    {
+      total->interval_histogram[i] += stats.interval_histogram[i];
+      total->latency_histogram[i] += stats.latency_histogram[i];
+    }
+}
+
+static void
+reset_configures (MetaWindowActor *actor,
+                  gpointer         data)
+{
+  MetaWindow *window = meta_window_actor_get_meta_window (actor);
+
+  g_object_set_data (G_OBJECT (window), "test-configures", NULL);
+}
+
+static PerfPhase *
+perf_phase_new (const char *name)
+{
+  PerfPhase *phase = g_new0 (PerfPhase, 1);
+
+  phase->name = g_strdup (name);
+  phase->frame_times = g_array_new (FALSE, FALSE, sizeof (gint64));
+  phase->paint_times = g_array_new (FALSE, FALSE, sizeof (gint64));
+  phase->reconfig_times = g_array_new (FALSE, FALSE, sizeof (gint64));
+  phase->cursor_latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  foreach_test_window_actor (reset_frame_stats, NULL);
+  foreach_test_window_actor (reset_configures, NULL);
+
+  phase->start_time = g_get_monotonic_time ();
+  phase->start_cpu_time = get_cpu_time ();
+
+  return phase;
+}
+
+static void
+perf_phase_free (PerfPhase *phase)
+{
+  g_array_free (phase->frame_times, TRUE);
+  g_array_free (phase->paint_times, TRUE);
+  g_array_free (phase->reconfig_times, TRUE);
+  g_array_free (phase->cursor_latencies, TRUE);
+  g_free (phase->name);
+  g_free (phase);
+}
+
+static void
+perf_phase_add_frame (PerfPhase *phase,
+                      gint64     paint_start_time,
+                      gint64     paint_end_time)
+{
+  gint64 paint_time = paint_end_time - paint_start_time;
+
+  g_array_append_val (phase->paint_times, paint_time);
+
+  if (phase->last_paint_time != 0)
+    {
+      gint64 frame_time = paint_end_time - phase->last_paint_time;
+      g_array_append_val (phase->frame_times, frame_time);
+    }
+
+  phase->last_paint_time = paint_end_time;
+}
+
+/* Brings the totals up to date with the current time */
+static void
+perf_phase_update (PerfPhase *phase)
+{
+  phase->duration = g_get_monotonic_time () - phase->start_time;
+  phase->cpu_time = get_cpu_time () - phase->start_cpu_time;
+
+  memset (&phase->frame_stats, 0, sizeof (MetaFrameStats));
+  foreach_test_window_actor (add_frame_stats, &phase->frame_stats);
+
+  phase->rss = get_rss ();
+  phase->peak_rss = get_peak_rss ();
+}
+
+static int
+compare_int64 (const void *a,
+               const void *b)
+{
+  gint64 value_a = *(const gint64 *) a;
+  gint64 value_b = *(const gint64 *) b;
+
+  return value_a < value_b ? -1 : value_a > value_b ? 1 : 0;
+}
+
+static gint64
+get_percentile (GArray *values,
+                double  percentile)
+{
+  gint64 *sorted;
+  gint64 result;
+  int index;
+
+  if (values->len == 0)
+    return 0;
+
+  sorted = g_memdup (values->data, values->len * sizeof (gint64));
+  qsort (sorted, values->len, sizeof (gint64), compare_int64);
+
+  index = (int) ceil (percentile / 100 * values->len) - 1;
+  result = sorted[CLAMP (index, 0, (int) values->len - 1)];
+
+  g_free (sorted);
+
+  return result;
+}
+
+/* Returns the upper bound of the histogram bucket the percentile falls
+ * into, which is G_MAXINT64 for the last, unbounded, bucket */
+static gint64
+get_histogram_percentile (const guint *histogram,
+                          guint        n_values,
+                          double       percentile)
+{
+  guint target;
+  guint count = 0;
+  int i;
+
+  if (n_values == 0)
+    return 0;
+
+  target = MAX ((guint) ceil (percentile / 100 * n_values), 1);
+
+  for (i = 0; i < META_FRAME_STATS_N_BUCKETS - 1; i++)
+    {
+      count += histogram[i];
+      if (count >= target)
+        break;
+    }
+
+  return meta_frame_stats_get_bucket_limit (i);
+}
+
+static void
+append_json_string (GString    *json,
+                    const char *str)
+{
+  const char *p;
+
+  g_string_append_c (json, '"');
+
+  for (p = str; *p; p++)
+    {
+      if (*p == '"' || *p == '\\')
+        g_string_append_printf (json, "\\%c", *p);
+      else if ((guchar) *p < 0x20)
+        g_string_append_printf (json, "\\u%04x", *p);
+      else
+        g_string_append_c (json, *p);
+    }
+
+  g_string_append_c (json, '"');
+}
+
+static void
+append_json_value (GString *json,
+                   gint64   value)
+{
+  if (value == G_MAXINT64)
+    g_string_append (json, "null");
+  else
+    g_string_append_printf (json, "%" G_GINT64_FORMAT, value);
+}
+
+static void
+append_json_percentiles (GString    *json,
+                         const char *name,
+                         GArray     *values)
+{
+  g_string_append_printf (json,
+                          "          \"%s\": { \"p50\": %" G_GINT64_FORMAT
+                          ", \"p95\": %" G_GINT64_FORMAT
+                          ", \"p99\": %" G_GINT64_FORMAT
+                          ", \"max\": %" G_GINT64_FORMAT " },\n",
+                          name,
+                          get_percentile (values, 50),
+                          get_percentile (values, 95),
+                          get_percentile (values, 99),
+                          get_percentile (values, 100));
+}
+
+static void
+perf_phase_append_json (PerfPhase *phase,
+                        GString   *json)
+{
+  MetaFrameStats *stats = &phase->frame_stats;
+
+  g_string_append (json, "        {\n          \"name\": ");
+  append_json_string (json, phase->name);
+  g_string_append_printf (json,
+                          ",\n"
+                          "          \"duration_us\": %" G_GINT64_FORMAT ",\n"
+                          "          \"cpu_time_us\": %" G_GINT64_FORMAT ",\n"
+                          "          \"frames\": %u,\n",
+                          phase->duration,
+                          phase->cpu_time,
+                          phase->paint_times->len);
+  append_json_percentiles (json, "frame_time_us", phase->frame_times);
+  append_json_percentiles (json, "paint_time_us", phase->paint_times);
+  if (phase->reconfig_times->len > 0)
+    append_json_percentiles (json, "reconfig_time_us", phase->reconfig_times);
+  if (phase->cursor_latencies->len > 0)
+    append_json_percentiles (json, "cursor_latency_us", phase->cursor_latencies);
+  g_string_append_printf (json,
+                          "          \"window_frames\": %u,\n"
+                          "          \"missed_frames\": %u,\n"
+                          "          \"latency_us\": { \"p50\": ",
+                          stats->n_frames,
+                          stats->n_missed_frames);
+  append_json_value (json, get_histogram_percentile (stats->latency_histogram,
+                                                     stats->n_frames, 50));
+  g_string_append (json, ", \"p95\": ");
+  append_json_value (json, get_histogram_percentile (stats->latency_histogram,
+                                                     stats->n_frames, 95));
+  g_string_append (json, ", \"p99\": ");
+  append_json_value (json, get_histogram_percentile (stats->latency_histogram,
+                                                     stats->n_frames, 99));
+  g_string_append_printf (json,
+                          " },\n"
+                          "          \"rss_bytes\": %" G_GUINT64_FORMAT ",\n"
+                          "          \"peak_rss_bytes\": %" G_GUINT64_FORMAT "\n"
+                          "        }",
+                          phase->rss,
+                          phase->peak_rss);
+}
+
+/**********************************************************************/
+
+/* How long wait_frames waits for the frames to be painted, in seconds */
+#define WAIT_FRAMES_TIMEOUT 30
+
+/* How long to wait for a reconfiguration or a cursor update, in seconds */
+#define WAIT_DISPLAY_TIMEOUT 10
+
 typedef struct {
   GHashTable *clients;
   AsyncWaiter *waiter;
   guint log_handler_id;
   GString *warning_messages;
   GMainLoop *loop;
+
+  guint pre_paint_func_id;
+  guint post_paint_func_id;
+  gint64 paint_start_time;
+  int frames_to_wait;
+  guint wait_frames_timeout_id;
+
+  /* Set by the signal handlers below; waited for by test_case_wait_for() */
+  gboolean monitors_changed;
+  gboolean cursor_painted;
+  guint wait_timeout_id;
+
+  /* The phase being measured, and the ones that ended */
+  PerfPhase *phase;
+  GPtrArray *phases;
 } TestCase;
 
 static gboolean
@@ -468,6 +891,74 @@ test_case_log_func (const gchar   *log_domain,
     }
 }
 
+static gboolean
+test_case_pre_paint (gpointer data)
+{
+  TestCase *test = data;
+
+  test->paint_start_time = g_get_monotonic_time ();
+
+  return TRUE;
+}
+
+static gboolean
+test_case_post_paint (gpointer data)
+{
+  TestCase *test = data;
+
+  if (test->phase)
+    perf_phase_add_frame (test->phase, test->paint_start_time,
+                          g_get_monotonic_time ());
+
+  if (test->frames_to_wait > 0 && --test->frames_to_wait == 0)
+    g_main_loop_quit (test->loop);
+
+  return TRUE;
+}
+
+static void
+on_monitors_changed (MetaMonitorManager *manager,
+                     TestCase           *test)
+{
+  test->monitors_changed = TRUE;
+
+  if (test->wait_timeout_id != 0)
+    g_main_loop_quit (test->loop);
+}
+
+static void
+on_cursor_painted (MetaCursorRenderer *renderer,
+                   TestCase           *test)
+{
+  test->cursor_painted = TRUE;
+
+  if (test->wait_timeout_id != 0)
+    g_main_loop_quit (test->loop);
+}
+
+/* Counts the size changes of each window, which the current phase
+ * starts again from 0; see 'assert_configures' */
+static void
+on_window_size_changed (MetaWindow *window,
+                        gpointer    data)
+{
+  guint n_configures;
+
+  n_configures = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (window),
+                                                      "test-configures"));
+  g_object_set_data (G_OBJECT (window), "test-configures",
+                     GUINT_TO_POINTER (n_configures + 1));
+}
+
+static void
+on_window_created (MetaDisplay *display,
+                   MetaWindow  *window,
+                   TestCase    *test)
+{
+  g_signal_connect (window, "size-changed",
+                    G_CALLBACK (on_window_size_changed), NULL);
+}
+
 static TestCase *
 test_case_new (void)
 {
@@ -478,61 +969,406 @@ test_case_new (void)
                                             test_case_log_func,
                                             test);
 
-  meta_display_set_alarm_filter (meta_get_display (),
-                                 test_case_alarm_filter, test);
+  meta_display_set_alarm_filter (meta_get_display (),
+                                 test_case_alarm_filter, test);
+
+  test->clients = g_hash_table_new (g_str_hash, g_str_equal);
+  test->waiter = async_waiter_new ();
+  test->loop = g_main_loop_new (NULL, FALSE);
+
+  test->phases = g_ptr_array_new_with_free_func ((GDestroyNotify) perf_phase_free);
+  test->pre_paint_func_id =
+    clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_PRE_PAINT,
+                                           test_case_pre_paint,
+                                           test, NULL);
+  test->post_paint_func_id =
+    clutter_threads_add_repaint_func_full (CLUTTER_REPAINT_FLAGS_POST_PAINT,
+                                           test_case_post_paint,
+                                           test, NULL);
+
+  g_signal_connect (meta_monitor_manager_get (), "monitors-changed",
+                    G_CALLBACK (on_monitors_changed), test);
+  g_signal_connect (meta_backend_get_cursor_renderer (meta_get_backend ()),
+                    "cursor-painted",
+                    G_CALLBACK (on_cursor_painted), test);
+  g_signal_connect (meta_get_display (), "window-created",
+                    G_CALLBACK (on_window_created), test);
+
+  return test;
+}
+
+static gboolean
+test_case_before_redraw (gpointer data)
+{
+  TestCase *test = data;
+
+  g_main_loop_quit (test->loop);
+
+  return FALSE;
+}
+
+static gboolean
+test_case_wait (TestCase *test,
+                GError  **error)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+
+  /* First have each client set a XSync counter, and wait until
+   * we receive the resulting event - so we know we've received
+   * everything that the client have sent us.
+   */
+  g_hash_table_iter_init (&iter, test->clients);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    if (!test_client_wait (value, error))
+      return FALSE;
+
+  /* Then wait until we've done any outstanding queued up work.
+   * Though we add this as BEFORE_REDRAW, the iteration that runs the
+   * BEFORE_REDRAW idles will proceed on and do the redraw, so we're
+   * waiting until after *all* frame processing.
+   */
+  meta_later_add (META_LATER_BEFORE_REDRAW,
+                  test_case_before_redraw,
+                  test,
+                  NULL);
+  g_main_loop_run (test->loop);
+
+  /* Then set an XSync counter ourselves and and wait until
+   * we receive the resulting event - this makes sure that we've
+   * received back any X events we generated.
+   */
+  async_waiter_set_and_wait (test->waiter);
+  return TRUE;
+}
+
+static gboolean
+test_case_wait_frames_timeout (gpointer data)
+{
+  TestCase *test = data;
+
+  test->wait_frames_timeout_id = 0;
+  g_main_loop_quit (test->loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+test_case_wait_frames (TestCase *test,
+                       int       n_frames,
+                       GError  **error)
+{
+  test->frames_to_wait = n_frames;
+  test->wait_frames_timeout_id = g_timeout_add_seconds (WAIT_FRAMES_TIMEOUT,
+                                                        test_case_wait_frames_timeout,
+                                                        test);
+  g_main_loop_run (test->loop);
+
+  if (test->frames_to_wait > 0)
+    {
+      g_set_error (error, TEST_RUNNER_ERROR, TEST_RUNNER_ERROR_RUNTIME_ERROR,
+                   "timed out with %d of %d frames not painted",
+                   test->frames_to_wait, n_frames);
+      test->frames_to_wait = 0;
+      return FALSE;
+    }
+
+  g_source_remove (test->wait_frames_timeout_id);
+  test->wait_frames_timeout_id = 0;
+
+  return TRUE;
+}
+
+static gboolean
+test_case_wait_timeout (gpointer data)
+{
+  TestCase *test = data;
+
+  test->wait_timeout_id = 0;
+  g_main_loop_quit (test->loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Waits for one of the flags set by the signal handlers to become TRUE */
+static gboolean
+test_case_wait_for (TestCase   *test,
+                    gboolean   *flag,
+                    const char *what,
+                    GError    **error)
+{
+  if (*flag)
+    return TRUE;
+
+  test->wait_timeout_id = g_timeout_add_seconds (WAIT_DISPLAY_TIMEOUT,
+                                                 test_case_wait_timeout,
+                                                 test);
+  while (!*flag && test->wait_timeout_id != 0)
+    g_main_loop_run (test->loop);
+
+  if (!*flag)
+    {
+      g_set_error (error, TEST_RUNNER_ERROR, TEST_RUNNER_ERROR_RUNTIME_ERROR,
+                   "timed out waiting for %s", what);
+      return FALSE;
+    }
+
+  g_source_remove (test->wait_timeout_id);
+  test->wait_timeout_id = 0;
+
+  return TRUE;
+}
+
+/* Waits for the monitor manager to pick up a change made at start_time,
+ * and for a frame painted with the new configuration */
+static gboolean
+test_case_wait_reconfiguration (TestCase *test,
+                                gint64    start_time,
+                                GError  **error)
+{
+  gint64 reconfig_time;
+
+  if (!test_case_wait_for (test, &test->monitors_changed,
+                           "the monitors to change", error))
+    return FALSE;
+
+  if (!test_case_wait_frames (test, 1, error))
+    return FALSE;
+
+  reconfig_time = g_get_monotonic_time () - start_time;
+  if (test->phase)
+    g_array_append_val (test->phase->reconfig_times, reconfig_time);
+
+  return TRUE;
+}
+
+/* Forces a connector of the DRM device the headless backend runs on
+ * on or off, like plugging or unplugging a monitor */
+static gboolean
+test_case_set_connector (TestCase   *test,
+                         const char *connector,
+                         const char *status,
+                         GError    **error)
+{
+  const char *device;
+  char *card;
+  char *path;
+  FILE *file;
+  gint64 start_time;
+  gboolean written;
+
+  device = g_getenv ("META_HEADLESS_DRM_DEVICE");
+  if (device == NULL)
+    {
+      g_set_error (error, TEST_RUNNER_ERROR, TEST_RUNNER_ERROR_RUNTIME_ERROR,
+                   "set_connector needs META_HEADLESS_DRM_DEVICE to be set");
+      return FALSE;
+    }
+
+  card = g_path_get_basename (device);
+  path = g_strdup_printf ("/sys/class/drm/%s-%s/status", card, connector);
+  g_free (card);
+
+  test->monitors_changed = FALSE;
+  start_time = g_get_monotonic_time ();
+
+  /* Not g_file_set_contents(), sysfs attributes can't be replaced */
+  file = fopen (path, "w");
+  written = file != NULL && fputs (status, file) >= 0;
+  if (file != NULL && fclose (file) != 0)
+    written = FALSE;
+
+  if (!written)
+    {
+      int errsv = errno;
+
+      g_set_error (error, TEST_RUNNER_ERROR, TEST_RUNNER_ERROR_RUNTIME_ERROR,
+                   "Can't write %s: %s", path, g_strerror (errsv));
+      g_free (path);
+      return FALSE;
+    }
+
+  g_free (path);
+
+  return test_case_wait_reconfiguration (test, start_time, error);
+}
+
+static MetaMonitorMode *
+find_output_mode (MetaOutput *output,
+                  int         width,
+                  int         height)
+{
+  MetaMonitorMode *best = NULL;
+  unsigned int i;
+
+  for (i = 0; i < output->n_modes; i++)
+    {
+      MetaMonitorMode *mode = output->modes[i];
+
+      if (mode->width == width && mode->height == height &&
+          (best == NULL || mode->refresh_rate > best->refresh_rate))
+        best = mode;
+    }
+
+  return best;
+}
+
+/* Switches one output to another mode, keeping the rest of the
+ * configuration as it is */
+static gboolean
+test_case_set_mode (TestCase   *test,
+                    int         width,
+                    int         height,
+                    const char *output_name,
+                    GError    **error)
+{
+  MetaMonitorManager *manager = meta_monitor_manager_get ();
+  MetaOutput *target = NULL;
+  MetaMonitorMode *mode;
+  GPtrArray *crtc_infos;
+  GPtrArray *output_infos;
+  gint64 start_time;
+  unsigned int i, j;
+
+  for (i = 0; i < manager->n_outputs; i++)
+    {
+      MetaOutput *output = &manager->outputs[i];
+
+      if (output->crtc == NULL)
+        continue;
+
+      if (output_name == NULL || strcmp (output->name, output_name) == 0)
+        {
+          target = output;
+          break;
+        }
+    }
+
+  if (target == NULL)
+    {
+      g_set_error (error, TEST_RUNNER_ERROR, TEST_RUNNER_ERROR_RUNTIME_ERROR,
+                   "No active output %s", output_name ? output_name : "");
+      return FALSE;
+    }
+
+  mode = find_output_mode (target, width, height);
+  if (mode == NULL)
+    {
+      g_set_error (error, TEST_RUNNER_ERROR, TEST_RUNNER_ERROR_RUNTIME_ERROR,
+                   "Output %s has no %dx%d mode", target->name, width, height);
+      return FALSE;
+    }
+
+  crtc_infos = g_ptr_array_new_with_free_func ((GDestroyNotify) meta_crtc_info_free);
+  output_infos = g_ptr_array_new_with_free_func ((GDestroyNotify) meta_output_info_free);
+
+  for (i = 0; i < manager->n_crtcs; i++)
+    {
+      MetaCRTC *crtc = &manager->crtcs[i];
+      MetaCRTCInfo *crtc_info;
+
+      if (crtc->current_mode == NULL)
+        continue;
+
+      crtc_info = g_slice_new0 (MetaCRTCInfo);
+      crtc_info->crtc = crtc;
+      crtc_info->mode = crtc == target->crtc ? mode : crtc->current_mode;
+      crtc_info->x = crtc->rect.x;
+      crtc_info->y = crtc->rect.y;
+      crtc_info->transform = crtc->transform;
+      crtc_info->outputs = g_ptr_array_new ();
+
+      for (j = 0; j < manager->n_outputs; j++)
+        {
+          MetaOutput *output = &manager->outputs[j];
+
+          if (output->crtc == crtc)
+            g_ptr_array_add (crtc_info->outputs, output);
+        }
+
+      g_ptr_array_add (crtc_infos, crtc_info);
+    }
+
+  for (i = 0; i < manager->n_outputs; i++)
+    {
+      MetaOutput *output = &manager->outputs[i];
+      MetaOutputInfo *output_info;
+
+      if (output->crtc == NULL)
+        continue;
+
+      output_info = g_slice_new0 (MetaOutputInfo);
+      output_info->output = output;
+      output_info->is_primary = output->is_primary;
+      output_info->is_presentation = output->is_presentation;
+      output_info->is_underscanning = output->is_underscanning;
+
+      g_ptr_array_add (output_infos, output_info);
+    }
+
+  test->monitors_changed = FALSE;
+  start_time = g_get_monotonic_time ();
 
-  test->clients = g_hash_table_new (g_str_hash, g_str_equal);
-  test->waiter = async_waiter_new ();
-  test->loop = g_main_loop_new (NULL, FALSE);
+  meta_monitor_manager_apply_configuration (manager,
+                                            (MetaCRTCInfo **) crtc_infos->pdata,
+                                            crtc_infos->len,
+                                            (MetaOutputInfo **) output_infos->pdata,
+                                            output_infos->len);
 
-  return test;
+  g_ptr_array_unref (crtc_infos);
+  g_ptr_array_unref (output_infos);
+
+  return test_case_wait_reconfiguration (test, start_time, error);
 }
 
+/* Warps the pointer n_moves times, waiting each time for the cursor to
+ * be on screen at its new position */
 static gboolean
-test_case_before_redraw (gpointer data)
+test_case_move_cursor (TestCase *test,
+                       int       n_moves,
+                       GError  **error)
 {
-  TestCase *test = data;
+  MetaBackend *backend = meta_get_backend ();
+  MetaMonitorManager *manager = meta_monitor_manager_get ();
+  int i;
 
-  g_main_loop_quit (test->loop);
+  for (i = 0; i < n_moves; i++)
+    {
+      /* Back and forth over a 16x16 grid, 8 pixels apart, around the
+       * middle of the screen, so that each warp moves the cursor */
+      int x = manager->screen_width / 2 + ((i % 16) - 8) * 8;
+      int y = manager->screen_height / 2 + (((i / 16) % 16) - 8) * 8;
+      gint64 start_time;
+      gint64 latency;
 
-  return FALSE;
-}
+      test->cursor_painted = FALSE;
+      start_time = g_get_monotonic_time ();
 
-static gboolean
-test_case_wait (TestCase *test,
-                GError  **error)
-{
-  GHashTableIter iter;
-  gpointer key, value;
+      meta_backend_warp_pointer (backend, x, y);
 
-  /* First have each client set a XSync counter, and wait until
-   * we receive the resulting event - so we know we've received
-   * everything that the client have sent us.
-   */
-  g_hash_table_iter_init (&iter, test->clients);
-  while (g_hash_table_iter_next (&iter, &key, &value))
-    if (!test_client_wait (value, error))
-      return FALSE;
+      if (!test_case_wait_for (test, &test->cursor_painted,
+                               "the cursor to be painted", error))
+        return FALSE;
 
-  /* Then wait until we've done any outstanding queued up work.
-   * Though we add this as BEFORE_REDRAW, the iteration that runs the
-   * BEFORE_REDRAW idles will proceed on and do the redraw, so we're
-   * waiting until after *all* frame processing.
-   */
-  meta_later_add (META_LATER_BEFORE_REDRAW,
-                  test_case_before_redraw,
-                  test,
-                  NULL);
-  g_main_loop_run (test->loop);
+      latency = g_get_monotonic_time () - start_time;
+      if (test->phase)
+        g_array_append_val (test->phase->cursor_latencies, latency);
+    }
 
-  /* Then set an XSync counter ourselves and and wait until
-   * we receive the resulting event - this makes sure that we've
-   * received back any X events we generated.
-   */
-  async_waiter_set_and_wait (test->waiter);
   return TRUE;
 }
 
+static void
+test_case_end_phase (TestCase *test)
+{
+  if (test->phase == NULL)
+    return;
+
+  perf_phase_update (test->phase);
+  g_ptr_array_add (test->phases, test->phase);
+  test->phase = NULL;
+}
+
 #define BAD_COMMAND(...)                                                \
   G_STMT_START {                                                        \
       g_set_error (error,                                               \
@@ -605,7 +1441,8 @@ test_case_assert_stacking (TestCase *test,
             g_string_append_c (stack_string, ' ');
 
           if (g_str_has_prefix (window->title, "test/"))
-            g_string_append (stack_string, window->title + 5);
+            g_string_append_len (stack_string, window->title + 5,
+                                 strcspn (window->title + 5, " "));
           else
             g_string_append_printf (stack_string, "(%s)", window->title);
         }
@@ -702,6 +1539,161 @@ test_case_check_xserver_stacking (TestCase *test,
   return *error == NULL;
 }
 
+static gboolean
+parse_number (const char *str,
+              double     *value)
+{
+  char *end;
+
+  *value = g_ascii_strtod (str, &end);
+
+  return end != str && *end == '\0' && *value >= 0;
+}
+
+static gboolean
+check_limit (const char *what,
+             double      value,
+             double      limit,
+             const char *unit,
+             GError    **error)
+{
+  if (value > limit)
+    g_set_error (error, TEST_RUNNER_ERROR, TEST_RUNNER_ERROR_ASSERTION_FAILED,
+                 "%s: %.1f %s, expected at most %.1f %s",
+                 what, value, unit, limit, unit);
+
+  return *error == NULL;
+}
+
+static gboolean
+test_case_assert_perf (TestCase *test,
+                       int       argc,
+                       char    **argv,
+                       GError  **error)
+{
+  PerfPhase *phase = test->phase;
+  double percentile = 0;
+  double limit;
+  char *what;
+  gboolean result;
+
+  if (phase == NULL)
+    BAD_COMMAND("%s can only be used within a phase", argv[0]);
+
+  if (strcmp (argv[0], "assert_frame_time") == 0 ||
+      strcmp (argv[0], "assert_paint_time") == 0 ||
+      strcmp (argv[0], "assert_latency") == 0 ||
+      strcmp (argv[0], "assert_reconfig_time") == 0 ||
+      strcmp (argv[0], "assert_cursor_latency") == 0)
+    {
+      if (argc != 3 ||
+          !parse_number (argv[1], &percentile) || percentile > 100 ||
+          !parse_number (argv[2], &limit))
+        BAD_COMMAND("usage: %s <percentile> <max-ms>", argv[0]);
+    }
+  else
+    {
+      if (argc != 2 || !parse_number (argv[1], &limit))
+        BAD_COMMAND("usage: %s <max>", argv[0]);
+    }
+
+  perf_phase_update (phase);
+
+  if (strcmp (argv[0], "assert_frame_time") == 0)
+    {
+      what = g_strdup_printf ("frame time p%g", percentile);
+      result = check_limit (what, get_percentile (phase->frame_times, percentile) / 1000.0,
+                            limit, "ms", error);
+    }
+  else if (strcmp (argv[0], "assert_paint_time") == 0)
+    {
+      what = g_strdup_printf ("paint time p%g", percentile);
+      result = check_limit (what, get_percentile (phase->paint_times, percentile) / 1000.0,
+                            limit, "ms", error);
+    }
+  else if (strcmp (argv[0], "assert_latency") == 0)
+    {
+      gint64 latency = get_histogram_percentile (phase->frame_stats.latency_histogram,
+                                                 phase->frame_stats.n_frames,
+                                                 percentile);
+
+      what = g_strdup_printf ("latency p%g", percentile);
+      if (latency == G_MAXINT64)
+        result = check_limit (what, INFINITY, limit, "ms", error);
+      else
+        result = check_limit (what, latency / 1000.0, limit, "ms", error);
+    }
+  else if (strcmp (argv[0], "assert_reconfig_time") == 0)
+    {
+      what = g_strdup_printf ("reconfiguration time p%g", percentile);
+      result = check_limit (what, get_percentile (phase->reconfig_times, percentile) / 1000.0,
+                            limit, "ms", error);
+    }
+  else if (strcmp (argv[0], "assert_cursor_latency") == 0)
+    {
+      what = g_strdup_printf ("cursor latency p%g", percentile);
+      result = check_limit (what, get_percentile (phase->cursor_latencies, percentile) / 1000.0,
+                            limit, "ms", error);
+    }
+  else if (strcmp (argv[0], "assert_missed_frames") == 0)
+    {
+      what = g_strdup ("missed frames");
+      result = check_limit (what, phase->frame_stats.n_missed_frames,
+                            limit, "frames", error);
+    }
+  else if (strcmp (argv[0], "assert_rss") == 0)
+    {
+      what = g_strdup ("resident memory");
+      result = check_limit (what, phase->rss / (1024.0 * 1024.0),
+                            limit, "MiB", error);
+    }
+  else
+    {
+      what = g_strdup ("CPU time");
+      result = check_limit (what, phase->cpu_time / 1000.0,
+                            limit, "ms", error);
+    }
+
+  g_free (what);
+
+  return result;
+}
+
+static gboolean
+test_case_assert_configures (TestCase *test,
+                             int       argc,
+                             char    **argv,
+                             GError  **error)
+{
+  TestClient *client;
+  const char *window_id;
+  MetaWindow *window;
+  double min;
+  guint n_configures;
+
+  if (test->phase == NULL)
+    BAD_COMMAND("%s can only be used within a phase", argv[0]);
+
+  if (argc != 3 || !parse_number (argv[2], &min))
+    BAD_COMMAND("usage: %s <client-id>/<window-id> <min>", argv[0]);
+
+  if (!test_case_parse_window_id (test, argv[1], &client, &window_id, error))
+    return FALSE;
+
+  window = test_client_find_window (client, window_id, error);
+  if (!window)
+    return FALSE;
+
+  n_configures = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (window),
+                                                      "test-configures"));
+  if (n_configures < min)
+    g_set_error (error, TEST_RUNNER_ERROR, TEST_RUNNER_ERROR_ASSERTION_FAILED,
+                 "%s: %u configures, expected at least %g",
+                 argv[1], n_configures, min);
+
+  return *error == NULL;
+}
+
 static gboolean
 test_case_do (TestCase *test,
               int       argc,
@@ -731,6 +1723,54 @@ test_case_do (TestCase *test,
 
       g_hash_table_insert (test->clients, client->id, client);
     }
+  else if (strcmp (argv[0], "spawn_clients") == 0)
+    {
+      MetaWindowClientType type;
+      int n_clients, i;
+
+      if (argc != 4 && argc != 6)
+        BAD_COMMAND("usage: spawn_clients <client-id-prefix> <n> [wayland|x11] [redraw|resize|move <fps>]");
+
+      n_clients = atoi (argv[2]);
+      if (n_clients <= 0)
+        BAD_COMMAND("invalid number of clients %s", argv[2]);
+
+      if (strcmp (argv[3], "x11") == 0)
+        type = META_WINDOW_CLIENT_TYPE_X11;
+      else if (strcmp (argv[3], "wayland") == 0)
+        type = META_WINDOW_CLIENT_TYPE_WAYLAND;
+      else
+        BAD_COMMAND("usage: spawn_clients <client-id-prefix> <n> [wayland|x11] [redraw|resize|move <fps>]");
+
+      for (i = 1; i <= n_clients; i++)
+        {
+          char *id = g_strdup_printf ("%s%d", argv[1], i);
+          TestClient *client;
+
+          if (g_hash_table_lookup (test->clients, id))
+            {
+              g_set_error (error, TEST_RUNNER_ERROR, TEST_RUNNER_ERROR_BAD_COMMAND,
+                           "client %s already exists", id);
+              g_free (id);
+              return FALSE;
+            }
+
+          client = test_client_new (id, type, error);
+          g_free (id);
+          if (!client)
+            return FALSE;
+
+          g_hash_table_insert (test->clients, client->id, client);
+
+          if (!test_client_do (client, error, "create", "1", NULL) ||
+              !test_client_do (client, error, "show", "1", NULL))
+            return FALSE;
+
+          if (argc == 6 &&
+              !test_client_do (client, error, "animate", "1", argv[4], argv[5], NULL))
+            return FALSE;
+        }
+    }
   else if (strcmp (argv[0], "quit_client") == 0)
     {
       if (argc != 2)
@@ -803,6 +1843,168 @@ test_case_do (TestCase *test,
 
       meta_window_activate (window, 0);
     }
+  else if (strcmp (argv[0], "begin_resize") == 0)
+    {
+      if (argc != 2)
+        BAD_COMMAND("usage: %s <client-id>/<window-id>", argv[0]);
+
+      TestClient *client;
+      const char *window_id;
+      if (!test_case_parse_window_id (test, argv[1], &client, &window_id, error))
+        return FALSE;
+
+      MetaWindow *window = test_client_find_window (client, window_id, error);
+      if (!window)
+        return FALSE;
+
+      MetaDisplay *display = window->display;
+      if (!meta_display_begin_grab_op (display, window->screen, window,
+                                       META_GRAB_OP_KEYBOARD_RESIZING_SE,
+                                       FALSE, FALSE, 0, 0,
+                                       meta_display_get_current_time_roundtrip (display),
+                                       window->rect.x, window->rect.y))
+        {
+          g_set_error (error, TEST_RUNNER_ERROR, TEST_RUNNER_ERROR_RUNTIME_ERROR,
+                       "Failed to begin resizing %s", argv[1]);
+          return FALSE;
+        }
+    }
+  else if (strcmp (argv[0], "end_resize") == 0)
+    {
+      if (argc != 1)
+        BAD_COMMAND("usage: %s", argv[0]);
+
+      MetaDisplay *display = meta_get_display ();
+      meta_display_end_grab_op (display,
+                                meta_display_get_current_time_roundtrip (display));
+    }
+  else if (strcmp (argv[0], "resize") == 0 ||
+           strcmp (argv[0], "assert_size") == 0)
+    {
+      int width, height;
+
+      if (argc != 3 || sscanf (argv[2], "%dx%d", &width, &height) != 2)
+        BAD_COMMAND("usage: %s <client-id>/<window-id> <width>x<height>", argv[0]);
+
+      TestClient *client;
+      const char *window_id;
+      if (!test_case_parse_window_id (test, argv[1], &client, &window_id, error))
+        return FALSE;
+
+      MetaWindow *window = test_client_find_window (client, window_id, error);
+      if (!window)
+        return FALSE;
+
+      if (strcmp (argv[0], "resize") == 0)
+        {
+          meta_window_resize_frame_with_gravity (window, TRUE, width, height,
+                                                 NorthWestGravity);
+        }
+      else if (window->rect.width != width || window->rect.height != height)
+        {
+          g_set_error (error, TEST_RUNNER_ERROR, TEST_RUNNER_ERROR_ASSERTION_FAILED,
+                       "%s: size is %dx%d, expected %dx%d", argv[1],
+                       window->rect.width, window->rect.height, width, height);
+          return FALSE;
+        }
+    }
+  else if (strcmp (argv[0], "animate") == 0)
+    {
+      if (argc != 4)
+        BAD_COMMAND("usage: %s <client-id>/<window-id> [redraw|resize|move] <fps>", argv[0]);
+
+      TestClient *client;
+      const char *window_id;
+      if (!test_case_parse_window_id (test, argv[1], &client, &window_id, error))
+        return FALSE;
+
+      if (!test_client_do (client, error, "animate", window_id, argv[2], argv[3], NULL))
+        return FALSE;
+    }
+  else if (strcmp (argv[0], "load") == 0)
+    {
+      if (argc < 3)
+        BAD_COMMAND("usage: %s <client-id>/<window-id> stop|<key>=<value>...", argv[0]);
+
+      TestClient *client;
+      const char *window_id;
+      if (!test_case_parse_window_id (test, argv[1], &client, &window_id, error))
+        return FALSE;
+
+      if (!test_client_do_argv (client, error, "load", window_id, argv + 2, argc - 2))
+        return FALSE;
+    }
+  else if (strcmp (argv[0], "wait_frames") == 0)
+    {
+      if (argc != 2 || atoi (argv[1]) <= 0)
+        BAD_COMMAND("usage: %s <n-frames>", argv[0]);
+
+      if (!test_case_wait_frames (test, atoi (argv[1]), error))
+        return FALSE;
+    }
+  else if (strcmp (argv[0], "set_connector") == 0)
+    {
+      if (argc != 3 ||
+          (strcmp (argv[2], "on") != 0 &&
+           strcmp (argv[2], "off") != 0 &&
+           strcmp (argv[2], "detect") != 0))
+        BAD_COMMAND("usage: %s <connector> on|off|detect", argv[0]);
+
+      if (!test_case_set_connector (test, argv[1], argv[2], error))
+        return FALSE;
+    }
+  else if (strcmp (argv[0], "set_mode") == 0)
+    {
+      int width, height;
+
+      if ((argc != 2 && argc != 3) ||
+          sscanf (argv[1], "%dx%d", &width, &height) != 2)
+        BAD_COMMAND("usage: %s <width>x<height> [<output>]", argv[0]);
+
+      if (!test_case_set_mode (test, width, height,
+                               argc == 3 ? argv[2] : NULL, error))
+        return FALSE;
+    }
+  else if (strcmp (argv[0], "move_cursor") == 0)
+    {
+      if (argc != 2 || atoi (argv[1]) <= 0)
+        BAD_COMMAND("usage: %s <n-moves>", argv[0]);
+
+      if (!test_case_move_cursor (test, atoi (argv[1]), error))
+        return FALSE;
+    }
+  else if (strcmp (argv[0], "phase") == 0)
+    {
+      if (argc != 2)
+        BAD_COMMAND("usage: %s <name>", argv[0]);
+
+      test_case_end_phase (test);
+      test->phase = perf_phase_new (argv[1]);
+    }
+  else if (strcmp (argv[0], "end_phase") == 0)
+    {
+      if (argc != 1)
+        BAD_COMMAND("usage: %s", argv[0]);
+
+      test_case_end_phase (test);
+    }
+  else if (strcmp (argv[0], "assert_frame_time") == 0 ||
+           strcmp (argv[0], "assert_paint_time") == 0 ||
+           strcmp (argv[0], "assert_latency") == 0 ||
+           strcmp (argv[0], "assert_reconfig_time") == 0 ||
+           strcmp (argv[0], "assert_cursor_latency") == 0 ||
+           strcmp (argv[0], "assert_missed_frames") == 0 ||
+           strcmp (argv[0], "assert_rss") == 0 ||
+           strcmp (argv[0], "assert_cpu_time") == 0)
+    {
+      if (!test_case_assert_perf (test, argc, argv, error))
+        return FALSE;
+    }
+  else if (strcmp (argv[0], "assert_configures") == 0)
+    {
+      if (!test_case_assert_configures (test, argc, argv, error))
+        return FALSE;
+    }
   else if (strcmp (argv[0], "wait") == 0)
     {
       if (argc != 1)
@@ -861,6 +2063,16 @@ test_case_destroy (TestCase *test,
 
   async_waiter_destroy (test->waiter);
 
+  clutter_threads_remove_repaint_func (test->pre_paint_func_id);
+  clutter_threads_remove_repaint_func (test->post_paint_func_id);
+  g_signal_handlers_disconnect_by_func (meta_monitor_manager_get (),
+                                        on_monitors_changed, test);
+  g_signal_handlers_disconnect_by_func (meta_backend_get_cursor_renderer (meta_get_backend ()),
+                                        on_cursor_painted, test);
+  g_signal_handlers_disconnect_by_func (meta_get_display (),
+                                        on_window_created, test);
+  g_ptr_array_unref (test->phases);
+
   meta_display_set_alarm_filter (meta_get_display (), NULL, NULL);
 
   g_hash_table_destroy (test->clients);
@@ -873,6 +2085,46 @@ test_case_destroy (TestCase *test,
 
 /**********************************************************************/
 
+/* Set if --perf-output is given */
+static char *perf_output;
+static GString *perf_report;
+static int n_perf_report_tests;
+
+static void
+perf_report_add_test (const char *name,
+                      GPtrArray  *phases)
+{
+  guint i;
+
+  if (phases->len == 0)
+    return;
+
+  if (n_perf_report_tests++ > 0)
+    g_string_append (perf_report, ",");
+
+  g_string_append (perf_report, "\n    {\n      \"name\": ");
+  append_json_string (perf_report, name);
+  g_string_append (perf_report, ",\n      \"phases\": [\n");
+
+  for (i = 0; i < phases->len; i++)
+    {
+      if (i > 0)
+        g_string_append (perf_report, ",\n");
+
+      perf_phase_append_json (phases->pdata[i], perf_report);
+    }
+
+  g_string_append (perf_report, "\n      ]\n    }");
+}
+
+static gboolean
+perf_report_write (GError **error)
+{
+  g_string_append (perf_report, "\n  ]\n}\n");
+
+  return g_file_set_contents (perf_output, perf_report->str, perf_report->len, error);
+}
+
 static gboolean
 run_test (const char *filename,
           int         index)
@@ -939,9 +2191,6 @@ run_test (const char *filename,
   if (in != NULL)
     g_object_unref (in);
 
-  GError *cleanup_error = NULL;
-  test_case_destroy (test, &cleanup_error);
-
   const char *testspos = strstr (filename, "tests/");
   char *pretty_name;
   if (testspos)
@@ -949,6 +2198,14 @@ run_test (const char *filename,
   else
     pretty_name = g_strdup (filename);
 
+  /* Measure before the cleanup destroys the windows */
+  test_case_end_phase (test);
+  if (perf_report)
+    perf_report_add_test (pretty_name, test->phases);
+
+  GError *cleanup_error = NULL;
+  test_case_destroy (test, &cleanup_error);
+
   if (error || cleanup_error)
     {
       g_print ("not ok %d %s\n", index, pretty_name);
@@ -996,6 +2253,18 @@ run_tests (gpointer data)
     if (!run_test (info->tests[i], i + 1))
       success = FALSE;
 
+  if (perf_report)
+    {
+      GError *error = NULL;
+
+      if (!perf_report_write (&error))
+        {
+          g_printerr ("Error writing %s: %s\n", perf_output, error->message);
+          g_error_free (error);
+          success = FALSE;
+        }
+    }
+
   meta_quit (success ? 0 : 1);
 
   return FALSE;
@@ -1058,6 +2327,7 @@ find_metatests_in_directory (GFile     *directory,
 }
 
 static gboolean all_tests = FALSE;
+static gboolean headless = FALSE;
 
 const GOptionEntry options[] = {
   {
@@ -1066,6 +2336,18 @@ const GOptionEntry options[] = {
     "Run all installed tests",
     NULL
   },
+  {
+    "headless", 0, 0, G_OPTION_ARG_NONE,
+    &headless,
+    "Run mutter headless rather than nested",
+    NULL
+  },
+  {
+    "perf-output", 0, 0, G_OPTION_ARG_FILENAME,
+    &perf_output,
+    "Write the measurements of test phases as JSON to FILE",
+    "FILE"
+  },
   { NULL }
 };
 
@@ -1119,7 +2401,7 @@ main (int argc, char **argv)
 
   /* Then initalize mutter with a different set of arguments */
 
-  char *fake_args[] = { NULL, (char *)"--wayland" };
+  char *fake_args[] = { NULL, headless ? (char *)"--headless" : (char *)"--wayland" };
   fake_args[0] = argv[0];
   char **fake_argv = fake_args;
   int fake_argc = 2;
@@ -1146,6 +2428,9 @@ main (int argc, char **argv)
   meta_init ();
   meta_register_with_session ();
 
+  if (perf_output)
+    perf_report = g_string_new ("{\n  \"tests\": [");
+
   RunTestsInfo info;
   info.tests = (char **)tests->pdata;
   info.n_tests = tests->len;
@@ -115,17 +115,32 @@ meta_wayland_buffer_ensure_texture (MetaWaylandBuffer *buffer)
     }
 
   buffer->texture = texture;
+  buffer->width = cogl_texture_get_width (texture);
+  buffer->height = cogl_texture_get_height (texture);
 
  out:
   return buffer->texture;
 }
 
+/* Drops the texture imported from the buffer, but keeps the buffer itself
+ * so that meta_wayland_buffer_ensure_texture() can import it again. The
+ * size of the buffer stays valid. */
+void
+meta_wayland_buffer_release_texture (MetaWaylandBuffer *buffer)
+{
+  g_clear_pointer (&buffer->texture, cogl_object_unref);
+}
+
 void
 meta_wayland_buffer_process_damage (MetaWaylandBuffer *buffer,
                                     cairo_region_t    *region)
 {
   struct wl_shm_buffer *shm_buffer;
 
+  /* The whole buffer is uploaded when the texture is imported again */
+  if (buffer->texture == NULL)
+    return;
+
   shm_buffer = wl_shm_buffer_get (buffer->resource);
 
   if (shm_buffer)
@@ -55,10 +55,10 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include <sys/mman.h>
 #include <clutter/evdev/clutter-evdev.h>
 
 #include "backends/meta-backend-private.h"
+#include "util-private.h"
 
 #include "meta-wayland-private.h"
 
@@ -75,42 +75,151 @@ unbind_resource (struct wl_resource *resource)
   wl_list_remove (wl_resource_get_link (resource));
 }
 
-static int
-create_anonymous_file (off_t size,
-                       GError **error)
+#ifndef F_LINUX_SPECIFIC_BASE
+#define F_LINUX_SPECIFIC_BASE 1024
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS (F_LINUX_SPECIFIC_BASE + 9)
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#define F_SEAL_WRITE 0x0008
+#endif
+
+/* How many serialized keymaps are kept around for switching back */
+#define KEYMAP_FILE_CACHE_SIZE 4
+
+struct _MetaWaylandKeymapFile
 {
-  static const char template[] = "mutter-shared-XXXXXX";
-  char *path;
-  int fd, flags;
+  struct xkb_keymap *keymap;
+  int fd;
+  size_t size;
+};
+
+static void
+keymap_file_free (MetaWaylandKeymapFile *keymap_file)
+{
+  xkb_keymap_unref (keymap_file->keymap);
+  close (keymap_file->fd);
+  g_slice_free (MetaWaylandKeymapFile, keymap_file);
+}
+
+/* Writes at the start of the file without moving its offset, which
+ * clients share with us through the passed file descriptor.
+ */
+static gboolean
+write_all (int          fd,
+           const char  *data,
+           size_t       size,
+           GError     **error)
+{
+  off_t offset = 0;
+
+  while (size > 0)
+    {
+      ssize_t written = pwrite (fd, data, size, offset);
+
+      if (written < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          g_set_error_literal (error,
+                               G_FILE_ERROR,
+                               g_file_error_from_errno (errno),
+                               strerror (errno));
+          return FALSE;
+        }
+
+      data += written;
+      size -= written;
+      offset += written;
+    }
+
+  return TRUE;
+}
+
+/* Serializes the keymap to a file shared by all clients. When the file
+ * is a memfd, it is sealed, so that no client can alter what the others
+ * read from it.
+ */
+static MetaWaylandKeymapFile *
+keymap_file_new (struct xkb_keymap  *keymap,
+                 GError            **error)
+{
+  MetaWaylandKeymapFile *keymap_file;
+  char *keymap_str;
+  size_t size;
+  int fd;
+
+  keymap_str = xkb_keymap_get_as_string (keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+  if (keymap_str == NULL)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                           "Failed to get string version of keymap");
+      return NULL;
+    }
+
+  size = strlen (keymap_str) + 1;
+
+  fd = meta_create_anonymous_file ("mutter-keymap", 0, error);
+  if (fd < 0)
+    {
+      free (keymap_str);
+      return NULL;
+    }
 
-  fd = g_file_open_tmp (template, &path, error);
+  if (!write_all (fd, keymap_str, size, error))
+    {
+      free (keymap_str);
+      close (fd);
+      return NULL;
+    }
 
-  if (fd == -1)
-    return -1;
+  free (keymap_str);
 
-  unlink (path);
-  g_free (path);
+  /* Fails with EINVAL for the temporary file fallback, which is fine */
+  fcntl (fd, F_ADD_SEALS,
+         F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
 
-  flags = fcntl (fd, F_GETFD);
-  if (flags == -1)
-    goto err;
+  keymap_file = g_slice_new0 (MetaWaylandKeymapFile);
+  keymap_file->keymap = xkb_keymap_ref (keymap);
+  keymap_file->fd = fd;
+  keymap_file->size = size;
 
-  if (fcntl (fd, F_SETFD, flags | FD_CLOEXEC) == -1)
-    goto err;
+  return keymap_file;
+}
 
-  if (ftruncate (fd, size) < 0)
-    goto err;
+static MetaWaylandKeymapFile *
+ensure_keymap_file (MetaWaylandXkbInfo  *xkb_info,
+                    struct xkb_keymap   *keymap,
+                    GError             **error)
+{
+  MetaWaylandKeymapFile *keymap_file;
+  GList *l;
 
-  return fd;
+  for (l = xkb_info->keymap_files.head; l; l = l->next)
+    {
+      keymap_file = l->data;
 
- err:
-  g_set_error_literal (error,
-                       G_FILE_ERROR,
-                       g_file_error_from_errno (errno),
-                       strerror (errno));
-  close (fd);
+      if (keymap_file->keymap == keymap)
+        {
+          g_queue_unlink (&xkb_info->keymap_files, l);
+          g_queue_push_head_link (&xkb_info->keymap_files, l);
+          return keymap_file;
+        }
+    }
+
+  keymap_file = keymap_file_new (keymap, error);
+  if (!keymap_file)
+    return NULL;
+
+  g_queue_push_head (&xkb_info->keymap_files, keymap_file);
 
-  return -1;
+  while (g_queue_get_length (&xkb_info->keymap_files) > KEYMAP_FILE_CACHE_SIZE)
+    keymap_file_free (g_queue_pop_tail (&xkb_info->keymap_files));
+
+  return keymap_file;
 }
 
 static void
@@ -139,9 +248,8 @@ meta_wayland_keyboard_take_keymap (MetaWaylandKeyboard *keyboard,
 				   struct xkb_keymap   *keymap)
 {
   MetaWaylandXkbInfo  *xkb_info = &keyboard->xkb_info;
+  MetaWaylandKeymapFile *keymap_file;
   GError *error = NULL;
-  char *keymap_str;
-  size_t previous_size;
 
   if (keymap == NULL)
     {
@@ -149,60 +257,28 @@ meta_wayland_keyboard_take_keymap (MetaWaylandKeyboard *keyboard,
       return;
     }
 
+  if (keymap == xkb_info->keymap)
+    return;
+
   xkb_keymap_unref (xkb_info->keymap);
   xkb_info->keymap = xkb_keymap_ref (keymap);
 
   meta_wayland_keyboard_update_xkb_state (keyboard);
 
-  keymap_str = xkb_map_get_as_string (xkb_info->keymap);
-  if (keymap_str == NULL)
-    {
-      g_warning ("failed to get string version of keymap");
-      return;
-    }
-  previous_size = xkb_info->keymap_size;
-  xkb_info->keymap_size = strlen (keymap_str) + 1;
-
-  if (xkb_info->keymap_fd >= 0)
-    close (xkb_info->keymap_fd);
-
-  xkb_info->keymap_fd = create_anonymous_file (xkb_info->keymap_size, &error);
-  if (xkb_info->keymap_fd < 0)
+  keymap_file = ensure_keymap_file (xkb_info, keymap, &error);
+  if (!keymap_file)
     {
-      g_warning ("creating a keymap file for %lu bytes failed: %s",
-                 (unsigned long) xkb_info->keymap_size,
-                 error->message);
+      g_warning ("Creating a keymap file failed: %s", error->message);
       g_clear_error (&error);
-      goto err_keymap_str;
+      return;
     }
 
-  if (xkb_info->keymap_area)
-    munmap (xkb_info->keymap_area, previous_size);
-
-  xkb_info->keymap_area = mmap (NULL, xkb_info->keymap_size,
-                                PROT_READ | PROT_WRITE,
-                                MAP_SHARED, xkb_info->keymap_fd, 0);
-  if (xkb_info->keymap_area == MAP_FAILED)
-    {
-      g_warning ("failed to mmap() %lu bytes\n",
-                 (unsigned long) xkb_info->keymap_size);
-      goto err_dev_zero;
-    }
-  strcpy (xkb_info->keymap_area, keymap_str);
-  free (keymap_str);
+  xkb_info->keymap_fd = keymap_file->fd;
+  xkb_info->keymap_size = keymap_file->size;
 
   inform_clients_of_new_keymap (keyboard);
 
   notify_modifiers (keyboard);
-
-  return;
-
-err_dev_zero:
-  close (xkb_info->keymap_fd);
-  xkb_info->keymap_fd = -1;
-err_keymap_str:
-  free (keymap_str);
-  return;
 }
 
 static void
@@ -390,6 +466,7 @@ meta_wayland_keyboard_init (MetaWaylandKeyboard *keyboard,
   keyboard->focus_surface_listener.notify = keyboard_handle_focus_surface_destroy;
 
   keyboard->xkb_info.keymap_fd = -1;
+  g_queue_init (&keyboard->xkb_info.keymap_files);
 
   keyboard->settings = g_settings_new ("org.gnome.desktop.peripherals.keyboard");
   g_signal_connect (keyboard->settings, "changed",
@@ -408,10 +485,10 @@ meta_wayland_xkb_info_destroy (MetaWaylandXkbInfo *xkb_info)
   xkb_keymap_unref (xkb_info->keymap);
   xkb_state_unref (xkb_info->state);
 
-  if (xkb_info->keymap_area)
-    munmap (xkb_info->keymap_area, xkb_info->keymap_size);
-  if (xkb_info->keymap_fd >= 0)
-    close (xkb_info->keymap_fd);
+  /* keymap_fd belongs to one of the cached keymap files */
+  g_queue_foreach (&xkb_info->keymap_files, (GFunc) keymap_file_free, NULL);
+  g_queue_clear (&xkb_info->keymap_files);
+  xkb_info->keymap_fd = -1;
 }
 
 void
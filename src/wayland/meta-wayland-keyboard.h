@@ -49,13 +49,17 @@
 #include <wayland-server.h>
 #include <xkbcommon/xkbcommon.h>
 
+typedef struct _MetaWaylandKeymapFile MetaWaylandKeymapFile;
+
 typedef struct
 {
   struct xkb_keymap *keymap;
   struct xkb_state *state;
   int keymap_fd;
   size_t keymap_size;
-  char *keymap_area;
+
+  /* MetaWaylandKeymapFile, most recently used first */
+  GQueue keymap_files;
 } MetaWaylandXkbInfo;
 
 struct _MetaWaylandKeyboard
@@ -55,6 +55,7 @@
 #include "meta-wayland-surface.h"
 #include "meta-wayland-buffer.h"
 #include "meta-wayland-surface-role-cursor.h"
+#include "meta-wayland-relative-pointer.h"
 #include "meta-xwayland.h"
 #include "meta-cursor.h"
 #include "meta-cursor-tracker-private.h"
@@ -63,8 +64,10 @@
 #include "backends/meta-backend-private.h"
 #include "backends/meta-cursor-tracker-private.h"
 #include "backends/meta-cursor-renderer.h"
+#include "meta/prefs.h"
 
 #ifdef HAVE_NATIVE_BACKEND
+#include <clutter/evdev/clutter-evdev.h>
 #include "backends/native/meta-backend-native.h"
 #endif
 
@@ -72,6 +75,11 @@
 
 #define DEFAULT_AXIS_STEP_DISTANCE wl_fixed_from_int (10)
 
+/* Longest time a coalesced motion event is held back when no frame
+ * is painted in the meantime.
+ */
+#define MOTION_COALESCE_DEADLINE_MS 8
+
 static MetaWaylandPointerClient *
 meta_wayland_pointer_client_new (void)
 {
@@ -81,6 +89,7 @@ meta_wayland_pointer_client_new (void)
   wl_list_init (&pointer_client->pointer_resources);
   wl_list_init (&pointer_client->swipe_gesture_resources);
   wl_list_init (&pointer_client->pinch_gesture_resources);
+  wl_list_init (&pointer_client->relative_pointer_resources);
 
   return pointer_client;
 }
@@ -109,6 +118,11 @@ meta_wayland_pointer_client_free (MetaWaylandPointerClient *pointer_client)
       wl_list_remove (wl_resource_get_link (resource));
       wl_list_init (wl_resource_get_link (resource));
     }
+  wl_resource_for_each_safe (resource, next, &pointer_client->relative_pointer_resources)
+    {
+      wl_list_remove (wl_resource_get_link (resource));
+      wl_list_init (wl_resource_get_link (resource));
+    }
 
   g_slice_free (MetaWaylandPointerClient, pointer_client);
 }
@@ -118,7 +132,8 @@ meta_wayland_pointer_client_is_empty (MetaWaylandPointerClient *pointer_client)
 {
   return (wl_list_empty (&pointer_client->pointer_resources) &&
           wl_list_empty (&pointer_client->swipe_gesture_resources) &&
-          wl_list_empty (&pointer_client->pinch_gesture_resources));
+          wl_list_empty (&pointer_client->pinch_gesture_resources) &&
+          wl_list_empty (&pointer_client->relative_pointer_resources));
 }
 
 MetaWaylandPointerClient *
@@ -227,18 +242,61 @@ pointer_handle_focus_surface_destroy (struct wl_listener *listener, void *data)
   meta_wayland_pointer_set_focus (pointer, NULL);
 }
 
-void
-meta_wayland_pointer_send_motion (MetaWaylandPointer *pointer,
-                                  const ClutterEvent *event)
+typedef struct
+{
+  uint64_t time_us;
+  double dx, dy;
+  double dx_unaccel, dy_unaccel;
+} RelativeMotion;
+
+static void
+relative_motion_free (RelativeMotion *motion)
+{
+  g_slice_free (RelativeMotion, motion);
+}
+
+/* Takes the device samples the motion event stands for, Clutter having
+ * possibly compressed several into it; they are sent along with it, so
+ * they follow the same focus and grabs as wl_pointer.motion. */
+static void
+take_relative_motions (MetaWaylandPointer *pointer,
+                       const ClutterEvent *event)
+{
+  guint32 time = clutter_event_get_time (event);
+  RelativeMotion *motion;
+
+  g_queue_foreach (&pointer->event_relative_motions, (GFunc) relative_motion_free, NULL);
+  g_queue_clear (&pointer->event_relative_motions);
+
+  while ((motion = g_queue_peek_head (&pointer->queued_relative_motions)) &&
+         (guint32) (motion->time_us / 1000) <= time)
+    g_queue_push_tail (&pointer->event_relative_motions,
+                       g_queue_pop_head (&pointer->queued_relative_motions));
+}
+
+static void
+send_relative_motions (MetaWaylandPointer *pointer)
+{
+  RelativeMotion *motion;
+
+  while ((motion = g_queue_pop_head (&pointer->event_relative_motions)))
+    {
+      meta_wayland_relative_pointer_send_motion (pointer,
+                                                 motion->time_us,
+                                                 motion->dx, motion->dy,
+                                                 motion->dx_unaccel,
+                                                 motion->dy_unaccel);
+      relative_motion_free (motion);
+    }
+}
+
+static void
+send_motion (MetaWaylandPointer *pointer,
+             uint32_t            time)
 {
   struct wl_resource *resource;
-  uint32_t time;
   wl_fixed_t sx, sy;
 
-  if (!pointer->focus_client)
-    return;
-
-  time = clutter_event_get_time (event);
   meta_wayland_pointer_get_relative_coordinates (pointer,
                                                  pointer->focus_surface,
                                                  &sx, &sy);
@@ -247,6 +305,74 @@ meta_wayland_pointer_send_motion (MetaWaylandPointer *pointer,
     {
       wl_pointer_send_motion (resource, time, sx, sy);
     }
+
+  pointer->n_motion_events_sent++;
+}
+
+/**
+ * meta_wayland_pointer_flush_motion:
+ * @pointer: a #MetaWaylandPointer
+ *
+ * Sends the motion event held back by coalescing, if any. This is done
+ * at the end of every frame, and before any event that has to be
+ * ordered after the motion, like button presses, axis events or focus
+ * changes.
+ */
+void
+meta_wayland_pointer_flush_motion (MetaWaylandPointer *pointer)
+{
+  if (pointer->motion_deadline_id == 0)
+    return;
+
+  g_source_remove (pointer->motion_deadline_id);
+  pointer->motion_deadline_id = 0;
+
+  if (pointer->focus_client)
+    send_motion (pointer, pointer->pending_motion_time);
+}
+
+static gboolean
+on_motion_deadline (gpointer user_data)
+{
+  MetaWaylandPointer *pointer = user_data;
+
+  pointer->motion_deadline_id = 0;
+
+  if (pointer->focus_client)
+    send_motion (pointer, pointer->pending_motion_time);
+
+  return G_SOURCE_REMOVE;
+}
+
+void
+meta_wayland_pointer_send_motion (MetaWaylandPointer *pointer,
+                                  const ClutterEvent *event)
+{
+  if (!pointer->focus_client)
+    return;
+
+  send_relative_motions (pointer);
+
+  pointer->n_motion_events++;
+
+  if (!pointer->coalesce_motion)
+    {
+      send_motion (pointer, clutter_event_get_time (event));
+      return;
+    }
+
+  /* The position is read from the device when the event is finally
+   * sent, so only the time of the latest event needs to be kept.
+   */
+  pointer->pending_motion_time = clutter_event_get_time (event);
+
+  if (pointer->motion_deadline_id == 0)
+    {
+      pointer->motion_deadline_id =
+        g_timeout_add (MOTION_COALESCE_DEADLINE_MS, on_motion_deadline, pointer);
+      g_source_set_name_by_id (pointer->motion_deadline_id,
+                               "[mutter] on_motion_deadline");
+    }
 }
 
 void
@@ -356,6 +482,59 @@ meta_wayland_pointer_on_cursor_changed (MetaCursorTracker *cursor_tracker,
     meta_wayland_surface_update_outputs (pointer->cursor_surface);
 }
 
+static void
+update_motion_coalescing (MetaWaylandPointer *pointer)
+{
+  gboolean coalesce_motion = meta_prefs_get_coalesce_pointer_motion ();
+
+  if (pointer->coalesce_motion == coalesce_motion)
+    return;
+
+  meta_wayland_pointer_flush_motion (pointer);
+  pointer->coalesce_motion = coalesce_motion;
+}
+
+static void
+prefs_changed_callback (MetaPreference pref,
+                        gpointer       data)
+{
+  MetaWaylandPointer *pointer = data;
+
+  if (pref == META_PREF_COALESCE_POINTER_MOTION)
+    update_motion_coalescing (pointer);
+}
+
+#ifdef HAVE_NATIVE_BACKEND
+/* Clutter throttles motion events to one per frame, and only gives the
+ * accelerated absolute position; relative pointer clients get every
+ * device sample, with its real deltas, taken from libinput here and
+ * sent once Clutter dispatches the motion event they went into.
+ */
+static gboolean
+evdev_filter_func (struct libinput_event *event,
+                   gpointer               data)
+{
+  MetaWaylandPointer *pointer = data;
+  struct libinput_event_pointer *pointer_event;
+  RelativeMotion *motion;
+
+  if (libinput_event_get_type (event) != LIBINPUT_EVENT_POINTER_MOTION)
+    return CLUTTER_EVENT_PROPAGATE;
+
+  pointer_event = libinput_event_get_pointer_event (event);
+
+  motion = g_slice_new (RelativeMotion);
+  motion->time_us = libinput_event_pointer_get_time_usec (pointer_event);
+  motion->dx = libinput_event_pointer_get_dx (pointer_event);
+  motion->dy = libinput_event_pointer_get_dy (pointer_event);
+  motion->dx_unaccel = libinput_event_pointer_get_dx_unaccelerated (pointer_event);
+  motion->dy_unaccel = libinput_event_pointer_get_dy_unaccelerated (pointer_event);
+  g_queue_push_tail (&pointer->queued_relative_motions, motion);
+
+  return CLUTTER_EVENT_PROPAGATE;
+}
+#endif
+
 void
 meta_wayland_pointer_init (MetaWaylandPointer *pointer,
                            struct wl_display  *display)
@@ -386,6 +565,15 @@ meta_wayland_pointer_init (MetaWaylandPointer *pointer,
                     "cursor-changed",
                     G_CALLBACK (meta_wayland_pointer_on_cursor_changed),
                     pointer);
+
+  pointer->coalesce_motion = meta_prefs_get_coalesce_pointer_motion ();
+  meta_prefs_add_listener (prefs_changed_callback, pointer);
+
+#ifdef HAVE_NATIVE_BACKEND
+  MetaBackend *backend = meta_get_backend ();
+  if (META_IS_BACKEND_NATIVE (backend))
+    clutter_evdev_add_filter (evdev_filter_func, pointer, NULL);
+#endif
 }
 
 void
@@ -405,6 +593,29 @@ meta_wayland_pointer_release (MetaWaylandPointer *pointer)
 
   meta_wayland_pointer_set_focus (pointer, NULL);
 
+  if (pointer->motion_deadline_id)
+    {
+      g_source_remove (pointer->motion_deadline_id);
+      pointer->motion_deadline_id = 0;
+    }
+
+  meta_prefs_remove_listener (prefs_changed_callback, pointer);
+
+#ifdef HAVE_NATIVE_BACKEND
+  MetaBackend *backend = meta_get_backend ();
+  if (META_IS_BACKEND_NATIVE (backend))
+    clutter_evdev_remove_filter (evdev_filter_func, pointer);
+#endif
+
+  g_queue_foreach (&pointer->queued_relative_motions, (GFunc) relative_motion_free, NULL);
+  g_queue_clear (&pointer->queued_relative_motions);
+  g_queue_foreach (&pointer->event_relative_motions, (GFunc) relative_motion_free, NULL);
+  g_queue_clear (&pointer->event_relative_motions);
+
+  meta_verbose ("Pointer motion: %" G_GUINT64_FORMAT " events, "
+                "%" G_GUINT64_FORMAT " sent to clients\n",
+                pointer->n_motion_events, pointer->n_motion_events_sent);
+
   g_clear_pointer (&pointer->pointer_clients, g_hash_table_unref);
   pointer->display = NULL;
   pointer->cursor_surface = NULL;
@@ -458,6 +669,10 @@ meta_wayland_pointer_update (MetaWaylandPointer *pointer,
 {
   repick_for_event (pointer, event);
 
+  /* Motion events a grab or the stage consumes take theirs as well */
+  if (event->type == CLUTTER_MOTION)
+    take_relative_motions (pointer, event);
+
   pointer->button_count = count_buttons (event);
 }
 
@@ -558,6 +773,10 @@ gboolean
 meta_wayland_pointer_handle_event (MetaWaylandPointer *pointer,
                                    const ClutterEvent *event)
 {
+  /* Motion held back must reach the client before anything else */
+  if (event->type != CLUTTER_MOTION)
+    meta_wayland_pointer_flush_motion (pointer);
+
   switch (event->type)
     {
     case CLUTTER_MOTION:
@@ -648,6 +867,8 @@ meta_wayland_pointer_set_focus (MetaWaylandPointer *pointer,
   if (pointer->focus_surface == surface)
     return;
 
+  meta_wayland_pointer_flush_motion (pointer);
+
   if (pointer->focus_surface != NULL)
     {
       struct wl_client *client =
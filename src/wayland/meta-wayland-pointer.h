@@ -52,6 +52,7 @@ struct _MetaWaylandPointerClient
   struct wl_list pointer_resources;
   struct wl_list swipe_gesture_resources;
   struct wl_list pinch_gesture_resources;
+  struct wl_list relative_pointer_resources;
 };
 
 struct _MetaWaylandPointer
@@ -80,6 +81,21 @@ struct _MetaWaylandPointer
   MetaWaylandSurface *current;
 
   guint32 button_count;
+
+  /* Absolute motion sent to clients is coalesced up to the next frame,
+   * or until the deadline passes, when coalesce_motion is set.
+   */
+  gboolean coalesce_motion;
+  guint motion_deadline_id;
+  guint32 pending_motion_time;
+
+  guint64 n_motion_events;
+  guint64 n_motion_events_sent;
+
+  /* Device samples read ahead of the Clutter motion events carrying
+   * them, and those of the motion event being processed */
+  GQueue queued_relative_motions;
+  GQueue event_relative_motions;
 };
 
 void meta_wayland_pointer_init (MetaWaylandPointer *pointer,
@@ -96,6 +112,8 @@ gboolean meta_wayland_pointer_handle_event (MetaWaylandPointer *pointer,
 void meta_wayland_pointer_send_motion (MetaWaylandPointer *pointer,
                                        const ClutterEvent *event);
 
+void meta_wayland_pointer_flush_motion (MetaWaylandPointer *pointer);
+
 void meta_wayland_pointer_send_button (MetaWaylandPointer *pointer,
                                        const ClutterEvent *event);
 
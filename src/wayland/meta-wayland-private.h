@@ -56,6 +56,7 @@ typedef struct
   char *display_name;
 
   GMainLoop *init_loop;
+  gboolean ready;
 
   MetaXWaylandSelection *selection_data;
 } MetaXWaylandManager;
@@ -0,0 +1,170 @@
+/*
+ * Wayland Support
+ *
+ * Copyright (C) 2016 Red Hat
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "meta-wayland-relative-pointer.h"
+#include "meta-wayland-pointer.h"
+#include "meta-wayland-private.h"
+#include "meta-wayland-versions.h"
+#include "relative-pointer-unstable-v1-server-protocol.h"
+
+#ifdef HAVE_NATIVE_BACKEND
+#include "backends/native/meta-backend-native.h"
+#endif
+
+/*
+ * Relative pointer motion is sent for every sample of the device, even
+ * when the absolute wl_pointer.motion events are coalesced; clients that
+ * want the full rate history of the pointer can get it from here. The
+ * deltas come from the device, so they are only available with the
+ * native backend.
+ */
+void
+meta_wayland_relative_pointer_send_motion (MetaWaylandPointer *pointer,
+                                           uint64_t            time_us,
+                                           double              dx,
+                                           double              dy,
+                                           double              dx_unaccel,
+                                           double              dy_unaccel)
+{
+  struct wl_resource *resource;
+  int scale;
+
+  if (!pointer->focus_client ||
+      wl_list_empty (&pointer->focus_client->relative_pointer_resources))
+    return;
+
+  scale = pointer->focus_surface->scale;
+
+  wl_resource_for_each (resource,
+                        &pointer->focus_client->relative_pointer_resources)
+    {
+      zwp_relative_pointer_v1_send_relative_motion (resource,
+                                                    (uint32_t) (time_us >> 32),
+                                                    (uint32_t) time_us,
+                                                    wl_fixed_from_double (dx / scale),
+                                                    wl_fixed_from_double (dy / scale),
+                                                    wl_fixed_from_double (dx_unaccel / scale),
+                                                    wl_fixed_from_double (dy_unaccel / scale));
+    }
+}
+
+static void
+relative_pointer_destroy (struct wl_client   *client,
+                          struct wl_resource *resource)
+{
+  wl_resource_destroy (resource);
+}
+
+static const struct zwp_relative_pointer_v1_interface relative_pointer_interface = {
+  relative_pointer_destroy
+};
+
+static void
+relative_pointer_manager_destroy (struct wl_client   *client,
+                                  struct wl_resource *resource)
+{
+  wl_resource_destroy (resource);
+}
+
+static void
+relative_pointer_manager_get_relative_pointer (struct wl_client   *client,
+                                               struct wl_resource *resource,
+                                               uint32_t            id,
+                                               struct wl_resource *pointer_resource)
+{
+  MetaWaylandPointer *pointer = wl_resource_get_user_data (pointer_resource);
+  MetaWaylandPointerClient *pointer_client;
+  struct wl_resource *relative_pointer_resource;
+
+  relative_pointer_resource =
+    wl_resource_create (client, &zwp_relative_pointer_v1_interface,
+                        wl_resource_get_version (resource), id);
+  if (!relative_pointer_resource)
+    {
+      wl_client_post_no_memory (client);
+      return;
+    }
+
+  /* The wl_pointer may have been made defunct; the relative pointer is
+   * then inert until destroyed.
+   */
+  pointer_client = meta_wayland_pointer_get_pointer_client (pointer, client);
+  if (!pointer_client)
+    {
+      wl_resource_set_implementation (relative_pointer_resource,
+                                      &relative_pointer_interface,
+                                      NULL, NULL);
+      return;
+    }
+
+  wl_resource_set_implementation (relative_pointer_resource,
+                                  &relative_pointer_interface,
+                                  pointer,
+                                  meta_wayland_pointer_unbind_pointer_client_resource);
+  wl_list_insert (&pointer_client->relative_pointer_resources,
+                  wl_resource_get_link (relative_pointer_resource));
+}
+
+static const struct zwp_relative_pointer_manager_v1_interface relative_pointer_manager = {
+  relative_pointer_manager_destroy,
+  relative_pointer_manager_get_relative_pointer,
+};
+
+static void
+bind_relative_pointer_manager (struct wl_client *client,
+                               void             *data,
+                               uint32_t          version,
+                               uint32_t          id)
+{
+  struct wl_resource *resource;
+
+  resource = wl_resource_create (client,
+                                 &zwp_relative_pointer_manager_v1_interface,
+                                 version, id);
+  if (!resource)
+    {
+      wl_client_post_no_memory (client);
+      return;
+    }
+
+  wl_resource_set_implementation (resource, &relative_pointer_manager,
+                                  NULL, NULL);
+}
+
+void
+meta_wayland_relative_pointer_init (MetaWaylandCompositor *compositor)
+{
+  gboolean have_device_deltas = FALSE;
+
+#ifdef HAVE_NATIVE_BACKEND
+  have_device_deltas = META_IS_BACKEND_NATIVE (meta_get_backend ());
+#endif
+
+  /* Without device deltas there is nothing to send */
+  if (!have_device_deltas)
+    return;
+
+  if (!wl_global_create (compositor->wayland_display,
+                         &zwp_relative_pointer_manager_v1_interface,
+                         META_ZWP_RELATIVE_POINTER_V1_VERSION,
+                         NULL, bind_relative_pointer_manager))
+    g_error ("Could not create relative pointer manager global");
+}
@@ -0,0 +1,38 @@
+/*
+ * Wayland Support
+ *
+ * Copyright (C) 2016 Red Hat
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef META_WAYLAND_RELATIVE_POINTER_H
+#define META_WAYLAND_RELATIVE_POINTER_H
+
+#include <wayland-server.h>
+#include <clutter/clutter.h>
+#include <glib.h>
+
+#include "meta-wayland-types.h"
+
+void meta_wayland_relative_pointer_init (MetaWaylandCompositor *compositor);
+
+void meta_wayland_relative_pointer_send_motion (MetaWaylandPointer *pointer,
+                                                uint64_t            time_us,
+                                                double              dx,
+                                                double              dy,
+                                                double              dx_unaccel,
+                                                double              dy_unaccel);
+
+#endif /* META_WAYLAND_RELATIVE_POINTER_H */
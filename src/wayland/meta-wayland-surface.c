@@ -215,8 +215,8 @@ surface_process_damage (MetaWaylandSurface *surface,
   /* Intersect the damage region with the surface region before scaling in
    * order to avoid integer overflow when scaling a damage region is too large
    * (for example INT32_MAX which mesa passes). */
-  buffer_width = cogl_texture_get_width (surface->buffer->texture);
-  buffer_height = cogl_texture_get_height (surface->buffer->texture);
+  buffer_width = surface->buffer->width;
+  buffer_height = surface->buffer->height;
   surface_rect = (cairo_rectangle_int_t) {
     .width = buffer_width / surface->scale,
     .height = buffer_height / surface->scale,
@@ -224,8 +224,12 @@ surface_process_damage (MetaWaylandSurface *surface,
   cairo_region_intersect_rectangle (region, &surface_rect);
 
   /* The damage region must be in the same coordinate space as the buffer,
-   * i.e. scaled with surface->scale. */
-  scaled_region = meta_region_scale (region, surface->scale);
+   * i.e. scaled with surface->scale. The pending damage is reset after
+   * this, so at scale 1 it is used as is rather than copied. */
+  if (surface->scale == 1)
+    scaled_region = cairo_region_reference (region);
+  else
+    scaled_region = meta_region_scale (region, surface->scale);
 
   /* First update the buffer. */
   meta_wayland_buffer_process_damage (surface->buffer, scaled_region);
@@ -463,29 +467,91 @@ pending_state_destroy (MetaWaylandPendingState *state)
     wl_resource_destroy (cb->resource);
 }
 
+/* Unlike pending_state_destroy() followed by pending_state_init(), this
+ * keeps the damage region around, so that the steady state commit path
+ * doesn't allocate.
+ */
 static void
 pending_state_reset (MetaWaylandPendingState *state)
 {
-  pending_state_destroy (state);
-  pending_state_init (state);
+  MetaWaylandFrameCallback *cb, *next;
+
+  state->newly_attached = FALSE;
+  if (state->buffer)
+    wl_list_remove (&state->buffer_destroy_listener.link);
+  state->buffer = NULL;
+  state->dx = 0;
+  state->dy = 0;
+  state->scale = 0;
+
+  /* Subtracting a region from itself empties it in place */
+  cairo_region_subtract (state->damage, state->damage);
+
+  g_clear_pointer (&state->input_region, cairo_region_destroy);
+  state->input_region_set = FALSE;
+  g_clear_pointer (&state->opaque_region, cairo_region_destroy);
+  state->opaque_region_set = FALSE;
+
+  wl_list_for_each_safe (cb, next, &state->frame_callback_list, link)
+    wl_resource_destroy (cb->resource);
+
+  state->has_new_geometry = FALSE;
 }
 
+/* Adds the state committed to a synchronized subsurface to the state
+ * cached until its parent is committed; later commits replace or add
+ * to what earlier ones set, as if they had been one commit.
+ */
 static void
-move_pending_state (MetaWaylandPendingState *from,
-                    MetaWaylandPendingState *to)
+merge_pending_state (MetaWaylandPendingState *from,
+                     MetaWaylandPendingState *to)
 {
-  if (from->buffer)
-    wl_list_remove (&from->buffer_destroy_listener.link);
+  if (from->newly_attached)
+    {
+      if (to->buffer)
+        wl_list_remove (&to->buffer_destroy_listener.link);
+
+      to->newly_attached = TRUE;
+      to->buffer = from->buffer;
+
+      if (to->buffer)
+        wl_signal_add (&to->buffer->destroy_signal, &to->buffer_destroy_listener);
+    }
 
-  *to = *from;
+  to->dx += from->dx;
+  to->dy += from->dy;
 
-  wl_list_init (&to->frame_callback_list);
-  wl_list_insert_list (&to->frame_callback_list, &from->frame_callback_list);
+  if (from->scale > 0)
+    to->scale = from->scale;
 
-  if (to->buffer)
-    wl_signal_add (&to->buffer->destroy_signal, &to->buffer_destroy_listener);
+  cairo_region_union (to->damage, from->damage);
 
-  pending_state_init (from);
+  if (from->input_region_set)
+    {
+      g_clear_pointer (&to->input_region, cairo_region_destroy);
+      to->input_region = from->input_region;
+      to->input_region_set = TRUE;
+      from->input_region = NULL;
+    }
+
+  if (from->opaque_region_set)
+    {
+      g_clear_pointer (&to->opaque_region, cairo_region_destroy);
+      to->opaque_region = from->opaque_region;
+      to->opaque_region_set = TRUE;
+      from->opaque_region = NULL;
+    }
+
+  wl_list_insert_list (to->frame_callback_list.prev, &from->frame_callback_list);
+  wl_list_init (&from->frame_callback_list);
+
+  if (from->has_new_geometry)
+    {
+      to->new_geometry = from->new_geometry;
+      to->has_new_geometry = TRUE;
+    }
+
+  pending_state_reset (from);
 }
 
 static void
@@ -675,7 +741,7 @@ meta_wayland_surface_commit (MetaWaylandSurface *surface)
    *     surface is in effective desynchronized mode.
    */
   if (is_surface_effectively_synchronized (surface))
-    move_pending_state (&surface->pending, &surface->sub.pending);
+    merge_pending_state (&surface->pending, &surface->sub.pending);
   else
     apply_pending_state (surface, &surface->pending);
 }
@@ -767,6 +833,19 @@ wl_surface_frame (struct wl_client *client,
   wl_list_insert (surface->pending.frame_callback_list.prev, &callback->link);
 }
 
+/* Clients tend to set the same regions on every commit; share the
+ * region currently in use instead of copying it again then.
+ */
+static cairo_region_t *
+reuse_or_copy_region (cairo_region_t *current,
+                      cairo_region_t *region)
+{
+  if (current && cairo_region_equal (current, region))
+    return cairo_region_reference (current);
+  else
+    return cairo_region_copy (region);
+}
+
 static void
 wl_surface_set_opaque_region (struct wl_client *client,
                               struct wl_resource *surface_resource,
@@ -783,7 +862,8 @@ wl_surface_set_opaque_region (struct wl_client *client,
     {
       MetaWaylandRegion *region = wl_resource_get_user_data (region_resource);
       cairo_region_t *cr_region = meta_wayland_region_peek_cairo_region (region);
-      surface->pending.opaque_region = cairo_region_copy (cr_region);
+      surface->pending.opaque_region =
+        reuse_or_copy_region (surface->opaque_region, cr_region);
     }
   surface->pending.opaque_region_set = TRUE;
 }
@@ -804,7 +884,8 @@ wl_surface_set_input_region (struct wl_client *client,
     {
       MetaWaylandRegion *region = wl_resource_get_user_data (region_resource);
       cairo_region_t *cr_region = meta_wayland_region_peek_cairo_region (region);
-      surface->pending.input_region = cairo_region_copy (cr_region);
+      surface->pending.input_region =
+        reuse_or_copy_region (surface->input_region, cr_region);
     }
   surface->pending.input_region_set = TRUE;
 }
@@ -2265,31 +2346,24 @@ meta_wayland_shell_init (MetaWaylandCompositor *compositor)
     g_error ("Failed to register a global wl-subcompositor object");
 }
 
+/* Enough room for every state fill_states() may add */
+#define MAX_XDG_SURFACE_STATES 4
+
 static void
 fill_states (struct wl_array *states, MetaWindow *window)
 {
-  uint32_t *s;
+  uint32_t *s = states->data;
 
   if (META_WINDOW_MAXIMIZED (window))
-    {
-      s = wl_array_add (states, sizeof *s);
-      *s = XDG_SURFACE_STATE_MAXIMIZED;
-    }
+    *s++ = XDG_SURFACE_STATE_MAXIMIZED;
   if (meta_window_is_fullscreen (window))
-    {
-      s = wl_array_add (states, sizeof *s);
-      *s = XDG_SURFACE_STATE_FULLSCREEN;
-    }
+    *s++ = XDG_SURFACE_STATE_FULLSCREEN;
   if (meta_grab_op_is_resizing (window->display->grab_op))
-    {
-      s = wl_array_add (states, sizeof *s);
-      *s = XDG_SURFACE_STATE_RESIZING;
-    }
+    *s++ = XDG_SURFACE_STATE_RESIZING;
   if (meta_window_appears_focused (window))
-    {
-      s = wl_array_add (states, sizeof *s);
-      *s = XDG_SURFACE_STATE_ACTIVATED;
-    }
+    *s++ = XDG_SURFACE_STATE_ACTIVATED;
+
+  states->size = (char *) s - (char *) states->data;
 }
 
 void
@@ -2303,15 +2377,18 @@ meta_wayland_surface_configure_notify (MetaWaylandSurface *surface,
       struct wl_client *client = wl_resource_get_client (surface->xdg_surface);
       struct wl_display *display = wl_client_get_display (client);
       uint32_t serial = wl_display_next_serial (display);
+      uint32_t state_data[MAX_XDG_SURFACE_STATES];
       struct wl_array states;
 
-      wl_array_init (&states);
+      /* Configures are sent for every step of an interactive resize,
+       * so the states are gathered on the stack rather than allocated.
+       */
+      states.data = state_data;
+      states.alloc = sizeof (state_data);
       fill_states (&states, surface->window);
 
       xdg_surface_send_configure (surface->xdg_surface, new_width, new_height, &states, serial);
 
-      wl_array_release (&states);
-
       if (sent_serial)
         {
           sent_serial->set = TRUE;
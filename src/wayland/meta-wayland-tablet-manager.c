@@ -260,3 +260,19 @@ meta_wayland_tablet_manager_update_cursor_position (MetaWaylandTabletManager *ma
       meta_wayland_tablet_tool_set_cursor_position (tool, new_x, new_y);
     }
 }
+
+void
+meta_wayland_tablet_manager_flush_frames (MetaWaylandTabletManager *manager)
+{
+  MetaWaylandTabletSeat *tablet_seat;
+  MetaWaylandTabletTool *tool;
+  GHashTableIter seat_iter, tool_iter;
+
+  g_hash_table_iter_init (&seat_iter, manager->seats);
+  while (g_hash_table_iter_next (&seat_iter, NULL, (gpointer*) &tablet_seat))
+    {
+      g_hash_table_iter_init (&tool_iter, tablet_seat->tools);
+      while (g_hash_table_iter_next (&tool_iter, NULL, (gpointer*) &tool))
+        meta_wayland_tablet_tool_flush_frame (tool);
+    }
+}
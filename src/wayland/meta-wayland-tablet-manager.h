@@ -50,4 +50,6 @@ gboolean meta_wayland_tablet_manager_handle_event   (MetaWaylandTabletManager *m
 void     meta_wayland_tablet_manager_update_cursor_position (MetaWaylandTabletManager *manager,
                                                              const ClutterEvent       *event);
 
+void     meta_wayland_tablet_manager_flush_frames (MetaWaylandTabletManager *manager);
+
 #endif /* META_WAYLAND_TABLET_MANAGER_H */
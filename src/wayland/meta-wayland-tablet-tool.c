@@ -35,9 +35,23 @@
 #include "meta-wayland-tablet.h"
 #include "meta-wayland-tablet-seat.h"
 #include "meta-wayland-tablet-tool.h"
+#include "meta/prefs.h"
 
 #define TABLET_AXIS_MAX 65535
 
+/* Longest time axis changes are held back when no frame is painted in
+ * the meantime, see meta_prefs_get_coalesce_pointer_motion().
+ */
+#define FRAME_DEADLINE_MS 8
+
+enum
+{
+  TOOL_AXIS_MOTION   = 1 << 0,
+  TOOL_AXIS_PRESSURE = 1 << 1,
+  TOOL_AXIS_DISTANCE = 1 << 2,
+  TOOL_AXIS_TILT     = 1 << 3,
+};
+
 static void
 unbind_resource (struct wl_resource *resource)
 {
@@ -184,7 +198,6 @@ meta_wayland_tablet_tool_notify_details (MetaWaylandTabletTool *tool,
 {
   guint64 serial;
 
-meta_warning("Beginning to blast tool events...\n");
   zwp_tablet_tool_v1_send_type (resource,
                               input_device_tool_get_type (tool->device_tool));
 
@@ -198,7 +211,6 @@ meta_warning("Beginning to blast tool events...\n");
   /* FIXME: zwp_tablet_tool_v1.hardware_id missing */
 
   zwp_tablet_tool_v1_send_done (resource);
-meta_warning("Beginning to blast tool events... DONE\n");
 }
 
 static void
@@ -207,7 +219,6 @@ meta_wayland_tablet_tool_ensure_resource (MetaWaylandTabletTool *tool,
 {
   struct wl_resource *seat_resource, *tool_resource;
 
-meta_warning("Ensuring tool resources are present...\n");
   seat_resource = meta_wayland_tablet_seat_lookup_resource (tool->seat, client);
 
   if (seat_resource &&
@@ -217,12 +228,9 @@ meta_warning("Ensuring tool resources are present...\n");
                                                                     seat_resource,
                                                                     0);
 
-      meta_warning("NOTIFYING OF NEW TOOL...\n");
       meta_wayland_tablet_seat_notify_tool (tool->seat, tool, client);
-      meta_warning("NOTIFYING OF NEW TOOL... DONE\n");
       meta_wayland_tablet_tool_notify_details (tool, tool_resource);
     }
-meta_warning("Ensuring tool resources are present... DONE\n");
 }
 
 static void
@@ -232,6 +240,11 @@ meta_wayland_tablet_tool_set_focus (MetaWaylandTabletTool *tool,
   if (tool->focus_surface == surface)
     return;
 
+  meta_wayland_tablet_tool_flush_frame (tool);
+
+  /* A new focus gets all axis values in its first frame */
+  tool->sent_axes = 0;
+
   if (tool->focus_surface != NULL)
     {
       struct wl_resource *resource;
@@ -337,6 +350,9 @@ meta_wayland_tablet_tool_free (MetaWaylandTabletTool *tool)
 
   meta_wayland_tablet_tool_set_focus (tool, NULL);
   meta_wayland_tablet_tool_set_cursor_surface (tool, NULL);
+
+  if (tool->frame_deadline_id)
+    g_source_remove (tool->frame_deadline_id);
   g_clear_object (&tool->cursor_renderer);
 
   wl_resource_for_each_safe (resource, next, &tool->resource_list)
@@ -536,160 +552,213 @@ meta_wayland_tablet_tool_get_relative_coordinates (MetaWaylandTabletTool *tool,
   *sy = wl_fixed_from_double (yf) / surface->scale;
 }
 
-static void
-notify_motion (MetaWaylandTabletTool *tool,
-               const ClutterEvent    *event)
+static gboolean
+send_motion (MetaWaylandTabletTool *tool)
 {
   struct wl_resource *resource;
-  ClutterInputDevice *device;
   wl_fixed_t sx, sy;
 
-  device = clutter_event_get_source_device (event);
-  meta_wayland_tablet_tool_get_relative_coordinates (tool, device,
+  meta_wayland_tablet_tool_get_relative_coordinates (tool, tool->device,
                                                      tool->focus_surface,
                                                      &sx, &sy);
 
+  if ((tool->sent_axes & TOOL_AXIS_MOTION) &&
+      sx == tool->sent_x && sy == tool->sent_y)
+    return FALSE;
+
   wl_resource_for_each(resource, &tool->focus_resource_list)
     {
       zwp_tablet_tool_v1_send_motion (resource, sx, sy);
     }
+
+  tool->sent_x = sx;
+  tool->sent_y = sy;
+  tool->sent_axes |= TOOL_AXIS_MOTION;
+
+  return TRUE;
 }
 
-static void
-notify_down (MetaWaylandTabletTool *tool,
-             const ClutterEvent    *event)
+static gboolean
+send_pending_axes (MetaWaylandTabletTool *tool)
 {
   struct wl_resource *resource;
-
-  tool->down_serial = wl_display_next_serial (tool->seat->manager->wl_display);
+  guint32 changed = 0;
+
+  if (tool->pending_axes & TOOL_AXIS_PRESSURE &&
+      (!(tool->sent_axes & TOOL_AXIS_PRESSURE) ||
+       tool->pending_pressure != tool->sent_pressure))
+    changed |= TOOL_AXIS_PRESSURE;
+  if (tool->pending_axes & TOOL_AXIS_DISTANCE &&
+      (!(tool->sent_axes & TOOL_AXIS_DISTANCE) ||
+       tool->pending_distance != tool->sent_distance))
+    changed |= TOOL_AXIS_DISTANCE;
+  if (tool->pending_axes & TOOL_AXIS_TILT &&
+      (!(tool->sent_axes & TOOL_AXIS_TILT) ||
+       tool->pending_tilt_x != tool->sent_tilt_x ||
+       tool->pending_tilt_y != tool->sent_tilt_y))
+    changed |= TOOL_AXIS_TILT;
 
   wl_resource_for_each(resource, &tool->focus_resource_list)
     {
-      zwp_tablet_tool_v1_send_down (resource, tool->down_serial);
+      if (changed & TOOL_AXIS_PRESSURE)
+        zwp_tablet_tool_v1_send_pressure (resource, tool->pending_pressure);
+      if (changed & TOOL_AXIS_DISTANCE)
+        zwp_tablet_tool_v1_send_distance (resource, tool->pending_distance);
+      if (changed & TOOL_AXIS_TILT)
+        zwp_tablet_tool_v1_send_tilt (resource,
+                                      tool->pending_tilt_x,
+                                      tool->pending_tilt_y);
     }
+
+  tool->sent_pressure = tool->pending_pressure;
+  tool->sent_distance = tool->pending_distance;
+  tool->sent_tilt_x = tool->pending_tilt_x;
+  tool->sent_tilt_y = tool->pending_tilt_y;
+  tool->sent_axes |= changed;
+
+  return changed != 0;
 }
 
-static void
-notify_up (MetaWaylandTabletTool *tool,
-           const ClutterEvent    *event)
+/**
+ * meta_wayland_tablet_tool_flush_frame:
+ * @tool: a #MetaWaylandTabletTool
+ *
+ * Sends the axis changes accumulated since the last frame, followed by
+ * a frame event. Axes that didn't change since they were last sent
+ * are left out. This must be done before proximity, tip and button
+ * events, so those are seen in order.
+ */
+void
+meta_wayland_tablet_tool_flush_frame (MetaWaylandTabletTool *tool)
 {
   struct wl_resource *resource;
+  gboolean changed = FALSE;
 
-  wl_resource_for_each(resource, &tool->focus_resource_list)
+  if (tool->frame_deadline_id)
     {
-      zwp_tablet_tool_v1_send_up (resource);
+      g_source_remove (tool->frame_deadline_id);
+      tool->frame_deadline_id = 0;
     }
-}
 
-static void
-notify_button (MetaWaylandTabletTool *tool,
-               const ClutterEvent    *event)
-{
-  struct wl_resource *resource;
+  if (!tool->pending_axes)
+    return;
 
-  tool->button_serial = wl_display_next_serial (tool->seat->manager->wl_display);
+  if (tool->focus_surface)
+    {
+      if (tool->pending_axes & TOOL_AXIS_MOTION)
+        changed |= send_motion (tool);
+      changed |= send_pending_axes (tool);
+    }
 
-  wl_resource_for_each(resource, &tool->focus_resource_list)
+  if (changed)
     {
-      zwp_tablet_tool_v1_send_button (resource, tool->button_serial,
-                                    event->button.button,
-                                    event->type == CLUTTER_BUTTON_PRESS ?
-                                    ZWP_TABLET_TOOL_V1_BUTTON_STATE_PRESSED :
-                                    ZWP_TABLET_TOOL_V1_BUTTON_STATE_RELEASED);
+      wl_resource_for_each(resource, &tool->focus_resource_list)
+        {
+          zwp_tablet_tool_v1_send_frame (resource, tool->pending_time);
+        }
     }
+
+  tool->pending_axes = 0;
+}
+
+static gboolean
+on_frame_deadline (gpointer user_data)
+{
+  MetaWaylandTabletTool *tool = user_data;
+
+  tool->frame_deadline_id = 0;
+  meta_wayland_tablet_tool_flush_frame (tool);
+
+  return G_SOURCE_REMOVE;
 }
 
 static void
-notify_axis (MetaWaylandTabletTool *tool,
-             const ClutterEvent    *event,
-             ClutterInputAxis       axis)
+accumulate_axes (MetaWaylandTabletTool *tool,
+                 const ClutterEvent    *event)
 {
-  struct wl_resource *resource;
   ClutterInputDevice *source;
-  uint32_t value;
-  gdouble val;
+  guint32 capabilities;
+  gdouble val, xtilt, ytilt;
 
-  source = clutter_event_get_source_device (event);
+  tool->pending_axes |= TOOL_AXIS_MOTION;
+  tool->pending_time = clutter_event_get_time (event);
 
-  if (!clutter_input_device_get_axis_value (source, event->motion.axes, axis, &val))
+  if (!event->motion.axes)
     return;
 
-  value = val * TABLET_AXIS_MAX;
+  source = clutter_event_get_source_device (event);
+  capabilities = input_device_get_capabilities (source);
 
-  wl_resource_for_each(resource, &tool->focus_resource_list)
+  if (capabilities & ZWP_TABLET_TOOL_V1_CAPABILITY_PRESSURE &&
+      clutter_input_device_get_axis_value (source, event->motion.axes,
+                                           CLUTTER_INPUT_AXIS_PRESSURE, &val))
     {
-      switch (axis)
-        {
-        case CLUTTER_INPUT_AXIS_PRESSURE:
-          zwp_tablet_tool_v1_send_pressure (resource, value);
-          break;
-        case CLUTTER_INPUT_AXIS_DISTANCE:
-          zwp_tablet_tool_v1_send_distance (resource, value);
-          break;
-        default:
-          break;
-        }
+      tool->pending_pressure = val * TABLET_AXIS_MAX;
+      tool->pending_axes |= TOOL_AXIS_PRESSURE;
+    }
+
+  if (capabilities & ZWP_TABLET_TOOL_V1_CAPABILITY_DISTANCE &&
+      clutter_input_device_get_axis_value (source, event->motion.axes,
+                                           CLUTTER_INPUT_AXIS_DISTANCE, &val))
+    {
+      tool->pending_distance = val * TABLET_AXIS_MAX;
+      tool->pending_axes |= TOOL_AXIS_DISTANCE;
+    }
+
+  if (capabilities & ZWP_TABLET_TOOL_V1_CAPABILITY_TILT &&
+      clutter_input_device_get_axis_value (source, event->motion.axes,
+                                           CLUTTER_INPUT_AXIS_XTILT, &xtilt) &&
+      clutter_input_device_get_axis_value (source, event->motion.axes,
+                                           CLUTTER_INPUT_AXIS_YTILT, &ytilt))
+    {
+      tool->pending_tilt_x = (int32_t) (xtilt * TABLET_AXIS_MAX);
+      tool->pending_tilt_y = (int32_t) (ytilt * TABLET_AXIS_MAX);
+      tool->pending_axes |= TOOL_AXIS_TILT;
     }
 }
 
 static void
-notify_tilt (MetaWaylandTabletTool *tool,
+notify_down (MetaWaylandTabletTool *tool,
              const ClutterEvent    *event)
 {
   struct wl_resource *resource;
-  ClutterInputDevice *source;
-  gdouble xtilt, ytilt;
 
-  source = clutter_event_get_source_device (event);
-
-  if (!clutter_input_device_get_axis_value (source, event->motion.axes,
-                                            CLUTTER_INPUT_AXIS_XTILT, &xtilt) ||
-      !clutter_input_device_get_axis_value (source, event->motion.axes,
-                                            CLUTTER_INPUT_AXIS_YTILT, &ytilt))
-    return;
+  tool->down_serial = wl_display_next_serial (tool->seat->manager->wl_display);
 
   wl_resource_for_each(resource, &tool->focus_resource_list)
     {
-      zwp_tablet_tool_v1_send_tilt (resource,
-                                  (int32_t) (xtilt * TABLET_AXIS_MAX),
-                                  (int32_t) (ytilt * TABLET_AXIS_MAX));
+      zwp_tablet_tool_v1_send_down (resource, tool->down_serial);
     }
 }
 
 static void
-notify_frame (MetaWaylandTabletTool *tool,
-              const ClutterEvent    *event)
+notify_up (MetaWaylandTabletTool *tool,
+           const ClutterEvent    *event)
 {
   struct wl_resource *resource;
-  guint32 _time = clutter_event_get_time (event);
 
   wl_resource_for_each(resource, &tool->focus_resource_list)
     {
-      zwp_tablet_tool_v1_send_frame (resource, _time);
+      zwp_tablet_tool_v1_send_up (resource);
     }
 }
 
 static void
-notify_axes (MetaWaylandTabletTool *tool,
-             const ClutterEvent    *event)
+notify_button (MetaWaylandTabletTool *tool,
+               const ClutterEvent    *event)
 {
-  ClutterInputDevice *device;
-  guint32 capabilities;
-
-  if (!event->motion.axes)
-    return;
-
-  device = clutter_event_get_source_device (event);
-  capabilities = input_device_get_capabilities (device);
+  struct wl_resource *resource;
 
-  if (capabilities & ZWP_TABLET_TOOL_V1_CAPABILITY_PRESSURE)
-    notify_axis (tool, event, CLUTTER_INPUT_AXIS_PRESSURE);
-  if (capabilities & ZWP_TABLET_TOOL_V1_CAPABILITY_DISTANCE)
-    notify_axis (tool, event, CLUTTER_INPUT_AXIS_DISTANCE);
-  if (capabilities & ZWP_TABLET_TOOL_V1_CAPABILITY_TILT)
-    notify_tilt (tool, event);
+  tool->button_serial = wl_display_next_serial (tool->seat->manager->wl_display);
 
-  notify_frame (tool, event);
+  wl_resource_for_each(resource, &tool->focus_resource_list)
+    {
+      zwp_tablet_tool_v1_send_button (resource, tool->button_serial,
+                                    event->button.button,
+                                    event->type == CLUTTER_BUTTON_PRESS ?
+                                    ZWP_TABLET_TOOL_V1_BUTTON_STATE_PRESSED :
+                                    ZWP_TABLET_TOOL_V1_BUTTON_STATE_RELEASED);
+    }
 }
 
 static void
@@ -699,8 +768,21 @@ handle_motion_event (MetaWaylandTabletTool *tool,
   if (!tool->focus_surface)
     return;
 
-  notify_motion (tool, event);
-  notify_axes (tool, event);
+  accumulate_axes (tool, event);
+
+  if (!meta_prefs_get_coalesce_pointer_motion ())
+    {
+      meta_wayland_tablet_tool_flush_frame (tool);
+      return;
+    }
+
+  if (tool->frame_deadline_id == 0)
+    {
+      tool->frame_deadline_id =
+        g_timeout_add (FRAME_DEADLINE_MS, on_frame_deadline, tool);
+      g_source_set_name_by_id (tool->frame_deadline_id,
+                               "[mutter] on_frame_deadline");
+    }
 }
 
 static void
@@ -710,6 +792,8 @@ handle_button_event (MetaWaylandTabletTool *tool,
   if (!tool->focus_surface)
     return;
 
+  meta_wayland_tablet_tool_flush_frame (tool);
+
   if (event->type == CLUTTER_BUTTON_PRESS && event->button.button == 1)
     notify_down (tool, event);
   else if (event->type == CLUTTER_BUTTON_RELEASE && event->button.button == 1)
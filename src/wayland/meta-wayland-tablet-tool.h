@@ -52,6 +52,20 @@ struct _MetaWaylandTabletTool
   guint32 button_serial;
 
   MetaWaylandTablet *current_tablet;
+
+  /* Axes changed since the last frame, and the values last sent to the
+   * focus client, so that only actual changes are sent.
+   */
+  guint32 pending_axes;
+  guint32 pending_time;
+  uint32_t pending_pressure, pending_distance;
+  int32_t pending_tilt_x, pending_tilt_y;
+  guint frame_deadline_id;
+
+  guint32 sent_axes;
+  wl_fixed_t sent_x, sent_y;
+  uint32_t sent_pressure, sent_distance;
+  int32_t sent_tilt_x, sent_tilt_y;
 };
 
 MetaWaylandTabletTool * meta_wayland_tablet_tool_new  (MetaWaylandTabletSeat  *seat,
@@ -73,6 +87,8 @@ void     meta_wayland_tablet_tool_update              (MetaWaylandTabletTool  *t
 gboolean meta_wayland_tablet_tool_handle_event        (MetaWaylandTabletTool  *tool,
                                                        const ClutterEvent     *event);
 
+void     meta_wayland_tablet_tool_flush_frame         (MetaWaylandTabletTool  *tool);
+
 void     meta_wayland_tablet_tool_set_cursor_position (MetaWaylandTabletTool  *tool,
                                                        int                     new_x,
                                                        int                     new_y);
@@ -87,8 +87,6 @@ meta_wayland_tablet_notify_device_details (MetaWaylandTablet  *tablet,
   ClutterInputDevice *device = tablet->device;
   guint vid, pid;
 
-  meta_warning("Beginning to blast tablet events...\n");
-
   zwp_tablet_v1_send_name (resource, clutter_input_device_get_device_name (device));
 
   if (sscanf (clutter_input_device_get_vendor_id (device), "%x", &vid) == 1 &&
@@ -98,7 +96,6 @@ meta_wayland_tablet_notify_device_details (MetaWaylandTablet  *tablet,
   /* FIXME: zwp_tablet_v1.type, zwp_tablet_v1.path missing */
 
   zwp_tablet_v1_send_done (resource);
-  meta_warning("Beginning to blast tablet events... DONE\n");
 }
 
 struct wl_resource *
@@ -109,8 +106,6 @@ meta_wayland_tablet_create_new_resource (MetaWaylandTablet  *tablet,
 {
   struct wl_resource *resource;
 
-  meta_warning("Creating new wayland tablet resource...\n");
-
   resource = wl_resource_create (client, &zwp_tablet_v1_interface,
                                  wl_resource_get_version (seat_resource), id);
   wl_resource_set_implementation (resource, &tablet_interface,
@@ -119,7 +114,6 @@ meta_wayland_tablet_create_new_resource (MetaWaylandTablet  *tablet,
   wl_list_insert (&tablet->resource_list, wl_resource_get_link (resource));
 
   //meta_wayland_tablet_notify_device_details (tablet, resource);
-  meta_warning("Creating new wayland tablet resource... DONE\n");
   return resource;
 }
 
@@ -36,25 +36,34 @@
 #include "backends/native/meta-backend-native.h"
 #endif
 
+#define SLOT_MASK(slot) (G_GUINT64_CONSTANT (1) << (slot))
+
 struct _MetaWaylandTouchSurface
 {
   MetaWaylandSurface *surface;
   MetaWaylandTouch *touch;
   struct wl_listener surface_destroy_listener;
   struct wl_list resource_list;
+  struct wl_list link;
   gint touch_count;
+  guint needs_frame : 1;
 };
 
 struct _MetaWaylandTouchInfo
 {
   MetaWaylandTouchSurface *touch_surface;
+  ClutterEventSequence *sequence;
   guint32 slot_serial;
   gint32 slot;
   gfloat start_x;
   gfloat start_y;
   gfloat x;
   gfloat y;
+  guint32 time;
+  guint in_use : 1;
   guint updated : 1;
+  guint motion_pending : 1;
+  guint ended : 1;
 };
 
 static void
@@ -81,14 +90,14 @@ move_resources_for_client (struct wl_list   *destination,
 }
 
 static void
-touch_surface_free (gpointer data)
+touch_surface_free (MetaWaylandTouchSurface *touch_surface)
 {
-  MetaWaylandTouchSurface *touch_surface = data;
   MetaWaylandTouch *touch = touch_surface->touch;
 
   move_resources (&touch->resource_list,
                   &touch_surface->resource_list);
   wl_list_remove (&touch_surface->surface_destroy_listener.link);
+  wl_list_remove (&touch_surface->link);
   g_free (touch_surface);
 }
 
@@ -104,41 +113,44 @@ touch_surface_decrement_touch (MetaWaylandTouchSurface *touch_surface)
 {
   touch_surface->touch_count--;
 
+  /* Now that there are no touches on the surface, free the
+   * MetaWaylandTouchSurface.
+   */
   if (touch_surface->touch_count == 0)
-    {
-      /* Now that there are no touches on the surface, free the
-       * MetaWaylandTouchSurface, the memory is actually owned by
-       * the touch_surface->touch_surfaces hashtable, so remove the
-       * item from there.
-       */
-      MetaWaylandTouch *touch = touch_surface->touch;
-      g_hash_table_remove (touch->touch_surfaces, touch_surface->surface);
-    }
+    touch_surface_free (touch_surface);
+}
+
+static void
+touch_info_release (MetaWaylandTouchInfo *touch_info)
+{
+  MetaWaylandTouchSurface *touch_surface = touch_info->touch_surface;
+
+  memset (touch_info, 0, sizeof (*touch_info));
+  touch_surface_decrement_touch (touch_surface);
 }
 
 static void
 touch_handle_surface_destroy (struct wl_listener *listener, void *data)
 {
   MetaWaylandTouchSurface *touch_surface = wl_container_of (listener, touch_surface, surface_destroy_listener);
-  MetaWaylandSurface *surface = touch_surface->surface;
   MetaWaylandTouch *touch = touch_surface->touch;
-  MetaWaylandTouchInfo *touch_info;
-  GHashTableIter iter;
-
-  g_hash_table_iter_init (&iter, touch->touches);
+  int i, n_touches;
 
   /* Destroy all touches on the surface, this indirectly drops touch_count
-   * on the touch_surface to 0, also freeing touch_surface and removing
-   * from the touch_surfaces hashtable.
+   * on the touch_surface to 0, also freeing touch_surface.
    */
-  while (g_hash_table_iter_next (&iter, NULL, (gpointer*) &touch_info))
+  n_touches = touch_surface->touch_count;
+
+  for (i = 0; i < META_WAYLAND_TOUCH_MAX_SLOTS && n_touches > 0; i++)
     {
-      if (touch_info->touch_surface == touch_surface)
-        g_hash_table_iter_remove (&iter);
-    }
+      MetaWaylandTouchInfo *touch_info = &touch->touches[i];
 
-  /* Ensure the surface no longer exists */
-  g_assert (g_hash_table_remove (touch->touch_surfaces, surface) == FALSE);
+      if (touch_info->in_use && touch_info->touch_surface == touch_surface)
+        {
+          n_touches--;
+          touch_info_release (touch_info);
+        }
+    }
 }
 
 static MetaWaylandTouchSurface *
@@ -147,10 +159,11 @@ touch_surface_get (MetaWaylandTouch   *touch,
 {
   MetaWaylandTouchSurface *touch_surface;
 
-  touch_surface = g_hash_table_lookup (touch->touch_surfaces, surface);
-
-  if (touch_surface)
-    return touch_surface_increment_touch (touch_surface);
+  wl_list_for_each (touch_surface, &touch->touch_surfaces, link)
+    {
+      if (touch_surface->surface == surface)
+        return touch_surface_increment_touch (touch_surface);
+    }
 
   /* Create a new one for this surface */
   touch_surface = g_new0 (MetaWaylandTouchSurface, 1);
@@ -166,7 +179,7 @@ touch_surface_get (MetaWaylandTouch   *touch,
                              &touch->resource_list,
                              wl_resource_get_client (touch_surface->surface->resource));
 
-  g_hash_table_insert (touch->touch_surfaces, surface, touch_surface);
+  wl_list_insert (&touch->touch_surfaces, &touch_surface->link);
 
   return touch_surface;
 }
@@ -176,17 +189,48 @@ touch_get_info (MetaWaylandTouch     *touch,
                 ClutterEventSequence *sequence,
                 gboolean              create)
 {
-  MetaWaylandTouchInfo *touch_info;
+  MetaWaylandTouchInfo *touch_info = NULL;
+  gint32 slot;
+  int i;
+
+  if (!touch->touches)
+    return NULL;
 
-  touch_info = g_hash_table_lookup (touch->touches, sequence);
+  slot = clutter_evdev_event_sequence_get_slot (sequence);
 
-  if (!touch_info && create)
+  /* On the native backend, sequences map to libinput slots, which is
+   * where the touch is kept when possible. Other backends may give
+   * sequences that don't fit in the array; those, and slots reused
+   * while the touch last using it waits for its frame, are looked up.
+   */
+  if (slot >= 0 && slot < META_WAYLAND_TOUCH_MAX_SLOTS)
     {
-      touch_info = g_new0 (MetaWaylandTouchInfo, 1);
-      touch_info->slot = clutter_evdev_event_sequence_get_slot (sequence);
-      g_hash_table_insert (touch->touches, sequence, touch_info);
+      touch_info = &touch->touches[slot];
+
+      if (touch_info->in_use && !touch_info->ended &&
+          touch_info->sequence == sequence)
+        return touch_info;
+      if (touch_info->in_use)
+        touch_info = NULL;
     }
 
+  for (i = 0; i < META_WAYLAND_TOUCH_MAX_SLOTS; i++)
+    {
+      MetaWaylandTouchInfo *info = &touch->touches[i];
+
+      if (info->in_use && !info->ended && info->sequence == sequence)
+        return info;
+      if (!info->in_use && !touch_info)
+        touch_info = info;
+    }
+
+  if (!create || !touch_info)
+    return NULL;
+
+  touch_info->in_use = TRUE;
+  touch_info->sequence = sequence;
+  touch_info->slot = slot;
+
   return touch_info;
 }
 
@@ -213,6 +257,72 @@ touch_get_relative_coordinates (MetaWaylandTouch   *touch,
 }
 
 
+static void touch_send_frame_event (MetaWaylandTouch *touch);
+
+static void
+pop_pending_frame (MetaWaylandTouch *touch)
+{
+  touch->n_pending_frames--;
+  memmove (&touch->pending_frames[0], &touch->pending_frames[1],
+           touch->n_pending_frames * sizeof (touch->pending_frames[0]));
+}
+
+static void
+check_frame_complete (MetaWaylandTouch   *touch,
+                      const ClutterEvent *event)
+{
+  ClutterEventSequence *sequence;
+  guint64 slot_mask;
+  gint32 slot;
+
+  if (!touch->touches)
+    return;
+
+  /* The event that completed the last frame was consumed before it
+   * reached the client, send what that frame gathered so far.
+   */
+  if (touch->frame_complete)
+    {
+      touch_send_frame_event (touch);
+      touch->frame_complete = FALSE;
+    }
+
+  /* Without frame information from libinput, every event is a frame */
+  if (touch->n_pending_frames == 0)
+    {
+      touch->frame_complete = TRUE;
+      return;
+    }
+
+  sequence = clutter_event_get_event_sequence (event);
+  slot = clutter_evdev_event_sequence_get_slot (sequence);
+
+  /* Frames with such slots are never queued, see evdev_filter_func() */
+  if (slot < 0 || slot >= META_WAYLAND_TOUCH_MAX_SLOTS)
+    {
+      touch->frame_complete = TRUE;
+      return;
+    }
+
+  slot_mask = SLOT_MASK (slot);
+
+  /* Clutter may compress updates of a touch point from several frames
+   * into one event; the frames left without their event are merged
+   * into the one the event came from.
+   */
+  while (touch->n_pending_frames > 1 &&
+         !(touch->pending_frames[0] & slot_mask))
+    pop_pending_frame (touch);
+
+  touch->pending_frames[0] &= ~slot_mask;
+
+  if (touch->pending_frames[0] == 0)
+    {
+      pop_pending_frame (touch);
+      touch->frame_complete = TRUE;
+    }
+}
+
 void
 meta_wayland_touch_update (MetaWaylandTouch   *touch,
                            const ClutterEvent *event)
@@ -220,6 +330,13 @@ meta_wayland_touch_update (MetaWaylandTouch   *touch,
   MetaWaylandTouchInfo *touch_info;
   ClutterEventSequence *sequence;
 
+  /* Every touch event comes through here, including those a grab or
+   * the stage consumes later on, so this is where the pending frames
+   * are accounted for; the frame itself is sent once the event has
+   * been handled.
+   */
+  check_frame_complete (touch, event);
+
   sequence = clutter_event_get_event_sequence (event);
 
   if (event->type == CLUTTER_TOUCH_BEGIN)
@@ -236,6 +353,9 @@ meta_wayland_touch_update (MetaWaylandTouch   *touch,
         return;
 
       touch_info = touch_get_info (touch, sequence, TRUE);
+      if (!touch_info)
+        return;
+
       touch_info->touch_surface = touch_surface_get (touch, surface);
       clutter_event_get_coords (event, &touch_info->start_x, &touch_info->start_y);
     }
@@ -260,6 +380,25 @@ meta_wayland_touch_update (MetaWaylandTouch   *touch,
   touch_info->updated = TRUE;
 }
 
+static void
+touch_send_motion (MetaWaylandTouchInfo *touch_info)
+{
+  struct wl_resource *resource;
+  struct wl_list *l;
+
+  l = &touch_info->touch_surface->resource_list;
+  wl_resource_for_each(resource, l)
+    {
+      wl_touch_send_motion (resource,
+                            touch_info->time,
+                            touch_info->slot,
+                            wl_fixed_from_double (touch_info->x),
+                            wl_fixed_from_double (touch_info->y));
+    }
+
+  touch_info->motion_pending = FALSE;
+}
+
 static void
 handle_touch_begin (MetaWaylandTouch   *touch,
                     const ClutterEvent *event)
@@ -293,8 +432,6 @@ handle_touch_update (MetaWaylandTouch   *touch,
 {
   MetaWaylandTouchInfo *touch_info;
   ClutterEventSequence *sequence;
-  struct wl_resource *resource;
-  struct wl_list *l;
 
   sequence = clutter_event_get_event_sequence (event);
   touch_info = touch_get_info (touch, sequence, FALSE);
@@ -302,15 +439,11 @@ handle_touch_update (MetaWaylandTouch   *touch,
   if (!touch_info)
     return;
 
-  l = &touch_info->touch_surface->resource_list;
-  wl_resource_for_each(resource, l)
-    {
-      wl_touch_send_motion (resource,
-                            clutter_event_get_time (event),
-                            touch_info->slot,
-                            wl_fixed_from_double (touch_info->x),
-                            wl_fixed_from_double (touch_info->y));
-    }
+  /* Motion is sent along with the frame, so each touch point sends
+   * at most one motion event per frame.
+   */
+  touch_info->time = clutter_event_get_time (event);
+  touch_info->motion_pending = TRUE;
 }
 
 static void
@@ -328,6 +461,9 @@ handle_touch_end (MetaWaylandTouch   *touch,
   if (!touch_info)
     return;
 
+  if (touch_info->motion_pending)
+    touch_send_motion (touch_info);
+
   l = &touch_info->touch_surface->resource_list;
   wl_resource_for_each(resource, l)
     {
@@ -336,75 +472,61 @@ handle_touch_end (MetaWaylandTouch   *touch,
                         touch_info->slot);
     }
 
-  g_hash_table_remove (touch->touches, sequence);
+  /* Kept until the frame is sent, so its surface gets the frame */
+  touch_info->ended = TRUE;
 }
 
-static GList *
-touch_get_surfaces (MetaWaylandTouch *touch,
-                    gboolean          only_updated)
+static void
+touch_send_frame_event (MetaWaylandTouch *touch)
 {
-  MetaWaylandTouchInfo *touch_info;
-  GList *surfaces = NULL;
-  GHashTableIter iter;
-
-  g_hash_table_iter_init (&iter, touch->touches);
+  MetaWaylandTouchSurface *touch_surface;
+  int i;
 
-  while (g_hash_table_iter_next (&iter, NULL, (gpointer*) &touch_info))
+  for (i = 0; i < META_WAYLAND_TOUCH_MAX_SLOTS; i++)
     {
-      if (only_updated && !touch_info->updated)
-        continue;
-      if (g_list_find (surfaces, touch_info->touch_surface))
+      MetaWaylandTouchInfo *touch_info = &touch->touches[i];
+
+      if (!touch_info->in_use || !touch_info->updated)
         continue;
 
-      surfaces = g_list_prepend (surfaces, touch_info->touch_surface);
+      if (touch_info->motion_pending)
+        touch_send_motion (touch_info);
+
+      touch_info->touch_surface->needs_frame = TRUE;
       touch_info->updated = FALSE;
     }
 
-  return g_list_reverse (surfaces);
-}
-
-static void
-touch_send_frame_event (MetaWaylandTouch *touch)
-{
-  GList *surfaces, *s;
-
-  surfaces = touch_get_surfaces (touch, TRUE);
-
-  for (s = surfaces; s; s = s->next)
+  wl_list_for_each (touch_surface, &touch->touch_surfaces, link)
     {
-      MetaWaylandTouchSurface *touch_surface = s->data;
       struct wl_resource *resource;
-      struct wl_list *l;
 
-      l = &touch_surface->resource_list;
-      wl_resource_for_each(resource, l)
+      if (!touch_surface->needs_frame)
+        continue;
+
+      wl_resource_for_each(resource, &touch_surface->resource_list)
         {
           wl_touch_send_frame (resource);
         }
-    }
-
-  g_list_free (surfaces);
-}
 
-static void
-check_send_frame_event (MetaWaylandTouch   *touch,
-                        const ClutterEvent *event)
-{
-  ClutterEventSequence *sequence;
-  gint32 slot;
+      touch_surface->needs_frame = FALSE;
+    }
 
-  sequence = clutter_event_get_event_sequence (event);
-  slot = clutter_evdev_event_sequence_get_slot (sequence);
-  touch->frame_slots &= ~(1 << slot);
+  for (i = 0; i < META_WAYLAND_TOUCH_MAX_SLOTS; i++)
+    {
+      MetaWaylandTouchInfo *touch_info = &touch->touches[i];
 
-  if (touch->frame_slots == 0)
-    touch_send_frame_event (touch);
+      if (touch_info->in_use && touch_info->ended)
+        touch_info_release (touch_info);
+    }
 }
 
 gboolean
 meta_wayland_touch_handle_event (MetaWaylandTouch   *touch,
                                  const ClutterEvent *event)
 {
+  if (!touch->touches)
+    return FALSE;
+
   switch (event->type)
     {
     case CLUTTER_TOUCH_BEGIN:
@@ -423,7 +545,12 @@ meta_wayland_touch_handle_event (MetaWaylandTouch   *touch,
       return FALSE;
     }
 
-  check_send_frame_event (touch, event);
+  if (touch->frame_complete)
+    {
+      touch_send_frame_event (touch);
+      touch->frame_complete = FALSE;
+    }
+
   return FALSE;
 }
 
@@ -445,35 +572,39 @@ static const struct wl_touch_interface touch_interface = {
 };
 
 static void
-touch_info_free (MetaWaylandTouchInfo *touch_info)
+touch_release_all (MetaWaylandTouch *touch)
 {
-  touch_surface_decrement_touch (touch_info->touch_surface);
-  g_free (touch_info);
+  int i;
+
+  for (i = 0; i < META_WAYLAND_TOUCH_MAX_SLOTS; i++)
+    {
+      if (touch->touches[i].in_use)
+        touch_info_release (&touch->touches[i]);
+    }
+
+  touch->frame_slots = 0;
+  touch->frame_unmasked = FALSE;
+  touch->n_pending_frames = 0;
+  touch->frame_complete = FALSE;
 }
 
 void
 meta_wayland_touch_cancel (MetaWaylandTouch *touch)
 {
-  GList *surfaces, *s;
+  MetaWaylandTouchSurface *touch_surface;
 
   if (touch->display == NULL)
     return;
 
-  surfaces = s = touch_get_surfaces (touch, FALSE);
-
-  for (s = surfaces; s; s = s->next)
+  wl_list_for_each (touch_surface, &touch->touch_surfaces, link)
     {
-      MetaWaylandTouchSurface *touch_surface = s->data;
       struct wl_resource *resource;
-      struct wl_list *l;
 
-      l = &touch_surface->resource_list;
-      wl_resource_for_each(resource, l)
+      wl_resource_for_each(resource, &touch_surface->resource_list)
         wl_touch_send_cancel (resource);
     }
 
-  g_hash_table_remove_all (touch->touches);
-  g_list_free (surfaces);
+  touch_release_all (touch);
 }
 
 #ifdef HAVE_NATIVE_BACKEND
@@ -494,12 +625,37 @@ evdev_filter_func (struct libinput_event *event,
       touch_event = libinput_event_get_touch_event (event);
       slot = libinput_event_touch_get_slot (touch_event);
 
-      /* XXX: Could theoretically overflow, 64 slots should be
-       * enough for most hw/usecases though.
-       */
-      touch->frame_slots |= (1 << slot);
+      if (slot >= 0 && slot < META_WAYLAND_TOUCH_MAX_SLOTS)
+        touch->frame_slots |= SLOT_MASK (slot);
+      else
+        touch->frame_unmasked = TRUE;
       break;
     }
+    case LIBINPUT_EVENT_TOUCH_FRAME:
+      /* Clutter only dispatches the events of this frame later on;
+       * remember which slots it covers, so the wl_touch.frame event is
+       * sent once the last of them is handled.
+       */
+      /* A slot that doesn't fit in the mask can't be told apart, so the
+       * events of such a frame are each sent with a frame of their own.
+       */
+      if (touch->frame_unmasked)
+        {
+          touch->frame_slots = 0;
+          touch->frame_unmasked = FALSE;
+          break;
+        }
+
+      if (touch->frame_slots == 0)
+        break;
+
+      if (touch->n_pending_frames == META_WAYLAND_TOUCH_FRAME_QUEUE_SIZE)
+        touch->pending_frames[touch->n_pending_frames - 1] |= touch->frame_slots;
+      else
+        touch->pending_frames[touch->n_pending_frames++] = touch->frame_slots;
+
+      touch->frame_slots = 0;
+      break;
     case LIBINPUT_EVENT_TOUCH_CANCEL:
       /* Clutter translates this into individual CLUTTER_TOUCH_CANCEL events,
        * which are not so useful when sending a global signal as the protocol
@@ -524,11 +680,9 @@ meta_wayland_touch_init (MetaWaylandTouch  *touch,
   memset (touch, 0, sizeof *touch);
 
   touch->display = display;
-  touch->touch_surfaces = g_hash_table_new_full (NULL, NULL, NULL,
-                                                 (GDestroyNotify) touch_surface_free);
-  touch->touches = g_hash_table_new_full (NULL, NULL, NULL,
-                                          (GDestroyNotify) touch_info_free);
+  touch->touches = g_new0 (MetaWaylandTouchInfo, META_WAYLAND_TOUCH_MAX_SLOTS);
 
+  wl_list_init (&touch->touch_surfaces);
   wl_list_init (&touch->resource_list);
 
   manager = clutter_device_manager_get_default ();
@@ -550,8 +704,10 @@ meta_wayland_touch_release (MetaWaylandTouch *touch)
     clutter_evdev_remove_filter (evdev_filter_func, touch);
 #endif
 
-  g_clear_pointer (&touch->touch_surfaces, (GDestroyNotify) g_hash_table_unref);
-  g_clear_pointer (&touch->touches, (GDestroyNotify) g_hash_table_unref);
+  if (touch->touches)
+    touch_release_all (touch);
+
+  g_clear_pointer (&touch->touches, g_free);
   touch->display = NULL;
 }
 
@@ -579,19 +735,19 @@ gboolean
 meta_wayland_touch_can_popup (MetaWaylandTouch *touch,
                               uint32_t          serial)
 {
-  MetaWaylandTouchInfo *touch_info;
-  GHashTableIter iter;
+  int i;
 
   if (!touch->touches)
     return FALSE;
 
-  g_hash_table_iter_init (&iter, touch->touches);
-
-  while (g_hash_table_iter_next (&iter, NULL, (gpointer*) &touch_info))
+  for (i = 0; i < META_WAYLAND_TOUCH_MAX_SLOTS; i++)
     {
-      if (touch_info->slot_serial == serial)
+      MetaWaylandTouchInfo *touch_info = &touch->touches[i];
+
+      if (touch_info->in_use && touch_info->slot_serial == serial)
         return TRUE;
     }
+
   return FALSE;
 }
 
@@ -600,21 +756,19 @@ meta_wayland_touch_find_grab_sequence (MetaWaylandTouch   *touch,
                                        MetaWaylandSurface *surface,
                                        uint32_t            serial)
 {
-  MetaWaylandTouchInfo *touch_info;
-  ClutterEventSequence *sequence;
-  GHashTableIter iter;
+  int i;
 
   if (!touch->touches)
     return NULL;
 
-  g_hash_table_iter_init (&iter, touch->touches);
-
-  while (g_hash_table_iter_next (&iter, (gpointer*) &sequence,
-                                 (gpointer*) &touch_info))
+  for (i = 0; i < META_WAYLAND_TOUCH_MAX_SLOTS; i++)
     {
-      if (touch_info->slot_serial == serial &&
+      MetaWaylandTouchInfo *touch_info = &touch->touches[i];
+
+      if (touch_info->in_use &&
+          touch_info->slot_serial == serial &&
 	  touch_info->touch_surface->surface == surface)
-        return sequence;
+        return touch_info->sequence;
     }
 
   return NULL;
@@ -628,10 +782,7 @@ meta_wayland_touch_get_press_coords (MetaWaylandTouch     *touch,
 {
   MetaWaylandTouchInfo *touch_info;
 
-  if (!touch->touches)
-    return FALSE;
-
-  touch_info = g_hash_table_lookup (touch->touches, sequence);
+  touch_info = touch_get_info (touch, sequence, FALSE);
 
   if (!touch_info)
     return FALSE;
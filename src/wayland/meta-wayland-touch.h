@@ -28,6 +28,9 @@
 
 #include "meta-wayland-types.h"
 
+#define META_WAYLAND_TOUCH_MAX_SLOTS 64
+#define META_WAYLAND_TOUCH_FRAME_QUEUE_SIZE 16
+
 typedef struct _MetaWaylandTouchSurface MetaWaylandTouchSurface;
 typedef struct _MetaWaylandTouchInfo MetaWaylandTouchInfo;
 
@@ -36,11 +39,21 @@ struct _MetaWaylandTouch
   struct wl_display *display;
   struct wl_list resource_list;
 
-  GHashTable *touch_surfaces; /* HT of MetaWaylandSurface->MetaWaylandTouchSurface */
-  GHashTable *touches; /* HT of sequence->MetaWaylandTouchInfo */
+  struct wl_list touch_surfaces; /* list of MetaWaylandTouchSurface */
+  MetaWaylandTouchInfo *touches; /* array of META_WAYLAND_TOUCH_MAX_SLOTS */
 
   ClutterInputDevice *device;
+
+  /* Slots touched by the libinput frame being read, and by the frames
+   * read but not yet fully dispatched, oldest first.
+   */
   guint64 frame_slots;
+  guint64 pending_frames[META_WAYLAND_TOUCH_FRAME_QUEUE_SIZE];
+  guint n_pending_frames;
+  guint frame_unmasked : 1;
+
+  /* Set when the event being processed is the last of its frame */
+  guint frame_complete : 1;
 };
 
 void meta_wayland_touch_init (MetaWaylandTouch  *touch,
@@ -45,5 +45,6 @@
 #define META_GTK_SHELL_VERSION              2
 #define META_WL_SUBCOMPOSITOR_VERSION       1
 #define META_ZWP_POINTER_GESTURES_V1_VERSION    1
+#define META_ZWP_RELATIVE_POINTER_V1_VERSION    1
 
 #endif
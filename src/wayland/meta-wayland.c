@@ -40,6 +40,7 @@
 #include "meta-wayland-outputs.h"
 #include "meta-wayland-data-device.h"
 #include "meta-wayland-tablet-manager.h"
+#include "meta-wayland-relative-pointer.h"
 
 static MetaWaylandCompositor _meta_wayland_compositor;
 
@@ -185,6 +186,9 @@ meta_wayland_compositor_update (MetaWaylandCompositor *compositor,
 void
 meta_wayland_compositor_paint_finished (MetaWaylandCompositor *compositor)
 {
+  meta_wayland_pointer_flush_motion (&compositor->seat->pointer);
+  meta_wayland_tablet_manager_flush_frames (compositor->tablet_manager);
+
   while (!wl_list_empty (&compositor->frame_callbacks))
     {
       MetaWaylandFrameCallback *callback =
@@ -312,6 +316,13 @@ meta_wayland_pre_clutter_init (void)
     g_error ("Failed to create the global wl_display");
 
   clutter_wayland_set_compositor_display (compositor->wayland_display);
+
+  /* Xwayland is spawned before the backend and the Wayland globals are
+   * set up, so its startup runs alongside ours; what it asks of us as a
+   * Wayland client is only dispatched once those are in place.
+   */
+  if (!meta_xwayland_start (&compositor->xwayland_manager, compositor->wayland_display))
+    g_error ("Failed to start X Wayland");
 }
 
 void
@@ -343,12 +354,10 @@ meta_wayland_init (void)
   meta_wayland_data_device_manager_init (compositor);
   meta_wayland_shell_init (compositor);
   meta_wayland_pointer_gestures_init (compositor);
+  meta_wayland_relative_pointer_init (compositor);
   meta_wayland_seat_init (compositor);
   meta_wayland_tablet_manager_init (compositor);
 
-  if (!meta_xwayland_start (&compositor->xwayland_manager, compositor->wayland_display))
-    g_error ("Failed to start X Wayland");
-
   compositor->display_name = wl_display_add_socket_auto (compositor->wayland_display);
   if (compositor->display_name == NULL)
     g_error ("Failed to create socket");
@@ -357,6 +366,21 @@ meta_wayland_init (void)
   set_gnome_env ("WAYLAND_DISPLAY", meta_wayland_get_wayland_display_name (compositor));
 }
 
+/**
+ * meta_wayland_wait_for_xwayland:
+ *
+ * Xwayland is started by meta_wayland_pre_clutter_init(), but
+ * initializes in the background; this waits until it accepts
+ * connections, and must be called before connecting to the X display.
+ */
+void
+meta_wayland_wait_for_xwayland (void)
+{
+  MetaWaylandCompositor *compositor = meta_wayland_compositor_get_default ();
+
+  meta_xwayland_wait_until_ready (&compositor->xwayland_manager);
+}
+
 const char *
 meta_wayland_get_wayland_display_name (MetaWaylandCompositor *compositor)
 {
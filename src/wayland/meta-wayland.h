@@ -29,6 +29,7 @@
 
 void                    meta_wayland_pre_clutter_init           (void);
 void                    meta_wayland_init                       (void);
+void                    meta_wayland_wait_for_xwayland          (void);
 void                    meta_wayland_finalize                   (void);
 
 /* We maintain a singleton MetaWaylandCompositor which can be got at via this
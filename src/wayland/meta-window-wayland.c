@@ -44,6 +44,20 @@ struct _MetaWindowWayland
 
   int last_sent_width;
   int last_sent_height;
+
+  /* Interactive resizes send a new configure only once the client
+   * committed the previous one; sizes produced in between replace
+   * each other here.
+   */
+  gboolean has_queued_configure;
+  int queued_width;
+  int queued_height;
+  gint64 configure_sent_time;
+
+  /* Resize latency statistics of the current grab, in microseconds */
+  guint n_resize_configures;
+  gint64 resize_latency_total;
+  gint64 resize_latency_max;
 };
 
 struct _MetaWindowWaylandClass
@@ -126,22 +140,73 @@ meta_window_wayland_focus (MetaWindow *window,
 }
 
 static void
-surface_state_changed (MetaWindow *window)
+send_configure (MetaWindowWayland *wl_window,
+                int                width,
+                int                height)
 {
-  MetaWindowWayland *wl_window = META_WINDOW_WAYLAND (window);
+  MetaWindow *window = META_WINDOW (wl_window);
+
+  wl_window->has_queued_configure = FALSE;
+  wl_window->last_sent_width = width;
+  wl_window->last_sent_height = height;
 
   meta_wayland_surface_configure_notify (window->surface,
-                                         wl_window->last_sent_width,
-                                         wl_window->last_sent_height,
+                                         width, height,
                                          &wl_window->pending_configure_serial);
+  wl_window->configure_sent_time = g_get_monotonic_time ();
+}
+
+/* While a client is being resized interactively, don't send it sizes
+ * faster than it can draw them; the latest one goes out when the client
+ * commits the previous configure.
+ */
+static void
+queue_configure (MetaWindowWayland *wl_window,
+                 int                width,
+                 int                height)
+{
+  MetaWindow *window = META_WINDOW (wl_window);
+
+  if (meta_grab_op_is_resizing (window->display->grab_op) &&
+      wl_window->pending_configure_serial.set)
+    {
+      wl_window->has_queued_configure = TRUE;
+      wl_window->queued_width = width;
+      wl_window->queued_height = height;
+    }
+  else
+    send_configure (wl_window, width, height);
+}
+
+static void
+surface_state_changed (MetaWindow *window)
+{
+  MetaWindowWayland *wl_window = META_WINDOW_WAYLAND (window);
+
+  if (wl_window->has_queued_configure)
+    send_configure (wl_window,
+                    wl_window->queued_width,
+                    wl_window->queued_height);
+  else
+    send_configure (wl_window,
+                    wl_window->last_sent_width,
+                    wl_window->last_sent_height);
 }
 
 static void
 meta_window_wayland_grab_op_began (MetaWindow *window,
                                    MetaGrabOp  op)
 {
+  MetaWindowWayland *wl_window = META_WINDOW_WAYLAND (window);
+
   if (meta_grab_op_is_resizing (op))
-    surface_state_changed (window);
+    {
+      wl_window->n_resize_configures = 0;
+      wl_window->resize_latency_total = 0;
+      wl_window->resize_latency_max = 0;
+
+      surface_state_changed (window);
+    }
 
   META_WINDOW_CLASS (meta_window_wayland_parent_class)->grab_op_began (window, op);
 }
@@ -150,8 +215,23 @@ static void
 meta_window_wayland_grab_op_ended (MetaWindow *window,
                                    MetaGrabOp  op)
 {
+  MetaWindowWayland *wl_window = META_WINDOW_WAYLAND (window);
+
   if (meta_grab_op_is_resizing (op))
-    surface_state_changed (window);
+    {
+      /* This also sends the size of any configure still queued */
+      surface_state_changed (window);
+
+      if (wl_window->n_resize_configures > 0)
+        meta_topic (META_DEBUG_RESIZING,
+                    "Resize of %s: %u configures committed, "
+                    "latency average %.1f ms, max %.1f ms\n",
+                    window->desc,
+                    wl_window->n_resize_configures,
+                    wl_window->resize_latency_total /
+                    (wl_window->n_resize_configures * 1000.0),
+                    wl_window->resize_latency_max / 1000.0);
+    }
 
   META_WINDOW_CLASS (meta_window_wayland_parent_class)->grab_op_ended (window, op);
 }
@@ -233,10 +313,7 @@ meta_window_wayland_move_resize_internal (MetaWindow                *window,
               constrained_rect.height == 1)
             return;
 
-          meta_wayland_surface_configure_notify (window->surface,
-                                                 configured_width,
-                                                 configured_height,
-                                                 &wl_window->pending_configure_serial);
+          queue_configure (wl_window, configured_width, configured_height);
 
           /* We need to wait until the resize completes before we can move */
           can_move_now = FALSE;
@@ -246,6 +323,15 @@ meta_window_wayland_move_resize_internal (MetaWindow                *window,
           /* We're just moving the window, so we don't need to wait for a configure
            * and then ack to simply move the window. */
           can_move_now = TRUE;
+
+          /* The window was resized away and back before the client caught
+           * up; make sure it ends up at this size rather than the one it
+           * was sent last, or one still queued.
+           */
+          if (wl_window->pending_configure_serial.set &&
+              (configured_width != wl_window->last_sent_width ||
+               configured_height != wl_window->last_sent_height))
+            queue_configure (wl_window, configured_width, configured_height);
         }
     }
 
@@ -586,6 +672,19 @@ meta_window_wayland_move_resize (MetaWindow        *window,
         }
     }
 
+  if (wl_window->pending_configure_serial.set &&
+      acked_configure_serial->set &&
+      acked_configure_serial->value == wl_window->pending_configure_serial.value &&
+      meta_grab_op_is_resizing (window->display->grab_op))
+    {
+      gint64 latency = g_get_monotonic_time () - wl_window->configure_sent_time;
+
+      wl_window->n_resize_configures++;
+      wl_window->resize_latency_total += latency;
+      wl_window->resize_latency_max = MAX (wl_window->resize_latency_max,
+                                           latency);
+    }
+
   wl_window->pending_configure_serial.set = FALSE;
 
   rect.width = new_geom.width;
@@ -596,6 +695,10 @@ meta_window_wayland_move_resize (MetaWindow        *window,
 
   gravity = meta_resize_gravity_from_grab_op (window->display->grab_op);
   meta_window_move_resize_internal (window, flags, gravity, rect);
+
+  /* The client caught up; send it the latest size of the resize */
+  if (wl_window->has_queued_configure)
+    surface_state_changed (window);
 }
 
 void
@@ -28,6 +28,9 @@ gboolean
 meta_xwayland_start (MetaXWaylandManager *manager,
                      struct wl_display   *display);
 
+void
+meta_xwayland_wait_until_ready (MetaXWaylandManager *manager);
+
 void
 meta_xwayland_complete_init (void);
 
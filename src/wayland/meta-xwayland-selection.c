@@ -39,7 +39,10 @@
 #include "meta-xwayland-selection-private.h"
 #include "meta-wayland-data-device.h"
 
-#define INCR_CHUNK_SIZE (128 * 1024)
+/* Bounds of the size of the INCR chunks sent to X11 clients, which is
+ * otherwise as large as the X server accepts in a single request */
+#define MIN_INCR_CHUNK_SIZE (128 * 1024)
+#define MAX_INCR_CHUNK_SIZE (4 * 1024 * 1024)
 #define XDND_VERSION 5
 
 typedef struct {
@@ -48,9 +51,19 @@ typedef struct {
   GCancellable *cancellable;
   MetaWindow *window;
   XSelectionRequestEvent request_event;
-  guchar buffer[INCR_CHUNK_SIZE];
-  gsize buffer_len;
+
+  /* Data is read into one buffer while the other one, once full, waits
+   * for the requestor to take the previous chunk. */
+  guchar *buffers[2];
+  gsize buffer_lens[2];
+  gsize chunk_size;
+  int read_buffer;
+  int ready_buffer; /* -1 if none */
+
   guint incr : 1;
+  guint reading : 1;
+  guint eof : 1;
+  guint property_pending : 1; /* requestor didn't delete the last chunk yet */
 } WaylandSelectionData;
 
 typedef struct {
@@ -58,7 +71,13 @@ typedef struct {
   GOutputStream *stream;
   GCancellable *cancellable;
   gchar *mime_type;
+
+  /* Property data being written, freed with XFree() */
+  guchar *chunk;
+
   guint incr : 1;
+  guint writing : 1;
+  guint chunk_pending : 1; /* a new INCR chunk arrived during a write */
 } X11SelectionData;
 
 typedef struct {
@@ -384,6 +403,8 @@ x11_selection_data_free (X11SelectionData *data)
   g_object_unref (data->cancellable);
   g_object_unref (data->stream);
   g_free (data->mime_type);
+  if (data->chunk)
+    XFree (data->chunk);
   g_slice_free (X11SelectionData, data);
 }
 
@@ -402,17 +423,19 @@ x11_selection_data_finish (MetaSelectionBridge *selection,
                    (GDestroyNotify) x11_selection_data_free);
 }
 
+static void meta_xwayland_selection_get_incr_chunk (MetaSelectionBridge *selection);
+
 static void
 x11_data_write_cb (GObject      *object,
                    GAsyncResult *res,
                    gpointer      user_data)
 {
   MetaSelectionBridge *selection = user_data;
-  X11SelectionData *data = selection->x11_selection;
+  X11SelectionData *data;
   GError *error = NULL;
   gboolean success = TRUE;
 
-  g_output_stream_write_finish (G_OUTPUT_STREAM (object), res, &error);
+  g_output_stream_write_all_finish (G_OUTPUT_STREAM (object), res, NULL, &error);
 
   if (error)
     {
@@ -427,11 +450,19 @@ x11_data_write_cb (GObject      *object,
       success = FALSE;
     }
 
+  data = selection->x11_selection;
+  data->writing = FALSE;
+  g_clear_pointer (&data->chunk, XFree);
+
   if (success && data->incr)
     {
-      Display *xdisplay = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
-      XDeleteProperty (xdisplay, selection->window,
-                       gdk_x11_get_xatom_by_name ("_META_SELECTION"));
+      /* The property was deleted as soon as it was read, so the owner
+       * could already store the next chunk meanwhile. */
+      if (data->chunk_pending)
+        {
+          data->chunk_pending = FALSE;
+          meta_xwayland_selection_get_incr_chunk (selection);
+        }
     }
   else
     {
@@ -439,6 +470,7 @@ x11_data_write_cb (GObject      *object,
     }
 }
 
+/* Takes ownership of buffer, which must be freed with XFree() */
 static void
 x11_selection_data_write (MetaSelectionBridge *selection,
                           guchar              *buffer,
@@ -446,9 +478,12 @@ x11_selection_data_write (MetaSelectionBridge *selection,
 {
   X11SelectionData *data = selection->x11_selection;
 
-  g_output_stream_write_async (data->stream, buffer, len,
-                               G_PRIORITY_DEFAULT, data->cancellable,
-                               x11_data_write_cb, selection);
+  data->chunk = buffer;
+  data->writing = TRUE;
+
+  g_output_stream_write_all_async (data->stream, buffer, len,
+                                   G_PRIORITY_DEFAULT, data->cancellable,
+                                   x11_data_write_cb, selection);
 }
 
 static MetaWaylandDataSource *
@@ -463,6 +498,21 @@ data_device_get_active_source_for_atom (MetaWaylandDataDevice *data_device,
     return NULL;
 }
 
+static gsize
+get_incr_chunk_size (void)
+{
+  Display *xdisplay = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
+  long max_request_size;
+
+  /* In 4 byte units, and including the ChangeProperty request header */
+  max_request_size = XExtendedMaxRequestSize (xdisplay);
+  if (max_request_size == 0)
+    max_request_size = XMaxRequestSize (xdisplay);
+
+  return CLAMP ((max_request_size - 64) * 4,
+                MIN_INCR_CHUNK_SIZE, MAX_INCR_CHUNK_SIZE);
+}
+
 static WaylandSelectionData *
 wayland_selection_data_new (XSelectionRequestEvent *request_event,
                             MetaWaylandCompositor  *compositor)
@@ -513,6 +563,11 @@ wayland_selection_data_new (XSelectionRequestEvent *request_event,
   data->cancellable = g_cancellable_new ();
   data->stream = g_unix_input_stream_new (p[0], TRUE);
 
+  data->chunk_size = get_incr_chunk_size ();
+  data->buffers[0] = g_malloc (data->chunk_size);
+  data->buffers[1] = g_malloc (data->chunk_size);
+  data->ready_buffer = -1;
+
   data->window = meta_display_lookup_x_window (meta_get_display (),
                                                data->request_event.requestor);
 
@@ -563,11 +618,14 @@ wayland_selection_data_free (WaylandSelectionData *data)
   g_cancellable_cancel (data->cancellable);
   g_object_unref (data->cancellable);
   g_object_unref (data->stream);
+  g_free (data->buffers[0]);
+  g_free (data->buffers[1]);
   g_slice_free (WaylandSelectionData, data);
 }
 
 static void
-wayland_selection_update_x11_property (WaylandSelectionData *data)
+wayland_selection_update_x11_property (WaylandSelectionData *data,
+                                       int                   buffer)
 {
   Display *xdisplay = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
 
@@ -576,49 +634,38 @@ wayland_selection_update_x11_property (WaylandSelectionData *data)
                    data->request_event.property,
                    data->request_event.target,
                    8, PropModeReplace,
-                   data->buffer, data->buffer_len);
-  data->buffer_len = 0;
+                   data->buffers[buffer], data->buffer_lens[buffer]);
+  data->buffer_lens[buffer] = 0;
 }
 
+static void wayland_selection_data_read (MetaSelectionBridge *selection);
+static void wayland_selection_send_chunk (MetaSelectionBridge *selection);
+
+/* Called when the read buffer is full, or the source reached its end */
 static void
-wayland_data_read_cb (GObject      *object,
-                      GAsyncResult *res,
-                      gpointer      user_data)
+wayland_selection_chunk_complete (MetaSelectionBridge *selection)
 {
-  MetaSelectionBridge *selection = user_data;
   WaylandSelectionData *data = selection->wayland_selection;
-  GError *error = NULL;
-  gsize bytes_read;
 
-  bytes_read = g_input_stream_read_finish (G_INPUT_STREAM (object),
-                                           res, &error);
-  if (error)
+  if (!data->incr)
     {
-      g_warning ("Error transfering wayland clipboard to X11: %s\n",
-                 error->message);
-      g_error_free (error);
-
-      if (data)
+      if (data->eof)
         {
-          reply_selection_request (&data->request_event, FALSE);
+          /* Non-incr transfer finished */
+          wayland_selection_update_x11_property (data, data->read_buffer);
+          reply_selection_request (&data->request_event, TRUE);
           g_clear_pointer (&selection->wayland_selection,
                            (GDestroyNotify) wayland_selection_data_free);
+          return;
         }
-
-      return;
-    }
-
-  data->buffer_len = bytes_read;
-
-  if (bytes_read == INCR_CHUNK_SIZE)
-    {
-      if (!data->incr)
+      else
         {
           Display *xdisplay = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
-          guint32 incr_chunk_size = INCR_CHUNK_SIZE;
+          guint32 incr_chunk_size = data->chunk_size;
 
           /* Not yet in incr */
           data->incr = TRUE;
+          data->property_pending = TRUE;
           XChangeProperty (xdisplay,
                            data->request_event.requestor,
                            data->request_event.property,
@@ -627,45 +674,117 @@ wayland_data_read_cb (GObject      *object,
                            (guchar *) &incr_chunk_size, 1);
           reply_selection_request (&data->request_event, TRUE);
         }
-      else
-        wayland_selection_update_x11_property (data);
     }
-  else
+
+  /* The other buffer still waits to be sent; continue once it is */
+  if (data->ready_buffer != -1)
+    return;
+
+  if (data->buffer_lens[data->read_buffer] > 0)
     {
-      if (!data->incr)
+      data->ready_buffer = data->read_buffer;
+      data->read_buffer = 1 - data->read_buffer;
+
+      if (!data->eof)
+        wayland_selection_data_read (selection);
+    }
+
+  if (!data->property_pending)
+    wayland_selection_send_chunk (selection);
+}
+
+/* Called when the requestor is ready to take the next chunk */
+static void
+wayland_selection_send_chunk (MetaSelectionBridge *selection)
+{
+  WaylandSelectionData *data = selection->wayland_selection;
+
+  if (data->ready_buffer != -1)
+    {
+      wayland_selection_update_x11_property (data, data->ready_buffer);
+      data->ready_buffer = -1;
+      data->property_pending = TRUE;
+
+      /* Reading stopped because both buffers were full, or everything
+       * was read, with some left to send */
+      if (!data->reading && data->buffer_lens[data->read_buffer] > 0)
+        wayland_selection_chunk_complete (selection);
+    }
+  else if (data->eof)
+    {
+      /* Incr transfer complete, setting an empty property */
+      wayland_selection_update_x11_property (data, data->read_buffer);
+      g_clear_pointer (&selection->wayland_selection,
+                       (GDestroyNotify) wayland_selection_data_free);
+    }
+}
+
+static void
+wayland_data_read_cb (GObject      *object,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+  MetaSelectionBridge *selection = user_data;
+  WaylandSelectionData *data;
+  GError *error = NULL;
+  gssize bytes_read;
+
+  bytes_read = g_input_stream_read_finish (G_INPUT_STREAM (object),
+                                           res, &error);
+  if (error)
+    {
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
         {
-          /* Non-incr transfer finished */
-          wayland_selection_update_x11_property (data);
-          reply_selection_request (&data->request_event, TRUE);
+          g_error_free (error);
+          return;
         }
-      else if (data->incr)
-        {
-          /* Incr transfer complete, setting a new property */
-          wayland_selection_update_x11_property (data);
 
-          if (bytes_read > 0)
-            return;
-        }
+      g_warning ("Error transfering wayland clipboard to X11: %s\n",
+                 error->message);
+      g_error_free (error);
 
+      data = selection->wayland_selection;
+      if (!data->incr)
+        reply_selection_request (&data->request_event, FALSE);
       g_clear_pointer (&selection->wayland_selection,
                        (GDestroyNotify) wayland_selection_data_free);
+
+      return;
     }
+
+  data = selection->wayland_selection;
+  data->reading = FALSE;
+
+  if (bytes_read == 0)
+    data->eof = TRUE;
+  else
+    data->buffer_lens[data->read_buffer] += bytes_read;
+
+  /* Pipes return whatever is available, keep reading until the chunk
+   * is full */
+  if (!data->eof && data->buffer_lens[data->read_buffer] < data->chunk_size)
+    wayland_selection_data_read (selection);
+  else
+    wayland_selection_chunk_complete (selection);
 }
 
 static void
 wayland_selection_data_read (MetaSelectionBridge *selection)
 {
   WaylandSelectionData *data = selection->wayland_selection;
+  gsize len = data->buffer_lens[data->read_buffer];
 
-  g_input_stream_read_async (data->stream, data->buffer,
-                             INCR_CHUNK_SIZE, G_PRIORITY_DEFAULT,
+  data->reading = TRUE;
+  g_input_stream_read_async (data->stream,
+                             data->buffers[data->read_buffer] + len,
+                             data->chunk_size - len,
+                             G_PRIORITY_DEFAULT,
                              data->cancellable,
                              wayland_data_read_cb, selection);
 }
 
 static void
-meta_xwayland_selection_get_incr_chunk (MetaWaylandCompositor *compositor,
-                                        MetaSelectionBridge   *selection)
+meta_xwayland_selection_get_incr_chunk (MetaSelectionBridge *selection)
 {
   Display *xdisplay = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
   gulong nitems_ret, bytes_after_ret;
@@ -673,12 +792,21 @@ meta_xwayland_selection_get_incr_chunk (MetaWaylandCompositor *compositor,
   int format_ret;
   Atom type_ret;
 
+  /* Only one chunk is written at a time; fetch this one when done */
+  if (selection->x11_selection->writing)
+    {
+      selection->x11_selection->chunk_pending = TRUE;
+      return;
+    }
+
+  /* Deleting the property right away lets the owner prepare the next
+   * chunk while this one is written */
   XGetWindowProperty (xdisplay,
                       selection->window,
                       gdk_x11_get_xatom_by_name ("_META_SELECTION"),
                       0, /* offset */
                       0x1fffffff, /* length */
-                      False, /* delete */
+                      True, /* delete */
                       AnyPropertyType,
                       &type_ret,
                       &format_ret,
@@ -693,10 +821,9 @@ meta_xwayland_selection_get_incr_chunk (MetaWaylandCompositor *compositor,
   else
     {
       /* Transfer has completed */
+      XFree (prop_ret);
       x11_selection_data_finish (selection, TRUE);
     }
-
-  XFree (prop_ret);
 }
 
 static void
@@ -959,12 +1086,15 @@ meta_xwayland_selection_get_x11_data (MetaWaylandCompositor *compositor,
   selection->x11_selection->incr = (type_ret == gdk_x11_get_xatom_by_name ("INCR"));
 
   if (selection->x11_selection->incr)
-    return;
+    {
+      XFree (prop_ret);
+      return;
+    }
 
   if (type_ret == gdk_x11_get_xatom_by_name (selection->x11_selection->mime_type))
     x11_selection_data_write (selection, prop_ret, nitems_ret);
-
-  XFree (prop_ret);
+  else
+    XFree (prop_ret);
 }
 
 static gboolean
@@ -1053,10 +1183,8 @@ meta_xwayland_selection_send_incr_chunk (MetaWaylandCompositor *compositor,
   if (!selection->wayland_selection)
     return;
 
-  if (selection->wayland_selection->buffer_len > 0)
-    wayland_selection_update_x11_property (selection->wayland_selection);
-  else
-    wayland_selection_data_read (selection);
+  selection->wayland_selection->property_pending = FALSE;
+  wayland_selection_send_chunk (selection);
 }
 
 static gboolean
@@ -1066,17 +1194,17 @@ handle_incr_chunk (MetaWaylandCompositor *compositor,
 {
   if (selection->x11_selection &&
       selection->x11_selection->incr &&
-      event->window == selection->owner &&
+      event->window == selection->window &&
       event->state == PropertyNewValue &&
       event->atom == gdk_x11_get_xatom_by_name ("_META_SELECTION"))
     {
       /* X11 to Wayland */
-      meta_xwayland_selection_get_incr_chunk (compositor, selection);
+      meta_xwayland_selection_get_incr_chunk (selection);
       return TRUE;
     }
   else if (selection->wayland_selection &&
            selection->wayland_selection->incr &&
-           event->window == selection->window &&
+           event->window == selection->wayland_selection->request_event.requestor &&
            event->state == PropertyDelete &&
            event->atom == selection->wayland_selection->request_event.property)
     {
@@ -448,11 +448,14 @@ static void
 xserver_finished_init (MetaXWaylandManager *manager)
 {
   /* At this point xwayland is all setup to start accepting
-   * connections so we can quit the transient initialization mainloop
-   * and unblock meta_wayland_init() to continue initializing mutter.
+   * connections so we can quit the transient initialization mainloop,
+   * if it already runs, and unblock meta_xwayland_wait_until_ready()
+   * to continue initializing mutter.
    * */
-  g_main_loop_quit (manager->init_loop);
-  g_clear_pointer (&manager->init_loop, g_main_loop_unref);
+  manager->ready = TRUE;
+
+  if (manager->init_loop)
+    g_main_loop_quit (manager->init_loop);
 }
 
 static gboolean
@@ -534,12 +537,9 @@ meta_xwayland_start (MetaXWaylandManager *manager,
   g_unix_fd_add (displayfd[0], G_IO_IN, on_displayfd_ready, manager);
   manager->client = wl_client_create (wl_display, xwayland_client_fd[0]);
 
-  /* We need to run a mainloop until we know xwayland has a binding
-   * for our xserver interface at which point we can assume it's
-   * ready to start accepting connections. */
-  manager->init_loop = g_main_loop_new (NULL, FALSE);
-  g_main_loop_run (manager->init_loop);
-
+  /* The server initializes while the rest of mutter does;
+   * meta_xwayland_wait_until_ready() waits for it to finish once the X
+   * display is needed. */
   started = TRUE;
 
 out:
@@ -551,6 +551,21 @@ out:
   return started;
 }
 
+void
+meta_xwayland_wait_until_ready (MetaXWaylandManager *manager)
+{
+  if (manager->ready)
+    return;
+
+  /* We need to run a mainloop until we know xwayland has a binding
+   * for our xserver interface at which point we can assume it's
+   * ready to start accepting connections. Xwayland being a Wayland
+   * client itself, its requests are dispatched meanwhile. */
+  manager->init_loop = g_main_loop_new (NULL, FALSE);
+  g_main_loop_run (manager->init_loop);
+  g_clear_pointer (&manager->init_loop, g_main_loop_unref);
+}
+
 /* To be called right after connecting */
 void
 meta_xwayland_complete_init (void)